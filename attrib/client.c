@@ -29,6 +29,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 
 #include <bluetooth/bluetooth.h>
@@ -58,6 +59,8 @@ struct gatt_service {
 	char *path;
 	GSList *primary;
 	GAttrib *attrib;
+	uint16_t sc_handle;		/* Service Changed value handle */
+	uint16_t sc_ccc;		/* Service Changed CCC handle */
 	DBusMessage *msg;
 	int psm;
 	gboolean listen;
@@ -284,6 +287,10 @@ static void events_handler(const uint8_t *pdu, uint16_t len,
 
 	handle = att_get_u16(&pdu[1]);
 
+	/* Confirmed by service_changed_handler() */
+	if (handle == gatt->sc_handle)
+		return;
+
 	for (lprim = gatt->primary, prim = NULL, chr = NULL; lprim;
 						lprim = lprim->next) {
 		prim = lprim->data;
@@ -315,6 +322,113 @@ static void events_handler(const uint8_t *pdu, uint16_t len,
 	}
 }
 
+static void service_changed_handler(const uint8_t *pdu, uint16_t len,
+							gpointer user_data)
+{
+	struct gatt_service *gatt = user_data;
+	uint8_t opdu[ATT_MAX_MTU];
+	uint16_t olen, start, end;
+	int err;
+
+	if (len < 3 || att_get_u16(&pdu[1]) != gatt->sc_handle)
+		return;
+
+	olen = enc_confirmation(opdu, sizeof(opdu));
+	g_attrib_send(gatt->attrib, 0, opdu[0], opdu, olen, NULL, NULL, NULL);
+
+	/* Without the affected range, assume the whole database changed */
+	if (len >= 7) {
+		start = att_get_u16(&pdu[3]);
+		end = att_get_u16(&pdu[5]);
+	} else {
+		start = 0x0001;
+		end = 0xffff;
+	}
+
+	DBG("Service Changed 0x%04x-0x%04x, rediscovering", start, end);
+
+	err = device_refresh_primaries(gatt->dev, start, end);
+	if (err < 0)
+		error("Can't rediscover services: %s (%d)", strerror(-err),
+									-err);
+}
+
+static void sc_ccc_written(guint8 status, const guint8 *pdu, guint16 len,
+							gpointer user_data)
+{
+	if (status)
+		DBG("Enabling Service Changed indications failed: %s",
+						att_ecode2str(status));
+}
+
+static void write_sc_ccc(struct gatt_service *gatt)
+{
+	uint8_t value[2];
+
+	att_put_u16(0x0002, value);
+	gatt_write_char(gatt->attrib, gatt->sc_ccc, value, sizeof(value),
+						sc_ccc_written, NULL);
+}
+
+static void sc_ccc_read(guint8 status, const guint8 *pdu, guint16 plen,
+							gpointer user_data)
+{
+	struct gatt_service *gatt = user_data;
+	uint8_t value[ATT_MAX_MTU];
+	int vlen;
+
+	if (gatt->attrib == NULL)
+		return;
+
+	/* Bonded devices keep the CCC across connections */
+	if (status == 0 && dec_read_resp(pdu, plen, value, &vlen) &&
+				vlen == 2 && att_get_u16(value) == 0x0002)
+		return;
+
+	write_sc_ccc(gatt);
+}
+
+/*
+ * The cached attributes are only valid as long as the remote database
+ * does not change, so ask the device to indicate when it does.
+ */
+static void enable_service_changed(struct gatt_service *gatt)
+{
+	struct gatt_table *table = device_get_gatt_table(gatt->dev);
+	const struct gatt_table_entry *chr, *ccc;
+	bt_uuid_t uuid;
+
+	gatt->sc_handle = 0;
+
+	if (table == NULL)
+		return;
+
+	bt_uuid16_create(&uuid, GATT_CHARAC_SERVICE_CHANGED);
+	chr = gatt_table_find_char(table, &uuid);
+	if (chr == NULL)
+		return;
+
+	bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+	ccc = gatt_table_find_desc(table, chr, &uuid);
+	if (ccc == NULL)
+		return;
+
+	gatt->sc_handle = chr->value_handle;
+	gatt->sc_ccc = ccc->handle;
+
+	g_attrib_register(gatt->attrib, ATT_OP_HANDLE_IND,
+				service_changed_handler, gatt, NULL);
+
+	/* Nothing worth reading back on a database just discovered */
+	if (device_is_gatt_cache_new(gatt->dev)) {
+		device_set_gatt_cache_new(gatt->dev, FALSE);
+		write_sc_ccc(gatt);
+		return;
+	}
+
+	gatt_read_char(gatt->attrib, gatt->sc_ccc, 0, sc_ccc_read, gatt);
+}
+
 static void attrib_destroy(gpointer user_data)
 {
 	struct gatt_service *gatt = user_data;
@@ -348,6 +462,8 @@ static void connect_cb(GIOChannel *chan, GError *gerr, gpointer user_data)
 	if (gatt->attrib == NULL)
 		return;
 
+	enable_service_changed(gatt);
+
 	/* Listen mode: used for notification and indication */
 	if (gatt->listen == TRUE) {
 		g_attrib_register(gatt->attrib,
@@ -948,6 +1064,7 @@ static DBusMessage *discover_char(DBusConnection *conn, DBusMessage *msg,
 	struct primary *prim = data;
 	struct att_primary *att = prim->att;
 	struct gatt_service *gatt = prim->gatt;
+	struct gatt_table *table;
 	struct query_data *qchr;
 	GError *gerr = NULL;
 
@@ -961,6 +1078,19 @@ static DBusMessage *discover_char(DBusConnection *conn, DBusMessage *msg,
 	qchr->prim = prim;
 	qchr->msg = dbus_message_ref(msg);
 
+	/* Answer from the attributes found while browsing, if any */
+	table = device_get_gatt_table(gatt->dev);
+	if (table) {
+		GSList *chars = gatt_table_chars(table, att->start, att->end);
+
+		char_discovered_cb(chars, 0, qchr);
+
+		g_slist_foreach(chars, (GFunc) g_free, NULL);
+		g_slist_free(chars);
+
+		return NULL;
+	}
+
 	gatt_discover_char(gatt->attrib, att->start, att->end, NULL,
 						char_discovered_cb, qchr);
 
@@ -1055,10 +1185,22 @@ GSList *attrib_client_register(DBusConnection *connection,
 	const char *path = device_get_path(device);
 	struct gatt_service *gatt;
 	bdaddr_t sba, dba;
+	GSList *l;
 
 	adapter_get_address(adapter, &sba);
 	device_get_address(device, &dba);
 
+	/* Services found later on, e.g. after a Service Changed */
+	l = g_slist_find_custom(gatt_services, device, gatt_dev_cmp);
+	if (l) {
+		gatt = l->data;
+
+		if (gatt->attrib == NULL && attrib)
+			gatt->attrib = g_attrib_ref(attrib);
+
+		return register_primaries(gatt, primaries);
+	}
+
 	gatt = g_new0(struct gatt_service, 1);
 	gatt->dev = btd_device_ref(device);
 	gatt->conn = dbus_connection_ref(connection);
@@ -1076,6 +1218,44 @@ GSList *attrib_client_register(DBusConnection *connection,
 	return register_primaries(gatt, primaries);
 }
 
+/* Drop the objects of the primary services overlapping start-end */
+void attrib_client_remove_primaries(struct btd_device *device,
+						uint16_t start, uint16_t end)
+{
+	struct gatt_service *gatt;
+	GSList *l, *next, *lc;
+
+	l = g_slist_find_custom(gatt_services, device, gatt_dev_cmp);
+	if (!l)
+		return;
+
+	gatt = l->data;
+
+	for (l = gatt->primary; l; l = next) {
+		struct primary *prim = l->data;
+		struct att_primary *att = prim->att;
+
+		next = l->next;
+
+		if (att->end < start || att->start > end)
+			continue;
+
+		for (lc = prim->chars; lc; lc = lc->next) {
+			struct characteristic *chr = lc->data;
+			g_dbus_unregister_interface(gatt->conn, chr->path,
+								CHAR_INTERFACE);
+		}
+		g_dbus_unregister_interface(gatt->conn, prim->path,
+								CHAR_INTERFACE);
+
+		delete_device_characteristics(&gatt->sba, &gatt->dba,
+								att->start);
+
+		gatt->primary = g_slist_delete_link(gatt->primary, l);
+		primary_free(prim);
+	}
+}
+
 void attrib_client_unregister(struct btd_device *device)
 {
 	struct gatt_service *gatt;
@@ -26,3 +26,5 @@ GSList *attrib_client_register(DBusConnection *connection,
 					struct btd_device *device, int psm,
 					GAttrib *attrib, GSList *primaries);
 void attrib_client_unregister(struct btd_device *device);
+void attrib_client_remove_primaries(struct btd_device *device,
+						uint16_t start, uint16_t end);
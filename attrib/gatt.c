@@ -352,6 +352,493 @@ guint gatt_discover_char(GAttrib *attrib, uint16_t start, uint16_t end,
 								dc, NULL);
 }
 
+struct discover_all {
+	GAttrib *attrib;
+	struct gatt_table *table;
+	unsigned int sorted;		/* Entries ordered by handle */
+	unsigned int cur;		/* Characteristic being searched */
+	uint16_t start;
+	uint16_t end;
+	gatt_table_cb_t cb;
+	void *user_data;
+};
+
+static void discover_all_desc(struct discover_all *da);
+
+void gatt_table_free(struct gatt_table *table)
+{
+	if (table == NULL)
+		return;
+
+	g_free(table->entries);
+	g_free(table);
+}
+
+static struct gatt_table_entry *table_append(struct gatt_table *table,
+						uint8_t kind, uint16_t handle)
+{
+	struct gatt_table_entry *entry;
+
+	if (table->len == table->size) {
+		unsigned int size = table->size ? table->size * 2 : 32;
+
+		entry = g_try_realloc(table->entries, size * sizeof(*entry));
+		if (entry == NULL)
+			return NULL;
+
+		table->entries = entry;
+		table->size = size;
+	}
+
+	entry = &table->entries[table->len++];
+	memset(entry, 0, sizeof(*entry));
+	entry->kind = kind;
+	entry->handle = handle;
+
+	return entry;
+}
+
+static int table_entry_cmp(const void *a, const void *b)
+{
+	const struct gatt_table_entry *ea = a, *eb = b;
+
+	return ea->handle - eb->handle;
+}
+
+static void table_sort(struct discover_all *da)
+{
+	struct gatt_table *table = da->table;
+
+	qsort(table->entries, table->len, sizeof(struct gatt_table_entry),
+							table_entry_cmp);
+	da->sorted = table->len;
+}
+
+static void discover_all_complete(struct discover_all *da, guint8 status)
+{
+	struct gatt_table *table = da->table;
+
+	if (status) {
+		gatt_table_free(table);
+		table = NULL;
+	} else
+		table_sort(da);
+
+	da->cb(table, status, da->user_data);
+
+	g_attrib_unref(da->attrib);
+	g_free(da);
+}
+
+/*
+ * ATT allows a single outstanding request, so requests are as wide as
+ * possible instead: characteristics of every service come back in one
+ * Read By Type sweep and descriptors are only looked for where a
+ * characteristic has handles after its value.
+ */
+static guint discover_all_send(struct discover_all *da, uint8_t opcode,
+						GAttribResultFunc func)
+{
+	bt_uuid_t type;
+	uint8_t *buf;
+	int buflen;
+	guint16 plen;
+
+	buf = g_attrib_get_buffer(da->attrib, &buflen);
+
+	switch (opcode) {
+	case ATT_OP_READ_BY_GROUP_REQ:
+		bt_uuid16_create(&type, GATT_PRIM_SVC_UUID);
+		plen = enc_read_by_grp_req(da->start, da->end, &type, buf,
+									buflen);
+		break;
+	case ATT_OP_READ_BY_TYPE_REQ:
+		bt_uuid16_create(&type, GATT_CHARAC_UUID);
+		plen = enc_read_by_type_req(da->start, da->end, &type, buf,
+									buflen);
+		break;
+	default:
+		plen = enc_find_info_req(da->start, da->end, buf, buflen);
+		break;
+	}
+
+	if (plen == 0)
+		return 0;
+
+	return g_attrib_send(da->attrib, 0, opcode, buf, plen, func, da, NULL);
+}
+
+/*
+ * Only the services are needed to use the device, past them a failing
+ * request ends the discovery with the attributes found so far
+ */
+static void discover_all_stop(struct discover_all *da)
+{
+	discover_all_complete(da, 0);
+}
+
+/* Characteristic ends are bound by the next declaration or service end */
+static void table_set_char_ends(struct gatt_table *table)
+{
+	struct gatt_table_entry *chr = NULL;
+	uint16_t svc_end = 0;
+	unsigned int i;
+
+	for (i = 0; i < table->len; i++) {
+		struct gatt_table_entry *entry = &table->entries[i];
+
+		if (chr)
+			chr->end = MIN(entry->handle - 1, svc_end);
+
+		if (entry->kind == GATT_TABLE_SERVICE) {
+			svc_end = entry->end;
+			chr = NULL;
+		} else
+			chr = entry;
+	}
+
+	if (chr)
+		chr->end = svc_end;
+}
+
+static void desc_cb(guint8 status, const guint8 *ipdu, guint16 iplen,
+							gpointer user_data)
+{
+	struct discover_all *da = user_data;
+	struct att_data_list *list;
+	uint16_t last = 0;
+	uint8_t format;
+	unsigned int i;
+
+	if (status) {
+		if (status != ATT_ECODE_ATTR_NOT_FOUND) {
+			discover_all_stop(da);
+			return;
+		}
+
+		goto next;
+	}
+
+	list = dec_find_info_resp(ipdu, iplen, &format);
+	if (list == NULL) {
+		discover_all_stop(da);
+		return;
+	}
+
+	for (i = 0; i < list->num; i++) {
+		const uint8_t *data = list->data[i];
+		struct gatt_table_entry *desc;
+		uint16_t handle = att_get_u16(data);
+
+		if (handle < da->start || handle > da->end)
+			continue;
+
+		desc = table_append(da->table, GATT_TABLE_DESC, handle);
+		if (desc == NULL) {
+			att_data_list_free(list);
+			discover_all_complete(da, ATT_ECODE_INSUFF_RESOURCES);
+			return;
+		}
+
+		if (format == 0x01)
+			desc->uuid = att_get_uuid16(&data[2]);
+		else
+			desc->uuid = att_get_uuid128(&data[2]);
+
+		last = handle;
+	}
+
+	att_data_list_free(list);
+
+	if (last != 0 && last < da->end) {
+		da->start = last + 1;
+		if (discover_all_send(da, ATT_OP_FIND_INFO_REQ, desc_cb) == 0)
+			discover_all_stop(da);
+		return;
+	}
+
+next:
+	da->cur++;
+	discover_all_desc(da);
+}
+
+static void discover_all_desc(struct discover_all *da)
+{
+	struct gatt_table_entry *entries = da->table->entries;
+
+	for (; da->cur < da->sorted; da->cur++) {
+		struct gatt_table_entry *chr = &entries[da->cur];
+
+		if (chr->kind != GATT_TABLE_CHAR ||
+					chr->value_handle >= chr->end)
+			continue;
+
+		da->start = chr->value_handle + 1;
+		da->end = chr->end;
+
+		if (discover_all_send(da, ATT_OP_FIND_INFO_REQ, desc_cb) == 0)
+			discover_all_stop(da);
+
+		return;
+	}
+
+	discover_all_complete(da, 0);
+}
+
+static void chars_cb(guint8 status, const guint8 *ipdu, guint16 iplen,
+							gpointer user_data)
+{
+	struct discover_all *da = user_data;
+	struct att_data_list *list;
+	uint16_t last = 0;
+	unsigned int i;
+
+	/* Any error ends the sweep, the characteristics found are kept */
+	if (status)
+		goto done;
+
+	list = dec_read_by_type_resp(ipdu, iplen);
+	if (list == NULL)
+		goto done;
+
+	for (i = 0; i < list->num; i++) {
+		const uint8_t *value = list->data[i];
+		struct gatt_table_entry *chr;
+		uint16_t handle = att_get_u16(value);
+
+		if (handle < da->start || (list->len != 7 && list->len != 21))
+			continue;
+
+		chr = table_append(da->table, GATT_TABLE_CHAR, handle);
+		if (chr == NULL) {
+			att_data_list_free(list);
+			discover_all_complete(da, ATT_ECODE_INSUFF_RESOURCES);
+			return;
+		}
+
+		chr->properties = value[2];
+		chr->value_handle = att_get_u16(&value[3]);
+
+		if (list->len == 7)
+			chr->uuid = att_get_uuid16(&value[5]);
+		else
+			chr->uuid = att_get_uuid128(&value[5]);
+
+		last = handle;
+	}
+
+	att_data_list_free(list);
+
+	if (last != 0 && last < da->end) {
+		da->start = last + 1;
+		if (discover_all_send(da, ATT_OP_READ_BY_TYPE_REQ,
+							chars_cb) == 0)
+			goto done;
+		return;
+	}
+
+done:
+	table_sort(da);
+	table_set_char_ends(da->table);
+
+	da->cur = 0;
+	discover_all_desc(da);
+}
+
+static void services_cb(guint8 status, const guint8 *ipdu, guint16 iplen,
+							gpointer user_data)
+{
+	struct discover_all *da = user_data;
+	struct att_data_list *list;
+	uint16_t end = 0;
+	unsigned int i;
+
+	if (status) {
+		if (status != ATT_ECODE_ATTR_NOT_FOUND) {
+			discover_all_complete(da, status);
+			return;
+		}
+
+		goto done;
+	}
+
+	list = dec_read_by_grp_resp(ipdu, iplen);
+	if (list == NULL) {
+		discover_all_complete(da, ATT_ECODE_IO);
+		return;
+	}
+
+	for (i = 0; i < list->num; i++) {
+		const uint8_t *data = list->data[i];
+		struct gatt_table_entry *svc;
+		uint16_t start = att_get_u16(&data[0]);
+
+		if (start < da->start || (list->len != 6 && list->len != 20))
+			continue;
+
+		svc = table_append(da->table, GATT_TABLE_SERVICE, start);
+		if (svc == NULL) {
+			att_data_list_free(list);
+			discover_all_complete(da, ATT_ECODE_INSUFF_RESOURCES);
+			return;
+		}
+
+		end = att_get_u16(&data[2]);
+		svc->end = MAX(end, start);
+
+		if (list->len == 6)
+			svc->uuid = att_get_uuid16(&data[4]);
+		else
+			svc->uuid = att_get_uuid128(&data[4]);
+	}
+
+	att_data_list_free(list);
+
+	if (end != 0 && end != 0xffff) {
+		da->start = end + 1;
+		if (discover_all_send(da, ATT_OP_READ_BY_GROUP_REQ,
+							services_cb) == 0)
+			discover_all_complete(da, ATT_ECODE_IO);
+		return;
+	}
+
+done:
+	if (da->table->len == 0) {
+		discover_all_complete(da, 0);
+		return;
+	}
+
+	da->start = da->table->entries[0].handle;
+	for (i = 0, da->end = 0; i < da->table->len; i++)
+		da->end = MAX(da->end, da->table->entries[i].end);
+
+	if (discover_all_send(da, ATT_OP_READ_BY_TYPE_REQ, chars_cb) == 0)
+		discover_all_stop(da);
+}
+
+guint gatt_discover_all(GAttrib *attrib, gatt_table_cb_t func,
+							gpointer user_data)
+{
+	struct discover_all *da;
+	guint id;
+
+	da = g_try_new0(struct discover_all, 1);
+	if (da == NULL)
+		return 0;
+
+	da->table = g_try_new0(struct gatt_table, 1);
+	if (da->table == NULL) {
+		g_free(da);
+		return 0;
+	}
+
+	da->attrib = g_attrib_ref(attrib);
+	da->cb = func;
+	da->user_data = user_data;
+	da->start = 0x0001;
+	da->end = 0xffff;
+
+	id = discover_all_send(da, ATT_OP_READ_BY_GROUP_REQ, services_cb);
+	if (id == 0) {
+		g_attrib_unref(da->attrib);
+		gatt_table_free(da->table);
+		g_free(da);
+	}
+
+	return id;
+}
+
+GSList *gatt_table_primaries(const struct gatt_table *table)
+{
+	GSList *primaries = NULL;
+	unsigned int i;
+
+	for (i = 0; i < table->len; i++) {
+		const struct gatt_table_entry *entry = &table->entries[i];
+		struct att_primary *primary;
+		bt_uuid_t uuid;
+
+		if (entry->kind != GATT_TABLE_SERVICE)
+			continue;
+
+		primary = g_new0(struct att_primary, 1);
+		primary->start = entry->handle;
+		primary->end = entry->end;
+		bt_uuid_to_uuid128(&entry->uuid, &uuid);
+		bt_uuid_to_string(&uuid, primary->uuid, sizeof(primary->uuid));
+
+		primaries = g_slist_prepend(primaries, primary);
+	}
+
+	return g_slist_reverse(primaries);
+}
+
+GSList *gatt_table_chars(const struct gatt_table *table, uint16_t start,
+								uint16_t end)
+{
+	GSList *chars = NULL;
+	unsigned int i;
+
+	for (i = 0; i < table->len; i++) {
+		const struct gatt_table_entry *entry = &table->entries[i];
+		struct att_char *chr;
+		bt_uuid_t uuid;
+
+		if (entry->kind != GATT_TABLE_CHAR || entry->handle < start)
+			continue;
+
+		if (entry->handle > end)
+			break;
+
+		chr = g_new0(struct att_char, 1);
+		chr->handle = entry->handle;
+		chr->properties = entry->properties;
+		chr->value_handle = entry->value_handle;
+		bt_uuid_to_uuid128(&entry->uuid, &uuid);
+		bt_uuid_to_string(&uuid, chr->uuid, sizeof(chr->uuid));
+
+		chars = g_slist_prepend(chars, chr);
+	}
+
+	return g_slist_reverse(chars);
+}
+
+const struct gatt_table_entry *gatt_table_find_char(
+					const struct gatt_table *table,
+					const bt_uuid_t *uuid)
+{
+	unsigned int i;
+
+	for (i = 0; i < table->len; i++) {
+		const struct gatt_table_entry *entry = &table->entries[i];
+
+		if (entry->kind == GATT_TABLE_CHAR &&
+					bt_uuid_cmp(&entry->uuid, uuid) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+const struct gatt_table_entry *gatt_table_find_desc(
+					const struct gatt_table *table,
+					const struct gatt_table_entry *chr,
+					const bt_uuid_t *uuid)
+{
+	const struct gatt_table_entry *entry;
+
+	/* Descriptors follow their characteristic declaration */
+	for (entry = chr + 1; entry < table->entries + table->len; entry++) {
+		if (entry->kind != GATT_TABLE_DESC)
+			break;
+
+		if (bt_uuid_cmp(&entry->uuid, uuid) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
 guint gatt_read_char_by_uuid(GAttrib *attrib, uint16_t start, uint16_t end,
 					bt_uuid_t *uuid, GAttribResultFunc func,
 					gpointer user_data)
@@ -25,6 +25,29 @@
 
 typedef void (*gatt_cb_t) (GSList *l, guint8 status, gpointer user_data);
 
+/* Kinds of entries in a discovered attribute table */
+#define GATT_TABLE_SERVICE	0x01
+#define GATT_TABLE_CHAR		0x02
+#define GATT_TABLE_DESC		0x03
+
+struct gatt_table_entry {
+	bt_uuid_t uuid;
+	uint16_t handle;
+	uint16_t end;		/* Last handle of a service or characteristic */
+	uint16_t value_handle;	/* Characteristics only */
+	uint8_t kind;
+	uint8_t properties;	/* Characteristics only */
+};
+
+struct gatt_table {
+	struct gatt_table_entry *entries;	/* Sorted by handle */
+	unsigned int len;
+	unsigned int size;
+};
+
+typedef void (*gatt_table_cb_t) (struct gatt_table *table, guint8 status,
+							gpointer user_data);
+
 guint gatt_discover_primary(GAttrib *attrib, bt_uuid_t *uuid, gatt_cb_t func,
 							gpointer user_data);
 
@@ -32,6 +55,20 @@ guint gatt_discover_char(GAttrib *attrib, uint16_t start, uint16_t end,
 					bt_uuid_t *uuid, gatt_cb_t func,
 					gpointer user_data);
 
+guint gatt_discover_all(GAttrib *attrib, gatt_table_cb_t func,
+							gpointer user_data);
+void gatt_table_free(struct gatt_table *table);
+GSList *gatt_table_primaries(const struct gatt_table *table);
+GSList *gatt_table_chars(const struct gatt_table *table, uint16_t start,
+								uint16_t end);
+const struct gatt_table_entry *gatt_table_find_char(
+					const struct gatt_table *table,
+					const bt_uuid_t *uuid);
+const struct gatt_table_entry *gatt_table_find_desc(
+					const struct gatt_table *table,
+					const struct gatt_table_entry *chr,
+					const bt_uuid_t *uuid);
+
 guint gatt_read_char(GAttrib *attrib, uint16_t handle, uint16_t offset,
 				GAttribResultFunc func, gpointer user_data);
 
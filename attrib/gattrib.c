@@ -37,6 +37,10 @@
 
 #define GATT_TIMEOUT 30
 
+/* Free commands kept per GAttrib; the first few are allocated up front */
+#define COMMAND_POOL_PREALLOC 4
+#define COMMAND_POOL_MAX 16
+
 struct _GAttrib {
 	GIOChannel *io;
 	gint refs;
@@ -46,6 +50,9 @@ struct _GAttrib {
 	guint write_watch;
 	guint timeout_watch;
 	GQueue *queue;
+	struct command *pool;
+	guint pool_len;
+	GAttribStats stats;
 	GSList *events;
 	guint next_cmd_id;
 	guint next_evt_id;
@@ -58,13 +65,14 @@ struct _GAttrib {
 struct command {
 	guint id;
 	guint8 opcode;
-	guint8 *pdu;
 	guint16 len;
 	guint8 expected;
 	gboolean sent;
 	GAttribResultFunc func;
 	gpointer user_data;
 	GDestroyNotify notify;
+	struct command *next;		/* Free list link */
+	guint8 pdu[ATT_MAX_MTU];
 };
 
 struct event {
@@ -150,13 +158,48 @@ GAttrib *g_attrib_ref(GAttrib *attrib)
 	return attrib;
 }
 
-static void command_destroy(struct command *cmd)
+static struct command *command_new(struct _GAttrib *attrib)
+{
+	struct command *cmd = attrib->pool;
+
+	if (cmd == NULL) {
+		attrib->stats.pool_misses++;
+		return g_try_new0(struct command, 1);
+	}
+
+	attrib->pool = cmd->next;
+	attrib->pool_len--;
+
+	return cmd;
+}
+
+static void command_destroy(struct _GAttrib *attrib, struct command *cmd)
 {
 	if (cmd->notify)
 		cmd->notify(cmd->user_data);
 
-	g_free(cmd->pdu);
-	g_free(cmd);
+	if (attrib->pool_len >= COMMAND_POOL_MAX) {
+		g_free(cmd);
+		return;
+	}
+
+	/* Only the header needs resetting, the PDU is always overwritten */
+	memset(cmd, 0, G_STRUCT_OFFSET(struct command, pdu));
+	cmd->next = attrib->pool;
+	attrib->pool = cmd;
+	attrib->pool_len++;
+}
+
+static void command_pool_free(struct _GAttrib *attrib)
+{
+	struct command *cmd;
+
+	while ((cmd = attrib->pool)) {
+		attrib->pool = cmd->next;
+		g_free(cmd);
+	}
+
+	attrib->pool_len = 0;
 }
 
 static void event_destroy(struct event *evt)
@@ -173,11 +216,13 @@ static void attrib_destroy(GAttrib *attrib)
 	struct command *c;
 
 	while ((c = g_queue_pop_head(attrib->queue)))
-		command_destroy(c);
+		command_destroy(attrib, c);
 
 	g_queue_free(attrib->queue);
 	attrib->queue = NULL;
 
+	command_pool_free(attrib);
+
 	for (l = attrib->events; l; l = l->next)
 		event_destroy(l->data);
 
@@ -255,6 +300,11 @@ static gboolean disconnect_timeout(gpointer data)
 	return FALSE;
 }
 
+/*
+ * The write watch has no destroy notify: it would run after the watch
+ * returns, when a callback may have dropped the last reference. Every
+ * path removing the watch clears write_watch itself instead.
+ */
 static gboolean can_write_data(GIOChannel *io, GIOCondition cond,
 								gpointer data)
 {
@@ -263,52 +313,76 @@ static gboolean can_write_data(GIOChannel *io, GIOCondition cond,
 	GError *gerr = NULL;
 	gsize len;
 	GIOStatus iostat;
+	gboolean ret = FALSE;
 
 	if (cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)) {
+		attrib->write_watch = 0;
 		if (attrib->disconnect)
 			attrib->disconnect(attrib->disc_user_data);
 
 		return FALSE;
 	}
 
-	cmd = g_queue_peek_head(attrib->queue);
-	if (cmd == NULL)
-		return FALSE;
+	attrib->stats.tx_wakeups++;
+
+	/* the notify of a sent command may drop the last reference */
+	g_attrib_ref(attrib);
+
+	/*
+	 * Commands and notifications get no response, so send every one of
+	 * them queued in a row now instead of one per G_IO_OUT wakeup. Stop
+	 * at the first request (or indication) and wait for its response.
+	 */
+	while ((cmd = g_queue_peek_head(attrib->queue))) {
+		if (cmd->sent)
+			goto done;
+
+		iostat = g_io_channel_write_chars(io, (gchar *) cmd->pdu,
+						cmd->len, &len, &gerr);
+		if (iostat == G_IO_STATUS_AGAIN) {
+			ret = TRUE;
+			goto done;
+		}
 
-	iostat = g_io_channel_write_chars(io, (gchar *) cmd->pdu, cmd->len,
-								&len, &gerr);
-	if (iostat != G_IO_STATUS_NORMAL)
-		return FALSE;
+		if (iostat != G_IO_STATUS_NORMAL) {
+			if (gerr)
+				g_error_free(gerr);
+			goto done;
+		}
 
-	if (cmd->expected == 0) {
-		g_queue_pop_head(attrib->queue);
-		command_destroy(cmd);
+		attrib->stats.tx_pdus++;
+		attrib->stats.tx_bytes += cmd->len;
 
-		return TRUE;
+		if (cmd->expected != 0)
+			break;
+
+		g_queue_pop_head(attrib->queue);
+		command_destroy(attrib, cmd);
 	}
 
+	if (cmd == NULL)
+		goto done;
+
 	cmd->sent = TRUE;
 
 	if (attrib->timeout_watch == 0)
 		attrib->timeout_watch = g_timeout_add_seconds(GATT_TIMEOUT,
 						disconnect_timeout, attrib);
 
-	return FALSE;
-}
+done:
+	if (ret == FALSE)
+		attrib->write_watch = 0;
 
-static void destroy_sender(gpointer data)
-{
-	struct _GAttrib *attrib = data;
+	g_attrib_unref(attrib);
 
-	attrib->write_watch = 0;
+	return ret;
 }
 
 static void wake_up_sender(struct _GAttrib *attrib)
 {
 	if (attrib->write_watch == 0)
-		attrib->write_watch = g_io_add_watch_full(attrib->io,
-			G_PRIORITY_DEFAULT, G_IO_OUT, can_write_data,
-			attrib, destroy_sender);
+		attrib->write_watch = g_io_add_watch(attrib->io, G_IO_OUT,
+							can_write_data, attrib);
 }
 
 static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
@@ -319,7 +393,7 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 	uint8_t buf[512], status;
 	gsize len;
 	GIOStatus iostat;
-	gboolean qempty;
+	gboolean qempty, ret = TRUE;
 
 	if (attrib->timeout_watch > 0) {
 		g_source_remove(attrib->timeout_watch);
@@ -335,6 +409,9 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 
 	memset(buf, 0, sizeof(buf));
 
+	/* event and response callbacks may drop the last reference */
+	g_attrib_ref(attrib);
+
 	iostat = g_io_channel_read_chars(io, (gchar *) buf, sizeof(buf),
 								&len, NULL);
 	if (iostat != G_IO_STATUS_NORMAL) {
@@ -342,6 +419,9 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 		goto done;
 	}
 
+	attrib->stats.rx_pdus++;
+	attrib->stats.rx_bytes += len;
+
 	for (l = attrib->events; l; l = l->next) {
 		struct event *evt = l->data;
 
@@ -351,12 +431,13 @@ static gboolean received_data(GIOChannel *io, GIOCondition cond, gpointer data)
 	}
 
 	if (is_response(buf[0]) == FALSE)
-		return TRUE;
+		goto out;
 
 	cmd = g_queue_pop_head(attrib->queue);
 	if (cmd == NULL) {
 		/* Keep the watch if we have events to report */
-		return attrib->events != NULL;
+		ret = attrib->events != NULL;
+		goto out;
 	}
 
 	if (buf[0] == ATT_OP_ERROR) {
@@ -378,19 +459,23 @@ done:
 		if (cmd->func)
 			cmd->func(status, buf, len, cmd->user_data);
 
-		command_destroy(cmd);
+		command_destroy(attrib, cmd);
 	}
 
 	if (!qempty)
 		wake_up_sender(attrib);
 
-	return TRUE;
+out:
+	g_attrib_unref(attrib);
+
+	return ret;
 }
 
 GAttrib *g_attrib_new(GIOChannel *io)
 {
 	struct _GAttrib *attrib;
 	uint16_t omtu;
+	int i;
 
 	g_io_channel_set_encoding(io, NULL, NULL);
 	g_io_channel_set_buffered(io, FALSE);
@@ -402,6 +487,17 @@ GAttrib *g_attrib_new(GIOChannel *io)
 	attrib->io = g_io_channel_ref(io);
 	attrib->queue = g_queue_new();
 
+	for (i = 0; i < COMMAND_POOL_PREALLOC; i++) {
+		struct command *cmd = g_try_new0(struct command, 1);
+
+		if (cmd == NULL)
+			break;
+
+		cmd->next = attrib->pool;
+		attrib->pool = cmd;
+		attrib->pool_len++;
+	}
+
 	attrib->read_watch = g_io_add_watch(attrib->io,
 			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 			received_data, attrib);
@@ -426,13 +522,15 @@ guint g_attrib_send(GAttrib *attrib, guint id, guint8 opcode,
 {
 	struct command *c;
 
-	c = g_try_new0(struct command, 1);
+	if (len > ATT_MAX_MTU)
+		return 0;
+
+	c = command_new(attrib);
 	if (c == NULL)
 		return 0;
 
 	c->opcode = opcode;
 	c->expected = opcode2expected(opcode);
-	c->pdu = g_malloc(len);
 	memcpy(c->pdu, pdu, len);
 	c->len = len;
 	c->func = func;
@@ -480,7 +578,7 @@ gboolean g_attrib_cancel(GAttrib *attrib, guint id)
 		cmd->func = NULL;
 	else {
 		g_queue_remove(attrib->queue, cmd);
-		command_destroy(cmd);
+		command_destroy(attrib, cmd);
 	}
 
 	return TRUE;
@@ -503,7 +601,7 @@ gboolean g_attrib_cancel_all(GAttrib *attrib)
 		}
 
 		first = FALSE;
-		command_destroy(c);
+		command_destroy(attrib, c);
 	}
 
 	if (head) {
@@ -520,6 +618,16 @@ gboolean g_attrib_set_debug(GAttrib *attrib,
 	return TRUE;
 }
 
+gboolean g_attrib_get_stats(GAttrib *attrib, GAttribStats *stats)
+{
+	if (attrib == NULL || stats == NULL)
+		return FALSE;
+
+	*stats = attrib->stats;
+
+	return TRUE;
+}
+
 uint8_t *g_attrib_get_buffer(GAttrib *attrib, int *len)
 {
 	if (len == NULL)
@@ -33,6 +33,15 @@ extern "C" {
 struct _GAttrib;
 typedef struct _GAttrib GAttrib;
 
+typedef struct {
+	guint64 tx_pdus;
+	guint64 tx_bytes;
+	guint64 rx_pdus;
+	guint64 rx_bytes;
+	guint tx_wakeups;	/* G_IO_OUT wakeups, tx_pdus / wakeup = batching */
+	guint pool_misses;	/* Commands allocated because the pool was empty */
+} GAttribStats;
+
 typedef void (*GAttribResultFunc) (guint8 status, const guint8 *pdu,
 					guint16 len, gpointer user_data);
 typedef void (*GAttribDisconnectFunc)(gpointer user_data);
@@ -68,6 +77,8 @@ guint g_attrib_register(GAttrib *attrib, guint8 opcode,
 
 gboolean g_attrib_is_encrypted(GAttrib *attrib);
 
+gboolean g_attrib_get_stats(GAttrib *attrib, GAttribStats *stats);
+
 uint8_t *g_attrib_get_buffer(GAttrib *attrib, int *len);
 gboolean g_attrib_set_mtu(GAttrib *attrib, int mtu);
 
@@ -60,6 +60,7 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
 	android_audio_hw.c \
 	liba2dp.c \
+	sbc_packetizer.c \
 	ipc.c \
 	../sbc/sbc_primitives.c \
 	../sbc/sbc_primitives_neon.c
@@ -67,6 +68,8 @@ LOCAL_SRC_FILES:= \
 ifeq ($(TARGET_ARCH),x86)
 LOCAL_SRC_FILES+= \
 	../sbc/sbc_primitives_mmx.c \
+	../sbc/sbc_primitives_sse.c \
+	../sbc/sbc_primitives_avx2.c \
 	../sbc/sbc.c
 else
 LOCAL_SRC_FILES+= \
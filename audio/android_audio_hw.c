@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <time.h>
 #include <sys/time.h>
 
 #include <cutils/log.h>
@@ -395,6 +396,25 @@ void _out_inc_rd_idx_locked(struct astream_out *out, size_t frames)
     pthread_cond_signal(&out->buf_cond);
 }
 
+/* sleeps until one buffer duration after the previous deadline, so that
+ * consecutive failed writes keep the pace of the audio output */
+static void _out_wait_next_buffer(struct astream_out *out)
+{
+    uint64_t duration_ns = out->buffer_duration_us * 1000ULL;
+    uint64_t now = system_time();
+    uint64_t next = out->last_write_time + duration_ns;
+    struct timespec ts;
+
+    if (next < now || next > now + duration_ns)
+        next = now + duration_ns;
+    out->last_write_time = next;
+
+    ts.tv_sec = next / 1000000000LL;
+    ts.tv_nsec = next % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
 static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
                          size_t bytes)
 {
@@ -467,7 +487,7 @@ err_bt_disabled:
     pthread_mutex_unlock(&out->lock);
 
     /* XXX: simulate audio output timing in case of error?!?! */
-    usleep(out->buffer_duration_us);
+    _out_wait_next_buffer(out);
     return ret;
 }
 
@@ -484,12 +504,9 @@ static void *_out_buf_thread_func(void *context)
         frames = _out_frames_ready_locked(out);
         while (frames && !out->buf_thread_exit) {
             int retries = MAX_WRITE_RETRIES;
-            uint64_t now;
-            uint32_t elapsed_us;
 
             while (frames > 0 && !out->buf_thread_exit) {
                 int ret;
-                uint32_t buffer_duration_us;
                 /* PCM format is always 16bit stereo */
                 size_t bytes = frames * sizeof(uint32_t);
                 if (bytes > out->buffer_size) {
@@ -535,21 +552,9 @@ static void *_out_buf_thread_func(void *context)
                 _out_inc_rd_idx_locked(out, ret);
                 frames -= ret;
 
-                /* XXX: PLEASE FIX ME!!!! */
-
-                /* if A2DP sink runs abnormally fast, sleep a little so that
-                 * audioflinger mixer thread does no spin and starve other threads. */
-                /* NOTE: It is likely that the A2DP headset is being disconnected */
-                now = system_time();
-                elapsed_us = (now - out->last_write_time) / 1000UL;
-                buffer_duration_us = ((ret * 1000) / out->sample_rate) * 1000;
-
-                if (elapsed_us < (buffer_duration_us / 4)) {
-                    LOGV("A2DP sink runs too fast");
-                    usleep(buffer_duration_us - elapsed_us);
-                }
-                out->last_write_time = now;
-
+                /* no throttling needed here: a2dp_write() blocks until the
+                 * liba2dp sender thread, which sends on a fixed schedule,
+                 * has room in its queue */
             }
             frames = _out_frames_ready_locked(out);
         }
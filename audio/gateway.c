@@ -268,7 +268,7 @@ static void get_record_cb(sdp_list_t *recs, int err, gpointer user_data)
 	struct audio_device *dev = user_data;
 	struct gateway *gw = dev->gateway;
 	int ch;
-	sdp_list_t *protos, *classes;
+	sdp_list_t *classes;
 	uuid_t uuid;
 	GIOChannel *io;
 	GError *gerr = NULL;
@@ -291,7 +291,9 @@ static void get_record_cb(sdp_list_t *recs, int err, gpointer user_data)
 		goto fail;
 	}
 
-	if (sdp_get_access_protos(recs->data, &protos) < 0) {
+	ch = sdp_get_access_proto_port(recs->data, RFCOMM_UUID);
+	if (ch < 0) {
+		sdp_list_free(classes, free);
 		error("Unable to get access protocols from record");
 		err = -ENODATA;
 		goto fail;
@@ -302,16 +304,12 @@ static void get_record_cb(sdp_list_t *recs, int err, gpointer user_data)
 
 	if (!sdp_uuid128_to_uuid(&uuid) || uuid.type != SDP_UUID16 ||
 			uuid.value.uuid16 != HANDSFREE_AGW_SVCLASS_ID) {
-		sdp_list_free(protos, NULL);
 		error("Invalid service record or not HFP");
 		err = -EIO;
 		goto fail;
 	}
 
-	ch = sdp_get_proto_port(protos, RFCOMM_UUID);
-	sdp_list_foreach(protos, (sdp_list_func_t) sdp_list_free, NULL);
-	sdp_list_free(protos, NULL);
-	if (ch <= 0) {
+	if (ch == 0) {
 		error("Unable to extract RFCOMM channel from service record");
 		err = -EIO;
 		goto fail;
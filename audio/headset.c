@@ -195,6 +195,7 @@ static int rfcomm_connect(struct audio_device *device, headset_stream_cb_t cb,
 				void *user_data, unsigned int *cb_id);
 static int get_records(struct audio_device *device, headset_stream_cb_t cb,
 			void *user_data, unsigned int *cb_id);
+static void get_record_cb(sdp_list_t *recs, int err, gpointer user_data);
 
 static void print_ag_features(uint32_t features)
 {
@@ -441,7 +442,7 @@ static void pending_connect_finalize(struct audio_device *dev)
 		return;
 
 	if (p->svclass)
-		bt_cancel_discovery(&dev->src, &dev->dst);
+		bt_cancel_discovery(&dev->src, &dev->dst, get_record_cb, dev);
 
 	g_slist_foreach(p->callbacks, (GFunc) pending_connect_complete, dev);
 
@@ -1442,19 +1443,14 @@ static int headset_set_channel(struct headset *headset,
 				const sdp_record_t *record, uint16_t svc)
 {
 	int ch;
-	sdp_list_t *protos;
 
-	if (sdp_get_access_protos(record, &protos) < 0) {
+	ch = sdp_get_access_proto_port(record, RFCOMM_UUID);
+	if (ch < 0) {
 		error("Unable to get access protos from headset record");
 		return -1;
 	}
 
-	ch = sdp_get_proto_port(protos, RFCOMM_UUID);
-
-	sdp_list_foreach(protos, (sdp_list_func_t) sdp_list_free, NULL);
-	sdp_list_free(protos, NULL);
-
-	if (ch <= 0) {
+	if (ch == 0) {
 		error("Unable to get RFCOMM channel from Headset record");
 		return -1;
 	}
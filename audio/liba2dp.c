@@ -34,17 +34,21 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include <netinet/in.h>
 #include <sys/poll.h>
 #include <sys/prctl.h>
+#include <sys/ioctl.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/l2cap.h>
 
 #include "ipc.h"
 #include "sbc.h"
-#include "rtp.h"
+#include "sbc_packetizer.h"
 #include "liba2dp.h"
 
 #define LOG_NDEBUG 0
@@ -92,6 +96,23 @@
  * on write()'s and fall-back to metered writes */
 #define CATCH_UP_TIMEOUT		200
 
+/* Number of packets queued between a2dp_write() and the sender thread */
+#define TX_QUEUE_SIZE			8
+
+/* Send queue levels, in 1/16 of the socket buffer, above which the
+ * bitpool is lowered and below which it may be raised again */
+#define BITPOOL_QUEUE_HIGH		8
+#define BITPOOL_QUEUE_LOW		2
+
+/* Bitpool decrease when the send queue backs up */
+#define BITPOOL_STEP_DOWN		4
+
+/* Packets the send queue has to stay short before raising the bitpool */
+#define BITPOOL_RAISE_PACKETS		50
+
+/* Packets to wait after a change for the send queue to react */
+#define BITPOOL_HOLD_PACKETS		PACKET_BUFFER_COUNT
+
 /* timeout in milliseconds for a2dp_write */
 #define WRITE_TIMEOUT			1000
 
@@ -118,6 +139,13 @@ typedef enum {
 	A2DP_CMD_QUIT,
 } a2dp_command_t;
 
+/* Packet waiting in the transmit queue, the packetizer builds it in place */
+struct tx_slot {
+	uint8_t buffer[BUFFER_SIZE];
+	struct iovec iov;
+	long duration;				/* Audio in the packet in usec */
+};
+
 struct bluetooth_data {
 	unsigned int link_mtu;			/* MTU for transport channel */
 	struct pollfd stream;			/* Audio stream filedescriptor */
@@ -135,20 +163,33 @@ struct bluetooth_data {
 	sbc_t sbc;				/* Codec data */
 	int	frame_duration;			/* length of an SBC frame in microseconds */
 	int codesize;				/* SBC codesize */
-	int samples;				/* Number of encoded samples */
-	uint8_t buffer[BUFFER_SIZE];		/* Codec transfer buffer */
-	int count;				/* Codec transfer buffer counter */
-
-	int nsamples;				/* Cumulative number of codec samples */
-	uint16_t seq_num;			/* Cumulative packet sequence */
-	int frame_count;			/* Current frames in buffer*/
+	struct sbc_packetizer *packetizer;	/* Media packet being built */
 
 	char	address[20];
 	int	rate;
 	int	channels;
 
-	/* used for pacing our writes to the output socket */
-	uint64_t	next_write;
+	/* Single producer (a2dp_write), single consumer (sender thread)
+	 * queue. Each index is only written by its side, the semaphores
+	 * count the free and filled slots and order the slot accesses */
+	struct tx_slot queue[TX_QUEUE_SIZE];
+	unsigned int queue_head;		/* Next slot to fill */
+	unsigned int queue_tail;		/* Next slot to send */
+	struct tx_slot *tx_slot;		/* Slot being filled, if any */
+	sem_t queue_free;
+	sem_t queue_filled;
+
+	/* Paced sender thread */
+	pthread_t sender;
+	volatile int sender_running;
+	volatile int stream_error;		/* errno of a failed send */
+	struct a2dp_stats stats;
+	uint64_t jitter_total;			/* Sum of deviations in usec */
+
+	/* Adaptive bitpool, only used from a2dp_write() */
+	int sndbuf;				/* Stream socket buffer size */
+	int bitpool_hold;			/* Packets until next decrease */
+	int bitpool_calm;			/* Packets with a short queue */
 };
 
 static uint64_t get_microseconds()
@@ -165,6 +206,296 @@ static void print_time(const char* message, uint64_t then, uint64_t now)
 }
 #endif
 
+static void timespec_add_us(struct timespec *ts, long us)
+{
+	ts->tv_nsec += (us % 1000000) * 1000;
+	ts->tv_sec += us / 1000000 + ts->tv_nsec / 1000000000;
+	ts->tv_nsec %= 1000000000;
+}
+
+static long timespec_diff_us(const struct timespec *a,
+					const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000L +
+				(a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+static int avdtp_send(struct bluetooth_data *data, struct tx_slot *slot)
+{
+	struct msghdr msg;
+	int ret;
+#ifdef ENABLE_TIMING
+	uint64_t begin, end;
+	begin = get_microseconds();
+#endif
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &slot->iov;
+	msg.msg_iovlen = 1;
+
+	data->stream.revents = 0;
+	ret = poll(&data->stream, 1, POLL_TIMEOUT);
+	if (ret != 1 || data->stream.revents != POLLOUT) {
+		/* can happen during normal remote disconnect */
+		VDBG("poll() failed: %d (revents = %d, errno %s)",
+				ret, data->stream.revents, strerror(errno));
+		return -EIO;
+	}
+
+	ret = sendmsg(data->stream.fd, &msg, MSG_NOSIGNAL);
+	if (ret < 0) {
+		/* can happen during normal remote disconnect */
+		VDBG("send() failed: %d (errno %s)", ret, strerror(errno));
+		if (errno == EPIPE)
+			data->stream_error = EPIPE;
+		return -errno;
+	}
+
+#ifdef ENABLE_TIMING
+	end = get_microseconds();
+	print_time("send", begin, end);
+#endif
+	return 0;
+}
+
+/* Sends the queued packets on an absolute schedule, one packet duration
+ * apart, so that the spacing does not depend on when a2dp_write() runs */
+static void *a2dp_sender_thread(void *d)
+{
+	struct bluetooth_data *data = d;
+	struct timespec deadline, now;
+	int scheduled = 0;
+
+	prctl(PR_SET_NAME, (unsigned long) "a2dp_sender", 0, 0, 0);
+
+	while (data->sender_running) {
+		struct tx_slot *slot;
+		long late;
+
+		if (scheduled) {
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+						&deadline, NULL) == EINTR);
+		}
+
+		if (sem_trywait(&data->queue_filled) < 0) {
+			/* nothing to send when the packet was due */
+			if (scheduled)
+				data->stats.underruns++;
+			scheduled = 0;
+
+			if (sem_wait(&data->queue_filled) < 0)
+				continue;
+		}
+
+		if (!data->sender_running)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (scheduled) {
+			late = timespec_diff_us(&now, &deadline);
+			if (late >= CATCH_UP_TIMEOUT * 1000) {
+				/* fallen too far behind, don't try to catch up */
+				VDBG("late %ld us, restarting schedule", late);
+				data->stats.resyncs++;
+				scheduled = 0;
+			} else {
+				data->jitter_total += late;
+				data->stats.jitter_avg_us = data->jitter_total /
+						(data->stats.packets + 1);
+				if ((unsigned long) late > data->stats.jitter_max_us)
+					data->stats.jitter_max_us = late;
+			}
+		}
+
+		if (!scheduled) {
+			deadline = now;
+			scheduled = 1;
+		}
+
+		slot = &data->queue[data->queue_tail];
+
+		if (avdtp_send(data, slot) < 0)
+			data->stats.errors++;
+
+		timespec_add_us(&deadline, slot->duration);
+		data->stats.packets++;
+
+		data->queue_tail = (data->queue_tail + 1) % TX_QUEUE_SIZE;
+		sem_post(&data->queue_free);
+	}
+
+	return NULL;
+}
+
+static int a2dp_sender_start(struct bluetooth_data *data)
+{
+	int i, err;
+
+	/* drop whatever is left over from the previous stream */
+	while (sem_trywait(&data->queue_filled) == 0);
+	while (sem_trywait(&data->queue_free) == 0);
+	for (i = 0; i < TX_QUEUE_SIZE; i++)
+		sem_post(&data->queue_free);
+
+	data->queue_head = 0;
+	data->queue_tail = 0;
+	data->tx_slot = NULL;
+	data->stream_error = 0;
+	data->jitter_total = 0;
+	memset(&data->stats, 0, sizeof(data->stats));
+
+	data->sender_running = 1;
+	err = pthread_create(&data->sender, NULL, a2dp_sender_thread, data);
+	if (err) {
+		data->sender_running = 0;
+		return -err;
+	}
+
+	return 0;
+}
+
+/* Must be called with data->mutex held, or before a2dp_thread runs */
+static void a2dp_sender_stop(struct bluetooth_data *data)
+{
+	if (!data->sender_running)
+		return;
+
+	data->sender_running = 0;
+	sem_post(&data->queue_filled);
+	pthread_join(data->sender, NULL);
+
+	/* wake up a2dp_write() if it is waiting for a free slot */
+	sem_post(&data->queue_free);
+
+	DBG("sent %lu packets, %lu errors, %lu underruns, %lu resyncs, "
+		"jitter avg %lu us max %lu us", data->stats.packets,
+		data->stats.errors, data->stats.underruns, data->stats.resyncs,
+		data->stats.jitter_avg_us, data->stats.jitter_max_us);
+}
+
+static void bitpool_publish(struct bluetooth_data *data)
+{
+	data->stats.bitpool = data->sbc.bitpool;
+	data->stats.bitrate = data->frame_duration <= 0 ? 0 :
+			sbc_get_frame_length(&data->sbc) * 8000000ULL /
+							data->frame_duration;
+}
+
+/* Starts the stream at the highest negotiated bitpool */
+static void bitpool_reset(struct bluetooth_data *data)
+{
+	socklen_t len = sizeof(data->sndbuf);
+
+	if (getsockopt(data->stream.fd, SOL_SOCKET, SO_SNDBUF,
+					&data->sndbuf, &len) < 0)
+		data->sndbuf = 0;
+
+	data->bitpool_hold = 0;
+	data->bitpool_calm = 0;
+	data->sbc.bitpool = data->sbc_capabilities.max_bitpool;
+	bitpool_publish(data);
+}
+
+/* Lowers the bitpool when the stream socket backs up, e.g. because the
+ * radio link got worse, and slowly raises it again while the queue stays
+ * short. Called between packets, the encoder picks up the new bitpool
+ * with the next frame. */
+static void bitpool_update(struct bluetooth_data *data)
+{
+	int outq, queued, bitpool = data->sbc.bitpool;
+
+	if (data->sndbuf <= 0)
+		return;
+
+	if (data->bitpool_hold > 0)
+		data->bitpool_hold--;
+
+	/* Bluetooth sockets report the free space left in the send
+	 * buffer rather than the number of bytes queued */
+	if (ioctl(data->stream.fd, TIOCOUTQ, &outq) < 0)
+		return;
+	queued = data->sndbuf - outq;
+
+	if (queued * 16 >= data->sndbuf * BITPOOL_QUEUE_HIGH) {
+		data->bitpool_calm = 0;
+		if (data->bitpool_hold > 0)
+			return;
+		bitpool = MAX(bitpool - BITPOOL_STEP_DOWN,
+				data->sbc_capabilities.min_bitpool);
+	} else if (queued * 16 <= data->sndbuf * BITPOOL_QUEUE_LOW) {
+		if (++data->bitpool_calm < BITPOOL_RAISE_PACKETS)
+			return;
+		data->bitpool_calm = 0;
+		bitpool = MIN(bitpool + 1, data->sbc_capabilities.max_bitpool);
+	} else {
+		data->bitpool_calm = 0;
+		return;
+	}
+
+	if (bitpool == data->sbc.bitpool)
+		return;
+
+	data->sbc.bitpool = bitpool;
+	data->bitpool_hold = BITPOOL_HOLD_PACKETS;
+	bitpool_publish(data);
+
+	DBG("%d of %d bytes queued, bitpool %d (%lu bps)", queued,
+			data->sndbuf, bitpool, data->stats.bitrate);
+}
+
+/* Returns the slot to encode into, waiting up to timeout milliseconds for
+ * the sender to free one */
+static struct tx_slot *tx_queue_get(struct bluetooth_data *data, int timeout)
+{
+	struct timeval tv;
+	struct timespec ts;
+
+	if (data->tx_slot)
+		return data->tx_slot;
+
+	gettimeofday(&tv, (struct timezone *) NULL);
+	ts.tv_sec = tv.tv_sec;
+	ts.tv_nsec = tv.tv_usec * 1000L;
+	timespec_add_us(&ts, timeout * 1000L);
+
+	while (sem_timedwait(&data->queue_free, &ts) < 0) {
+		if (errno != EINTR)
+			return NULL;
+	}
+
+	if (!data->sender_running)
+		return NULL;
+
+	bitpool_update(data);
+
+	data->tx_slot = &data->queue[data->queue_head];
+	sbc_packetizer_set_buffer(data->packetizer, data->tx_slot->buffer);
+
+	return data->tx_slot;
+}
+
+/* Hands the finished packet over to the sender thread */
+static void tx_queue_push(struct bluetooth_data *data)
+{
+	struct tx_slot *slot = data->tx_slot;
+	const struct iovec *iov;
+
+	iov = sbc_packetizer_get_packet(data->packetizer);
+	if (!slot || !iov)
+		return;
+
+	slot->iov = *iov;
+	slot->duration = data->frame_duration *
+			sbc_packetizer_get_frames(data->packetizer);
+
+	sbc_packetizer_next(data->packetizer);
+
+	data->tx_slot = NULL;
+	data->queue_head = (data->queue_head + 1) % TX_QUEUE_SIZE;
+	sem_post(&data->queue_filled);
+}
+
 static int audioservice_send(struct bluetooth_data *data, const bt_audio_msg_header_t *msg);
 static int audioservice_expect(struct bluetooth_data *data, bt_audio_msg_header_t *outmsg,
 				int expected_type);
@@ -175,6 +506,8 @@ static void set_state(struct bluetooth_data *data, a2dp_state_t state);
 static void bluetooth_close(struct bluetooth_data *data)
 {
 	DBG("bluetooth_close");
+	a2dp_sender_stop(data);
+
 	if (data->server.fd >= 0) {
 		bt_audio_service_close(data->server.fd);
 		data->server.fd = -1;
@@ -259,13 +592,20 @@ static int bluetooth_start(struct bluetooth_data *data)
 	setsockopt(data->stream.fd, SOL_SOCKET, SO_SNDBUF, &bytes,
 			sizeof(bytes));
 
-	data->count = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
-	data->frame_count = 0;
-	data->samples = 0;
-	data->nsamples = 0;
-	data->seq_num = 0;
-	data->frame_count = 0;
-	data->next_write = 0;
+	/* packets are encoded in place, limited to the link MTU */
+	sbc_packetizer_free(data->packetizer);
+	data->packetizer = sbc_packetizer_new(&data->sbc,
+				MIN(data->link_mtu, BUFFER_SIZE), 1);
+	if (!data->packetizer) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	err = a2dp_sender_start(data);
+	if (err < 0)
+		goto error;
+
+	bitpool_reset(data);
 
 	set_state(data, A2DP_STATE_STARTED);
 	return 0;
@@ -290,6 +630,7 @@ static int bluetooth_stop(struct bluetooth_data *data)
 	DBG("bluetooth_stop");
 
 	data->state = A2DP_STATE_STOPPING;
+	a2dp_sender_stop(data);
 	l2cap_set_flushable(data->stream.fd, 0);
 	if (data->stream.fd >= 0) {
 		close(data->stream.fd);
@@ -636,99 +977,6 @@ static int bluetooth_a2dp_hw_params(struct bluetooth_data *data)
 	return 0;
 }
 
-static int avdtp_write(struct bluetooth_data *data)
-{
-	int ret = 0;
-	struct rtp_header *header;
-	struct rtp_payload *payload;
-
-	uint64_t now;
-	long duration = data->frame_duration * data->frame_count;
-#ifdef ENABLE_TIMING
-	uint64_t begin, end, begin2, end2;
-	begin = get_microseconds();
-#endif
-
-	header = (struct rtp_header *)data->buffer;
-	payload = (struct rtp_payload *)(data->buffer + sizeof(*header));
-
-	memset(data->buffer, 0, sizeof(*header) + sizeof(*payload));
-
-	payload->frame_count = data->frame_count;
-	header->v = 2;
-	header->pt = 1;
-	header->sequence_number = htons(data->seq_num);
-	header->timestamp = htonl(data->nsamples);
-	header->ssrc = htonl(1);
-
-	data->stream.revents = 0;
-#ifdef ENABLE_TIMING
-	begin2 = get_microseconds();
-#endif
-	ret = poll(&data->stream, 1, POLL_TIMEOUT);
-#ifdef ENABLE_TIMING
-	end2 = get_microseconds();
-	print_time("poll", begin2, end2);
-#endif
-	if (ret == 1 && data->stream.revents == POLLOUT) {
-		long ahead = 0;
-		now = get_microseconds();
-
-		if (data->next_write) {
-			ahead = data->next_write - now;
-#ifdef ENABLE_TIMING
-			DBG("duration: %ld, ahead: %ld", duration, ahead);
-#endif
-			if (ahead > 0) {
-				/* too fast, need to throttle */
-				usleep(ahead);
-			}
-		} else {
-			data->next_write = now;
-		}
-		if (ahead <= -CATCH_UP_TIMEOUT * 1000) {
-			/* fallen too far behind, don't try to catch up */
-			VDBG("ahead < %d, reseting next_write timestamp", -CATCH_UP_TIMEOUT * 1000);
-			data->next_write = 0;
-		} else {
-			data->next_write += duration;
-		}
-
-#ifdef ENABLE_TIMING
-		begin2 = get_microseconds();
-#endif
-		ret = send(data->stream.fd, data->buffer, data->count, MSG_NOSIGNAL);
-#ifdef ENABLE_TIMING
-		end2 = get_microseconds();
-		print_time("send", begin2, end2);
-#endif
-		if (ret < 0) {
-			/* can happen during normal remote disconnect */
-			VDBG("send() failed: %d (errno %s)", ret, strerror(errno));
-		}
-		if (ret == -EPIPE) {
-			bluetooth_close(data);
-		}
-	} else {
-		/* can happen during normal remote disconnect */
-		VDBG("poll() failed: %d (revents = %d, errno %s)",
-				ret, data->stream.revents, strerror(errno));
-		data->next_write = 0;
-	}
-
-	/* Reset buffer of data to send */
-	data->count = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
-	data->frame_count = 0;
-	data->samples = 0;
-	data->seq_num++;
-
-#ifdef ENABLE_TIMING
-	end = get_microseconds();
-	print_time("avdtp_write", begin, end);
-#endif
-	return 0; /* always return success */
-}
-
 static int audioservice_send(struct bluetooth_data *data,
 		const bt_audio_msg_header_t *msg)
 {
@@ -1026,6 +1274,9 @@ static void a2dp_free(struct bluetooth_data *data)
 	pthread_cond_destroy(&data->thread_wait);
 	pthread_cond_destroy(&data->thread_start);
 	pthread_mutex_destroy(&data->mutex);
+	sem_destroy(&data->queue_free);
+	sem_destroy(&data->queue_filled);
+	sbc_packetizer_free(data->packetizer);
 	free(data);
 	return;
 }
@@ -1133,6 +1384,8 @@ int a2dp_init(int rate, int channels, a2dpData* dataPtr)
 	pthread_cond_init(&data->thread_start, NULL);
 	pthread_cond_init(&data->thread_wait, NULL);
 	pthread_cond_init(&data->client_wait, NULL);
+	sem_init(&data->queue_free, 0, 0);
+	sem_init(&data->queue_filled, 0, 0);
 
 	pthread_mutex_lock(&data->mutex);
 	data->started = 0;
@@ -1187,7 +1440,6 @@ int a2dp_write(a2dpData d, const void* buffer, int count)
 	int err, ret = 0;
 	long frames_left = count;
 	int encoded;
-	unsigned int written;
 	const char *buff;
 	int did_configure = 0;
 #ifdef ENABLE_TIMING
@@ -1203,35 +1455,42 @@ int a2dp_write(a2dpData d, const void* buffer, int count)
 	codesize = data->codesize;
 
 	while (frames_left >= codesize) {
-		/* Enough data to encode (sbc wants 512 byte blocks) */
-		encoded = sbc_encode(&(data->sbc), src, codesize,
-					data->buffer + data->count,
-					sizeof(data->buffer) - data->count,
-					&written);
-		if (encoded <= 0) {
-			ERR("Encoding error %d", encoded);
+		if (data->stream_error == EPIPE) {
+			/* a2dp_thread may be stopping the sender at the same
+			 * time, the mutex makes sure only one of us joins it */
+			pthread_mutex_lock(&data->mutex);
+			bluetooth_close(data);
+			pthread_mutex_unlock(&data->mutex);
 			goto done;
 		}
-		VDBG("sbc_encode returned %d, codesize: %d, written: %d\n",
-			encoded, codesize, written);
 
-		src += encoded;
-		data->count += written;
-		data->frame_count++;
-		data->samples += encoded;
-		data->nsamples += encoded;
+		/* Wait for the sender if all the queue slots are in use */
+		if (!tx_queue_get(data, WRITE_TIMEOUT)) {
+			ERR("No transmit queue slot available");
+			goto done;
+		}
+
+		/* Encode as many frames as fit straight into the packet */
+		encoded = sbc_packetizer_encode(data->packetizer, src,
+								frames_left);
+		if (encoded < 0) {
+			ERR("Encoding error %d", encoded);
+			goto done;
+		}
+		VDBG("sbc_packetizer_encode returned %d, codesize: %d, "
+			"frames: %d\n", encoded, codesize,
+			sbc_packetizer_get_frames(data->packetizer));
 
 		/* No space left for another frame then send */
-		if ((data->count + written >= data->link_mtu) ||
-				(data->count + written >= BUFFER_SIZE)) {
-			VDBG("sending packet %d, count %d, link_mtu %u",
-					data->seq_num, data->count,
-					data->link_mtu);
-			err = avdtp_write(data);
-			if (err < 0)
-				return err;
+		if (sbc_packetizer_is_full(data->packetizer)) {
+			VDBG("queueing packet, link_mtu %u", data->link_mtu);
+			tx_queue_push(data);
+		} else if (encoded == 0) {
+			ERR("Encoder made no progress");
+			goto done;
 		}
 
+		src += encoded;
 		ret += encoded;
 		frames_left -= encoded;
 	}
@@ -1247,6 +1506,19 @@ done:
 	return ret;
 }
 
+int a2dp_get_stats(a2dpData d, struct a2dp_stats *stats)
+{
+	struct bluetooth_data* data = (struct bluetooth_data*)d;
+
+	if (!data || !stats)
+		return -EINVAL;
+
+	/* updated by the sender thread without locking, so the values
+	 * may be slightly inconsistent with each other */
+	*stats = data->stats;
+	return 0;
+}
+
 int a2dp_stop(a2dpData d)
 {
 	struct bluetooth_data* data = (struct bluetooth_data*)d;
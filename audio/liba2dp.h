@@ -28,10 +28,23 @@ extern "C" {
 
 typedef void* a2dpData;
 
+/* Statistics of the stream, reset when it starts */
+struct a2dp_stats {
+	unsigned long packets;		/* Packets sent */
+	unsigned long errors;		/* Packets that failed to send */
+	unsigned long underruns;	/* No packet queued when one was due */
+	unsigned long resyncs;		/* Schedule restarted after falling behind */
+	unsigned long jitter_avg_us;	/* Average send delay past the deadline */
+	unsigned long jitter_max_us;	/* Maximum send delay past the deadline */
+	unsigned long bitpool;		/* Current SBC bitpool */
+	unsigned long bitrate;		/* Current SBC bitrate in bits/s */
+};
+
 int a2dp_init(int rate, int channels, a2dpData* dataPtr);
 void a2dp_set_sink(a2dpData data, const char* address);
 int a2dp_write(a2dpData data, const void* buffer, int count);
 int a2dp_stop(a2dpData data);
+int a2dp_get_stats(a2dpData data, struct a2dp_stats *stats);
 void a2dp_cleanup(a2dpData data);
 
 #ifdef __cplusplus
@@ -42,7 +42,7 @@
 
 #include "ipc.h"
 #include "sbc.h"
-#include "rtp.h"
+#include "sbc_packetizer.h"
 
 /* #define ENABLE_DEBUG */
 
@@ -97,13 +97,7 @@ struct bluetooth_a2dp {
 	sbc_t sbc;				/* Codec data */
 	int sbc_initialized;			/* Keep track if the encoder is initialized */
 	unsigned int codesize;			/* SBC codesize */
-	int samples;				/* Number of encoded samples */
-	uint8_t buffer[BUFFER_SIZE];		/* Codec transfer buffer */
-	unsigned int count;			/* Codec transfer buffer counter */
-
-	int nsamples;				/* Cumulative number of codec samples */
-	uint16_t seq_num;			/* Cumulative packet sequence */
-	int frame_count;			/* Current frames in buffer*/
+	struct sbc_packetizer *packetizer;	/* Media packet being built */
 };
 
 struct bluetooth_alsa_config {
@@ -310,6 +304,8 @@ static void bluetooth_exit(struct bluetooth_data *data)
 	if (a2dp->sbc_initialized)
 		sbc_finish(&a2dp->sbc);
 
+	sbc_packetizer_free(a2dp->packetizer);
+
 	if (data->pipefd[0] > 0)
 		close(data->pipefd[0]);
 
@@ -683,7 +679,6 @@ static void bluetooth_a2dp_setup(struct bluetooth_a2dp *a2dp)
 
 	a2dp->sbc.bitpool = active_capabilities.max_bitpool;
 	a2dp->codesize = sbc_get_codesize(&a2dp->sbc);
-	a2dp->count = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
 }
 
 static int bluetooth_a2dp_hw_params(snd_pcm_ioplug_t *io,
@@ -753,6 +748,13 @@ static int bluetooth_a2dp_hw_params(snd_pcm_ioplug_t *io,
 	/* Setup SBC encoder now we agree on parameters */
 	bluetooth_a2dp_setup(a2dp);
 
+	/* Frames are encoded straight into the packet to be sent */
+	sbc_packetizer_free(a2dp->packetizer);
+	a2dp->packetizer = sbc_packetizer_new(&a2dp->sbc,
+				MIN(data->link_mtu, BUFFER_SIZE), 1);
+	if (!a2dp->packetizer)
+		return -ENOMEM;
+
 	DBG("\tallocation=%u\n\tsubbands=%u\n\tblocks=%u\n\tbitpool=%u\n",
 		a2dp->sbc.allocation, a2dp->sbc.subbands, a2dp->sbc.blocks,
 		a2dp->sbc.bitpool);
@@ -969,33 +971,23 @@ static snd_pcm_sframes_t bluetooth_a2dp_read(snd_pcm_ioplug_t *io,
 static int avdtp_write(struct bluetooth_data *data)
 {
 	int ret = 0;
-	struct rtp_header *header;
-	struct rtp_payload *payload;
+	struct msghdr msg;
 	struct bluetooth_a2dp *a2dp = &data->a2dp;
 
-	header = (void *) a2dp->buffer;
-	payload = (void *) (a2dp->buffer + sizeof(*header));
-
-	memset(a2dp->buffer, 0, sizeof(*header) + sizeof(*payload));
-
-	payload->frame_count = a2dp->frame_count;
-	header->v = 2;
-	header->pt = 1;
-	header->sequence_number = htons(a2dp->seq_num);
-	header->timestamp = htonl(a2dp->nsamples);
-	header->ssrc = htonl(1);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *) sbc_packetizer_get_packet(a2dp->packetizer);
+	msg.msg_iovlen = 1;
+	if (!msg.msg_iov)
+		return 0;
 
-	ret = send(data->stream.fd, a2dp->buffer, a2dp->count, MSG_DONTWAIT);
+	ret = sendmsg(data->stream.fd, &msg, MSG_DONTWAIT);
 	if (ret < 0) {
 		DBG("send returned %d errno %s.", ret, strerror(errno));
 		ret = -errno;
 	}
 
-	/* Reset buffer of data to send */
-	a2dp->count = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
-	a2dp->frame_count = 0;
-	a2dp->samples = 0;
-	a2dp->seq_num++;
+	/* Start the next packet */
+	sbc_packetizer_next(a2dp->packetizer);
 
 	return ret;
 }
@@ -1009,7 +1001,6 @@ static snd_pcm_sframes_t bluetooth_a2dp_write(snd_pcm_ioplug_t *io,
 	snd_pcm_sframes_t ret = 0;
 	unsigned int bytes_left;
 	int frame_size, encoded;
-	ssize_t written;
 	uint8_t *buff;
 
 	DBG("areas->step=%u areas->first=%u offset=%lu size=%lu",
@@ -1062,27 +1053,17 @@ static snd_pcm_sframes_t bluetooth_a2dp_write(snd_pcm_ioplug_t *io,
 						additional_bytes_needed);
 
 		/* Enough data to encode (sbc wants 1k blocks) */
-		encoded = sbc_encode(&a2dp->sbc, data->buffer, a2dp->codesize,
-					a2dp->buffer + a2dp->count,
-					sizeof(a2dp->buffer) - a2dp->count,
-								&written);
+		encoded = sbc_packetizer_encode(a2dp->packetizer,
+						data->buffer, a2dp->codesize);
 		if (encoded <= 0) {
 			DBG("Encoding error %d", encoded);
 			goto done;
 		}
 
-		/* Increment a2dp buffers */
-		a2dp->count += written;
-		a2dp->frame_count++;
-		a2dp->samples += encoded / frame_size;
-		a2dp->nsamples += encoded / frame_size;
-
 		/* No space left for another frame then send */
-		if (a2dp->count + written >= data->link_mtu) {
+		if (sbc_packetizer_is_full(a2dp->packetizer)) {
 			avdtp_write(data);
-			DBG("sending packet %d, count %d, link_mtu %u",
-					a2dp->seq_num, a2dp->count,
-							data->link_mtu);
+			DBG("sending packet, link_mtu %u", data->link_mtu);
 		}
 
 		/* Increment up buff pointer to take into account
@@ -1097,33 +1078,26 @@ static snd_pcm_sframes_t bluetooth_a2dp_write(snd_pcm_ioplug_t *io,
 
 	/* Process this buffer in full chunks */
 	while (bytes_left >= a2dp->codesize) {
-		/* Enough data to encode (sbc wants 1k blocks) */
-		encoded = sbc_encode(&a2dp->sbc, buff, a2dp->codesize,
-					a2dp->buffer + a2dp->count,
-					sizeof(a2dp->buffer) - a2dp->count,
-								&written);
-		if (encoded <= 0) {
+		/* Encode as many frames as fit straight into the packet */
+		encoded = sbc_packetizer_encode(a2dp->packetizer, buff,
+								bytes_left);
+		if (encoded < 0) {
 			DBG("Encoding error %d", encoded);
 			goto done;
 		}
 
 		/* Increment up buff pointer to take into account
 		 * the data processed */
-		buff += a2dp->codesize;
-		bytes_left -= a2dp->codesize;
-
-		/* Increment a2dp buffers */
-		a2dp->count += written;
-		a2dp->frame_count++;
-		a2dp->samples += encoded / frame_size;
-		a2dp->nsamples += encoded / frame_size;
+		buff += encoded;
+		bytes_left -= encoded;
 
 		/* No space left for another frame then send */
-		if (a2dp->count + written >= data->link_mtu) {
+		if (sbc_packetizer_is_full(a2dp->packetizer)) {
 			avdtp_write(data);
-			DBG("sending packet %d, count %d, link_mtu %u",
-						a2dp->seq_num, a2dp->count,
-							data->link_mtu);
+			DBG("sending packet, link_mtu %u", data->link_mtu);
+		} else if (encoded == 0) {
+			DBG("Encoder made no progress");
+			goto done;
 		}
 	}
 
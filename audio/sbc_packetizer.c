@@ -0,0 +1,171 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <netinet/in.h>
+
+#include "sbc.h"
+#include "rtp.h"
+#include "sbc_packetizer.h"
+
+/* SBC frames per packet are limited by the 4 bit RTP payload field */
+#define MAX_FRAMES_PER_PACKET 15
+
+#define HEADER_SIZE (sizeof(struct rtp_header) + sizeof(struct rtp_payload))
+
+struct sbc_packetizer {
+	sbc_t *sbc;
+	size_t mtu;
+	size_t count;			/* Bytes used in the packet */
+	int frames;			/* Frames in the packet */
+	uint16_t seq_num;
+	uint32_t timestamp;		/* Timestamp of the packet */
+	uint32_t samples;		/* Samples encoded in the packet */
+	uint32_t ssrc;
+	struct iovec iov;
+	uint8_t *buffer;		/* Packet being built */
+	uint8_t data[0];
+};
+
+struct sbc_packetizer *sbc_packetizer_new(sbc_t *sbc, size_t mtu,
+							uint32_t ssrc)
+{
+	struct sbc_packetizer *p;
+
+	if (!sbc || mtu <= HEADER_SIZE)
+		return NULL;
+
+	p = malloc(sizeof(*p) + mtu);
+	if (!p)
+		return NULL;
+
+	p->sbc = sbc;
+	p->mtu = mtu;
+	p->buffer = p->data;
+	p->ssrc = ssrc;
+
+	sbc_packetizer_reset(p);
+
+	return p;
+}
+
+void sbc_packetizer_free(struct sbc_packetizer *p)
+{
+	free(p);
+}
+
+void sbc_packetizer_reset(struct sbc_packetizer *p)
+{
+	p->count = HEADER_SIZE;
+	p->frames = 0;
+	p->seq_num = 0;
+	p->timestamp = 0;
+	p->samples = 0;
+}
+
+void sbc_packetizer_set_buffer(struct sbc_packetizer *p, void *buffer)
+{
+	p->buffer = buffer ? buffer : p->data;
+}
+
+ssize_t sbc_packetizer_encode(struct sbc_packetizer *p, const void *pcm,
+								size_t len)
+{
+	ssize_t consumed, written;
+	int frames;
+
+	if (p->frames >= MAX_FRAMES_PER_PACKET)
+		return 0;
+
+	consumed = sbc_encode_multi(p->sbc, pcm, len, p->buffer + p->count,
+				p->mtu - p->count, &written, NULL,
+				MAX_FRAMES_PER_PACKET - p->frames, &frames);
+
+	/* Only an error if not even a single frame fits */
+	if (consumed == -ENOSPC && p->frames > 0)
+		return 0;
+
+	if (consumed <= 0)
+		return consumed;
+
+	p->count += written;
+	p->frames += frames;
+	p->samples += consumed /
+			(p->sbc->mode == SBC_MODE_MONO ? 2 : 4);
+
+	return consumed;
+}
+
+int sbc_packetizer_is_full(struct sbc_packetizer *p)
+{
+	if (p->frames >= MAX_FRAMES_PER_PACKET)
+		return 1;
+
+	return p->mtu - p->count < sbc_get_frame_length(p->sbc);
+}
+
+int sbc_packetizer_get_frames(struct sbc_packetizer *p)
+{
+	return p->frames;
+}
+
+const struct iovec *sbc_packetizer_get_packet(struct sbc_packetizer *p)
+{
+	struct rtp_header *header = (void *) p->buffer;
+	struct rtp_payload *payload = (void *) (p->buffer + sizeof(*header));
+
+	if (p->frames == 0)
+		return NULL;
+
+	memset(p->buffer, 0, HEADER_SIZE);
+
+	payload->frame_count = p->frames;
+	header->v = 2;
+	header->pt = 1;
+	header->sequence_number = htons(p->seq_num);
+	header->timestamp = htonl(p->timestamp);
+	header->ssrc = htonl(p->ssrc);
+
+	p->iov.iov_base = p->buffer;
+	p->iov.iov_len = p->count;
+
+	return &p->iov;
+}
+
+void sbc_packetizer_next(struct sbc_packetizer *p)
+{
+	p->count = HEADER_SIZE;
+	p->frames = 0;
+	p->seq_num++;
+	p->timestamp += p->samples;
+	p->samples = 0;
+}
@@ -0,0 +1,63 @@
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Builds A2DP media packets (RTP header, SBC payload header and SBC
+ * frames) in a single MTU sized buffer. The PCM data is encoded by the
+ * given codec straight into the packet. */
+struct sbc_packetizer;
+
+struct sbc_packetizer *sbc_packetizer_new(sbc_t *sbc, size_t mtu,
+							uint32_t ssrc);
+void sbc_packetizer_free(struct sbc_packetizer *p);
+
+/* Starts over with an empty packet, sequence number and timestamp 0 */
+void sbc_packetizer_reset(struct sbc_packetizer *p);
+
+/* Builds the packets from now on in the given buffer of at least mtu
+ * bytes, e.g. a slot of a transmit queue, or in the internal one if NULL.
+ * Only to be called while the current packet has no frames. */
+void sbc_packetizer_set_buffer(struct sbc_packetizer *p, void *buffer);
+
+/* Encodes as many frames from pcm as fit into the current packet.
+ * Returns the number of PCM bytes consumed, 0 if the packet is full
+ * or less than one frame of input is given, or a negative error. */
+ssize_t sbc_packetizer_encode(struct sbc_packetizer *p, const void *pcm,
+								size_t len);
+
+/* Returns 1 if the packet has no room left for another frame */
+int sbc_packetizer_is_full(struct sbc_packetizer *p);
+
+/* Returns the number of frames in the current packet */
+int sbc_packetizer_get_frames(struct sbc_packetizer *p);
+
+/* Fills in the headers and returns the packet ready to be sent with
+ * sendmsg(), or NULL if it has no frames. The data stays valid until
+ * sbc_packetizer_next() is called. */
+const struct iovec *sbc_packetizer_get_packet(struct sbc_packetizer *p);
+
+/* Moves on to the next packet, advancing sequence number and timestamp */
+void sbc_packetizer_next(struct sbc_packetizer *p);
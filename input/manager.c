@@ -85,7 +85,6 @@ static int headset_probe(struct btd_device *device, GSList *uuids)
 	struct btd_adapter *adapter = device_get_adapter(device);
 	const gchar *path = device_get_path(device);
 	const sdp_record_t *record;
-	sdp_list_t *protos;
 	int ch;
 	bdaddr_t src, dst;
 
@@ -97,14 +96,16 @@ static int headset_probe(struct btd_device *device, GSList *uuids)
 
 	record = btd_device_get_record(device, uuids->data);
 
-	if (!record || sdp_get_access_protos(record, &protos) < 0) {
+	if (!record) {
 		error("Invalid record");
 		return -EINVAL;
 	}
 
-	ch = sdp_get_proto_port(protos, RFCOMM_UUID);
-	sdp_list_foreach(protos, (sdp_list_func_t) sdp_list_free, NULL);
-	sdp_list_free(protos, NULL);
+	ch = sdp_get_access_proto_port(record, RFCOMM_UUID);
+	if (ch < 0) {
+		error("Invalid record");
+		return -EINVAL;
+	}
 
 	if (ch <= 0) {
 		error("Invalid RFCOMM channel");
@@ -406,6 +406,8 @@ extern "C" {
 #define SDP_SVC_UPDATE_RSP	0x78
 #define SDP_SVC_REMOVE_REQ	0x79
 #define SDP_SVC_REMOVE_RSP	0x80
+#define SDP_SVC_BATCH_REQ	0x81
+#define SDP_SVC_BATCH_RSP	0x82
 
 /*
  * SDP Error codes
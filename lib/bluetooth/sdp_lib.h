@@ -247,6 +247,13 @@ int sdp_get_proto_port(const sdp_list_t *list, int proto);
  */
 sdp_data_t *sdp_get_proto_desc(sdp_list_t *list, int proto);
 
+/*
+ * Get protocol port straight from the ProtocolDescriptorList attribute
+ * of the record, for callers that don't need the access protocols lists.
+ * Returns 0 if the protocol isn't there, or -1 (and sets errno).
+ */
+int sdp_get_access_proto_port(const sdp_record_t *rec, int proto);
+
 /*
  * Set the LanguageBase attributes to the values specified in list
  * (a linked list of sdp_lang_attr_t objects, one for each language in
@@ -431,6 +438,8 @@ int sdp_service_search_attr_req(sdp_session_t *session, const sdp_list_t *search
  * Allocate/free a service record and its attributes
  */
 sdp_record_t *sdp_record_alloc(void);
+sdp_record_t *sdp_record_alloc_arena(uint32_t size);
+void sdp_record_free_attrs(sdp_record_t *rec);
 void sdp_record_free(sdp_record_t *rec);
 
 /*
@@ -463,6 +472,24 @@ int sdp_device_record_update_binary(sdp_session_t *session, bdaddr_t *device, ui
 int sdp_device_record_update(sdp_session_t *session, bdaddr_t *device, const sdp_record_t *rec);
 int sdp_record_update(sdp_session_t *sess, const sdp_record_t *rec);
 
+/*
+ * Register, update or unregister several service records with one
+ * request to the local server.  Every operation gets its own result in
+ * err (0 or an errno value) and the records are handled exactly like
+ * the single record functions above do; unregistered records are freed
+ * and rec is set to NULL.  Returns the number of failed operations, or
+ * -1 (and sets errno) when the server could not be reached.
+ */
+typedef struct {
+	uint8_t op;		/* SDP_SVC_REGISTER_REQ, _UPDATE_REQ or _REMOVE_REQ */
+	uint8_t flags;		/* Registration flags */
+	sdp_record_t *rec;
+	int err;
+} sdp_record_op_t;
+
+int sdp_device_record_batch(sdp_session_t *session, bdaddr_t *device, sdp_record_op_t *ops, int count);
+int sdp_record_batch(sdp_session_t *session, sdp_record_op_t *ops, int count);
+
 void sdp_record_print(const sdp_record_t *rec);
 
 /*
@@ -600,6 +627,7 @@ int sdp_set_supp_feat(sdp_record_t *rec, const sdp_list_t *sf);
 int sdp_get_supp_feat(const sdp_record_t *rec, sdp_list_t **seqp);
 
 sdp_record_t *sdp_extract_pdu(const uint8_t *pdata, int bufsize, int *scanned);
+sdp_record_t *sdp_extract_pdu_arena(const uint8_t *pdata, int bufsize, int *scanned);
 sdp_record_t *sdp_copy_record(sdp_record_t *rec);
 
 void sdp_data_print(sdp_data_t *data);
@@ -617,6 +645,37 @@ int sdp_gen_record_pdu(const sdp_record_t *rec, sdp_buf_t *pdu);
 
 int sdp_extract_seqtype(const uint8_t *buf, int bufsize, uint8_t *dtdp, int *size);
 
+/*
+ * Allocation free parsing of encoded data elements. A cursor walks a
+ * buffer of elements, each element points at its value (or at the
+ * contents of a sequence or alternative) inside that buffer and stays
+ * valid as long as the buffer does.
+ */
+typedef struct {
+	uint8_t dtd;
+	const uint8_t *val;
+	uint32_t len;
+} sdp_elem_t;
+
+typedef struct {
+	const uint8_t *pos;
+	const uint8_t *end;
+} sdp_cursor_t;
+
+void sdp_cursor_init(sdp_cursor_t *cur, const uint8_t *buf, uint32_t size);
+void sdp_cursor_enter(sdp_cursor_t *cur, const sdp_elem_t *seq);
+int sdp_cursor_next(sdp_cursor_t *cur, sdp_elem_t *elem);
+int sdp_elem_get_uint(const sdp_elem_t *elem, uint32_t *val);
+int sdp_elem_get_uuid(const sdp_elem_t *elem, uuid_t *uuid);
+
+/*
+ * Lookups on an encoded service record, as found in the attribute lists
+ * of ServiceAttribute and ServiceSearchAttribute responses
+ */
+int sdp_pdu_find_attr(const uint8_t *pdu, uint32_t size, uint16_t attr,
+							sdp_elem_t *val);
+int sdp_pdu_get_proto_port(const uint8_t *pdu, uint32_t size, int proto);
+
 sdp_data_t *sdp_extract_attr(const uint8_t *pdata, int bufsize, int *extractedLength, sdp_record_t *rec);
 
 void sdp_pattern_add_uuid(sdp_record_t *rec, uuid_t *uuid);
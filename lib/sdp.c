@@ -36,6 +36,7 @@
 #include <limits.h>
 #include <string.h>
 #include <syslog.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -62,6 +63,8 @@
 
 #define BASE_UUID "00000000-0000-1000-8000-00805F9B34FB"
 
+struct sdp_arena;
+
 static uint128_t bluetooth_base_uuid = {
 	.data = {	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
 			0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB }
@@ -69,7 +72,11 @@ static uint128_t bluetooth_base_uuid = {
 
 #define SDP_MAX_ATTR_LEN 65535
 
-static sdp_data_t *sdp_copy_seq(sdp_data_t *data);
+static sdp_data_t *sdp_copy_seq(struct sdp_arena *arena, sdp_data_t *data);
+static void pattern_add_uuid(sdp_record_t *rec, struct sdp_arena *arena,
+							uuid_t *uuid);
+static sdp_data_t *extract_attr(const uint8_t *p, int bufsize, int *size,
+				sdp_record_t *rec, struct sdp_arena *arena);
 static int sdp_attr_add_new_with_length(sdp_record_t *rec,
 	uint16_t attr, uint8_t dtd, const void *value, uint32_t len);
 static int sdp_gen_buffer(sdp_buf_t *buf, sdp_data_t *d);
@@ -352,11 +359,263 @@ void sdp_uuid_print(const uuid_t *uuid)
 }
 #endif
 
-sdp_data_t *sdp_data_alloc_with_length(uint8_t dtd, const void *value,
-							uint32_t length)
+/*
+ * Arena backed records keep the record, its data elements, strings and
+ * search pattern UUIDs in a short chain of blocks. Allocation is a pointer
+ * bump and nothing is released before the record itself, so freeing the
+ * record is a matter of a few free() calls however big its data tree is.
+ */
+#define SDP_ARENA_BLOCK		1024
+#define SDP_ARENA_ALIGN(x)	(((x) + 7) & ~7)
+
+struct sdp_arena {
+	struct sdp_arena *next;
+	uint32_t size;
+	uint32_t used;
+	int foreign;	/* First block only: an attribute is not arena memory */
+};
+
+#define SDP_ARENA_HDR	SDP_ARENA_ALIGN(sizeof(struct sdp_arena))
+
+/* Arena of a record known to come from sdp_record_alloc_arena() */
+#define RECORD_ARENA(rec) \
+	((struct sdp_arena *) ((uint8_t *) (rec) - SDP_ARENA_HDR))
+
+static struct sdp_arena *arena_block_new(uint32_t size)
+{
+	struct sdp_arena *a;
+
+	if (size < SDP_ARENA_BLOCK)
+		size = SDP_ARENA_BLOCK;
+
+	a = malloc(SDP_ARENA_HDR + size);
+	if (!a)
+		return NULL;
+
+	a->next = NULL;
+	a->size = size;
+	a->used = 0;
+	a->foreign = 0;
+
+	return a;
+}
+
+static void *arena_block_alloc(struct sdp_arena *a, uint32_t size)
+{
+	void *p;
+
+	if (a->size - a->used < size)
+		return NULL;
+
+	p = (uint8_t *) a + SDP_ARENA_HDR + a->used;
+	a->used += size;
+
+	return p;
+}
+
+static void *arena_alloc(struct sdp_arena *arena, uint32_t size)
+{
+	struct sdp_arena *a;
+	void *p;
+
+	size = SDP_ARENA_ALIGN(size);
+
+	/* Only the first block and the newest one can have room left */
+	p = arena_block_alloc(arena, size);
+	if (p)
+		return p;
+
+	if (arena->next) {
+		p = arena_block_alloc(arena->next, size);
+		if (p)
+			return p;
+	}
+
+	a = arena_block_new(size > arena->size ? size : arena->size);
+	if (!a)
+		return NULL;
+
+	a->next = arena->next;
+	arena->next = a;
+
+	return arena_block_alloc(a, size);
+}
+
+static int arena_owns(const struct sdp_arena *a, const void *p)
+{
+	for (; a; a = a->next) {
+		const uint8_t *start = (const uint8_t *) a + SDP_ARENA_HDR;
+
+		if ((const uint8_t *) p >= start &&
+					(const uint8_t *) p < start + a->used)
+			return 1;
+	}
+
+	return 0;
+}
+
+static uint32_t arena_used(const struct sdp_arena *a)
+{
+	uint32_t used = 0;
+
+	for (; a; a = a->next)
+		used += a->used;
+
+	return used;
+}
+
+static void arena_free(struct sdp_arena *a)
+{
+	while (a) {
+		struct sdp_arena *next = a->next;
+		free(a);
+		a = next;
+	}
+}
+
+/*
+ * sdp_record_t has no room for the arena, so the records allocated by
+ * sdp_record_alloc_arena() are kept in this table sorted by address. Such
+ * a record is the first allocation of its arena, right after the header
+ * of the first block.
+ */
+static const sdp_record_t **arena_records;
+static int arena_records_len;
+static int arena_records_size;
+static pthread_mutex_t arena_records_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Index of rec in the table or where it belongs, with the lock held */
+static int arena_record_pos(const sdp_record_t *rec)
+{
+	int low = 0, high = arena_records_len;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (arena_records[mid] < rec)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static int arena_record_add(const sdp_record_t *rec)
+{
+	int pos, err = 0;
+
+	pthread_mutex_lock(&arena_records_lock);
+
+	if (arena_records_len == arena_records_size) {
+		int size = arena_records_size ? arena_records_size * 2 : 16;
+		const sdp_record_t **recs;
+
+		recs = realloc(arena_records, size * sizeof(*recs));
+		if (!recs) {
+			err = -ENOMEM;
+			goto done;
+		}
+
+		arena_records = recs;
+		arena_records_size = size;
+	}
+
+	pos = arena_record_pos(rec);
+	memmove(arena_records + pos + 1, arena_records + pos,
+			(arena_records_len - pos) * sizeof(*arena_records));
+	arena_records[pos] = rec;
+	arena_records_len++;
+
+done:
+	pthread_mutex_unlock(&arena_records_lock);
+
+	return err;
+}
+
+/* Take rec out of the table, returns its arena or NULL if it has none */
+static struct sdp_arena *arena_record_remove(const sdp_record_t *rec)
+{
+	struct sdp_arena *arena = NULL;
+	int pos;
+
+	pthread_mutex_lock(&arena_records_lock);
+
+	pos = arena_record_pos(rec);
+	if (pos < arena_records_len && arena_records[pos] == rec) {
+		arena_records_len--;
+		memmove(arena_records + pos, arena_records + pos + 1,
+			(arena_records_len - pos) * sizeof(*arena_records));
+		arena = RECORD_ARENA(rec);
+	}
+
+	pthread_mutex_unlock(&arena_records_lock);
+
+	return arena;
+}
+
+static struct sdp_arena *record_arena(const sdp_record_t *rec)
+{
+	struct sdp_arena *arena = NULL;
+	int pos;
+
+	if (!rec)
+		return NULL;
+
+	pthread_mutex_lock(&arena_records_lock);
+
+	pos = arena_record_pos(rec);
+	if (pos < arena_records_len && arena_records[pos] == rec)
+		arena = RECORD_ARENA(rec);
+
+	pthread_mutex_unlock(&arena_records_lock);
+
+	return arena;
+}
+
+/*
+ * Allocations made on behalf of a record come from its arena when it has
+ * one. Elements attached later with sdp_attr_add() and friends may still
+ * be malloc()ed, so release goes through mem_free() which skips arena
+ * memory. The arena is looked up once by the entry points and handed
+ * down, a NULL arena means plain malloc().
+ */
+static void *mem_alloc(struct sdp_arena *arena, uint32_t size)
+{
+	if (arena)
+		return arena_alloc(arena, size);
+
+	return malloc(size);
+}
+
+static void mem_free(struct sdp_arena *arena, void *p)
+{
+	if (arena && arena_owns(arena, p))
+		return;
+
+	free(p);
+}
+
+static void arena_data_free(struct sdp_arena *arena, sdp_data_t *d)
+{
+	if (arena && arena_owns(arena, d))
+		return;
+
+	sdp_data_free(d);
+}
+
+/* An arena record tracks whether all of its attributes are arena owned */
+static void arena_adopt(struct sdp_arena *arena, sdp_data_t *d)
+{
+	if (arena && !arena_owns(arena, d))
+		arena->foreign = 1;
+}
+
+static sdp_data_t *data_alloc(struct sdp_arena *arena, uint8_t dtd,
+					const void *value, uint32_t length)
 {
 	sdp_data_t *seq;
-	sdp_data_t *d = malloc(sizeof(sdp_data_t));
+	sdp_data_t *d = mem_alloc(arena, sizeof(sdp_data_t));
 
 	if (!d)
 		return NULL;
@@ -426,22 +685,22 @@ sdp_data_t *sdp_data_alloc_with_length(uint8_t dtd, const void *value,
 	case SDP_TEXT_STR8:
 	case SDP_TEXT_STR16:
 		if (!value) {
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 
 		d->unitSize += length;
 		if (length <= USHRT_MAX) {
-			d->val.str = malloc(length);
+			d->val.str = mem_alloc(arena, length);
 			if (!d->val.str) {
-				free(d);
+				mem_free(arena, d);
 				return NULL;
 			}
 
 			memcpy(d->val.str, value, length);
 		} else {
 			SDPERR("Strings of size > USHRT_MAX not supported\n");
-			free(d);
+			mem_free(arena, d);
 			d = NULL;
 		}
 		break;
@@ -467,13 +726,19 @@ sdp_data_t *sdp_data_alloc_with_length(uint8_t dtd, const void *value,
 			d->unitSize += seq->unitSize;
 		break;
 	default:
-		free(d);
+		mem_free(arena, d);
 		d = NULL;
 	}
 
 	return d;
 }
 
+sdp_data_t *sdp_data_alloc_with_length(uint8_t dtd, const void *value,
+							uint32_t length)
+{
+	return data_alloc(NULL, dtd, value, length);
+}
+
 sdp_data_t *sdp_data_alloc(uint8_t dtd, const void *value)
 {
 	uint32_t length;
@@ -591,6 +856,7 @@ int sdp_attr_add(sdp_record_t *rec, uint16_t attr, sdp_data_t *d)
 
 	d->attrId = attr;
 	rec->attrlist = sdp_list_insert_sorted(rec->attrlist, d, sdp_attrid_comp_func);
+	arena_adopt(record_arena(rec), d);
 
 	if (attr == SDP_ATTR_SVCLASS_ID_LIST)
 		extract_svclass_uuid(d, &rec->svclass);
@@ -927,6 +1193,9 @@ int sdp_gen_record_pdu(const sdp_record_t *rec, sdp_buf_t *buf)
 	memset(buf, 0, sizeof(sdp_buf_t));
 	sdp_list_foreach(rec->attrlist, sdp_attr_size, buf);
 
+	/* room for the sequence header added by sdp_append_to_buf() */
+	buf->buf_size += sizeof(uint8_t) + sizeof(uint16_t);
+
 	buf->data = malloc(buf->buf_size);
 	if (!buf->data)
 		return -ENOMEM;
@@ -938,22 +1207,29 @@ int sdp_gen_record_pdu(const sdp_record_t *rec, sdp_buf_t *buf)
 	return 0;
 }
 
-void sdp_attr_replace(sdp_record_t *rec, uint16_t attr, sdp_data_t *d)
+static void attr_replace(sdp_record_t *rec, struct sdp_arena *arena,
+						uint16_t attr, sdp_data_t *d)
 {
 	sdp_data_t *p = sdp_data_get(rec, attr);
 
 	if (p) {
 		rec->attrlist = sdp_list_remove(rec->attrlist, p);
-		sdp_data_free(p);
+		arena_data_free(arena, p);
 	}
 
 	d->attrId = attr;
 	rec->attrlist = sdp_list_insert_sorted(rec->attrlist, d, sdp_attrid_comp_func);
+	arena_adopt(arena, d);
 
 	if (attr == SDP_ATTR_SVCLASS_ID_LIST)
 		extract_svclass_uuid(d, &rec->svclass);
 }
 
+void sdp_attr_replace(sdp_record_t *rec, uint16_t attr, sdp_data_t *d)
+{
+	attr_replace(rec, record_arena(rec), attr, d);
+}
+
 int sdp_attrid_comp_func(const void *key1, const void *key2)
 {
 	const sdp_data_t *d1 = (const sdp_data_t *)key1;
@@ -1038,7 +1314,8 @@ int sdp_uuid_extract(const uint8_t *p, int bufsize, uuid_t *uuid, int *scanned)
 	return 0;
 }
 
-static sdp_data_t *extract_int(const void *p, int bufsize, int *len)
+static sdp_data_t *extract_int(const void *p, int bufsize, int *len,
+				sdp_record_t *rec, struct sdp_arena *arena)
 {
 	sdp_data_t *d;
 
@@ -1047,7 +1324,7 @@ static sdp_data_t *extract_int(const void *p, int bufsize, int *len)
 		return NULL;
 	}
 
-	d = malloc(sizeof(sdp_data_t));
+	d = mem_alloc(arena, sizeof(sdp_data_t));
 	if (!d)
 		return NULL;
 
@@ -1066,7 +1343,7 @@ static sdp_data_t *extract_int(const void *p, int bufsize, int *len)
 	case SDP_UINT8:
 		if (bufsize < (int) sizeof(uint8_t)) {
 			SDPERR("Unexpected end of packet");
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 		*len += sizeof(uint8_t);
@@ -1076,7 +1353,7 @@ static sdp_data_t *extract_int(const void *p, int bufsize, int *len)
 	case SDP_UINT16:
 		if (bufsize < (int) sizeof(uint16_t)) {
 			SDPERR("Unexpected end of packet");
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 		*len += sizeof(uint16_t);
@@ -1086,7 +1363,7 @@ static sdp_data_t *extract_int(const void *p, int bufsize, int *len)
 	case SDP_UINT32:
 		if (bufsize < (int) sizeof(uint32_t)) {
 			SDPERR("Unexpected end of packet");
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 		*len += sizeof(uint32_t);
@@ -1096,7 +1373,7 @@ static sdp_data_t *extract_int(const void *p, int bufsize, int *len)
 	case SDP_UINT64:
 		if (bufsize < (int) sizeof(uint64_t)) {
 			SDPERR("Unexpected end of packet");
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 		*len += sizeof(uint64_t);
@@ -1106,23 +1383,23 @@ static sdp_data_t *extract_int(const void *p, int bufsize, int *len)
 	case SDP_UINT128:
 		if (bufsize < (int) sizeof(uint128_t)) {
 			SDPERR("Unexpected end of packet");
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 		*len += sizeof(uint128_t);
 		ntoh128((uint128_t *) p, &d->val.uint128);
 		break;
 	default:
-		free(d);
+		mem_free(arena, d);
 		d = NULL;
 	}
 	return d;
 }
 
 static sdp_data_t *extract_uuid(const uint8_t *p, int bufsize, int *len,
-							sdp_record_t *rec)
+				sdp_record_t *rec, struct sdp_arena *arena)
 {
-	sdp_data_t *d = malloc(sizeof(sdp_data_t));
+	sdp_data_t *d = mem_alloc(arena, sizeof(sdp_data_t));
 
 	if (!d)
 		return NULL;
@@ -1130,19 +1407,20 @@ static sdp_data_t *extract_uuid(const uint8_t *p, int bufsize, int *len,
 	SDPDBG("Extracting UUID");
 	memset(d, 0, sizeof(sdp_data_t));
 	if (sdp_uuid_extract(p, bufsize, &d->val.uuid, len) < 0) {
-		free(d);
+		mem_free(arena, d);
 		return NULL;
 	}
 	d->dtd = *p;
 	if (rec)
-		sdp_pattern_add_uuid(rec, &d->val.uuid);
+		pattern_add_uuid(rec, arena, &d->val.uuid);
 	return d;
 }
 
 /*
  * Extract strings from the PDU (could be service description and similar info)
  */
-static sdp_data_t *extract_str(const void *p, int bufsize, int *len)
+static sdp_data_t *extract_str(const void *p, int bufsize, int *len,
+				sdp_record_t *rec, struct sdp_arena *arena)
 {
 	char *s;
 	int n;
@@ -1153,7 +1431,7 @@ static sdp_data_t *extract_str(const void *p, int bufsize, int *len)
 		return NULL;
 	}
 
-	d = malloc(sizeof(sdp_data_t));
+	d = mem_alloc(arena, sizeof(sdp_data_t));
 	if (!d)
 		return NULL;
 
@@ -1168,7 +1446,7 @@ static sdp_data_t *extract_str(const void *p, int bufsize, int *len)
 	case SDP_URL_STR8:
 		if (bufsize < (int) sizeof(uint8_t)) {
 			SDPERR("Unexpected end of packet");
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 		n = *(uint8_t *) p;
@@ -1180,7 +1458,7 @@ static sdp_data_t *extract_str(const void *p, int bufsize, int *len)
 	case SDP_URL_STR16:
 		if (bufsize < (int) sizeof(uint16_t)) {
 			SDPERR("Unexpected end of packet");
-			free(d);
+			mem_free(arena, d);
 			return NULL;
 		}
 		n = ntohs(bt_get_unaligned((uint16_t *) p));
@@ -1190,20 +1468,20 @@ static sdp_data_t *extract_str(const void *p, int bufsize, int *len)
 		break;
 	default:
 		SDPERR("Sizeof text string > UINT16_MAX\n");
-		free(d);
+		mem_free(arena, d);
 		return NULL;
 	}
 
 	if (bufsize < n) {
 		SDPERR("String too long to fit in packet");
-		free(d);
+		mem_free(arena, d);
 		return NULL;
 	}
 
-	s = malloc(n + 1);
+	s = mem_alloc(arena, n + 1);
 	if (!s) {
 		SDPERR("Not enough memory for incoming string");
-		free(d);
+		mem_free(arena, d);
 		return NULL;
 	}
 	memset(s, 0, n + 1);
@@ -1273,11 +1551,11 @@ int sdp_extract_seqtype(const uint8_t *buf, int bufsize, uint8_t *dtdp, int *siz
 }
 
 static sdp_data_t *extract_seq(const void *p, int bufsize, int *len,
-							sdp_record_t *rec)
+				sdp_record_t *rec, struct sdp_arena *arena)
 {
 	int seqlen, n = 0;
 	sdp_data_t *curr, *prev;
-	sdp_data_t *d = malloc(sizeof(sdp_data_t));
+	sdp_data_t *d = mem_alloc(arena, sizeof(sdp_data_t));
 
 	if (!d)
 		return NULL;
@@ -1292,7 +1570,7 @@ static sdp_data_t *extract_seq(const void *p, int bufsize, int *len,
 
 	if (*len > bufsize) {
 		SDPERR("Packet not big enough to hold sequence.");
-		free(d);
+		mem_free(arena, d);
 		return NULL;
 	}
 
@@ -1301,7 +1579,7 @@ static sdp_data_t *extract_seq(const void *p, int bufsize, int *len,
 	prev = NULL;
 	while (n < seqlen) {
 		int attrlen = 0;
-		curr = sdp_extract_attr(p, bufsize, &attrlen, rec);
+		curr = extract_attr(p, bufsize, &attrlen, rec, arena);
 		if (curr == NULL)
 			break;
 
@@ -1321,8 +1599,8 @@ static sdp_data_t *extract_seq(const void *p, int bufsize, int *len,
 	return d;
 }
 
-sdp_data_t *sdp_extract_attr(const uint8_t *p, int bufsize, int *size,
-							sdp_record_t *rec)
+static sdp_data_t *extract_attr(const uint8_t *p, int bufsize, int *size,
+				sdp_record_t *rec, struct sdp_arena *arena)
 {
 	sdp_data_t *elem;
 	int n = 0;
@@ -1349,12 +1627,12 @@ sdp_data_t *sdp_extract_attr(const uint8_t *p, int bufsize, int *size,
 	case SDP_INT32:
 	case SDP_INT64:
 	case SDP_INT128:
-		elem = extract_int(p, bufsize, &n);
+		elem = extract_int(p, bufsize, &n, rec, arena);
 		break;
 	case SDP_UUID16:
 	case SDP_UUID32:
 	case SDP_UUID128:
-		elem = extract_uuid(p, bufsize, &n, rec);
+		elem = extract_uuid(p, bufsize, &n, rec, arena);
 		break;
 	case SDP_TEXT_STR8:
 	case SDP_TEXT_STR16:
@@ -1362,7 +1640,7 @@ sdp_data_t *sdp_extract_attr(const uint8_t *p, int bufsize, int *size,
 	case SDP_URL_STR8:
 	case SDP_URL_STR16:
 	case SDP_URL_STR32:
-		elem = extract_str(p, bufsize, &n);
+		elem = extract_str(p, bufsize, &n, rec, arena);
 		break;
 	case SDP_SEQ8:
 	case SDP_SEQ16:
@@ -1370,7 +1648,7 @@ sdp_data_t *sdp_extract_attr(const uint8_t *p, int bufsize, int *size,
 	case SDP_ALT8:
 	case SDP_ALT16:
 	case SDP_ALT32:
-		elem = extract_seq(p, bufsize, &n, rec);
+		elem = extract_seq(p, bufsize, &n, rec, arena);
 		break;
 	default:
 		SDPERR("Unknown data descriptor : 0x%x terminating\n", dtd);
@@ -1380,6 +1658,12 @@ sdp_data_t *sdp_extract_attr(const uint8_t *p, int bufsize, int *size,
 	return elem;
 }
 
+sdp_data_t *sdp_extract_attr(const uint8_t *p, int bufsize, int *size,
+							sdp_record_t *rec)
+{
+	return extract_attr(p, bufsize, size, rec, record_arena(rec));
+}
+
 #ifdef SDP_DEBUG
 static void attr_print_func(void *value, void *userData)
 {
@@ -1403,14 +1687,17 @@ void sdp_print_service_attr(sdp_list_t *svcAttrList)
 }
 #endif
 
-sdp_record_t *sdp_extract_pdu(const uint8_t *buf, int bufsize, int *scanned)
+static sdp_record_t *extract_pdu(sdp_record_t *rec, struct sdp_arena *arena,
+				const uint8_t *buf, int bufsize, int *scanned)
 {
 	int extracted = 0, seqlen = 0;
 	uint8_t dtd;
 	uint16_t attr;
-	sdp_record_t *rec = sdp_record_alloc();
 	const uint8_t *p = buf;
 
+	if (!rec)
+		return NULL;
+
 	*scanned = sdp_extract_seqtype(buf, bufsize, &dtd, &seqlen);
 	p += *scanned;
 	bufsize -= *scanned;
@@ -1434,7 +1721,7 @@ sdp_record_t *sdp_extract_pdu(const uint8_t *buf, int bufsize, int *scanned)
 
 		SDPDBG("DTD of attrId : %d Attr id : 0x%x \n", dtd, attr);
 
-		data = sdp_extract_attr(p + n, bufsize - n, &attrlen, rec);
+		data = extract_attr(p + n, bufsize - n, &attrlen, rec, arena);
 
 		SDPDBG("Attr id : 0x%x attrValueLength : %d\n", attr, attrlen);
 
@@ -1453,7 +1740,7 @@ sdp_record_t *sdp_extract_pdu(const uint8_t *buf, int bufsize, int *scanned)
 		extracted += n;
 		p += n;
 		bufsize -= n;
-		sdp_attr_replace(rec, attr, data);
+		attr_replace(rec, arena, attr, data);
 
 		SDPDBG("Extract PDU, seqLength: %d localExtractedLength: %d",
 							seqlen, extracted);
@@ -1466,15 +1753,51 @@ sdp_record_t *sdp_extract_pdu(const uint8_t *buf, int bufsize, int *scanned)
 	return rec;
 }
 
+sdp_record_t *sdp_extract_pdu(const uint8_t *buf, int bufsize, int *scanned)
+{
+	return extract_pdu(sdp_record_alloc(), NULL, buf, bufsize, scanned);
+}
+
+/*
+ * Same as sdp_extract_pdu() but the record and its whole data tree are
+ * carved out of a single arena. Most elements take two or three bytes on
+ * the wire, which gives the initial size estimate from the length of the
+ * record's attribute list; buf may hold more records after it. The arena
+ * grows if a record needs more.
+ */
+sdp_record_t *sdp_extract_pdu_arena(const uint8_t *buf, int bufsize,
+								int *scanned)
+{
+	sdp_record_t *rec;
+	int seqlen = 0;
+	uint8_t dtd;
+
+	if (sdp_extract_seqtype(buf, bufsize, &dtd, &seqlen) == 0 ||
+						seqlen < 0 || seqlen > bufsize)
+		seqlen = bufsize;
+
+	rec = sdp_record_alloc_arena(seqlen * 8);
+	if (!rec)
+		return NULL;
+
+	return extract_pdu(rec, RECORD_ARENA(rec), buf, bufsize, scanned);
+}
+
+struct record_copy {
+	sdp_record_t *rec;
+	struct sdp_arena *arena;
+};
+
 static void sdp_copy_pattern(void *value, void *udata)
 {
 	uuid_t *uuid = value;
-	sdp_record_t *rec = udata;
+	struct record_copy *cpy = udata;
 
-	sdp_pattern_add_uuid(rec, uuid);
+	pattern_add_uuid(cpy->rec, cpy->arena, uuid);
 }
 
-static void *sdp_data_value(sdp_data_t *data, uint32_t *len)
+static void *sdp_data_value(struct sdp_arena *arena, sdp_data_t *data,
+								uint32_t *len)
 {
 	void *val = NULL;
 
@@ -1537,14 +1860,14 @@ static void *sdp_data_value(sdp_data_t *data, uint32_t *len)
 	case SDP_SEQ8:
 	case SDP_SEQ16:
 	case SDP_SEQ32:
-		val = sdp_copy_seq(data->val.dataseq);
+		val = sdp_copy_seq(arena, data->val.dataseq);
 		break;
 	}
 
 	return val;
 }
 
-static sdp_data_t *sdp_copy_seq(sdp_data_t *data)
+static sdp_data_t *sdp_copy_seq(struct sdp_arena *arena, sdp_data_t *data)
 {
 	sdp_data_t *tmp, *seq = NULL, *cur = NULL;
 
@@ -1552,9 +1875,8 @@ static sdp_data_t *sdp_copy_seq(sdp_data_t *data)
 		sdp_data_t *datatmp;
 		void *value;
 
-		value = sdp_data_value(tmp, NULL);
-		datatmp = sdp_data_alloc_with_length(tmp->dtd, value,
-								tmp->unitSize);
+		value = sdp_data_value(arena, tmp, NULL);
+		datatmp = data_alloc(arena, tmp->dtd, value, tmp->unitSize);
 
 		if (cur)
 			cur->next = datatmp;
@@ -1570,29 +1892,176 @@ static sdp_data_t *sdp_copy_seq(sdp_data_t *data)
 static void sdp_copy_attrlist(void *value, void *udata)
 {
 	sdp_data_t *data = value;
-	sdp_record_t *rec = udata;
+	struct record_copy *cpy = udata;
+	sdp_data_t *d;
 	void *val;
 	uint32_t len = 0;
 
-	val = sdp_data_value(data, &len);
+	val = sdp_data_value(cpy->arena, data, &len);
 
-	if (!len)
-		sdp_attr_add_new(rec, data->attrId, data->dtd, val);
-	else
-		sdp_attr_add_new_with_length(rec, data->attrId,
-							data->dtd, val, len);
+	d = data_alloc(cpy->arena, data->dtd, val, len);
+	if (d)
+		attr_replace(cpy->rec, cpy->arena, data->attrId, d);
+}
+
+/* Pointer p of the block at from, moved to the same offset in the block at to */
+static int arena_move(void **p, const uint8_t *from, uint32_t used,
+								uint8_t *to)
+{
+	const uint8_t *old = *p;
+
+	if (!old)
+		return 0;
+
+	if (old < from || old >= from + used)
+		return -1;
+
+	*p = to + (old - from);
+
+	return 0;
+}
+
+static int arena_move_data(sdp_data_t *d, const uint8_t *from, uint32_t used,
+								uint8_t *to)
+{
+	for (; d; d = d->next) {
+		switch (d->dtd) {
+		case SDP_SEQ8:
+		case SDP_SEQ16:
+		case SDP_SEQ32:
+		case SDP_ALT8:
+		case SDP_ALT16:
+		case SDP_ALT32:
+			if (arena_move((void **) &d->val.dataseq, from, used,
+									to) < 0)
+				return -1;
+			if (arena_move_data(d->val.dataseq, from, used, to) < 0)
+				return -1;
+			break;
+		case SDP_URL_STR8:
+		case SDP_URL_STR16:
+		case SDP_URL_STR32:
+		case SDP_TEXT_STR8:
+		case SDP_TEXT_STR16:
+		case SDP_TEXT_STR32:
+			if (arena_move((void **) &d->val.str, from, used,
+									to) < 0)
+				return -1;
+			break;
+		}
+
+		if (arena_move((void **) &d->next, from, used, to) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Copy of the list of pointers into the block at from, moved to to */
+static sdp_list_t *arena_move_list(const sdp_list_t *list,
+				const uint8_t *from, uint32_t used, uint8_t *to)
+{
+	sdp_list_t *cpy = NULL, **tail = &cpy;
+
+	for (; list; list = list->next) {
+		sdp_list_t *l = malloc(sizeof(sdp_list_t));
+
+		if (!l)
+			goto fail;
+
+		l->next = NULL;
+		l->data = list->data;
+		*tail = l;
+		tail = &l->next;
+
+		if (arena_move(&l->data, from, used, to) < 0)
+			goto fail;
+	}
+
+	return cpy;
+
+fail:
+	sdp_list_free(cpy, NULL);
+	return NULL;
+}
+
+/*
+ * A record whose whole tree lives in the single block of its arena is
+ * copied with one memcpy() of the block, then the pointers inside it are
+ * moved to the copy. Only the list nodes are allocated. Returns NULL if
+ * the record doesn't qualify or something points out of the block.
+ */
+static sdp_record_t *copy_arena_block(const sdp_record_t *rec,
+						struct sdp_arena *arena)
+{
+	const uint8_t *from = (const uint8_t *) arena + SDP_ARENA_HDR;
+	struct sdp_arena *a;
+	sdp_record_t *cpy;
+	uint8_t *to;
+	sdp_list_t *l;
+
+	if (arena->next || arena->foreign)
+		return NULL;
+
+	a = arena_block_new(arena->used);
+	if (!a)
+		return NULL;
+
+	to = (uint8_t *) a + SDP_ARENA_HDR;
+	memcpy(to, from, arena->used);
+	a->used = arena->used;
+	a->foreign = 0;
+
+	cpy = (sdp_record_t *) to;
+	cpy->attrlist = arena_move_list(rec->attrlist, from, arena->used, to);
+	cpy->pattern = arena_move_list(rec->pattern, from, arena->used, to);
+
+	if ((rec->attrlist && !cpy->attrlist) ||
+					(rec->pattern && !cpy->pattern))
+		goto fail;
+
+	for (l = cpy->attrlist; l; l = l->next)
+		if (arena_move_data(l->data, from, arena->used, to) < 0)
+			goto fail;
+
+	if (arena_record_add(cpy) < 0)
+		goto fail;
+
+	return cpy;
+
+fail:
+	sdp_list_free(cpy->attrlist, NULL);
+	sdp_list_free(cpy->pattern, NULL);
+	arena_free(a);
+	return NULL;
 }
 
 sdp_record_t *sdp_copy_record(sdp_record_t *rec)
 {
+	struct sdp_arena *arena = record_arena(rec);
+	struct record_copy copy;
 	sdp_record_t *cpy;
 
-	cpy = sdp_record_alloc();
+	if (arena) {
+		cpy = copy_arena_block(rec, arena);
+		if (cpy)
+			return cpy;
+
+		/* Otherwise a single block of the same size */
+		cpy = sdp_record_alloc_arena(arena_used(arena));
+	} else
+		cpy = sdp_record_alloc();
+
+	if (!cpy)
+		return NULL;
 
 	cpy->handle = rec->handle;
 
-	sdp_list_foreach(rec->pattern, sdp_copy_pattern, cpy);
-	sdp_list_foreach(rec->attrlist, sdp_copy_attrlist, cpy);
+	copy.rec = cpy;
+	copy.arena = arena ? RECORD_ARENA(cpy) : NULL;
+
+	sdp_list_foreach(rec->pattern, sdp_copy_pattern, &copy);
+	sdp_list_foreach(rec->attrlist, sdp_copy_attrlist, &copy);
 
 	cpy->svclass = rec->svclass;
 
@@ -1915,26 +2384,314 @@ int sdp_get_add_access_protos(const sdp_record_t *rec, sdp_list_t **pap)
 	return 0;
 }
 
-int sdp_get_uuidseq_attr(const sdp_record_t *rec, uint16_t attr,
-							sdp_list_t **seqp)
+/*
+ * Port of protocol proto in the ProtocolDescriptorList of rec, without
+ * building the lists sdp_get_access_protos() returns
+ */
+int sdp_get_access_proto_port(const sdp_record_t *rec, int proto)
 {
-	sdp_data_t *sdpdata = sdp_data_get(rec, attr);
+	sdp_data_t *pdlist, *seq, *curr;
 
-	*seqp = NULL;
-	if (sdpdata && sdpdata->dtd >= SDP_SEQ8 && sdpdata->dtd <= SDP_SEQ32) {
-		sdp_data_t *d;
-		for (d = sdpdata->val.dataseq; d; d = d->next) {
-			uuid_t *u;
-			if (d->dtd < SDP_UUID16 || d->dtd > SDP_UUID128) {
-				errno = EINVAL;
-				goto fail;
-			}
+	if (proto != L2CAP_UUID && proto != RFCOMM_UUID) {
+		errno = EINVAL;
+		return -1;
+	}
 
-			u = malloc(sizeof(uuid_t));
-			if (!u)
-				goto fail;
+	pdlist = sdp_data_get(rec, SDP_ATTR_PROTO_DESC_LIST);
+	if (pdlist == NULL) {
+		errno = ENODATA;
+		return -1;
+	}
 
-			memset(u, 0, sizeof(uuid_t));
+	/* An alternative holds several protocol descriptor lists */
+	if (pdlist->dtd >= SDP_ALT8 && pdlist->dtd <= SDP_ALT32)
+		seq = pdlist->val.dataseq;
+	else
+		seq = pdlist;
+
+	for (; seq; seq = (seq == pdlist ? NULL : seq->next)) {
+		for (curr = seq->val.dataseq; curr; curr = curr->next) {
+			int port = __find_port(curr->val.dataseq, proto);
+			if (port)
+				return port;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Data element cursor. It walks the data elements of a PDU in place, the
+ * elements point into the buffer, so nothing is allocated or copied.
+ */
+void sdp_cursor_init(sdp_cursor_t *cur, const uint8_t *buf, uint32_t size)
+{
+	cur->pos = buf;
+	cur->end = buf + size;
+}
+
+void sdp_cursor_enter(sdp_cursor_t *cur, const sdp_elem_t *seq)
+{
+	sdp_cursor_init(cur, seq->val, seq->len);
+}
+
+/*
+ * Read the next element, returns 1 if there was one, 0 at the end of the
+ * data and -1 (setting errno to EPROTO) if the element is malformed
+ */
+int sdp_cursor_next(sdp_cursor_t *cur, sdp_elem_t *elem)
+{
+	const uint8_t *p = cur->pos;
+	uint32_t left = cur->end - p, hdr = 1, len;
+
+	if (left == 0)
+		return 0;
+
+	switch (*p) {
+	case SDP_DATA_NIL:
+		len = 0;
+		break;
+	case SDP_UINT8:
+	case SDP_INT8:
+	case SDP_BOOL:
+		len = 1;
+		break;
+	case SDP_UINT16:
+	case SDP_INT16:
+	case SDP_UUID16:
+		len = 2;
+		break;
+	case SDP_UINT32:
+	case SDP_INT32:
+	case SDP_UUID32:
+		len = 4;
+		break;
+	case SDP_UINT64:
+	case SDP_INT64:
+		len = 8;
+		break;
+	case SDP_UINT128:
+	case SDP_INT128:
+	case SDP_UUID128:
+		len = 16;
+		break;
+	case SDP_TEXT_STR8:
+	case SDP_URL_STR8:
+	case SDP_SEQ8:
+	case SDP_ALT8:
+		hdr += sizeof(uint8_t);
+		if (left < hdr)
+			goto invalid;
+		len = p[1];
+		break;
+	case SDP_TEXT_STR16:
+	case SDP_URL_STR16:
+	case SDP_SEQ16:
+	case SDP_ALT16:
+		hdr += sizeof(uint16_t);
+		if (left < hdr)
+			goto invalid;
+		len = ntohs(bt_get_unaligned((uint16_t *) (p + 1)));
+		break;
+	case SDP_TEXT_STR32:
+	case SDP_URL_STR32:
+	case SDP_SEQ32:
+	case SDP_ALT32:
+		hdr += sizeof(uint32_t);
+		if (left < hdr)
+			goto invalid;
+		len = ntohl(bt_get_unaligned((uint32_t *) (p + 1)));
+		break;
+	default:
+		goto invalid;
+	}
+
+	if (left - hdr < len)
+		goto invalid;
+
+	elem->dtd = *p;
+	elem->val = p + hdr;
+	elem->len = len;
+
+	cur->pos = p + hdr + len;
+
+	return 1;
+
+invalid:
+	SDPERR("Invalid data element at %p", p);
+	errno = EPROTO;
+	return -1;
+}
+
+int sdp_elem_get_uint(const sdp_elem_t *elem, uint32_t *val)
+{
+	switch (elem->dtd) {
+	case SDP_UINT8:
+	case SDP_INT8:
+	case SDP_BOOL:
+		*val = elem->val[0];
+		return 0;
+	case SDP_UINT16:
+	case SDP_INT16:
+		*val = ntohs(bt_get_unaligned((uint16_t *) elem->val));
+		return 0;
+	case SDP_UINT32:
+	case SDP_INT32:
+		*val = ntohl(bt_get_unaligned((uint32_t *) elem->val));
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+int sdp_elem_get_uuid(const sdp_elem_t *elem, uuid_t *uuid)
+{
+	switch (elem->dtd) {
+	case SDP_UUID16:
+		sdp_uuid16_create(uuid,
+				ntohs(bt_get_unaligned((uint16_t *) elem->val)));
+		return 0;
+	case SDP_UUID32:
+		sdp_uuid32_create(uuid,
+				ntohl(bt_get_unaligned((uint32_t *) elem->val)));
+		return 0;
+	case SDP_UUID128:
+		sdp_uuid128_create(uuid, elem->val);
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * Find the value of attribute attr in the encoded record pdu (the
+ * sequence of attribute ID and value pairs)
+ */
+int sdp_pdu_find_attr(const uint8_t *pdu, uint32_t size, uint16_t attr,
+							sdp_elem_t *val)
+{
+	sdp_cursor_t cur;
+	sdp_elem_t seq, id;
+	uint32_t attr_id;
+
+	sdp_cursor_init(&cur, pdu, size);
+
+	if (sdp_cursor_next(&cur, &seq) <= 0 ||
+			seq.dtd < SDP_SEQ8 || seq.dtd > SDP_SEQ32) {
+		errno = EPROTO;
+		return -1;
+	}
+
+	sdp_cursor_enter(&cur, &seq);
+
+	while (sdp_cursor_next(&cur, &id) > 0) {
+		if (sdp_cursor_next(&cur, val) <= 0)
+			break;
+
+		if (id.dtd != SDP_UINT16 || sdp_elem_get_uint(&id, &attr_id) < 0)
+			break;
+
+		if (attr_id == attr)
+			return 0;
+	}
+
+	errno = ENODATA;
+	return -1;
+}
+
+/* Port of proto in the protocol descriptor list at the cursor */
+static int cursor_find_port(sdp_cursor_t *list, int proto)
+{
+	sdp_elem_t desc, elem;
+	uint32_t port;
+	uuid_t uuid;
+
+	while (sdp_cursor_next(list, &desc) > 0) {
+		sdp_cursor_t cur;
+
+		if (desc.dtd < SDP_SEQ8 || desc.dtd > SDP_SEQ32)
+			continue;
+
+		sdp_cursor_enter(&cur, &desc);
+
+		if (sdp_cursor_next(&cur, &elem) <= 0 ||
+					sdp_elem_get_uuid(&elem, &uuid) < 0 ||
+					sdp_uuid_to_proto(&uuid) != proto)
+			continue;
+
+		if (sdp_cursor_next(&cur, &elem) <= 0)
+			continue;
+
+		if ((elem.dtd == SDP_UINT8 || elem.dtd == SDP_UINT16) &&
+					sdp_elem_get_uint(&elem, &port) == 0)
+			return port;
+	}
+
+	return 0;
+}
+
+/*
+ * Same as sdp_get_access_proto_port() but straight from the encoded
+ * record pdu, without extracting it
+ */
+int sdp_pdu_get_proto_port(const uint8_t *pdu, uint32_t size, int proto)
+{
+	sdp_cursor_t cur;
+	sdp_elem_t val, seq;
+	int port;
+
+	if (proto != L2CAP_UUID && proto != RFCOMM_UUID) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (sdp_pdu_find_attr(pdu, size, SDP_ATTR_PROTO_DESC_LIST, &val) < 0)
+		return -1;
+
+	sdp_cursor_enter(&cur, &val);
+
+	if (val.dtd >= SDP_SEQ8 && val.dtd <= SDP_SEQ32)
+		return cursor_find_port(&cur, proto);
+
+	if (val.dtd < SDP_ALT8 || val.dtd > SDP_ALT32)
+		return 0;
+
+	/* An alternative holds several protocol descriptor lists */
+	while (sdp_cursor_next(&cur, &seq) > 0) {
+		sdp_cursor_t list;
+
+		sdp_cursor_enter(&list, &seq);
+
+		port = cursor_find_port(&list, proto);
+		if (port)
+			return port;
+	}
+
+	return 0;
+}
+
+int sdp_get_uuidseq_attr(const sdp_record_t *rec, uint16_t attr,
+							sdp_list_t **seqp)
+{
+	sdp_data_t *sdpdata = sdp_data_get(rec, attr);
+
+	*seqp = NULL;
+	if (sdpdata && sdpdata->dtd >= SDP_SEQ8 && sdpdata->dtd <= SDP_SEQ32) {
+		sdp_data_t *d;
+		for (d = sdpdata->val.dataseq; d; d = d->next) {
+			uuid_t *u;
+			if (d->dtd < SDP_UUID16 || d->dtd > SDP_UUID128) {
+				errno = EINVAL;
+				goto fail;
+			}
+
+			u = malloc(sizeof(uuid_t));
+			if (!u)
+				goto fail;
+
+			memset(u, 0, sizeof(uuid_t));
 			*u = d->val.uuid;
 			*seqp = sdp_list_append(*seqp, u);
 		}
@@ -2192,12 +2949,21 @@ int sdp_get_database_state(const sdp_record_t *rec, uint32_t *svcDBState)
 int sdp_attr_add_new(sdp_record_t *rec, uint16_t attr, uint8_t dtd,
 							const void *value)
 {
-	sdp_data_t *d = sdp_data_alloc(dtd, value);
-	if (d) {
-		sdp_attr_replace(rec, attr, d);
-		return 0;
+	uint32_t length = 0;
+
+	switch (dtd) {
+	case SDP_URL_STR8:
+	case SDP_URL_STR16:
+	case SDP_TEXT_STR8:
+	case SDP_TEXT_STR16:
+		if (!value)
+			return -1;
+
+		length = strlen((char *) value);
+		break;
 	}
-	return -1;
+
+	return sdp_attr_add_new_with_length(rec, attr, dtd, value, length);
 }
 
 static int sdp_attr_add_new_with_length(sdp_record_t *rec,
@@ -2205,11 +2971,17 @@ static int sdp_attr_add_new_with_length(sdp_record_t *rec,
 {
 	sdp_data_t *d;
 
-	d = sdp_data_alloc_with_length(dtd, value, len);
+	struct sdp_arena *arena = record_arena(rec);
+
+	/* Sequences adopt caller allocated elements, keep them off the arena */
+	if (dtd >= SDP_SEQ8 && dtd <= SDP_ALT32)
+		d = sdp_data_alloc_with_length(dtd, value, len);
+	else
+		d = data_alloc(arena, dtd, value, len);
 	if (!d)
 		return -1;
 
-	sdp_attr_replace(rec, attr, d);
+	attr_replace(rec, arena, attr, d);
 
 	return 0;
 }
@@ -3111,6 +3883,263 @@ int sdp_record_update(sdp_session_t *session, const sdp_record_t *rec)
 	return sdp_device_record_update(session, BDADDR_ANY, rec);
 }
 
+/*
+ * Operations per batch request, it keeps the response small enough to
+ * be read at once
+ */
+#define SDP_BATCH_MAX_OPS	128
+
+/* Space taken by the PDU id and the parameter length of a batched op */
+#define SDP_BATCH_OP_HDR_SIZE	(sizeof(uint8_t) + sizeof(uint16_t))
+
+/* Status and handle returned for every batched op */
+#define SDP_BATCH_RSP_SIZE	(sizeof(uint16_t) + sizeof(uint32_t))
+
+/*
+ * Append the parameters of op to the batch request at p, returns their
+ * length, 0 if they don't fit in size bytes and -1 on error
+ */
+static int batch_add_op(bdaddr_t *device, sdp_record_op_t *op,
+						uint8_t *p, uint32_t size)
+{
+	uint32_t handle, len = 0;
+	sdp_buf_t pdu;
+
+	switch (op->op) {
+	case SDP_SVC_REGISTER_REQ:
+		if (op->rec->handle && op->rec->handle != 0xffffffff) {
+			sdp_data_t *data;
+
+			handle = op->rec->handle;
+			data = sdp_data_alloc(SDP_UINT32, &handle);
+			sdp_attr_replace(op->rec, SDP_ATTR_RECORD_HANDLE, data);
+		}
+
+		if (sdp_gen_record_pdu(op->rec, &pdu) < 0) {
+			op->err = ENOMEM;
+			return -1;
+		}
+
+		len = sizeof(uint8_t) + pdu.data_size;
+		if (bacmp(device, BDADDR_ANY))
+			len += sizeof(bdaddr_t);
+
+		if (len + SDP_BATCH_OP_HDR_SIZE > size) {
+			free(pdu.data);
+			break;
+		}
+
+		p += SDP_BATCH_OP_HDR_SIZE;
+		if (bacmp(device, BDADDR_ANY)) {
+			*p++ = op->flags | SDP_DEVICE_RECORD;
+			bacpy((bdaddr_t *) p, device);
+			p += sizeof(bdaddr_t);
+		} else
+			*p++ = op->flags;
+
+		memcpy(p, pdu.data, pdu.data_size);
+		free(pdu.data);
+		break;
+	case SDP_SVC_UPDATE_REQ:
+	case SDP_SVC_REMOVE_REQ:
+		if (op->rec->handle == SDP_SERVER_RECORD_HANDLE) {
+			op->err = EINVAL;
+			return -1;
+		}
+
+		if (op->op == SDP_SVC_UPDATE_REQ) {
+			if (sdp_gen_record_pdu(op->rec, &pdu) < 0) {
+				op->err = ENOMEM;
+				return -1;
+			}
+		} else
+			pdu.data_size = 0;
+
+		len = sizeof(uint32_t) + pdu.data_size;
+		if (len + SDP_BATCH_OP_HDR_SIZE <= size) {
+			p += SDP_BATCH_OP_HDR_SIZE;
+			bt_put_unaligned(htonl(op->rec->handle), (uint32_t *) p);
+			p += sizeof(uint32_t);
+			if (pdu.data_size)
+				memcpy(p, pdu.data, pdu.data_size);
+		}
+
+		if (op->op == SDP_SVC_UPDATE_REQ)
+			free(pdu.data);
+		break;
+	default:
+		op->err = EINVAL;
+		return -1;
+	}
+
+	if (len + SDP_BATCH_OP_HDR_SIZE > size)
+		return 0;
+
+	return len;
+}
+
+/*
+ * Send as many of the count ops as fit in one batch request and apply
+ * the results, returns the number of ops consumed or -1 on error
+ */
+static int batch_send(sdp_session_t *session, bdaddr_t *device,
+				sdp_record_op_t *ops, int count,
+				uint8_t *req, uint8_t *rsp)
+{
+	int index[SDP_BATCH_MAX_OPS];
+	uint32_t reqsize, rspsize;
+	sdp_pdu_hdr_t *reqhdr, *rsphdr;
+	uint16_t sent = 0;
+	uint8_t *p;
+	int i, consumed;
+
+	reqhdr = (sdp_pdu_hdr_t *) req;
+	reqhdr->pdu_id = SDP_SVC_BATCH_REQ;
+	reqhdr->tid    = htons(sdp_gen_tid(session));
+	reqsize = sizeof(sdp_pdu_hdr_t) + sizeof(uint16_t);
+
+	for (i = 0; i < count && sent < SDP_BATCH_MAX_OPS; i++) {
+		sdp_record_op_t *op = &ops[i];
+		int len;
+
+		p = req + reqsize;
+		len = batch_add_op(device, op, p, sizeof(sdp_pdu_hdr_t) +
+						USHRT_MAX - reqsize);
+		if (len < 0)
+			continue;
+
+		if (len == 0) {
+			/* Doesn't fit even in an empty request */
+			if (sent == 0) {
+				op->err = EMSGSIZE;
+				continue;
+			}
+			break;
+		}
+
+		*p = op->op;
+		bt_put_unaligned(htons(len), (uint16_t *) (p + 1));
+		reqsize += SDP_BATCH_OP_HDR_SIZE + len;
+		index[sent++] = i;
+	}
+
+	consumed = i;
+	if (sent == 0)
+		return consumed;
+
+	bt_put_unaligned(htons(sent),
+			(uint16_t *) (req + sizeof(sdp_pdu_hdr_t)));
+	reqhdr->plen = htons(reqsize - sizeof(sdp_pdu_hdr_t));
+
+	if (sdp_send_req_w4_rsp(session, req, rsp, reqsize, &rspsize) < 0)
+		return -1;
+
+	if (rspsize < sizeof(sdp_pdu_hdr_t)) {
+		SDPERR("Unexpected end of packet");
+		errno = EPROTO;
+		return -1;
+	}
+
+	rsphdr = (sdp_pdu_hdr_t *) rsp;
+	p = rsp + sizeof(sdp_pdu_hdr_t);
+
+	if (rsphdr->pdu_id == SDP_ERROR_RSP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (rsphdr->pdu_id != SDP_SVC_BATCH_RSP ||
+			rspsize < sizeof(sdp_pdu_hdr_t) + sizeof(uint16_t) +
+					sent * SDP_BATCH_RSP_SIZE ||
+			ntohs(bt_get_unaligned((uint16_t *) p)) != sent) {
+		SDPERR("Unexpected batch response");
+		errno = EPROTO;
+		return -1;
+	}
+
+	p += sizeof(uint16_t);
+
+	for (i = 0; i < sent; i++, p += SDP_BATCH_RSP_SIZE) {
+		sdp_record_op_t *op = &ops[index[i]];
+		uint16_t status;
+		uint32_t handle;
+
+		status = ntohs(bt_get_unaligned((uint16_t *) p));
+		handle = ntohl(bt_get_unaligned((uint32_t *) (p +
+							sizeof(uint16_t))));
+
+		if (status) {
+			op->err = EINVAL;
+			continue;
+		}
+
+		if (op->op == SDP_SVC_REGISTER_REQ) {
+			sdp_data_t *data = sdp_data_alloc(SDP_UINT32, &handle);
+			op->rec->handle = handle;
+			sdp_attr_replace(op->rec, SDP_ATTR_RECORD_HANDLE, data);
+		} else if (op->op == SDP_SVC_REMOVE_REQ) {
+			sdp_record_free(op->rec);
+			op->rec = NULL;
+		}
+	}
+
+	return consumed;
+}
+
+int sdp_device_record_batch(sdp_session_t *session, bdaddr_t *device, sdp_record_op_t *ops, int count)
+{
+	uint8_t *req, *rsp;
+	int i, n, failed = 0;
+
+	SDPDBG("");
+
+	if (!session->local) {
+		errno = EREMOTE;
+		return -1;
+	}
+
+	req = malloc(sizeof(sdp_pdu_hdr_t) + USHRT_MAX);
+	rsp = malloc(SDP_RSP_BUFFER_SIZE);
+	if (!req || !rsp) {
+		free(req);
+		free(rsp);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < count; i++)
+		ops[i].err = 0;
+
+	for (i = 0; i < count; i += n) {
+		n = batch_send(session, device, ops + i, count - i, req, rsp);
+		if (n < 0) {
+			int err = errno;
+
+			for (; i < count; i++)
+				if (ops[i].err == 0)
+					ops[i].err = err;
+
+			failed = -1;
+			goto end;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		if (ops[i].err)
+			failed++;
+
+end:
+	free(req);
+	free(rsp);
+
+	return failed;
+}
+
+int sdp_record_batch(sdp_session_t *session, sdp_record_op_t *ops, int count)
+{
+	return sdp_device_record_batch(session, BDADDR_ANY, ops, count);
+}
+
 sdp_record_t *sdp_record_alloc(void)
 {
 	sdp_record_t *rec = malloc(sizeof(sdp_record_t));
@@ -3123,31 +4152,118 @@ sdp_record_t *sdp_record_alloc(void)
 	return rec;
 }
 
+/*
+ * Allocate a record in the first block of an arena of at least size
+ * bytes. Data elements later extracted or copied into the record, and
+ * the leaf attributes set with sdp_attr_add_new(), come from the same
+ * arena and are only released by sdp_record_free().
+ */
+sdp_record_t *sdp_record_alloc_arena(uint32_t size)
+{
+	uint32_t recsize = SDP_ARENA_ALIGN(sizeof(sdp_record_t));
+	struct sdp_arena *arena;
+	sdp_record_t *rec;
+
+	arena = arena_block_new(recsize + size);
+	if (!arena)
+		return NULL;
+
+	rec = arena_block_alloc(arena, recsize);
+
+	if (arena_record_add(rec) < 0) {
+		arena_free(arena);
+		return NULL;
+	}
+
+	memset(rec, 0, sizeof(sdp_record_t));
+	rec->handle = 0xffffffff;
+	return rec;
+}
+
+/* Attributes all from the arena go with it, only the list is freed */
+static void record_free_attrs(sdp_record_t *rec, struct sdp_arena *arena)
+{
+	sdp_list_t *l;
+
+	if (!arena || arena->foreign)
+		for (l = rec->attrlist; l; l = l->next)
+			arena_data_free(arena, l->data);
+
+	sdp_list_free(rec->attrlist, NULL);
+	rec->attrlist = NULL;
+
+	if (arena)
+		arena->foreign = 0;
+}
+
+/*
+ * Free all attributes of a service record, leaving it empty
+ */
+void sdp_record_free_attrs(sdp_record_t *rec)
+{
+	record_free_attrs(rec, record_arena(rec));
+}
+
 /*
  * Free the contents of a service record
  */
 void sdp_record_free(sdp_record_t *rec)
 {
-	sdp_list_free(rec->attrlist, (sdp_free_func_t) sdp_data_free);
-	sdp_list_free(rec->pattern, free);
-	free(rec);
+	struct sdp_arena *arena = arena_record_remove(rec);
+	sdp_list_t *l;
+
+	record_free_attrs(rec, arena);
+
+	/* The pattern of an arena record always comes from the arena */
+	if (!arena)
+		for (l = rec->pattern; l; l = l->next)
+			free(l->data);
+
+	sdp_list_free(rec->pattern, NULL);
+
+	if (arena)
+		arena_free(arena);
+	else
+		free(rec);
 }
 
-void sdp_pattern_add_uuid(sdp_record_t *rec, uuid_t *uuid)
+static void pattern_add_uuid(sdp_record_t *rec, struct sdp_arena *arena,
+								uuid_t *uuid)
 {
-	uuid_t *uuid128 = sdp_uuid_to_uuid128(uuid);
+	uuid_t tmp, *uuid128;
+
+	memset(&tmp, 0, sizeof(uuid_t));
+	switch (uuid->type) {
+	case SDP_UUID128:
+		tmp = *uuid;
+		break;
+	case SDP_UUID32:
+		sdp_uuid32_to_uuid128(&tmp, uuid);
+		break;
+	case SDP_UUID16:
+		sdp_uuid16_to_uuid128(&tmp, uuid);
+		break;
+	}
 
 	SDPDBG("Elements in target pattern : %d\n", sdp_list_len(rec->pattern));
-	SDPDBG("Trying to add : 0x%lx\n", (unsigned long) uuid128);
 
-	if (sdp_list_find(rec->pattern, uuid128, sdp_uuid128_cmp) == NULL)
+	if (sdp_list_find(rec->pattern, &tmp, sdp_uuid128_cmp) == NULL) {
+		uuid128 = mem_alloc(arena, sizeof(uuid_t));
+		if (!uuid128)
+			return;
+
+		*uuid128 = tmp;
 		rec->pattern = sdp_list_insert_sorted(rec->pattern, uuid128, sdp_uuid128_cmp);
-	else
-		bt_free(uuid128);
+	}
 
 	SDPDBG("Elements in target pattern : %d\n", sdp_list_len(rec->pattern));
 }
 
+void sdp_pattern_add_uuid(sdp_record_t *rec, uuid_t *uuid)
+{
+	pattern_add_uuid(rec, record_arena(rec), uuid);
+}
+
 void sdp_pattern_add_uuidseq(sdp_record_t *rec, sdp_list_t *seq)
 {
 	for (; seq; seq = seq->next) {
@@ -169,7 +169,7 @@ static sdp_record_t *server_record_new(const char *name, uint16_t id)
 	const char *desc = "Network service";
 	sdp_record_t *record;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 	if (!record)
 		return NULL;
 
@@ -0,0 +1,206 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) tools batch mode
+ *
+ *  Copyright (C) 2008-2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sbc.h"
+#include "batch.h"
+
+struct batch_pool {
+	pthread_mutex_t lock;
+	struct batch_job *jobs;
+	int count;
+	int next;
+	batch_func_t func;
+};
+
+static double get_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+char *batch_output_name(const char *filename, const char *ext)
+{
+	const char *base, *dot;
+	char *name;
+	size_t len;
+
+	base = strrchr(filename, '/');
+	base = base ? base + 1 : filename;
+
+	dot = strrchr(base, '.');
+	len = dot && dot != base ? (size_t) (dot - filename) : strlen(filename);
+
+	name = malloc(len + strlen(ext) + 1);
+	if (!name)
+		return NULL;
+
+	memcpy(name, filename, len);
+	strcpy(name + len, ext);
+
+	return name;
+}
+
+static void *batch_worker(void *user_data)
+{
+	struct batch_pool *pool = user_data;
+	sbc_t sbc;
+
+	/* One codec instance per worker, reinitialized for every job */
+	if (sbc_init(&sbc, 0L) < 0)
+		return NULL;
+
+	while (1) {
+		struct batch_job *job;
+		double start;
+
+		pthread_mutex_lock(&pool->lock);
+		job = pool->next < pool->count ? &pool->jobs[pool->next++] :
+									NULL;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!job)
+			break;
+
+		start = get_seconds();
+		job->err = pool->func(&sbc, job);
+		job->elapsed = get_seconds() - start;
+	}
+
+	sbc_finish(&sbc);
+
+	return NULL;
+}
+
+double batch_run(struct batch_job *jobs, int count, int workers,
+							batch_func_t func)
+{
+	struct batch_pool pool;
+	pthread_t *threads;
+	double start;
+	int i, started;
+
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (workers <= 0)
+		workers = 1;
+
+	if (workers > count)
+		workers = count;
+
+	for (i = 0; i < count; i++)
+		jobs[i].err = -ECANCELED;
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pool.jobs = jobs;
+	pool.count = count;
+	pool.next = 0;
+	pool.func = func;
+
+	start = get_seconds();
+
+	threads = malloc(workers * sizeof(pthread_t));
+	if (!threads) {
+		/* Still get the work done in the calling thread */
+		batch_worker(&pool);
+		workers = 0;
+	}
+
+	for (started = 0; started < workers; started++) {
+		if (pthread_create(&threads[started], NULL,
+						batch_worker, &pool) != 0)
+			break;
+	}
+
+	/* Nothing could be started, do the work in the calling thread */
+	if (threads && started == 0)
+		batch_worker(&pool);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+
+	pthread_mutex_destroy(&pool.lock);
+
+	return get_seconds() - start;
+}
+
+void batch_report(FILE *f, const struct batch_job *jobs, int count,
+							double elapsed)
+{
+	unsigned long long pcm_bytes = 0, sbc_bytes = 0, duration = 0;
+	unsigned long frames = 0;
+	int i, failed = 0;
+
+	for (i = 0; i < count; i++) {
+		const struct batch_job *job = &jobs[i];
+
+		if (job->err < 0) {
+			fprintf(f, "%s: failed (%s)\n", job->filename,
+							strerror(-job->err));
+			failed++;
+			continue;
+		}
+
+		fprintf(f, "%s: %s, %lu frames, %llu PCM bytes, "
+				"%llu SBC bytes, %.3f s audio, %.3f s, "
+				"%.1fx realtime\n",
+				job->filename, job->output, job->frames,
+				job->pcm_bytes, job->sbc_bytes,
+				job->duration / 1000000.0, job->elapsed,
+				job->elapsed > 0 ? job->duration /
+					1000000.0 / job->elapsed : 0.0);
+
+		frames += job->frames;
+		pcm_bytes += job->pcm_bytes;
+		sbc_bytes += job->sbc_bytes;
+		duration += job->duration;
+	}
+
+	fprintf(f, "total: %d files, %d failed, %lu frames, %llu PCM bytes, "
+			"%llu SBC bytes, %.3f s audio, %.3f s, "
+			"%.1fx realtime, %.1f frames/s, %.2f MB/s PCM\n",
+			count, failed, frames, pcm_bytes, sbc_bytes,
+			duration / 1000000.0, elapsed,
+			elapsed > 0 ? duration / 1000000.0 / elapsed : 0.0,
+			elapsed > 0 ? frames / elapsed : 0.0,
+			elapsed > 0 ? pcm_bytes / elapsed / 1000000.0 : 0.0);
+}
@@ -0,0 +1,53 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) tools batch mode
+ *
+ *  Copyright (C) 2008-2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+
+/* One input file processed in batch mode and its results */
+struct batch_job {
+	char *filename;
+	char *output;
+	int err;			/* 0 or negative errno value */
+	unsigned long frames;		/* number of SBC frames */
+	unsigned long long pcm_bytes;	/* PCM data size */
+	unsigned long long sbc_bytes;	/* SBC data size */
+	unsigned long long duration;	/* audio duration in usec */
+	double elapsed;			/* processing time in seconds */
+};
+
+/* Processes a single job, the sbc_t instance belongs to the worker and
+ * is reused for all its jobs, so it has to be reinitialized first */
+typedef int (*batch_func_t)(sbc_t *sbc, struct batch_job *job);
+
+/* Derives the output name from the input one, replacing its extension */
+char *batch_output_name(const char *filename, const char *ext);
+
+/* Runs the jobs on the given number of worker threads (0 to use all the
+ * online CPUs) and returns the total elapsed time in seconds */
+double batch_run(struct batch_job *jobs, int count, int workers,
+							batch_func_t func);
+
+/* Prints a line of results per job followed by the totals */
+void batch_report(FILE *f, const struct batch_job *jobs, int count,
+							double elapsed);
@@ -51,6 +51,28 @@
 
 #define SBC_SYNCWORD	0x9C
 
+#define MSBC_SYNCWORD	0xAD
+#define MSBC_BLOCKS	15
+#define MSBC_BITPOOL	26
+
+/* mSBC frames are carried over transparent SCO in 60 bytes H2 packets:
+ * 2 bytes of H2 header, the 57 bytes frame and one byte of padding */
+#define H2_HEADER_0	0x01
+#define H2_PACKET_SIZE	60
+
+#define SBC_BITS_CACHE_SIZE 8
+
+/* Recently calculated bit allocations, stationary audio tends to repeat
+ * the same scale factors so the bitneed/bitslice search can be skipped */
+struct sbc_bits_cache {
+	uint64_t scale_factors[SBC_BITS_CACHE_SIZE];
+	uint32_t params[SBC_BITS_CACHE_SIZE];
+	uint8_t bits[SBC_BITS_CACHE_SIZE][2][8];
+	unsigned int next;
+	unsigned long hits;
+	unsigned long misses;
+};
+
 /* This structure contains an unpacked SBC frame.
    Yes, there is probably quite some unused space herein */
 struct sbc_frame {
@@ -72,11 +94,14 @@ struct sbc_frame {
 	uint8_t subbands;
 	uint8_t bitpool;
 	uint16_t codesize;
-	uint8_t length;
+	uint16_t length;
 
 	/* bit number x set means joint stereo has been used in subband x */
 	uint8_t joint;
 
+	/* bit allocation cache, NULL if not enabled */
+	struct sbc_bits_cache *bits_cache;
+
 	/* only the lower 4 bits of every element are to be used */
 	uint32_t SBC_ALIGNED scale_factor[2][8];
 
@@ -90,12 +115,6 @@ struct sbc_frame {
 	int16_t SBC_ALIGNED pcm_sample[2][16*8];
 };
 
-struct sbc_decoder_state {
-	int subbands;
-	int32_t V[2][170];
-	int offset[2][16];
-};
-
 /*
  * Calculates the CRC-8 of the first len bits in data
  */
@@ -354,7 +373,8 @@ static SBC_ALWAYS_INLINE void sbc_calculate_bits_internal(
 
 }
 
-static void sbc_calculate_bits(const struct sbc_frame *frame, int (*bits)[8])
+static void sbc_calculate_bits_uncached(const struct sbc_frame *frame,
+							int (*bits)[8])
 {
 	if (frame->subbands == 4)
 		sbc_calculate_bits_internal(frame, bits, 4);
@@ -362,6 +382,61 @@ static void sbc_calculate_bits(const struct sbc_frame *frame, int (*bits)[8])
 		sbc_calculate_bits_internal(frame, bits, 8);
 }
 
+static void sbc_calculate_bits(const struct sbc_frame *frame, int (*bits)[8])
+{
+	struct sbc_bits_cache *cache = frame->bits_cache;
+	uint64_t scale_factors = 0;
+	uint32_t params;
+	int ch, sb, i;
+
+	if (!cache) {
+		sbc_calculate_bits_uncached(frame, bits);
+		return;
+	}
+
+	/* The allocation only depends on the scale factors (4 bits each)
+	 * and on the frame parameters, bit 16 marks a used entry */
+	for (ch = 0; ch < frame->channels; ch++)
+		for (sb = 0; sb < frame->subbands; sb++)
+			scale_factors |= (uint64_t) (frame->scale_factor[ch][sb]
+						& 0x0F) << ((ch * 8 + sb) * 4);
+
+	params = frame->frequency | frame->mode << 2 |
+			frame->allocation << 4 | (frame->subbands == 8) << 5 |
+			frame->bitpool << 8 | 1 << 16;
+
+	for (i = 0; i < SBC_BITS_CACHE_SIZE; i++) {
+		if (cache->params[i] != params ||
+				cache->scale_factors[i] != scale_factors)
+			continue;
+
+		for (ch = 0; ch < frame->channels; ch++)
+			for (sb = 0; sb < frame->subbands; sb++)
+				bits[ch][sb] = cache->bits[i][ch][sb];
+
+		cache->hits++;
+		return;
+	}
+
+	sbc_calculate_bits_uncached(frame, bits);
+
+	i = cache->next;
+	cache->next = (i + 1) % SBC_BITS_CACHE_SIZE;
+	cache->params[i] = params;
+	cache->scale_factors[i] = scale_factors;
+
+	for (ch = 0; ch < frame->channels; ch++)
+		for (sb = 0; sb < frame->subbands; sb++)
+			cache->bits[i][ch][sb] = bits[ch][sb];
+
+	cache->misses++;
+}
+
+static const uint8_t h2_header_sn[4] = { 0x08, 0x38, 0xc8, 0xf8 };
+
+static int sbc_unpack_frame_internal(const uint8_t *data,
+					struct sbc_frame *frame, size_t len);
+
 /*
  * Unpacks a SBC frame at the beginning of the stream in data,
  * which has at most len bytes into frame.
@@ -376,19 +451,6 @@ static void sbc_calculate_bits(const struct sbc_frame *frame, int (*bits)[8])
 static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 								size_t len)
 {
-	unsigned int consumed;
-	/* Will copy the parts of the header that are relevant to crc
-	 * calculation here */
-	uint8_t crc_header[11] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-	int crc_pos = 0;
-	int32_t temp;
-
-	int audio_sample;
-	int ch, sb, blk, bit;	/* channel, subband, block and bit standard
-				   counters */
-	int bits[2][8];		/* bits distribution */
-	uint32_t levels[2][8];	/* levels derived from that */
-
 	if (len < 4)
 		return -1;
 
@@ -440,6 +502,69 @@ static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 			frame->bitpool > 32 * frame->subbands)
 		return -4;
 
+	return sbc_unpack_frame_internal(data, frame, len);
+}
+
+/*
+ * Unpacks a mSBC frame, optionally preceded by its H2 header. All the
+ * header fields are implied and the two reserved bytes must be zero.
+ * Returns the length in bytes including the H2 header and padding,
+ * or the same error codes as sbc_unpack_frame().
+ */
+static int msbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
+								size_t len)
+{
+	int h2 = 0, framelen;
+
+	if (len >= 2 && data[0] == H2_HEADER_0 && (data[1] & 0x0f) == 0x08) {
+		h2 = 2;
+		data += h2;
+		len -= h2;
+	}
+
+	if (len < 4)
+		return -1;
+
+	if (data[0] != MSBC_SYNCWORD || data[1] != 0 || data[2] != 0)
+		return -2;
+
+	frame->frequency = SBC_FREQ_16000;
+	frame->block_mode = SBC_BLK_16;
+	frame->blocks = MSBC_BLOCKS;
+	frame->mode = MONO;
+	frame->channels = 1;
+	frame->allocation = LOUDNESS;
+	frame->subband_mode = SBC_SB_8;
+	frame->subbands = 8;
+	frame->bitpool = MSBC_BITPOOL;
+
+	framelen = sbc_unpack_frame_internal(data, frame, len);
+	if (framelen < 0 || !h2)
+		return framelen;
+
+	/* skip the padding byte completing the H2 packet */
+	if (len > (size_t) framelen)
+		return framelen + h2 + 1;
+
+	return framelen + h2;
+}
+
+static int sbc_unpack_frame_internal(const uint8_t *data,
+					struct sbc_frame *frame, size_t len)
+{
+	unsigned int consumed;
+	/* Will copy the parts of the header that are relevant to crc
+	 * calculation here */
+	uint8_t crc_header[11] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	int crc_pos = 0;
+	int32_t temp;
+
+	int audio_sample;
+	int ch, sb, blk, bit;	/* channel, subband, block and bit standard
+				   counters */
+	int bits[2][8];		/* bits distribution */
+	uint32_t levels[2][8];	/* levels derived from that */
+
 	/* data[3] is crc, we're checking it later */
 
 	consumed = 32;
@@ -536,139 +661,51 @@ static int sbc_unpack_frame(const uint8_t *data, struct sbc_frame *frame,
 }
 
 static void sbc_decoder_init(struct sbc_decoder_state *state,
-					const struct sbc_frame *frame)
+			const struct sbc_frame *frame, unsigned long flags)
 {
-	int i, ch;
-
 	memset(state->V, 0, sizeof(state->V));
 	state->subbands = frame->subbands;
+	state->position = SBC_V_BUFFER_SIZE - frame->subbands * 2 * 9;
 
-	for (ch = 0; ch < 2; ch++)
-		for (i = 0; i < frame->subbands * 2; i++)
-			state->offset[ch][i] = (10 * i + 10);
-}
-
-static SBC_ALWAYS_INLINE int16_t sbc_clip16(int32_t s)
-{
-	if (s > 0x7FFF)
-		return 0x7FFF;
-	else if (s < -0x8000)
-		return -0x8000;
-	else
-		return s;
-}
-
-static inline void sbc_synthesize_four(struct sbc_decoder_state *state,
-				struct sbc_frame *frame, int ch, int blk)
-{
-	int i, k, idx;
-	int32_t *v = state->V[ch];
-	int *offset = state->offset[ch];
-
-	for (i = 0; i < 8; i++) {
-		/* Shifting */
-		offset[i]--;
-		if (offset[i] < 0) {
-			offset[i] = 79;
-			memcpy(v + 80, v, 9 * sizeof(*v));
-		}
-
-		/* Distribute the new matrix value to the shifted position */
-		v[offset[i]] = SCALE4_STAGED1(
-			MULA(synmatrix4[i][0], frame->sb_sample[blk][ch][0],
-			MULA(synmatrix4[i][1], frame->sb_sample[blk][ch][1],
-			MULA(synmatrix4[i][2], frame->sb_sample[blk][ch][2],
-			MUL (synmatrix4[i][3], frame->sb_sample[blk][ch][3])))));
-	}
-
-	/* Compute the samples */
-	for (idx = 0, i = 0; i < 4; i++, idx += 5) {
-		k = (i + 4) & 0xf;
-
-		/* Store in output, Q0 */
-		frame->pcm_sample[ch][blk * 4 + i] = sbc_clip16(SCALE4_STAGED1(
-			MULA(v[offset[i] + 0], sbc_proto_4_40m0[idx + 0],
-			MULA(v[offset[k] + 1], sbc_proto_4_40m1[idx + 0],
-			MULA(v[offset[i] + 2], sbc_proto_4_40m0[idx + 1],
-			MULA(v[offset[k] + 3], sbc_proto_4_40m1[idx + 1],
-			MULA(v[offset[i] + 4], sbc_proto_4_40m0[idx + 2],
-			MULA(v[offset[k] + 5], sbc_proto_4_40m1[idx + 2],
-			MULA(v[offset[i] + 6], sbc_proto_4_40m0[idx + 3],
-			MULA(v[offset[k] + 7], sbc_proto_4_40m1[idx + 3],
-			MULA(v[offset[i] + 8], sbc_proto_4_40m0[idx + 4],
-			MUL( v[offset[k] + 9], sbc_proto_4_40m1[idx + 4]))))))))))));
-	}
-}
-
-static inline void sbc_synthesize_eight(struct sbc_decoder_state *state,
-				struct sbc_frame *frame, int ch, int blk)
-{
-	int i, j, k, idx;
-	int *offset = state->offset[ch];
-
-	for (i = 0; i < 16; i++) {
-		/* Shifting */
-		offset[i]--;
-		if (offset[i] < 0) {
-			offset[i] = 159;
-			for (j = 0; j < 9; j++)
-				state->V[ch][j + 160] = state->V[ch][j];
-		}
-
-		/* Distribute the new matrix value to the shifted position */
-		state->V[ch][offset[i]] = SCALE8_STAGED1(
-			MULA(synmatrix8[i][0], frame->sb_sample[blk][ch][0],
-			MULA(synmatrix8[i][1], frame->sb_sample[blk][ch][1],
-			MULA(synmatrix8[i][2], frame->sb_sample[blk][ch][2],
-			MULA(synmatrix8[i][3], frame->sb_sample[blk][ch][3],
-			MULA(synmatrix8[i][4], frame->sb_sample[blk][ch][4],
-			MULA(synmatrix8[i][5], frame->sb_sample[blk][ch][5],
-			MULA(synmatrix8[i][6], frame->sb_sample[blk][ch][6],
-			MUL( synmatrix8[i][7], frame->sb_sample[blk][ch][7])))))))));
-	}
-
-	/* Compute the samples */
-	for (idx = 0, i = 0; i < 8; i++, idx += 5) {
-		k = (i + 8) & 0xf;
-
-		/* Store in output, Q0 */
-		frame->pcm_sample[ch][blk * 8 + i] = sbc_clip16(SCALE8_STAGED1(
-			MULA(state->V[ch][offset[i] + 0], sbc_proto_8_80m0[idx + 0],
-			MULA(state->V[ch][offset[k] + 1], sbc_proto_8_80m1[idx + 0],
-			MULA(state->V[ch][offset[i] + 2], sbc_proto_8_80m0[idx + 1],
-			MULA(state->V[ch][offset[k] + 3], sbc_proto_8_80m1[idx + 1],
-			MULA(state->V[ch][offset[i] + 4], sbc_proto_8_80m0[idx + 2],
-			MULA(state->V[ch][offset[k] + 5], sbc_proto_8_80m1[idx + 2],
-			MULA(state->V[ch][offset[i] + 6], sbc_proto_8_80m0[idx + 3],
-			MULA(state->V[ch][offset[k] + 7], sbc_proto_8_80m1[idx + 3],
-			MULA(state->V[ch][offset[i] + 8], sbc_proto_8_80m0[idx + 4],
-			MUL( state->V[ch][offset[k] + 9], sbc_proto_8_80m1[idx + 4]))))))))))));
-	}
+	sbc_init_decoder_primitives(state, flags & SBC_BACKEND_MASK);
 }
 
 static int sbc_synthesize_audio(struct sbc_decoder_state *state,
 						struct sbc_frame *frame)
 {
 	int ch, blk;
+	int nrof = frame->subbands * 2;
+	void (*sbc_synthesize)(int32_t *v, const int32_t *in, int16_t *out);
 
 	switch (frame->subbands) {
 	case 4:
-		for (ch = 0; ch < frame->channels; ch++) {
-			for (blk = 0; blk < frame->blocks; blk++)
-				sbc_synthesize_four(state, frame, ch, blk);
-		}
-		return frame->blocks * 4;
-
+		sbc_synthesize = state->sbc_synthesize_4s;
+		break;
 	case 8:
-		for (ch = 0; ch < frame->channels; ch++) {
-			for (blk = 0; blk < frame->blocks; blk++)
-				sbc_synthesize_eight(state, frame, ch, blk);
-		}
-		return frame->blocks * 8;
-
+		sbc_synthesize = state->sbc_synthesize_8s;
+		break;
 	default:
 		return -EIO;
 	}
+
+	for (blk = 0; blk < frame->blocks; blk++) {
+		/* handle V buffer wraparound, keeping the 9 previous blocks */
+		if (state->position < nrof) {
+			for (ch = 0; ch < frame->channels; ch++)
+				memcpy(&state->V[ch][SBC_V_BUFFER_SIZE - 9 * nrof],
+					&state->V[ch][state->position],
+					9 * nrof * sizeof(int32_t));
+			state->position = SBC_V_BUFFER_SIZE - 9 * nrof;
+		}
+		state->position -= nrof;
+
+		for (ch = 0; ch < frame->channels; ch++)
+			sbc_synthesize(&state->V[ch][state->position],
+				frame->sb_sample[blk][ch],
+				&frame->pcm_sample[ch][blk * frame->subbands]);
+	}
+
+	return frame->blocks * frame->subbands;
 }
 
 static int sbc_analyze_audio(struct sbc_encoder_state *state,
@@ -694,6 +731,26 @@ static int sbc_analyze_audio(struct sbc_encoder_state *state,
 		return frame->blocks * 4;
 
 	case 8:
+		if (state->increment == 1) {
+			/* mSBC has an odd number of blocks per frame, so they
+			 * are analyzed one by one, the coefficients to use
+			 * alternate with the block position in the buffer */
+			for (ch = 0; ch < frame->channels; ch++) {
+				int pos = state->position - 8 +
+							frame->blocks * 8;
+				for (blk = 0; blk < frame->blocks; blk++) {
+					state->sbc_analyze_1b_8s(
+						&state->X[ch][pos],
+						frame->sb_sample_f[blk][ch],
+						(pos & 8) ?
+						analysis_consts_fixed8_simd_odd :
+						analysis_consts_fixed8_simd_even);
+					pos -= 8;
+				}
+			}
+			return frame->blocks * 8;
+		}
+
 		for (ch = 0; ch < frame->channels; ch++) {
 			x = &state->X[ch][state->position - 32 +
 							frame->blocks * 8];
@@ -777,39 +834,7 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 	uint32_t levels[2][8];	/* levels are derived from that */
 	uint32_t sb_sample_delta[2][8];
 
-	data[0] = SBC_SYNCWORD;
-
-	data[1] = (frame->frequency & 0x03) << 6;
-
-	data[1] |= (frame->block_mode & 0x03) << 4;
-
-	data[1] |= (frame->mode & 0x03) << 2;
-
-	data[1] |= (frame->allocation & 0x01) << 1;
-
-	switch (frame_subbands) {
-	case 4:
-		/* Nothing to do */
-		break;
-	case 8:
-		data[1] |= 0x01;
-		break;
-	default:
-		return -4;
-		break;
-	}
-
-	data[2] = frame->bitpool;
-
-	if ((frame->mode == MONO || frame->mode == DUAL_CHANNEL) &&
-			frame->bitpool > frame_subbands << 4)
-		return -5;
-
-	if ((frame->mode == STEREO || frame->mode == JOINT_STEREO) &&
-			frame->bitpool > frame_subbands << 5)
-		return -5;
-
-	/* Can't fill in crc yet */
+	/* Header bytes are already filled in, can't fill in crc yet */
 
 	crc_header[0] = data[1];
 	crc_header[1] = data[2];
@@ -876,6 +901,38 @@ static SBC_ALWAYS_INLINE ssize_t sbc_pack_frame_internal(uint8_t *data,
 static ssize_t sbc_pack_frame(uint8_t *data, struct sbc_frame *frame, size_t len,
 								int joint)
 {
+	data[0] = SBC_SYNCWORD;
+
+	data[1] = (frame->frequency & 0x03) << 6;
+
+	data[1] |= (frame->block_mode & 0x03) << 4;
+
+	data[1] |= (frame->mode & 0x03) << 2;
+
+	data[1] |= (frame->allocation & 0x01) << 1;
+
+	switch (frame->subbands) {
+	case 4:
+		/* Nothing to do */
+		break;
+	case 8:
+		data[1] |= 0x01;
+		break;
+	default:
+		return -4;
+		break;
+	}
+
+	data[2] = frame->bitpool;
+
+	if ((frame->mode == MONO || frame->mode == DUAL_CHANNEL) &&
+			frame->bitpool > frame->subbands << 4)
+		return -5;
+
+	if ((frame->mode == STEREO || frame->mode == JOINT_STEREO) &&
+			frame->bitpool > frame->subbands << 5)
+		return -5;
+
 	if (frame->subbands == 4) {
 		if (frame->channels == 1)
 			return sbc_pack_frame_internal(
@@ -893,29 +950,83 @@ static ssize_t sbc_pack_frame(uint8_t *data, struct sbc_frame *frame, size_t len
 	}
 }
 
+/*
+ * Packs a mSBC frame into a H2 packet: the H2 header carrying the
+ * sequence number, the frame with implied header fields (only the
+ * syncword and two zero bytes are stored) and one byte of padding.
+ */
+static ssize_t msbc_pack_frame(uint8_t *data, struct sbc_frame *frame,
+						size_t len, uint8_t seq)
+{
+	ssize_t framelen;
+
+	data[0] = H2_HEADER_0;
+	data[1] = h2_header_sn[seq & 0x03];
+
+	data[2] = MSBC_SYNCWORD;
+	data[3] = 0;
+	data[4] = 0;
+
+	framelen = sbc_pack_frame_internal(data + 2, frame, len - 2, 8, 1, 0);
+	if (framelen < 0)
+		return framelen;
+
+	data[framelen + 2] = 0;
+
+	return framelen + 3;
+}
+
 static void sbc_encoder_init(struct sbc_encoder_state *state,
-					const struct sbc_frame *frame)
+			const struct sbc_frame *frame, unsigned long flags)
 {
 	memset(&state->X, 0, sizeof(state->X));
 	state->position = (SBC_X_BUFFER_SIZE - frame->subbands * 9) & ~7;
+	state->increment = frame->blocks == MSBC_BLOCKS ? 1 : 4;
 
-	sbc_init_primitives(state);
+	sbc_init_primitives(state, flags & SBC_BACKEND_MASK);
 }
 
 struct sbc_priv {
 	int init;
+	int msbc;
+	uint8_t msbc_seq;
 	struct SBC_ALIGNED sbc_frame frame;
 	struct SBC_ALIGNED sbc_decoder_state dec_state;
 	struct SBC_ALIGNED sbc_encoder_state enc_state;
+	struct sbc_bits_cache bits_cache;
 };
 
-static void sbc_set_defaults(sbc_t *sbc, unsigned long flags)
+static void sbc_set_msbc_params(sbc_t *sbc)
 {
-	sbc->frequency = SBC_FREQ_44100;
-	sbc->mode = SBC_MODE_STEREO;
+	sbc->frequency = SBC_FREQ_16000;
+	sbc->mode = SBC_MODE_MONO;
 	sbc->subbands = SBC_SB_8;
+	/* the real block count of 15 is kept in priv->frame.blocks */
 	sbc->blocks = SBC_BLK_16;
-	sbc->bitpool = 32;
+	sbc->allocation = SBC_AM_LOUDNESS;
+	sbc->bitpool = MSBC_BITPOOL;
+}
+
+static void sbc_set_defaults(sbc_t *sbc, unsigned long flags)
+{
+	struct sbc_priv *priv = sbc->priv;
+
+	sbc->flags = flags;
+	priv->msbc = flags & SBC_MSBC ? 1 : 0;
+
+	memset(&priv->bits_cache, 0, sizeof(priv->bits_cache));
+	priv->frame.bits_cache = flags & SBC_BITS_CACHE ?
+						&priv->bits_cache : NULL;
+
+	if (priv->msbc) {
+		sbc_set_msbc_params(sbc);
+	} else {
+		sbc->frequency = SBC_FREQ_44100;
+		sbc->mode = SBC_MODE_STEREO;
+		sbc->subbands = SBC_SB_8;
+		sbc->blocks = SBC_BLK_16;
+		sbc->bitpool = 32;
+	}
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 	sbc->endian = SBC_LE;
 #elif __BYTE_ORDER == __BIG_ENDIAN
@@ -951,22 +1062,20 @@ ssize_t sbc_parse(sbc_t *sbc, const void *input, size_t input_len)
 	return sbc_decode(sbc, input, input_len, NULL, 0, NULL);
 }
 
-ssize_t sbc_decode(sbc_t *sbc, const void *input, size_t input_len,
+static ssize_t sbc_decode_frame(sbc_t *sbc, struct sbc_priv *priv,
+			const void *input, size_t input_len,
 			void *output, size_t output_len, size_t *written)
 {
-	struct sbc_priv *priv;
 	char *ptr;
 	int i, ch, framelen, samples;
 
-	if (!sbc || !input)
-		return -EIO;
-
-	priv = sbc->priv;
-
-	framelen = sbc_unpack_frame(input, &priv->frame, input_len);
+	if (priv->msbc)
+		framelen = msbc_unpack_frame(input, &priv->frame, input_len);
+	else
+		framelen = sbc_unpack_frame(input, &priv->frame, input_len);
 
 	if (!priv->init) {
-		sbc_decoder_init(&priv->dec_state, &priv->frame);
+		sbc_decoder_init(&priv->dec_state, &priv->frame, sbc->flags);
 		priv->init = 1;
 
 		sbc->frequency = priv->frame.frequency;
@@ -1020,23 +1129,79 @@ ssize_t sbc_decode(sbc_t *sbc, const void *input, size_t input_len,
 	return framelen;
 }
 
-ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
-			void *output, size_t output_len, ssize_t *written)
+ssize_t sbc_decode(sbc_t *sbc, const void *input, size_t input_len,
+			void *output, size_t output_len, size_t *written)
+{
+	if (!sbc || !input)
+		return -EIO;
+
+	return sbc_decode_frame(sbc, sbc->priv, input, input_len,
+					output, output_len, written);
+}
+
+ssize_t sbc_decode_multi(sbc_t *sbc, const void *input, size_t input_len,
+			void *output, size_t output_len, size_t *written,
+			size_t *offsets, int max_frames, int *frames)
 {
 	struct sbc_priv *priv;
-	int samples;
+	const uint8_t *in = input;
+	uint8_t *out = output;
+	size_t consumed = 0, total = 0, len;
 	ssize_t framelen;
-	int (*sbc_enc_process_input)(int position,
-			const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
-			int nsamples, int nchannels);
+	int n = 0;
 
-	if (!sbc || !input)
+	if (written)
+		*written = 0;
+
+	if (frames)
+		*frames = 0;
+
+	if (!sbc || !input || !output)
 		return -EIO;
 
 	priv = sbc->priv;
 
+	/* the first header tells how much output every frame needs */
+	if (!priv->init) {
+		framelen = sbc_decode_frame(sbc, priv, input, input_len,
+							NULL, 0, NULL);
+		if (framelen <= 0)
+			return framelen;
+	}
+
+	while (n < max_frames && consumed < input_len &&
+				output_len - total >= priv->frame.codesize) {
+		framelen = sbc_decode_frame(sbc, priv, in + consumed,
+					input_len - consumed, out + total,
+					output_len - total, &len);
+		if (framelen <= 0) {
+			if (n == 0)
+				return framelen;
+			break;
+		}
+
+		if (offsets)
+			offsets[n] = consumed;
+
+		consumed += framelen;
+		total += len;
+		n++;
+	}
+
 	if (written)
-		*written = 0;
+		*written = total;
+
+	if (frames)
+		*frames = n;
+
+	return consumed;
+}
+
+static void sbc_encoder_setup(sbc_t *sbc, struct sbc_priv *priv)
+{
+	/* mSBC parameters are fixed */
+	if (priv->msbc)
+		sbc_set_msbc_params(sbc);
 
 	if (!priv->init) {
 		priv->frame.frequency = sbc->frequency;
@@ -1046,25 +1211,28 @@ ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
 		priv->frame.subband_mode = sbc->subbands;
 		priv->frame.subbands = sbc->subbands ? 8 : 4;
 		priv->frame.block_mode = sbc->blocks;
-		priv->frame.blocks = 4 + (sbc->blocks * 4);
+		priv->frame.blocks = priv->msbc ? MSBC_BLOCKS :
+						4 + (sbc->blocks * 4);
 		priv->frame.bitpool = sbc->bitpool;
 		priv->frame.codesize = sbc_get_codesize(sbc);
 		priv->frame.length = sbc_get_frame_length(sbc);
 
-		sbc_encoder_init(&priv->enc_state, &priv->frame);
+		sbc_encoder_init(&priv->enc_state, &priv->frame, sbc->flags);
 		priv->init = 1;
 	} else if (priv->frame.bitpool != sbc->bitpool) {
 		priv->frame.length = sbc_get_frame_length(sbc);
 		priv->frame.bitpool = sbc->bitpool;
 	}
+}
 
-	/* input must be large enough to encode a complete frame */
-	if (input_len < priv->frame.codesize)
-		return 0;
-
-	/* output must be large enough to receive the encoded frame */
-	if (!output || output_len < priv->frame.length)
-		return -ENOSPC;
+static ssize_t sbc_encode_frame(sbc_t *sbc, struct sbc_priv *priv,
+			const void *input, void *output, size_t output_len,
+			ssize_t *framelen)
+{
+	int samples;
+	int (*sbc_enc_process_input)(int position,
+			const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+			int nsamples, int nchannels);
 
 	/* Select the needed input data processing function and call it */
 	if (priv->frame.subbands == 8) {
@@ -1094,19 +1262,119 @@ ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
 		int j = priv->enc_state.sbc_calc_scalefactors_j(
 			priv->frame.sb_sample_f, priv->frame.scale_factor,
 			priv->frame.blocks, priv->frame.subbands);
-		framelen = sbc_pack_frame(output, &priv->frame, output_len, j);
+		*framelen = sbc_pack_frame(output, &priv->frame, output_len, j);
 	} else {
 		priv->enc_state.sbc_calc_scalefactors(
 			priv->frame.sb_sample_f, priv->frame.scale_factor,
 			priv->frame.blocks, priv->frame.channels,
 			priv->frame.subbands);
-		framelen = sbc_pack_frame(output, &priv->frame, output_len, 0);
+		if (priv->msbc)
+			*framelen = msbc_pack_frame(output, &priv->frame,
+						output_len, priv->msbc_seq++);
+		else
+			*framelen = sbc_pack_frame(output, &priv->frame,
+							output_len, 0);
 	}
 
+	return samples * priv->frame.channels * 2;
+}
+
+ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
+			void *output, size_t output_len, ssize_t *written)
+{
+	struct sbc_priv *priv;
+	ssize_t framelen, consumed;
+
+	if (!sbc || !input)
+		return -EIO;
+
+	priv = sbc->priv;
+
+	if (written)
+		*written = 0;
+
+	sbc_encoder_setup(sbc, priv);
+
+	/* input must be large enough to encode a complete frame */
+	if (input_len < priv->frame.codesize)
+		return 0;
+
+	/* output must be large enough to receive the encoded frame */
+	if (!output || output_len < priv->frame.length)
+		return -ENOSPC;
+
+	consumed = sbc_encode_frame(sbc, priv, input, output, output_len,
+								&framelen);
+
 	if (written)
 		*written = framelen;
 
-	return samples * priv->frame.channels * 2;
+	return consumed;
+}
+
+ssize_t sbc_encode_multi(sbc_t *sbc, const void *input, size_t input_len,
+			void *output, size_t output_len, ssize_t *written,
+			size_t *offsets, int max_frames, int *frames)
+{
+	struct sbc_priv *priv;
+	const uint8_t *in = input;
+	uint8_t *out = output;
+	size_t consumed = 0;
+	ssize_t framelen, total = 0;
+	int n = 0;
+
+	if (!sbc || !input)
+		return -EIO;
+
+	priv = sbc->priv;
+
+	if (written)
+		*written = 0;
+
+	if (frames)
+		*frames = 0;
+
+	sbc_encoder_setup(sbc, priv);
+
+	/* input must be large enough to encode a complete frame */
+	if (input_len < priv->frame.codesize)
+		return 0;
+
+	/* output must be large enough to receive the encoded frame */
+	if (!output || output_len < priv->frame.length)
+		return -ENOSPC;
+
+	while (n < max_frames &&
+			input_len - consumed >= priv->frame.codesize &&
+			output_len - total >= priv->frame.length) {
+		ssize_t used;
+
+		used = sbc_encode_frame(sbc, priv, in + consumed,
+				out + total, output_len - total, &framelen);
+
+		/* Report the error only if no frame was encoded */
+		if (framelen < 0) {
+			if (n == 0)
+				return framelen;
+			break;
+		}
+
+		consumed += used;
+
+		if (offsets)
+			offsets[n] = total;
+
+		total += framelen;
+		n++;
+	}
+
+	if (written)
+		*written = total;
+
+	if (frames)
+		*frames = n;
+
+	return consumed;
 }
 
 void sbc_finish(sbc_t *sbc)
@@ -1129,6 +1397,9 @@ size_t sbc_get_frame_length(sbc_t *sbc)
 	if (priv->init && priv->frame.bitpool == sbc->bitpool)
 		return priv->frame.length;
 
+	if (priv->msbc)
+		return H2_PACKET_SIZE;
+
 	subbands = sbc->subbands ? 8 : 4;
 	blocks = 4 + (sbc->blocks * 4);
 	channels = sbc->mode == SBC_MODE_MONO ? 1 : 2;
@@ -1137,7 +1408,7 @@ size_t sbc_get_frame_length(sbc_t *sbc)
 
 	ret = 4 + (4 * subbands * channels) / 8;
 	/* This term is not always evenly divide so we round it up */
-	if (channels == 1)
+	if (channels == 1 || sbc->mode == SBC_MODE_DUAL_CHANNEL)
 		ret += ((blocks * channels * bitpool) + 7) / 8;
 	else
 		ret += (((joint ? subbands : 0) + blocks * bitpool) + 7) / 8;
@@ -1154,7 +1425,7 @@ unsigned sbc_get_frame_duration(sbc_t *sbc)
 	priv = sbc->priv;
 	if (!priv->init) {
 		subbands = sbc->subbands ? 8 : 4;
-		blocks = 4 + (sbc->blocks * 4);
+		blocks = priv->msbc ? MSBC_BLOCKS : 4 + (sbc->blocks * 4);
 	} else {
 		subbands = priv->frame.subbands;
 		blocks = priv->frame.blocks;
@@ -1191,7 +1462,7 @@ size_t sbc_get_codesize(sbc_t *sbc)
 	priv = sbc->priv;
 	if (!priv->init) {
 		subbands = sbc->subbands ? 8 : 4;
-		blocks = 4 + (sbc->blocks * 4);
+		blocks = priv->msbc ? MSBC_BLOCKS : 4 + (sbc->blocks * 4);
 		channels = sbc->mode == SBC_MODE_MONO ? 1 : 2;
 	} else {
 		subbands = priv->frame.subbands;
@@ -1213,9 +1484,34 @@ const char *sbc_get_implementation_info(sbc_t *sbc)
 	if (!priv)
 		return NULL;
 
+	if (priv->dec_state.implementation_info)
+		return priv->dec_state.implementation_info;
+
 	return priv->enc_state.implementation_info;
 }
 
+int sbc_get_bits_cache_stats(sbc_t *sbc, unsigned long *hits,
+						unsigned long *misses)
+{
+	struct sbc_priv *priv;
+
+	if (!sbc || !sbc->priv)
+		return -EIO;
+
+	priv = sbc->priv;
+
+	if (!priv->frame.bits_cache)
+		return -EINVAL;
+
+	if (hits)
+		*hits = priv->bits_cache.hits;
+
+	if (misses)
+		*misses = priv->bits_cache.misses;
+
+	return 0;
+}
+
 int sbc_reinit(sbc_t *sbc, unsigned long flags)
 {
 	struct sbc_priv *priv;
@@ -34,6 +34,24 @@ extern "C" {
 #include <stdint.h>
 #include <sys/types.h>
 
+/* initialization flags */
+#define SBC_MSBC		0x01
+#define SBC_BITS_CACHE		0x02
+
+/* Restricts the primitives to the given backend and the ones it builds
+ * upon, mostly useful for benchmarking and testing. Requesting a backend
+ * the CPU or the build does not support falls back to the best one that
+ * is available, check sbc_get_implementation_info() for what is used */
+#define SBC_BACKEND_MASK	0xf0
+#define SBC_BACKEND_AUTO	0x00
+#define SBC_BACKEND_C		0x10
+#define SBC_BACKEND_MMX		0x20
+#define SBC_BACKEND_SSE		0x30
+#define SBC_BACKEND_AVX2	0x40
+#define SBC_BACKEND_ARMV6	0x50
+#define SBC_BACKEND_IWMMXT	0x60
+#define SBC_BACKEND_NEON	0x70
+
 /* sampling frequency */
 #define SBC_FREQ_16000		0x00
 #define SBC_FREQ_32000		0x01
@@ -81,6 +99,10 @@ struct sbc_struct {
 
 typedef struct sbc_struct sbc_t;
 
+/* With the SBC_MSBC flag the codec is set up for wideband speech (mSBC):
+ * 16 kHz mono, 15 blocks, 8 subbands, bitpool 26. Every encoded frame
+ * is wrapped into a 60 bytes H2 packet, which is also what the decoder
+ * expects (plain mSBC frames without H2 header are accepted as well) */
 int sbc_init(sbc_t *sbc, unsigned long flags);
 int sbc_reinit(sbc_t *sbc, unsigned long flags);
 
@@ -94,6 +116,20 @@ ssize_t sbc_decode(sbc_t *sbc, const void *input, size_t input_len,
 ssize_t sbc_encode(sbc_t *sbc, const void *input, size_t input_len,
 			void *output, size_t output_len, ssize_t *written);
 
+/* Decodes up to max_frames input blocks, as many as fit into the output
+ * buffer. Returns the number of input bytes consumed; the start of every
+ * decoded frame within the input is stored to offsets (if not NULL) */
+ssize_t sbc_decode_multi(sbc_t *sbc, const void *input, size_t input_len,
+			void *output, size_t output_len, size_t *written,
+			size_t *offsets, int max_frames, int *frames);
+
+/* Encodes up to max_frames input blocks, as many as fit into the output
+ * buffer. Returns the number of input bytes consumed; the start of every
+ * encoded frame within the output is stored to offsets (if not NULL) */
+ssize_t sbc_encode_multi(sbc_t *sbc, const void *input, size_t input_len,
+			void *output, size_t output_len, ssize_t *written,
+			size_t *offsets, int max_frames, int *frames);
+
 /* Returns the output block size in bytes */
 size_t sbc_get_frame_length(sbc_t *sbc);
 
@@ -104,6 +140,13 @@ unsigned sbc_get_frame_duration(sbc_t *sbc);
 size_t sbc_get_codesize(sbc_t *sbc);
 
 const char *sbc_get_implementation_info(sbc_t *sbc);
+
+/* With the SBC_BITS_CACHE flag the bit allocation of a few recent frames
+ * is kept and reused for frames with the same scale factors. Returns the
+ * number of cache hits and misses, or -EINVAL if the cache is not enabled */
+int sbc_get_bits_cache_stats(sbc_t *sbc, unsigned long *hits,
+						unsigned long *misses);
+
 void sbc_finish(sbc_t *sbc);
 
 #ifdef __cplusplus
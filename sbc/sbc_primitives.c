@@ -33,10 +33,17 @@
 
 #include "sbc_primitives.h"
 #include "sbc_primitives_mmx.h"
+#include "sbc_primitives_sse.h"
+#include "sbc_primitives_avx2.h"
 #include "sbc_primitives_iwmmxt.h"
 #include "sbc_primitives_neon.h"
 #include "sbc_primitives_armv6.h"
 
+/* Backends are initialized in order, each one overriding what the previous
+ * ones have set up, so limiting to one backend disables the later ones */
+#define BACKEND_ENABLED(backend, b) \
+	((backend) == SBC_BACKEND_AUTO || (b) <= (backend))
+
 /*
  * A reference C code of analysis filter with SIMD-friendly tables
  * reordering and code layout. This code can be used to develop platform
@@ -284,18 +291,52 @@ static SBC_ALWAYS_INLINE int sbc_encoder_process_input_s8_internal(
 {
 	/* handle X buffer wraparound */
 	if (position < nsamples) {
+		/* a half filled chunk of 16 samples (mSBC) has to be kept
+		 * together with the data following it */
+		int half = position & 8;
 		if (nchannels > 0)
-			memcpy(&X[0][SBC_X_BUFFER_SIZE - 72], &X[0][position],
-							72 * sizeof(int16_t));
+			memcpy(&X[0][SBC_X_BUFFER_SIZE - 72 - 2 * half],
+				&X[0][position - half],
+				(72 + half) * sizeof(int16_t));
 		if (nchannels > 1)
-			memcpy(&X[1][SBC_X_BUFFER_SIZE - 72], &X[1][position],
-							72 * sizeof(int16_t));
-		position = SBC_X_BUFFER_SIZE - 72;
+			memcpy(&X[1][SBC_X_BUFFER_SIZE - 72 - 2 * half],
+				&X[1][position - half],
+				(72 + half) * sizeof(int16_t));
+		position = SBC_X_BUFFER_SIZE - 72 - half;
 	}
 
 	#define PCM(i) (big_endian ? \
 		unaligned16_be(pcm + (i) * 2) : unaligned16_le(pcm + (i) * 2))
 
+	/* complete the chunk which was half filled by the previous call */
+	if (position & 8) {
+		position -= 8;
+		nsamples -= 8;
+		if (nchannels > 0) {
+			int16_t *x = &X[0][position];
+			x[0]  = PCM(0 + 7 * nchannels);
+			x[2]  = PCM(0 + 6 * nchannels);
+			x[3]  = PCM(0 + 0 * nchannels);
+			x[4]  = PCM(0 + 5 * nchannels);
+			x[5]  = PCM(0 + 1 * nchannels);
+			x[6]  = PCM(0 + 4 * nchannels);
+			x[7]  = PCM(0 + 2 * nchannels);
+			x[8]  = PCM(0 + 3 * nchannels);
+		}
+		if (nchannels > 1) {
+			int16_t *x = &X[1][position];
+			x[0]  = PCM(1 + 7 * nchannels);
+			x[2]  = PCM(1 + 6 * nchannels);
+			x[3]  = PCM(1 + 0 * nchannels);
+			x[4]  = PCM(1 + 5 * nchannels);
+			x[5]  = PCM(1 + 1 * nchannels);
+			x[6]  = PCM(1 + 4 * nchannels);
+			x[7]  = PCM(1 + 2 * nchannels);
+			x[8]  = PCM(1 + 3 * nchannels);
+		}
+		pcm += 16 * nchannels;
+	}
+
 	/* copy/permutate audio samples */
 	while ((nsamples -= 16) >= 0) {
 		position -= 16;
@@ -339,6 +380,33 @@ static SBC_ALWAYS_INLINE int sbc_encoder_process_input_s8_internal(
 		}
 		pcm += 32 * nchannels;
 	}
+
+	/* only the first half of the next chunk is available (mSBC) */
+	if (nsamples + 16 == 8) {
+		position -= 8;
+		if (nchannels > 0) {
+			int16_t *x = &X[0][position];
+			x[-7] = PCM(0 + 7 * nchannels);
+			x[1]  = PCM(0 + 3 * nchannels);
+			x[2]  = PCM(0 + 6 * nchannels);
+			x[3]  = PCM(0 + 0 * nchannels);
+			x[4]  = PCM(0 + 5 * nchannels);
+			x[5]  = PCM(0 + 1 * nchannels);
+			x[6]  = PCM(0 + 4 * nchannels);
+			x[7]  = PCM(0 + 2 * nchannels);
+		}
+		if (nchannels > 1) {
+			int16_t *x = &X[1][position];
+			x[-7] = PCM(1 + 7 * nchannels);
+			x[1]  = PCM(1 + 3 * nchannels);
+			x[2]  = PCM(1 + 6 * nchannels);
+			x[3]  = PCM(1 + 0 * nchannels);
+			x[4]  = PCM(1 + 5 * nchannels);
+			x[5]  = PCM(1 + 1 * nchannels);
+			x[6]  = PCM(1 + 4 * nchannels);
+			x[7]  = PCM(1 + 2 * nchannels);
+		}
+	}
 	#undef PCM
 
 	return position;
@@ -516,14 +584,99 @@ static int sbc_calc_scalefactors_j(
 	return joint;
 }
 
+/*
+ * A reference C code of synthesis filter with SIMD-friendly tables
+ * reordering and history layout. The "v" pointer is expected to point to
+ * the place for the newest block, followed by the 9 previous blocks. Each
+ * block holds (2 * nrof_subbands) matrixing results, so the windowing part
+ * only needs to multiply contiguous runs of data by contiguous runs of
+ * constants and does not have to maintain any per-sample offsets.
+ */
+
+static SBC_ALWAYS_INLINE int16_t sbc_clip16(int32_t s)
+{
+	if (s > 0x7FFF)
+		return 0x7FFF;
+	else if (s < -0x8000)
+		return -0x8000;
+	else
+		return s;
+}
+
+static void sbc_synthesize_4s_simd(int32_t *v, const int32_t *in,
+								int16_t *out)
+{
+	int32_t t[8];
+	int i, j;
+
+	/* matrixing */
+	for (i = 0; i < 8; i++)
+		t[i] = 0;
+
+	for (j = 0; j < 4; j++)
+		for (i = 0; i < 8; i++)
+			t[i] += synmatrix4_simd[j][i] * in[j];
+
+	for (i = 0; i < 8; i++)
+		v[i] = SCALE4_STAGED1(t[i]);
+
+	/* windowing */
+	for (i = 0; i < 4; i++)
+		t[i] = 0;
+
+	for (j = 0; j < 5; j++, v += 16) {
+		for (i = 0; i < 4; i++) {
+			t[i] += v[i] * sbc_proto_4_40_simd[j][i];
+			t[i] += v[12 + i] * sbc_proto_4_40_simd[j][4 + i];
+		}
+	}
+
+	for (i = 0; i < 4; i++)
+		out[i] = sbc_clip16(SCALE4_STAGED1(t[i]));
+}
+
+static void sbc_synthesize_8s_simd(int32_t *v, const int32_t *in,
+								int16_t *out)
+{
+	int32_t t[16];
+	int i, j;
+
+	/* matrixing */
+	for (i = 0; i < 16; i++)
+		t[i] = 0;
+
+	for (j = 0; j < 8; j++)
+		for (i = 0; i < 16; i++)
+			t[i] += synmatrix8_simd[j][i] * in[j];
+
+	for (i = 0; i < 16; i++)
+		v[i] = SCALE8_STAGED1(t[i]);
+
+	/* windowing */
+	for (i = 0; i < 8; i++)
+		t[i] = 0;
+
+	for (j = 0; j < 5; j++, v += 32) {
+		for (i = 0; i < 8; i++) {
+			t[i] += v[i] * sbc_proto_8_80_simd[j][i];
+			t[i] += v[24 + i] * sbc_proto_8_80_simd[j][8 + i];
+		}
+	}
+
+	for (i = 0; i < 8; i++)
+		out[i] = sbc_clip16(SCALE8_STAGED1(t[i]));
+}
+
 /*
  * Detect CPU features and setup function pointers
  */
-void sbc_init_primitives(struct sbc_encoder_state *state)
+void sbc_init_primitives(struct sbc_encoder_state *state,
+						unsigned long backend)
 {
 	/* Default implementation for analyze functions */
 	state->sbc_analyze_4b_4s = sbc_analyze_4b_4s_simd;
 	state->sbc_analyze_4b_8s = sbc_analyze_4b_8s_simd;
+	state->sbc_analyze_1b_8s = sbc_analyze_eight_simd;
 
 	/* Default implementation for input reordering / deinterleaving */
 	state->sbc_enc_process_input_4s_le = sbc_enc_process_input_4s_le;
@@ -538,17 +691,66 @@ void sbc_init_primitives(struct sbc_encoder_state *state)
 
 	/* X86/AMD64 optimizations */
 #ifdef SBC_BUILD_WITH_MMX_SUPPORT
-	sbc_init_primitives_mmx(state);
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_MMX))
+		sbc_init_primitives_mmx(state);
+#endif
+#ifdef SBC_BUILD_WITH_SSE_SUPPORT
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_SSE))
+		sbc_init_primitives_sse(state);
+#endif
+#ifdef SBC_BUILD_WITH_AVX2_SUPPORT
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_AVX2))
+		sbc_init_primitives_avx2(state);
 #endif
 
 	/* ARM optimizations */
 #ifdef SBC_BUILD_WITH_ARMV6_SUPPORT
-	sbc_init_primitives_armv6(state);
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_ARMV6))
+		sbc_init_primitives_armv6(state);
 #endif
 #ifdef SBC_BUILD_WITH_IWMMXT_SUPPORT
-	sbc_init_primitives_iwmmxt(state);
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_IWMMXT))
+		sbc_init_primitives_iwmmxt(state);
+#endif
+#ifdef SBC_BUILD_WITH_NEON_SUPPORT
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_NEON))
+		sbc_init_primitives_neon(state);
 #endif
+
+	/* mSBC frames have 120 samples, which is not a multiple of the
+	 * 16 samples chunks handled by the optimized input processing */
+	if (state->increment == 1) {
+		state->sbc_enc_process_input_8s_le =
+					sbc_enc_process_input_8s_le;
+		state->sbc_enc_process_input_8s_be =
+					sbc_enc_process_input_8s_be;
+	}
+}
+
+/*
+ * Detect CPU features and setup decoder function pointers
+ */
+void sbc_init_decoder_primitives(struct sbc_decoder_state *state,
+						unsigned long backend)
+{
+	/* Default implementation for synthesis functions */
+	state->sbc_synthesize_4s = sbc_synthesize_4s_simd;
+	state->sbc_synthesize_8s = sbc_synthesize_8s_simd;
+	state->implementation_info = "Generic C";
+
+	/* X86/AMD64 optimizations */
+#ifdef SBC_BUILD_WITH_SSE_SUPPORT
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_SSE))
+		sbc_init_decoder_primitives_sse4(state);
+#endif
+#ifdef SBC_BUILD_WITH_AVX2_SUPPORT
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_AVX2))
+		sbc_init_decoder_primitives_avx2(state);
+#endif
+
+	/* ARM optimizations */
 #ifdef SBC_BUILD_WITH_NEON_SUPPORT
-	sbc_init_primitives_neon(state);
+	if (BACKEND_ENABLED(backend, SBC_BACKEND_NEON))
+		sbc_init_decoder_primitives_neon(state);
 #endif
 }
@@ -29,6 +29,7 @@
 
 #define SCALE_OUT_BITS 15
 #define SBC_X_BUFFER_SIZE 328
+#define SBC_V_BUFFER_SIZE 416
 
 #ifdef __GNUC__
 #define SBC_ALWAYS_INLINE __attribute__((always_inline))
@@ -38,6 +39,9 @@
 
 struct sbc_encoder_state {
 	int position;
+	/* Number of blocks handled by one analysis call, 4 normally and 1
+	 * for mSBC, which has 15 blocks per frame */
+	int increment;
 	int16_t SBC_ALIGNED X[2][SBC_X_BUFFER_SIZE];
 	/* Polyphase analysis filter for 4 subbands configuration,
 	 * it handles 4 blocks at once */
@@ -45,6 +49,10 @@ struct sbc_encoder_state {
 	/* Polyphase analysis filter for 8 subbands configuration,
 	 * it handles 4 blocks at once */
 	void (*sbc_analyze_4b_8s)(int16_t *x, int32_t *out, int out_stride);
+	/* Polyphase analysis filter for 8 subbands configuration,
+	 * it handles a single block using the given coefficients */
+	void (*sbc_analyze_1b_8s)(const int16_t *x, int32_t *out,
+			const FIXED_T *consts);
 	/* Process input data (deinterleave, endian conversion, reordering),
 	 * depending on the number of subbands and input data byte order */
 	int (*sbc_enc_process_input_4s_le)(int position,
@@ -70,11 +78,29 @@ struct sbc_encoder_state {
 	const char *implementation_info;
 };
 
+struct sbc_decoder_state {
+	int subbands;
+	int position;
+	/* Synthesis filter history, newest block first. Each block occupies
+	 * (2 * nrof_subbands) consecutive entries */
+	int32_t SBC_ALIGNED V[2][SBC_V_BUFFER_SIZE];
+	/* Polyphase synthesis filter for 4 subbands configuration,
+	 * it handles 1 block at once */
+	void (*sbc_synthesize_4s)(int32_t *v, const int32_t *in, int16_t *out);
+	/* Polyphase synthesis filter for 8 subbands configuration,
+	 * it handles 1 block at once */
+	void (*sbc_synthesize_8s)(int32_t *v, const int32_t *in, int16_t *out);
+	const char *implementation_info;
+};
+
 /*
  * Initialize pointers to the functions which are the basic "building bricks"
  * of SBC codec. Best implementation is selected based on target CPU
  * capabilities.
  */
-void sbc_init_primitives(struct sbc_encoder_state *encoder_state);
+void sbc_init_primitives(struct sbc_encoder_state *encoder_state,
+							unsigned long backend);
+void sbc_init_decoder_primitives(struct sbc_decoder_state *decoder_state,
+							unsigned long backend);
 
 #endif
@@ -0,0 +1,435 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) library
+ *
+ *  Copyright (C) 2008-2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *  Copyright (C) 2004-2005  Henryk Ploetz <henryk@ploetzli.ch>
+ *  Copyright (C) 2005-2006  Brad Midgley <bmidgley@xmission.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <limits.h>
+#include "sbc.h"
+#include "sbc_math.h"
+#include "sbc_tables.h"
+
+#include "sbc_primitives_avx2.h"
+#include "sbc_primitives_x86.h"
+
+/*
+ * AVX2 optimizations
+ */
+
+#ifdef SBC_BUILD_WITH_AVX2_SUPPORT
+
+static inline void sbc_analyze_eight_avx2(const int16_t *in, int32_t *out,
+							const FIXED_T *consts)
+{
+	static const SBC_ALIGNED int32_t round_c[8] = {
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+	};
+	asm volatile (
+		"vmovdqu        (%0), %%ymm0\n"
+		"vmovdqu      32(%0), %%ymm1\n"
+		"vpmaddwd       (%1), %%ymm0, %%ymm0\n"
+		"vpmaddwd     32(%1), %%ymm1, %%ymm1\n"
+		"vpaddd         (%2), %%ymm0, %%ymm0\n"
+		"vpaddd       %%ymm1, %%ymm0, %%ymm0\n"
+		"\n"
+		"vmovdqu      64(%0), %%ymm1\n"
+		"vmovdqu      96(%0), %%ymm2\n"
+		"vmovdqu     128(%0), %%ymm3\n"
+		"vpmaddwd     64(%1), %%ymm1, %%ymm1\n"
+		"vpmaddwd     96(%1), %%ymm2, %%ymm2\n"
+		"vpmaddwd    128(%1), %%ymm3, %%ymm3\n"
+		"vpaddd       %%ymm1, %%ymm0, %%ymm0\n"
+		"vpaddd       %%ymm2, %%ymm0, %%ymm0\n"
+		"vpaddd       %%ymm3, %%ymm0, %%ymm0\n"
+		"\n"
+		"vpsrad           %4, %%ymm0, %%ymm0\n"
+		"vextracti128     $1, %%ymm0, %%xmm1\n"
+		"vpackssdw    %%xmm1, %%xmm0, %%xmm0\n"
+		"vinserti128      $1, %%xmm0, %%ymm0, %%ymm0\n"
+		"\n"
+		"vpshufd       $0x00, %%ymm0, %%ymm4\n"
+		"vpshufd       $0x55, %%ymm0, %%ymm1\n"
+		"vpshufd       $0xaa, %%ymm0, %%ymm2\n"
+		"vpshufd       $0xff, %%ymm0, %%ymm3\n"
+		"vpmaddwd    160(%1), %%ymm4, %%ymm4\n"
+		"vpmaddwd    192(%1), %%ymm1, %%ymm1\n"
+		"vpmaddwd    224(%1), %%ymm2, %%ymm2\n"
+		"vpmaddwd    256(%1), %%ymm3, %%ymm3\n"
+		"vpaddd       %%ymm1, %%ymm4, %%ymm4\n"
+		"vpaddd       %%ymm3, %%ymm2, %%ymm2\n"
+		"vpaddd       %%ymm2, %%ymm4, %%ymm4\n"
+		"\n"
+		"vmovdqu      %%ymm4, (%3)\n"
+		:
+		: "r" (in), "r" (consts), "r" (&round_c), "r" (out),
+			"i" (SBC_PROTO_FIXED8_SCALE)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm2", "xmm3", "xmm4");
+}
+
+static inline void sbc_analyze_4b_8s_avx2(int16_t *x, int32_t *out,
+						int out_stride)
+{
+	/* Analyze blocks */
+	sbc_analyze_eight_avx2(x + 24, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_avx2(x + 16, out, analysis_consts_fixed8_simd_even);
+	out += out_stride;
+	sbc_analyze_eight_avx2(x + 8, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_avx2(x + 0, out, analysis_consts_fixed8_simd_even);
+
+	asm volatile ("vzeroupper\n" : : : SBC_VZEROUPPER_CLOBBERS);
+}
+
+static const SBC_ALIGNED int32_t sbc_scalefactor_consts_avx2[16] = {
+	1 << SCALE_OUT_BITS, 1 << SCALE_OUT_BITS,
+	1 << SCALE_OUT_BITS, 1 << SCALE_OUT_BITS,
+	1 << SCALE_OUT_BITS, 1 << SCALE_OUT_BITS,
+	1 << SCALE_OUT_BITS, 1 << SCALE_OUT_BITS,
+	0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+/*
+ * Accumulate (by OR operation) the (abs(sample) - 1) values of all the
+ * nonzero samples for 8 adjacent subbands. When there are only 4 subbands,
+ * the upper half of the result is just ignored by the caller.
+ */
+static inline void sbc_accumulate_scalefactors_avx2(int32_t *sb_sample_f,
+					intptr_t blk, uint32_t *acc)
+{
+	asm volatile (
+		"vmovdqu        (%3), %%ymm0\n"
+	"1:\n"
+		"vmovdqu    (%1, %0), %%ymm1\n"
+		"vpcmpgtd     32(%3), %%ymm1, %%ymm2\n"
+		"vpaddd       %%ymm1, %%ymm2, %%ymm2\n"
+		"vpsrad          $31, %%ymm2, %%ymm1\n"
+		"vpxor        %%ymm2, %%ymm1, %%ymm1\n"
+		"vpor         %%ymm1, %%ymm0, %%ymm0\n"
+
+		"sub              %4, %0\n"
+		"jns              1b\n"
+
+		"vmovdqu      %%ymm0, (%2)\n"
+		"vzeroupper\n"
+		: "+r" (blk)
+		: "r" (sb_sample_f), "r" (acc),
+			"r" (sbc_scalefactor_consts_avx2),
+			"i" (sizeof(int32_t) * 2 * 8)
+		: "cc", "memory",
+			SBC_VZEROUPPER_CLOBBERS);
+}
+
+static void sbc_calc_scalefactors_avx2(
+	int32_t sb_sample_f[16][2][8],
+	uint32_t scale_factor[2][8],
+	int blocks, int channels, int subbands)
+{
+	uint32_t acc[8];
+	int ch, sb;
+
+	for (ch = 0; ch < channels; ch++) {
+		sbc_accumulate_scalefactors_avx2(&sb_sample_f[0][ch][0],
+				(blocks - 1) * sizeof(sb_sample_f[0]), acc);
+		for (sb = 0; sb < subbands; sb++)
+			scale_factor[ch][sb] = (31 - SCALE_OUT_BITS) -
+							__builtin_clz(acc[sb]);
+	}
+}
+
+/*
+ * Same as above, but for both channels at once and also for their joint
+ * stereo (mid/side) representation
+ */
+static inline void sbc_accumulate_scalefactors_j_avx2(int32_t *sb_sample_f,
+					intptr_t blk, uint32_t acc[4][8])
+{
+	asm volatile (
+		"vmovdqu        (%3), %%ymm0\n"
+		"vmovdqa      %%ymm0, %%ymm1\n"
+		"vmovdqa      %%ymm0, %%ymm2\n"
+		"vmovdqa      %%ymm0, %%ymm3\n"
+	"1:\n"
+		"vmovdqu    (%1, %0), %%ymm4\n"
+		"vmovdqu  32(%1, %0), %%ymm5\n"
+
+		"vpcmpgtd     32(%3), %%ymm4, %%ymm7\n"
+		"vpaddd       %%ymm4, %%ymm7, %%ymm7\n"
+		"vpsrad          $31, %%ymm7, %%ymm6\n"
+		"vpxor        %%ymm7, %%ymm6, %%ymm6\n"
+		"vpor         %%ymm6, %%ymm0, %%ymm0\n"
+
+		"vpcmpgtd     32(%3), %%ymm5, %%ymm7\n"
+		"vpaddd       %%ymm5, %%ymm7, %%ymm7\n"
+		"vpsrad          $31, %%ymm7, %%ymm6\n"
+		"vpxor        %%ymm7, %%ymm6, %%ymm6\n"
+		"vpor         %%ymm6, %%ymm1, %%ymm1\n"
+
+		"vpsrad           $1, %%ymm4, %%ymm4\n"
+		"vpsrad           $1, %%ymm5, %%ymm5\n"
+		"vpaddd       %%ymm5, %%ymm4, %%ymm6\n"
+		"vpsubd       %%ymm5, %%ymm4, %%ymm4\n"
+
+		"vpcmpgtd     32(%3), %%ymm6, %%ymm7\n"
+		"vpaddd       %%ymm6, %%ymm7, %%ymm7\n"
+		"vpsrad          $31, %%ymm7, %%ymm6\n"
+		"vpxor        %%ymm7, %%ymm6, %%ymm6\n"
+		"vpor         %%ymm6, %%ymm2, %%ymm2\n"
+
+		"vpcmpgtd     32(%3), %%ymm4, %%ymm7\n"
+		"vpaddd       %%ymm4, %%ymm7, %%ymm7\n"
+		"vpsrad          $31, %%ymm7, %%ymm6\n"
+		"vpxor        %%ymm7, %%ymm6, %%ymm6\n"
+		"vpor         %%ymm6, %%ymm3, %%ymm3\n"
+
+		"sub              %4, %0\n"
+		"jns              1b\n"
+
+		"vmovdqu      %%ymm0, (%2)\n"
+		"vmovdqu      %%ymm1, 32(%2)\n"
+		"vmovdqu      %%ymm2, 64(%2)\n"
+		"vmovdqu      %%ymm3, 96(%2)\n"
+		"vzeroupper\n"
+		: "+r" (blk)
+		: "r" (sb_sample_f), "r" (acc),
+			"r" (sbc_scalefactor_consts_avx2),
+			"i" (sizeof(int32_t) * 2 * 8)
+		: "cc", "memory",
+			SBC_VZEROUPPER_CLOBBERS);
+}
+
+static int sbc_calc_scalefactors_j_avx2(
+	int32_t sb_sample_f[16][2][8],
+	uint32_t scale_factor[2][8],
+	int blocks, int subbands)
+{
+	uint32_t acc[4][8];
+	int blk, sb, joint = 0;
+	uint32_t x, y;
+
+	sbc_accumulate_scalefactors_j_avx2(&sb_sample_f[0][0][0],
+				(blocks - 1) * sizeof(sb_sample_f[0]), acc);
+
+	for (sb = 0; sb < subbands; sb++) {
+		scale_factor[0][sb] = (31 - SCALE_OUT_BITS) -
+						__builtin_clz(acc[0][sb]);
+		scale_factor[1][sb] = (31 - SCALE_OUT_BITS) -
+						__builtin_clz(acc[1][sb]);
+	}
+
+	/* last subband does not use joint stereo */
+	for (sb = 0; sb < subbands - 1; sb++) {
+		x = (31 - SCALE_OUT_BITS) - __builtin_clz(acc[2][sb]);
+		y = (31 - SCALE_OUT_BITS) - __builtin_clz(acc[3][sb]);
+
+		/* decide whether to use joint stereo for this subband */
+		if ((scale_factor[0][sb] + scale_factor[1][sb]) > x + y) {
+			joint |= 1 << (subbands - 1 - sb);
+			scale_factor[0][sb] = x;
+			scale_factor[1][sb] = y;
+			for (blk = 0; blk < blocks; blk++) {
+				int32_t tmp0 = sb_sample_f[blk][0][sb];
+				int32_t tmp1 = sb_sample_f[blk][1][sb];
+				sb_sample_f[blk][0][sb] =
+					ASR(tmp0, 1) + ASR(tmp1, 1);
+				sb_sample_f[blk][1][sb] =
+					ASR(tmp0, 1) - ASR(tmp1, 1);
+			}
+		}
+	}
+
+	/* bitmask with the information about subbands using joint stereo */
+	return joint;
+}
+
+static inline void sbc_synthesize_matrix_4s_avx2(int32_t *v,
+					const int32_t *in, const int32_t *consts)
+{
+	int n = 4;
+	asm volatile (
+		"vpxor      %%ymm0, %%ymm0, %%ymm0\n"
+	"1:\n"
+		"vpbroadcastd (%0), %%ymm4\n"
+		"vpmulld      (%1), %%ymm4, %%ymm5\n"
+		"vpaddd     %%ymm5, %%ymm0, %%ymm0\n"
+		"add            $4, %0\n"
+		"add           $32, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"vpsrad         %4, %%ymm0, %%ymm0\n"
+		"vmovdqu    %%ymm0, (%3)\n"
+		"vzeroupper\n"
+		: "+r" (in), "+r" (consts), "+r" (n)
+		: "r" (v), "i" (SCALE4_STAGED1_BITS)
+		: "cc", "memory",
+			SBC_VZEROUPPER_CLOBBERS);
+}
+
+static inline void sbc_synthesize_window_4s_avx2(const int32_t *v,
+					int16_t *out, const int32_t *consts)
+{
+	int n = 5;
+	asm volatile (
+		"vpxor      %%xmm0, %%xmm0, %%xmm0\n"
+	"1:\n"
+		"vmovdqu      (%0), %%xmm2\n"
+		"vmovdqu    48(%0), %%xmm3\n"
+		"vpmulld      (%1), %%xmm2, %%xmm2\n"
+		"vpmulld    16(%1), %%xmm3, %%xmm3\n"
+		"vpaddd     %%xmm2, %%xmm0, %%xmm0\n"
+		"vpaddd     %%xmm3, %%xmm0, %%xmm0\n"
+		"add           $64, %0\n"
+		"add           $32, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"vpsrad         %4, %%xmm0, %%xmm0\n"
+		"vpackssdw  %%xmm0, %%xmm0, %%xmm0\n"
+		"vmovq      %%xmm0, (%3)\n"
+		: "+r" (v), "+r" (consts), "+r" (n)
+		: "r" (out), "i" (SCALE4_STAGED1_BITS)
+		: "cc", "memory",
+			"xmm0", "xmm2", "xmm3");
+}
+
+static inline void sbc_synthesize_matrix_8s_avx2(int32_t *v,
+					const int32_t *in, const int32_t *consts)
+{
+	int n = 8;
+	asm volatile (
+		"vpxor      %%ymm0, %%ymm0, %%ymm0\n"
+		"vpxor      %%ymm1, %%ymm1, %%ymm1\n"
+	"1:\n"
+		"vpbroadcastd (%0), %%ymm4\n"
+		"vpmulld      (%1), %%ymm4, %%ymm5\n"
+		"vpmulld    32(%1), %%ymm4, %%ymm6\n"
+		"vpaddd     %%ymm5, %%ymm0, %%ymm0\n"
+		"vpaddd     %%ymm6, %%ymm1, %%ymm1\n"
+		"add            $4, %0\n"
+		"add           $64, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"vpsrad         %4, %%ymm0, %%ymm0\n"
+		"vpsrad         %4, %%ymm1, %%ymm1\n"
+		"vmovdqu    %%ymm0, (%3)\n"
+		"vmovdqu    %%ymm1, 32(%3)\n"
+		"vzeroupper\n"
+		: "+r" (in), "+r" (consts), "+r" (n)
+		: "r" (v), "i" (SCALE8_STAGED1_BITS)
+		: "cc", "memory",
+			SBC_VZEROUPPER_CLOBBERS);
+}
+
+static inline void sbc_synthesize_window_8s_avx2(const int32_t *v,
+					int16_t *out, const int32_t *consts)
+{
+	int n = 5;
+	asm volatile (
+		"vpxor      %%ymm0, %%ymm0, %%ymm0\n"
+	"1:\n"
+		"vmovdqu      (%0), %%ymm2\n"
+		"vmovdqu    96(%0), %%ymm3\n"
+		"vpmulld      (%1), %%ymm2, %%ymm2\n"
+		"vpmulld    32(%1), %%ymm3, %%ymm3\n"
+		"vpaddd     %%ymm2, %%ymm0, %%ymm0\n"
+		"vpaddd     %%ymm3, %%ymm0, %%ymm0\n"
+		"add          $128, %0\n"
+		"add           $64, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"vpsrad         %4, %%ymm0, %%ymm0\n"
+		"vextracti128 $1, %%ymm0, %%xmm1\n"
+		"vpackssdw  %%xmm1, %%xmm0, %%xmm0\n"
+		"vmovdqu    %%xmm0, (%3)\n"
+		"vzeroupper\n"
+		: "+r" (v), "+r" (consts), "+r" (n)
+		: "r" (out), "i" (SCALE8_STAGED1_BITS)
+		: "cc", "memory",
+			SBC_VZEROUPPER_CLOBBERS);
+}
+
+static void sbc_synthesize_4s_avx2(int32_t *v, const int32_t *in,
+								int16_t *out)
+{
+	sbc_synthesize_matrix_4s_avx2(v, in, synmatrix4_simd[0]);
+	sbc_synthesize_window_4s_avx2(v, out, sbc_proto_4_40_simd[0]);
+}
+
+static void sbc_synthesize_8s_avx2(int32_t *v, const int32_t *in,
+								int16_t *out)
+{
+	sbc_synthesize_matrix_8s_avx2(v, in, synmatrix8_simd[0]);
+	sbc_synthesize_window_8s_avx2(v, out, sbc_proto_8_80_simd[0]);
+}
+
+static int check_avx2_support(void)
+{
+	uint32_t regs[4];
+	uint32_t xcr0;
+
+	/* OS has to save YMM registers state (OSXSAVE + AVX) */
+	if (!sbc_cpuid_leaf(1, regs) || (regs[2] & (3 << 27)) != (3 << 27))
+		return 0;
+
+	asm volatile (
+		"xgetbv\n"
+		: "=a" (xcr0)
+		: "c" (0)
+		: "edx");
+	if ((xcr0 & 6) != 6)
+		return 0;
+
+	if (!sbc_cpuid_leaf(7, regs))
+		return 0;
+
+	return regs[1] & (1 << 5);
+}
+
+void sbc_init_primitives_avx2(struct sbc_encoder_state *state)
+{
+	if (check_avx2_support()) {
+		state->sbc_analyze_4b_8s = sbc_analyze_4b_8s_avx2;
+		state->sbc_calc_scalefactors = sbc_calc_scalefactors_avx2;
+		state->sbc_calc_scalefactors_j = sbc_calc_scalefactors_j_avx2;
+		state->implementation_info = "AVX2";
+	}
+}
+
+void sbc_init_decoder_primitives_avx2(struct sbc_decoder_state *state)
+{
+	if (check_avx2_support()) {
+		state->sbc_synthesize_4s = sbc_synthesize_4s_avx2;
+		state->sbc_synthesize_8s = sbc_synthesize_8s_avx2;
+		state->implementation_info = "AVX2";
+	}
+}
+
+#endif
@@ -877,11 +877,196 @@ static int sbc_enc_process_input_8s_le_neon(int position, const uint8_t *pcm,
 		position, pcm, X, nsamples, nchannels, 0);
 }
 
+static inline void sbc_synthesize_matrix_4s_neon(int32_t *v,
+					const int32_t *in, const int32_t *consts)
+{
+	asm volatile (
+		"vld1.32    {d0, d1}, [%2, :128]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vmul.i32   q8, q12, d0[0]\n"
+		"vmul.i32   q9, q13, d0[0]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d0[1]\n"
+		"vmla.i32   q9, q13, d0[1]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d1[0]\n"
+		"vmla.i32   q9, q13, d1[0]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d1[1]\n"
+		"vmla.i32   q9, q13, d1[1]\n"
+
+		"vshr.s32   q8, q8, %3\n"
+		"vshr.s32   q9, q9, %3\n"
+
+		"vst1.32    {d16, d17, d18, d19}, [%0, :128]\n"
+		: "+r" (v), "+r" (consts)
+		: "r" (in), "i" (SCALE4_STAGED1_BITS)
+		: "memory",
+			"d0", "d1", "d16", "d17", "d18", "d19",
+			"d24", "d25", "d26", "d27");
+}
+
+static inline void sbc_synthesize_window_4s_neon(const int32_t *v,
+					int16_t *out, const int32_t *consts)
+{
+	int n = 5;
+	asm volatile (
+		"vmov.i32   q0, #0\n"
+	"1:\n"
+		"vld1.32    {d16, d17}, [%0, :128]!\n"
+		"add        %0, %0, #32\n"
+		"vld1.32    {d18, d19}, [%0, :128]!\n"
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vmla.i32   q0, q8, q12\n"
+		"vmla.i32   q0, q9, q13\n"
+		"subs       %2, %2, #1\n"
+		"bne        1b\n"
+
+		"vqshrn.s32 d0, q0, %4\n"
+
+		"vst1.16    {d0}, [%3]\n"
+		: "+r" (v), "+r" (consts), "+r" (n)
+		: "r" (out), "i" (SCALE4_STAGED1_BITS)
+		: "cc", "memory",
+			"d0", "d1", "d16", "d17", "d18", "d19",
+			"d24", "d25", "d26", "d27");
+}
+
+static inline void sbc_synthesize_matrix_8s_neon(int32_t *v,
+					const int32_t *in, const int32_t *consts)
+{
+	asm volatile (
+		"vld1.32    {d0, d1, d2, d3}, [%2, :128]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmul.i32   q8, q12, d0[0]\n"
+		"vmul.i32   q9, q13, d0[0]\n"
+		"vmul.i32   q10, q14, d0[0]\n"
+		"vmul.i32   q11, q15, d0[0]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d0[1]\n"
+		"vmla.i32   q9, q13, d0[1]\n"
+		"vmla.i32   q10, q14, d0[1]\n"
+		"vmla.i32   q11, q15, d0[1]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d1[0]\n"
+		"vmla.i32   q9, q13, d1[0]\n"
+		"vmla.i32   q10, q14, d1[0]\n"
+		"vmla.i32   q11, q15, d1[0]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d1[1]\n"
+		"vmla.i32   q9, q13, d1[1]\n"
+		"vmla.i32   q10, q14, d1[1]\n"
+		"vmla.i32   q11, q15, d1[1]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d2[0]\n"
+		"vmla.i32   q9, q13, d2[0]\n"
+		"vmla.i32   q10, q14, d2[0]\n"
+		"vmla.i32   q11, q15, d2[0]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d2[1]\n"
+		"vmla.i32   q9, q13, d2[1]\n"
+		"vmla.i32   q10, q14, d2[1]\n"
+		"vmla.i32   q11, q15, d2[1]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d3[0]\n"
+		"vmla.i32   q9, q13, d3[0]\n"
+		"vmla.i32   q10, q14, d3[0]\n"
+		"vmla.i32   q11, q15, d3[0]\n"
+
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q8, q12, d3[1]\n"
+		"vmla.i32   q9, q13, d3[1]\n"
+		"vmla.i32   q10, q14, d3[1]\n"
+		"vmla.i32   q11, q15, d3[1]\n"
+
+		"vshr.s32   q8, q8, %3\n"
+		"vshr.s32   q9, q9, %3\n"
+		"vshr.s32   q10, q10, %3\n"
+		"vshr.s32   q11, q11, %3\n"
+
+		"vst1.32    {d16, d17, d18, d19}, [%0, :128]!\n"
+		"vst1.32    {d20, d21, d22, d23}, [%0, :128]\n"
+		: "+r" (v), "+r" (consts)
+		: "r" (in), "i" (SCALE8_STAGED1_BITS)
+		: "memory",
+			"d0", "d1", "d2", "d3",
+			"d16", "d17", "d18", "d19", "d20", "d21", "d22", "d23",
+			"d24", "d25", "d26", "d27", "d28", "d29", "d30", "d31");
+}
+
+static inline void sbc_synthesize_window_8s_neon(const int32_t *v,
+					int16_t *out, const int32_t *consts)
+{
+	int n = 5;
+	asm volatile (
+		"vmov.i32   q0, #0\n"
+		"vmov.i32   q1, #0\n"
+	"1:\n"
+		"vld1.32    {d16, d17, d18, d19}, [%0, :128]!\n"
+		"add        %0, %0, #64\n"
+		"vld1.32    {d20, d21, d22, d23}, [%0, :128]!\n"
+		"vld1.32    {d24, d25, d26, d27}, [%1, :128]!\n"
+		"vld1.32    {d28, d29, d30, d31}, [%1, :128]!\n"
+		"vmla.i32   q0, q8, q12\n"
+		"vmla.i32   q1, q9, q13\n"
+		"vmla.i32   q0, q10, q14\n"
+		"vmla.i32   q1, q11, q15\n"
+		"subs       %2, %2, #1\n"
+		"bne        1b\n"
+
+		"vqshrn.s32 d0, q0, %4\n"
+		"vqshrn.s32 d1, q1, %4\n"
+
+		"vst1.16    {d0, d1}, [%3]\n"
+		: "+r" (v), "+r" (consts), "+r" (n)
+		: "r" (out), "i" (SCALE8_STAGED1_BITS)
+		: "cc", "memory",
+			"d0", "d1", "d2", "d3",
+			"d16", "d17", "d18", "d19", "d20", "d21", "d22", "d23",
+			"d24", "d25", "d26", "d27", "d28", "d29", "d30", "d31");
+}
+
+static void sbc_synthesize_4s_neon(int32_t *v, const int32_t *in,
+								int16_t *out)
+{
+	sbc_synthesize_matrix_4s_neon(v, in, synmatrix4_simd[0]);
+	sbc_synthesize_window_4s_neon(v, out, sbc_proto_4_40_simd[0]);
+}
+
+static void sbc_synthesize_8s_neon(int32_t *v, const int32_t *in,
+								int16_t *out)
+{
+	sbc_synthesize_matrix_8s_neon(v, in, synmatrix8_simd[0]);
+	sbc_synthesize_window_8s_neon(v, out, sbc_proto_8_80_simd[0]);
+}
+
 void sbc_init_primitives_neon(struct sbc_encoder_state *state)
 {
 	state->sbc_analyze_4b_4s = sbc_analyze_4b_4s_neon;
 	state->sbc_analyze_4b_8s = sbc_analyze_4b_8s_neon;
-	state->sbc_calc_scalefactors = sbc_calc_scalefactors_neon;
+	state->sbc_analyze_1b_8s = _sbc_analyze_eight_neon;
+	/* processes 4 blocks per iteration, can't handle mSBC frames */
+	if (state->increment != 1)
+		state->sbc_calc_scalefactors = sbc_calc_scalefactors_neon;
 	state->sbc_calc_scalefactors_j = sbc_calc_scalefactors_j_neon;
 	state->sbc_enc_process_input_4s_le = sbc_enc_process_input_4s_le_neon;
 	state->sbc_enc_process_input_4s_be = sbc_enc_process_input_4s_be_neon;
@@ -890,4 +1075,11 @@ void sbc_init_primitives_neon(struct sbc_encoder_state *state)
 	state->implementation_info = "NEON";
 }
 
+void sbc_init_decoder_primitives_neon(struct sbc_decoder_state *state)
+{
+	state->sbc_synthesize_4s = sbc_synthesize_4s_neon;
+	state->sbc_synthesize_8s = sbc_synthesize_8s_neon;
+	state->implementation_info = "NEON";
+}
+
 #endif
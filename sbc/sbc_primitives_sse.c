@@ -0,0 +1,892 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) library
+ *
+ *  Copyright (C) 2008-2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *  Copyright (C) 2004-2005  Henryk Ploetz <henryk@ploetzli.ch>
+ *  Copyright (C) 2005-2006  Brad Midgley <bmidgley@xmission.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include "sbc.h"
+#include "sbc_math.h"
+#include "sbc_tables.h"
+
+#include "sbc_primitives_sse.h"
+#include "sbc_primitives_x86.h"
+
+/*
+ * SSE optimizations
+ */
+
+#ifdef SBC_BUILD_WITH_SSE_SUPPORT
+
+static inline void sbc_analyze_four_sse(const int16_t *in, int32_t *out,
+					const FIXED_T *consts)
+{
+	static const SBC_ALIGNED int32_t round_c[4] = {
+		1 << (SBC_PROTO_FIXED4_SCALE - 1),
+		1 << (SBC_PROTO_FIXED4_SCALE - 1),
+		1 << (SBC_PROTO_FIXED4_SCALE - 1),
+		1 << (SBC_PROTO_FIXED4_SCALE - 1),
+	};
+	asm volatile (
+		"movdqu       (%0), %%xmm0\n"
+		"movdqu     16(%0), %%xmm1\n"
+		"pmaddwd      (%1), %%xmm0\n"
+		"pmaddwd    16(%1), %%xmm1\n"
+		"paddd        (%2), %%xmm0\n"
+		"paddd      %%xmm1, %%xmm0\n"
+		"\n"
+		"movdqu     32(%0), %%xmm1\n"
+		"movdqu     48(%0), %%xmm2\n"
+		"movdqu     64(%0), %%xmm3\n"
+		"pmaddwd    32(%1), %%xmm1\n"
+		"pmaddwd    48(%1), %%xmm2\n"
+		"pmaddwd    64(%1), %%xmm3\n"
+		"paddd      %%xmm1, %%xmm0\n"
+		"paddd      %%xmm2, %%xmm0\n"
+		"paddd      %%xmm3, %%xmm0\n"
+		"\n"
+		"psrad          %4, %%xmm0\n"
+		"packssdw   %%xmm0, %%xmm0\n"
+		"\n"
+		"pshufd $0x00, %%xmm0, %%xmm1\n"
+		"pshufd $0x55, %%xmm0, %%xmm2\n"
+		"pmaddwd    80(%1), %%xmm1\n"
+		"pmaddwd    96(%1), %%xmm2\n"
+		"paddd      %%xmm2, %%xmm1\n"
+		"\n"
+		"movdqa     %%xmm1, (%3)\n"
+		:
+		: "r" (in), "r" (consts), "r" (&round_c), "r" (out),
+			"i" (SBC_PROTO_FIXED4_SCALE)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm2", "xmm3");
+}
+
+static inline void sbc_analyze_eight_sse(const int16_t *in, int32_t *out,
+							const FIXED_T *consts)
+{
+	static const SBC_ALIGNED int32_t round_c[4] = {
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+		1 << (SBC_PROTO_FIXED8_SCALE - 1),
+	};
+	asm volatile (
+		"movdqu       (%0), %%xmm0\n"
+		"movdqu     16(%0), %%xmm1\n"
+		"pmaddwd      (%1), %%xmm0\n"
+		"pmaddwd    16(%1), %%xmm1\n"
+		"paddd        (%2), %%xmm0\n"
+		"paddd        (%2), %%xmm1\n"
+		"\n"
+		"movdqu     32(%0), %%xmm2\n"
+		"movdqu     48(%0), %%xmm3\n"
+		"movdqu     64(%0), %%xmm4\n"
+		"movdqu     80(%0), %%xmm5\n"
+		"pmaddwd    32(%1), %%xmm2\n"
+		"pmaddwd    48(%1), %%xmm3\n"
+		"pmaddwd    64(%1), %%xmm4\n"
+		"pmaddwd    80(%1), %%xmm5\n"
+		"paddd      %%xmm2, %%xmm0\n"
+		"paddd      %%xmm3, %%xmm1\n"
+		"paddd      %%xmm4, %%xmm0\n"
+		"paddd      %%xmm5, %%xmm1\n"
+		"\n"
+		"movdqu     96(%0), %%xmm2\n"
+		"movdqu    112(%0), %%xmm3\n"
+		"movdqu    128(%0), %%xmm4\n"
+		"movdqu    144(%0), %%xmm5\n"
+		"pmaddwd    96(%1), %%xmm2\n"
+		"pmaddwd   112(%1), %%xmm3\n"
+		"pmaddwd   128(%1), %%xmm4\n"
+		"pmaddwd   144(%1), %%xmm5\n"
+		"paddd      %%xmm2, %%xmm0\n"
+		"paddd      %%xmm3, %%xmm1\n"
+		"paddd      %%xmm4, %%xmm0\n"
+		"paddd      %%xmm5, %%xmm1\n"
+		"\n"
+		"psrad          %4, %%xmm0\n"
+		"psrad          %4, %%xmm1\n"
+		"packssdw   %%xmm1, %%xmm0\n"
+		"\n"
+		"pshufd $0x00, %%xmm0, %%xmm4\n"
+		"pshufd $0x00, %%xmm0, %%xmm5\n"
+		"pmaddwd   160(%1), %%xmm4\n"
+		"pmaddwd   176(%1), %%xmm5\n"
+		"\n"
+		"pshufd $0x55, %%xmm0, %%xmm2\n"
+		"pshufd $0x55, %%xmm0, %%xmm3\n"
+		"pmaddwd   192(%1), %%xmm2\n"
+		"pmaddwd   208(%1), %%xmm3\n"
+		"paddd      %%xmm2, %%xmm4\n"
+		"paddd      %%xmm3, %%xmm5\n"
+		"\n"
+		"pshufd $0xaa, %%xmm0, %%xmm2\n"
+		"pshufd $0xaa, %%xmm0, %%xmm3\n"
+		"pmaddwd   224(%1), %%xmm2\n"
+		"pmaddwd   240(%1), %%xmm3\n"
+		"paddd      %%xmm2, %%xmm4\n"
+		"paddd      %%xmm3, %%xmm5\n"
+		"\n"
+		"pshufd $0xff, %%xmm0, %%xmm2\n"
+		"pshufd $0xff, %%xmm0, %%xmm3\n"
+		"pmaddwd   256(%1), %%xmm2\n"
+		"pmaddwd   272(%1), %%xmm3\n"
+		"paddd      %%xmm2, %%xmm4\n"
+		"paddd      %%xmm3, %%xmm5\n"
+		"\n"
+		"movdqa     %%xmm4, (%3)\n"
+		"movdqa     %%xmm5, 16(%3)\n"
+		:
+		: "r" (in), "r" (consts), "r" (&round_c), "r" (out),
+			"i" (SBC_PROTO_FIXED8_SCALE)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5");
+}
+
+static inline void sbc_analyze_4b_4s_sse(int16_t *x, int32_t *out,
+						int out_stride)
+{
+	/* Analyze blocks */
+	sbc_analyze_four_sse(x + 12, out, analysis_consts_fixed4_simd_odd);
+	out += out_stride;
+	sbc_analyze_four_sse(x + 8, out, analysis_consts_fixed4_simd_even);
+	out += out_stride;
+	sbc_analyze_four_sse(x + 4, out, analysis_consts_fixed4_simd_odd);
+	out += out_stride;
+	sbc_analyze_four_sse(x + 0, out, analysis_consts_fixed4_simd_even);
+}
+
+static inline void sbc_analyze_4b_8s_sse(int16_t *x, int32_t *out,
+						int out_stride)
+{
+	/* Analyze blocks */
+	sbc_analyze_eight_sse(x + 24, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_sse(x + 16, out, analysis_consts_fixed8_simd_even);
+	out += out_stride;
+	sbc_analyze_eight_sse(x + 8, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_sse(x + 0, out, analysis_consts_fixed8_simd_even);
+}
+
+/*
+ * For every one of 4 adjacent subbands accumulate (by OR operation)
+ * the (abs(sample) - 1) values of all the nonzero samples, the scale
+ * factor is then derived from the position of the most significant bit
+ */
+static inline void sbc_accumulate_scalefactors_sse(int32_t *sb_sample_f,
+					intptr_t blk, uint32_t *acc)
+{
+	static const SBC_ALIGNED int32_t consts[4] = {
+		1 << SCALE_OUT_BITS,
+		1 << SCALE_OUT_BITS,
+		1 << SCALE_OUT_BITS,
+		1 << SCALE_OUT_BITS,
+	};
+	asm volatile (
+		"movdqa       (%3), %%xmm0\n"
+	"1:\n"
+		"movdqa   (%1, %0), %%xmm1\n"
+		"pxor       %%xmm2, %%xmm2\n"
+		"pcmpgtd    %%xmm2, %%xmm1\n"
+		"paddd    (%1, %0), %%xmm1\n"
+		"pcmpgtd    %%xmm1, %%xmm2\n"
+		"pxor       %%xmm2, %%xmm1\n"
+
+		"por        %%xmm1, %%xmm0\n"
+
+		"sub            %4, %0\n"
+		"jns            1b\n"
+
+		"movdqu     %%xmm0, (%2)\n"
+		: "+r" (blk)
+		: "r" (sb_sample_f), "r" (acc), "r" (&consts),
+			"i" (sizeof(int32_t) * 2 * 8)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm2");
+}
+
+static void sbc_calc_scalefactors_sse(
+	int32_t sb_sample_f[16][2][8],
+	uint32_t scale_factor[2][8],
+	int blocks, int channels, int subbands)
+{
+	uint32_t acc[4];
+	int ch, sb, i;
+
+	for (ch = 0; ch < channels; ch++) {
+		for (sb = 0; sb < subbands; sb += 4) {
+			sbc_accumulate_scalefactors_sse(&sb_sample_f[0][ch][sb],
+				(blocks - 1) * sizeof(sb_sample_f[0]), acc);
+			for (i = 0; i < 4; i++)
+				scale_factor[ch][sb + i] = (31 - SCALE_OUT_BITS) -
+							__builtin_clz(acc[i]);
+		}
+	}
+}
+
+/*
+ * Same as above, but for both channels of 4 adjacent subbands at once and
+ * also for their joint stereo (mid/side) representation
+ */
+static inline void sbc_accumulate_scalefactors_j_sse(int32_t *sb_sample_f,
+					intptr_t blk, uint32_t acc[4][4])
+{
+	static const SBC_ALIGNED int32_t consts[8] = {
+		1 << SCALE_OUT_BITS,
+		1 << SCALE_OUT_BITS,
+		1 << SCALE_OUT_BITS,
+		1 << SCALE_OUT_BITS,
+		0, 0, 0, 0,
+	};
+	asm volatile (
+		"movdqa       (%3), %%xmm0\n"
+		"movdqa     %%xmm0, %%xmm1\n"
+		"movdqa     %%xmm0, %%xmm2\n"
+		"movdqa     %%xmm0, %%xmm3\n"
+	"1:\n"
+		"movdqa   (%1, %0), %%xmm4\n"
+		"movdqa 32(%1, %0), %%xmm5\n"
+		"movdqa     %%xmm4, %%xmm6\n"
+		"psrad          $1, %%xmm6\n"
+
+		"movdqa     %%xmm4, %%xmm7\n"
+		"pcmpgtd    16(%3), %%xmm7\n"
+		"paddd      %%xmm4, %%xmm7\n"
+		"movdqa     %%xmm7, %%xmm4\n"
+		"psrad         $31, %%xmm4\n"
+		"pxor       %%xmm7, %%xmm4\n"
+		"por        %%xmm4, %%xmm0\n"
+
+		"movdqa     %%xmm5, %%xmm4\n"
+		"psrad          $1, %%xmm4\n"
+
+		"movdqa     %%xmm5, %%xmm7\n"
+		"pcmpgtd    16(%3), %%xmm7\n"
+		"paddd      %%xmm5, %%xmm7\n"
+		"movdqa     %%xmm7, %%xmm5\n"
+		"psrad         $31, %%xmm5\n"
+		"pxor       %%xmm7, %%xmm5\n"
+		"por        %%xmm5, %%xmm1\n"
+
+		"movdqa     %%xmm6, %%xmm5\n"
+		"paddd      %%xmm4, %%xmm5\n"
+		"psubd      %%xmm4, %%xmm6\n"
+
+		"movdqa     %%xmm5, %%xmm7\n"
+		"pcmpgtd    16(%3), %%xmm7\n"
+		"paddd      %%xmm5, %%xmm7\n"
+		"movdqa     %%xmm7, %%xmm5\n"
+		"psrad         $31, %%xmm5\n"
+		"pxor       %%xmm7, %%xmm5\n"
+		"por        %%xmm5, %%xmm2\n"
+
+		"movdqa     %%xmm6, %%xmm7\n"
+		"pcmpgtd    16(%3), %%xmm7\n"
+		"paddd      %%xmm6, %%xmm7\n"
+		"movdqa     %%xmm7, %%xmm6\n"
+		"psrad         $31, %%xmm6\n"
+		"pxor       %%xmm7, %%xmm6\n"
+		"por        %%xmm6, %%xmm3\n"
+
+		"sub            %4, %0\n"
+		"jns            1b\n"
+
+		"movdqu     %%xmm0, (%2)\n"
+		"movdqu     %%xmm1, 16(%2)\n"
+		"movdqu     %%xmm2, 32(%2)\n"
+		"movdqu     %%xmm3, 48(%2)\n"
+		: "+r" (blk)
+		: "r" (sb_sample_f), "r" (acc), "r" (&consts),
+			"i" (sizeof(int32_t) * 2 * 8)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm2", "xmm3",
+			"xmm4", "xmm5", "xmm6", "xmm7");
+}
+
+static int sbc_calc_scalefactors_j_sse(
+	int32_t sb_sample_f[16][2][8],
+	uint32_t scale_factor[2][8],
+	int blocks, int subbands)
+{
+	uint32_t acc[4][4];
+	int blk, sb, i, joint = 0;
+	uint32_t x, y;
+
+	for (sb = 0; sb < subbands; sb += 4) {
+		sbc_accumulate_scalefactors_j_sse(&sb_sample_f[0][0][sb],
+				(blocks - 1) * sizeof(sb_sample_f[0]), acc);
+
+		for (i = 0; i < 4; i++) {
+			scale_factor[0][sb + i] = (31 - SCALE_OUT_BITS) -
+						__builtin_clz(acc[0][i]);
+			scale_factor[1][sb + i] = (31 - SCALE_OUT_BITS) -
+						__builtin_clz(acc[1][i]);
+
+			/* last subband does not use joint stereo */
+			if (sb + i == subbands - 1)
+				break;
+
+			x = (31 - SCALE_OUT_BITS) - __builtin_clz(acc[2][i]);
+			y = (31 - SCALE_OUT_BITS) - __builtin_clz(acc[3][i]);
+
+			/* decide whether to use joint stereo for this subband */
+			if ((scale_factor[0][sb + i] +
+					scale_factor[1][sb + i]) > x + y) {
+				joint |= 1 << (subbands - 1 - (sb + i));
+				scale_factor[0][sb + i] = x;
+				scale_factor[1][sb + i] = y;
+				for (blk = 0; blk < blocks; blk++) {
+					int32_t tmp0 = sb_sample_f[blk][0][sb + i];
+					int32_t tmp1 = sb_sample_f[blk][1][sb + i];
+					sb_sample_f[blk][0][sb + i] =
+						ASR(tmp0, 1) + ASR(tmp1, 1);
+					sb_sample_f[blk][1][sb + i] =
+						ASR(tmp0, 1) - ASR(tmp1, 1);
+				}
+			}
+		}
+	}
+
+	/* bitmask with the information about subbands using joint stereo */
+	return joint;
+}
+
+/*
+ * Input data processing with SSSE3. Every output vector is gathered from
+ * the input vectors by "pshufb" instructions using precomputed tables of
+ * byte positions, which take care of channels deinterleaving, samples
+ * reordering and endian conversion at the same time.
+ */
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_4s_mono_le[16] = {
+	0x0e, 0x0f, 0x06, 0x07, 0x0c, 0x0d, 0x08, 0x09,
+	0x00, 0x01, 0x04, 0x05, 0x02, 0x03, 0x0a, 0x0b
+};
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_4s_mono_be[16] = {
+	0x0f, 0x0e, 0x07, 0x06, 0x0d, 0x0c, 0x09, 0x08,
+	0x01, 0x00, 0x05, 0x04, 0x03, 0x02, 0x0b, 0x0a
+};
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_4s_stereo_le[64] = {
+	0x80, 0x80, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80,
+	0x00, 0x01, 0x08, 0x09, 0x04, 0x05, 0x80, 0x80,
+	0x0c, 0x0d, 0x80, 0x80, 0x08, 0x09, 0x00, 0x01,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x04, 0x05,
+	0x80, 0x80, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80,
+	0x02, 0x03, 0x0a, 0x0b, 0x06, 0x07, 0x80, 0x80,
+	0x0e, 0x0f, 0x80, 0x80, 0x0a, 0x0b, 0x02, 0x03,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x06, 0x07
+};
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_4s_stereo_be[64] = {
+	0x80, 0x80, 0x0d, 0x0c, 0x80, 0x80, 0x80, 0x80,
+	0x01, 0x00, 0x09, 0x08, 0x05, 0x04, 0x80, 0x80,
+	0x0d, 0x0c, 0x80, 0x80, 0x09, 0x08, 0x01, 0x00,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x05, 0x04,
+	0x80, 0x80, 0x0f, 0x0e, 0x80, 0x80, 0x80, 0x80,
+	0x03, 0x02, 0x0b, 0x0a, 0x07, 0x06, 0x80, 0x80,
+	0x0f, 0x0e, 0x80, 0x80, 0x0b, 0x0a, 0x03, 0x02,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x07, 0x06
+};
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_8s_mono_le[64] = {
+	0x80, 0x80, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x0e, 0x0f, 0x80, 0x80, 0x0c, 0x0d, 0x00, 0x01,
+	0x0a, 0x0b, 0x02, 0x03, 0x08, 0x09, 0x04, 0x05,
+	0x80, 0x80, 0x06, 0x07, 0x0c, 0x0d, 0x00, 0x01,
+	0x0a, 0x0b, 0x02, 0x03, 0x08, 0x09, 0x04, 0x05,
+	0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_8s_mono_be[64] = {
+	0x80, 0x80, 0x0f, 0x0e, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x0f, 0x0e, 0x80, 0x80, 0x0d, 0x0c, 0x01, 0x00,
+	0x0b, 0x0a, 0x03, 0x02, 0x09, 0x08, 0x05, 0x04,
+	0x80, 0x80, 0x07, 0x06, 0x0d, 0x0c, 0x01, 0x00,
+	0x0b, 0x0a, 0x03, 0x02, 0x09, 0x08, 0x05, 0x04,
+	0x07, 0x06, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_8s_stereo_le[256] = {
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01,
+	0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x08, 0x09,
+	0x0c, 0x0d, 0x80, 0x80, 0x08, 0x09, 0x80, 0x80,
+	0x04, 0x05, 0x80, 0x80, 0x00, 0x01, 0x80, 0x80,
+	0x80, 0x80, 0x0c, 0x0d, 0x80, 0x80, 0x00, 0x01,
+	0x80, 0x80, 0x04, 0x05, 0x80, 0x80, 0x08, 0x09,
+	0x80, 0x80, 0x80, 0x80, 0x08, 0x09, 0x80, 0x80,
+	0x04, 0x05, 0x80, 0x80, 0x00, 0x01, 0x80, 0x80,
+	0x0c, 0x0d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02, 0x03,
+	0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x0a, 0x0b,
+	0x0e, 0x0f, 0x80, 0x80, 0x0a, 0x0b, 0x80, 0x80,
+	0x06, 0x07, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80,
+	0x80, 0x80, 0x0e, 0x0f, 0x80, 0x80, 0x02, 0x03,
+	0x80, 0x80, 0x06, 0x07, 0x80, 0x80, 0x0a, 0x0b,
+	0x80, 0x80, 0x80, 0x80, 0x0a, 0x0b, 0x80, 0x80,
+	0x06, 0x07, 0x80, 0x80, 0x02, 0x03, 0x80, 0x80,
+	0x0e, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+static const uint8_t SBC_ALIGNED sbc_ssse3_perm_8s_stereo_be[256] = {
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x0d, 0x0c, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0x00,
+	0x80, 0x80, 0x05, 0x04, 0x80, 0x80, 0x09, 0x08,
+	0x0d, 0x0c, 0x80, 0x80, 0x09, 0x08, 0x80, 0x80,
+	0x05, 0x04, 0x80, 0x80, 0x01, 0x00, 0x80, 0x80,
+	0x80, 0x80, 0x0d, 0x0c, 0x80, 0x80, 0x01, 0x00,
+	0x80, 0x80, 0x05, 0x04, 0x80, 0x80, 0x09, 0x08,
+	0x80, 0x80, 0x80, 0x80, 0x09, 0x08, 0x80, 0x80,
+	0x05, 0x04, 0x80, 0x80, 0x01, 0x00, 0x80, 0x80,
+	0x0d, 0x0c, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x0f, 0x0e, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x03, 0x02,
+	0x80, 0x80, 0x07, 0x06, 0x80, 0x80, 0x0b, 0x0a,
+	0x0f, 0x0e, 0x80, 0x80, 0x0b, 0x0a, 0x80, 0x80,
+	0x07, 0x06, 0x80, 0x80, 0x03, 0x02, 0x80, 0x80,
+	0x80, 0x80, 0x0f, 0x0e, 0x80, 0x80, 0x03, 0x02,
+	0x80, 0x80, 0x07, 0x06, 0x80, 0x80, 0x0b, 0x0a,
+	0x80, 0x80, 0x80, 0x80, 0x0b, 0x0a, 0x80, 0x80,
+	0x07, 0x06, 0x80, 0x80, 0x03, 0x02, 0x80, 0x80,
+	0x0f, 0x0e, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
+static inline void sbc_ssse3_permute1(const uint8_t *pcm, const uint8_t *m,
+					int16_t *x0)
+{
+	asm volatile (
+		"movdqu       (%0), %%xmm0\n"
+		"pshufb       (%1), %%xmm0\n"
+		"movdqu     %%xmm0, (%2)\n"
+		:
+		: "r" (pcm), "r" (m), "r" (x0)
+		: "memory",
+			"xmm0");
+}
+
+static inline void sbc_ssse3_permute2(const uint8_t *pcm, const uint8_t *m,
+					int16_t *x0, int16_t *x1)
+{
+	asm volatile (
+		"movdqu       (%0), %%xmm0\n"
+		"movdqu     16(%0), %%xmm1\n"
+		"movdqa     %%xmm0, %%xmm2\n"
+		"movdqa     %%xmm1, %%xmm3\n"
+		"pshufb       (%1), %%xmm2\n"
+		"pshufb     16(%1), %%xmm3\n"
+		"por        %%xmm3, %%xmm2\n"
+		"pshufb     32(%1), %%xmm0\n"
+		"pshufb     48(%1), %%xmm1\n"
+		"por        %%xmm1, %%xmm0\n"
+		"movdqu     %%xmm2, (%2)\n"
+		"movdqu     %%xmm0, (%3)\n"
+		:
+		: "r" (pcm), "r" (m), "r" (x0), "r" (x1)
+		: "memory",
+			"xmm0", "xmm1", "xmm2", "xmm3");
+}
+
+static inline void sbc_ssse3_permute4(const uint8_t *pcm, const uint8_t *m,
+					int16_t *x0, int16_t *x1)
+{
+	int i;
+
+	/* x0 and x1 get 16 samples each, using 4 masks per 8 samples */
+	for (i = 0; i < 4; i++) {
+		int16_t *x = (i < 2 ? x0 : x1) + (i & 1) * 8;
+		asm volatile (
+			"movdqu       (%0), %%xmm0\n"
+			"movdqu     16(%0), %%xmm1\n"
+			"movdqu     32(%0), %%xmm2\n"
+			"movdqu     48(%0), %%xmm3\n"
+			"pshufb       (%1), %%xmm0\n"
+			"pshufb     16(%1), %%xmm1\n"
+			"pshufb     32(%1), %%xmm2\n"
+			"pshufb     48(%1), %%xmm3\n"
+			"por        %%xmm1, %%xmm0\n"
+			"por        %%xmm3, %%xmm2\n"
+			"por        %%xmm2, %%xmm0\n"
+			"movdqu     %%xmm0, (%2)\n"
+			:
+			: "r" (pcm), "r" (m + i * 64), "r" (x)
+			: "memory",
+				"xmm0", "xmm1", "xmm2", "xmm3");
+	}
+}
+
+static SBC_ALWAYS_INLINE int sbc_encoder_process_input_s4_ssse3(
+	int position,
+	const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+	int nsamples, int nchannels, const uint8_t *masks)
+{
+	/* handle X buffer wraparound */
+	if (position < nsamples) {
+		if (nchannels > 0)
+			memcpy(&X[0][SBC_X_BUFFER_SIZE - 40], &X[0][position],
+							36 * sizeof(int16_t));
+		if (nchannels > 1)
+			memcpy(&X[1][SBC_X_BUFFER_SIZE - 40], &X[1][position],
+							36 * sizeof(int16_t));
+		position = SBC_X_BUFFER_SIZE - 40;
+	}
+
+	/* copy/permutate audio samples */
+	while ((nsamples -= 8) >= 0) {
+		position -= 8;
+		if (nchannels > 1)
+			sbc_ssse3_permute2(pcm, masks,
+					&X[0][position], &X[1][position]);
+		else
+			sbc_ssse3_permute1(pcm, masks, &X[0][position]);
+		pcm += 16 * nchannels;
+	}
+
+	return position;
+}
+
+static SBC_ALWAYS_INLINE int sbc_encoder_process_input_s8_ssse3(
+	int position,
+	const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+	int nsamples, int nchannels, const uint8_t *masks)
+{
+	/* handle X buffer wraparound */
+	if (position < nsamples) {
+		if (nchannels > 0)
+			memcpy(&X[0][SBC_X_BUFFER_SIZE - 72], &X[0][position],
+							72 * sizeof(int16_t));
+		if (nchannels > 1)
+			memcpy(&X[1][SBC_X_BUFFER_SIZE - 72], &X[1][position],
+							72 * sizeof(int16_t));
+		position = SBC_X_BUFFER_SIZE - 72;
+	}
+
+	/* copy/permutate audio samples */
+	while ((nsamples -= 16) >= 0) {
+		position -= 16;
+		if (nchannels > 1)
+			sbc_ssse3_permute4(pcm, masks,
+					&X[0][position], &X[1][position]);
+		else
+			sbc_ssse3_permute2(pcm, masks,
+					&X[0][position], &X[0][position + 8]);
+		pcm += 32 * nchannels;
+	}
+
+	return position;
+}
+
+static int sbc_enc_process_input_4s_le_ssse3(int position,
+		const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+		int nsamples, int nchannels)
+{
+	if (nchannels > 1)
+		return sbc_encoder_process_input_s4_ssse3(position, pcm, X,
+				nsamples, 2, sbc_ssse3_perm_4s_stereo_le);
+	else
+		return sbc_encoder_process_input_s4_ssse3(position, pcm, X,
+				nsamples, 1, sbc_ssse3_perm_4s_mono_le);
+}
+
+static int sbc_enc_process_input_4s_be_ssse3(int position,
+		const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+		int nsamples, int nchannels)
+{
+	if (nchannels > 1)
+		return sbc_encoder_process_input_s4_ssse3(position, pcm, X,
+				nsamples, 2, sbc_ssse3_perm_4s_stereo_be);
+	else
+		return sbc_encoder_process_input_s4_ssse3(position, pcm, X,
+				nsamples, 1, sbc_ssse3_perm_4s_mono_be);
+}
+
+static int sbc_enc_process_input_8s_le_ssse3(int position,
+		const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+		int nsamples, int nchannels)
+{
+	if (nchannels > 1)
+		return sbc_encoder_process_input_s8_ssse3(position, pcm, X,
+				nsamples, 2, sbc_ssse3_perm_8s_stereo_le);
+	else
+		return sbc_encoder_process_input_s8_ssse3(position, pcm, X,
+				nsamples, 1, sbc_ssse3_perm_8s_mono_le);
+}
+
+static int sbc_enc_process_input_8s_be_ssse3(int position,
+		const uint8_t *pcm, int16_t X[2][SBC_X_BUFFER_SIZE],
+		int nsamples, int nchannels)
+{
+	if (nchannels > 1)
+		return sbc_encoder_process_input_s8_ssse3(position, pcm, X,
+				nsamples, 2, sbc_ssse3_perm_8s_stereo_be);
+	else
+		return sbc_encoder_process_input_s8_ssse3(position, pcm, X,
+				nsamples, 1, sbc_ssse3_perm_8s_mono_be);
+}
+
+/*
+ * The synthesis filter needs 32x32 bit multiplies (pmulld), which are
+ * only available starting with SSE4.1
+ */
+static inline void sbc_synthesize_matrix_4s_sse4(int32_t *v,
+					const int32_t *in, const int32_t *consts)
+{
+	int n = 4;
+	asm volatile (
+		"pxor       %%xmm0, %%xmm0\n"
+		"pxor       %%xmm1, %%xmm1\n"
+	"1:\n"
+		"movd         (%0), %%xmm4\n"
+		"pshufd $0, %%xmm4, %%xmm4\n"
+		"movdqa       (%1), %%xmm5\n"
+		"movdqa     16(%1), %%xmm6\n"
+		"pmulld     %%xmm4, %%xmm5\n"
+		"pmulld     %%xmm4, %%xmm6\n"
+		"paddd      %%xmm5, %%xmm0\n"
+		"paddd      %%xmm6, %%xmm1\n"
+		"add            $4, %0\n"
+		"add           $32, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"psrad          %4, %%xmm0\n"
+		"psrad          %4, %%xmm1\n"
+		"movdqa     %%xmm0, (%3)\n"
+		"movdqa     %%xmm1, 16(%3)\n"
+		: "+r" (in), "+r" (consts), "+r" (n)
+		: "r" (v), "i" (SCALE4_STAGED1_BITS)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm4", "xmm5", "xmm6");
+}
+
+static inline void sbc_synthesize_window_4s_sse4(const int32_t *v,
+					int16_t *out, const int32_t *consts)
+{
+	int n = 5;
+	asm volatile (
+		"pxor       %%xmm0, %%xmm0\n"
+	"1:\n"
+		"movdqa       (%0), %%xmm2\n"
+		"movdqa     48(%0), %%xmm3\n"
+		"pmulld       (%1), %%xmm2\n"
+		"pmulld     16(%1), %%xmm3\n"
+		"paddd      %%xmm2, %%xmm0\n"
+		"paddd      %%xmm3, %%xmm0\n"
+		"add           $64, %0\n"
+		"add           $32, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"psrad          %4, %%xmm0\n"
+		"packssdw   %%xmm0, %%xmm0\n"
+		"movq       %%xmm0, (%3)\n"
+		: "+r" (v), "+r" (consts), "+r" (n)
+		: "r" (out), "i" (SCALE4_STAGED1_BITS)
+		: "cc", "memory",
+			"xmm0", "xmm2", "xmm3");
+}
+
+static inline void sbc_synthesize_matrix_8s_sse4(int32_t *v,
+					const int32_t *in, const int32_t *consts)
+{
+	int n = 8;
+	asm volatile (
+		"pxor       %%xmm0, %%xmm0\n"
+		"pxor       %%xmm1, %%xmm1\n"
+		"pxor       %%xmm2, %%xmm2\n"
+		"pxor       %%xmm3, %%xmm3\n"
+	"1:\n"
+		"movd         (%0), %%xmm4\n"
+		"pshufd $0, %%xmm4, %%xmm4\n"
+		"movdqa       (%1), %%xmm5\n"
+		"movdqa     16(%1), %%xmm6\n"
+		"pmulld     %%xmm4, %%xmm5\n"
+		"pmulld     %%xmm4, %%xmm6\n"
+		"paddd      %%xmm5, %%xmm0\n"
+		"paddd      %%xmm6, %%xmm1\n"
+		"movdqa     32(%1), %%xmm5\n"
+		"movdqa     48(%1), %%xmm6\n"
+		"pmulld     %%xmm4, %%xmm5\n"
+		"pmulld     %%xmm4, %%xmm6\n"
+		"paddd      %%xmm5, %%xmm2\n"
+		"paddd      %%xmm6, %%xmm3\n"
+		"add            $4, %0\n"
+		"add           $64, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"psrad          %4, %%xmm0\n"
+		"psrad          %4, %%xmm1\n"
+		"psrad          %4, %%xmm2\n"
+		"psrad          %4, %%xmm3\n"
+		"movdqa     %%xmm0, (%3)\n"
+		"movdqa     %%xmm1, 16(%3)\n"
+		"movdqa     %%xmm2, 32(%3)\n"
+		"movdqa     %%xmm3, 48(%3)\n"
+		: "+r" (in), "+r" (consts), "+r" (n)
+		: "r" (v), "i" (SCALE8_STAGED1_BITS)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6");
+}
+
+static inline void sbc_synthesize_window_8s_sse4(const int32_t *v,
+					int16_t *out, const int32_t *consts)
+{
+	int n = 5;
+	asm volatile (
+		"pxor       %%xmm0, %%xmm0\n"
+		"pxor       %%xmm1, %%xmm1\n"
+	"1:\n"
+		"movdqa       (%0), %%xmm2\n"
+		"movdqa     16(%0), %%xmm3\n"
+		"pmulld       (%1), %%xmm2\n"
+		"pmulld     16(%1), %%xmm3\n"
+		"paddd      %%xmm2, %%xmm0\n"
+		"paddd      %%xmm3, %%xmm1\n"
+		"movdqa     96(%0), %%xmm2\n"
+		"movdqa    112(%0), %%xmm3\n"
+		"pmulld     32(%1), %%xmm2\n"
+		"pmulld     48(%1), %%xmm3\n"
+		"paddd      %%xmm2, %%xmm0\n"
+		"paddd      %%xmm3, %%xmm1\n"
+		"add          $128, %0\n"
+		"add           $64, %1\n"
+		"sub            $1, %2\n"
+		"jnz            1b\n"
+		"psrad          %4, %%xmm0\n"
+		"psrad          %4, %%xmm1\n"
+		"packssdw   %%xmm1, %%xmm0\n"
+		"movdqu     %%xmm0, (%3)\n"
+		: "+r" (v), "+r" (consts), "+r" (n)
+		: "r" (out), "i" (SCALE8_STAGED1_BITS)
+		: "cc", "memory",
+			"xmm0", "xmm1", "xmm2", "xmm3");
+}
+
+static void sbc_synthesize_4s_sse4(int32_t *v, const int32_t *in, int16_t *out)
+{
+	sbc_synthesize_matrix_4s_sse4(v, in, synmatrix4_simd[0]);
+	sbc_synthesize_window_4s_sse4(v, out, sbc_proto_4_40_simd[0]);
+}
+
+static void sbc_synthesize_8s_sse4(int32_t *v, const int32_t *in, int16_t *out)
+{
+	sbc_synthesize_matrix_8s_sse4(v, in, synmatrix8_simd[0]);
+	sbc_synthesize_window_8s_sse4(v, out, sbc_proto_8_80_simd[0]);
+}
+
+static int check_sse2_support(void)
+{
+	uint32_t regs[4];
+
+	if (!sbc_cpuid_leaf(1, regs))
+		return 0;
+
+	return regs[3] & (1 << 26);
+}
+
+static int check_ssse3_support(void)
+{
+	uint32_t regs[4];
+
+	if (!sbc_cpuid_leaf(1, regs))
+		return 0;
+
+	return regs[2] & (1 << 9);
+}
+
+static int check_sse4_1_support(void)
+{
+	uint32_t regs[4];
+
+	if (!sbc_cpuid_leaf(1, regs))
+		return 0;
+
+	return regs[2] & (1 << 19);
+}
+
+void sbc_init_primitives_sse(struct sbc_encoder_state *state)
+{
+	if (check_sse2_support()) {
+		state->sbc_analyze_4b_4s = sbc_analyze_4b_4s_sse;
+		state->sbc_analyze_4b_8s = sbc_analyze_4b_8s_sse;
+		state->sbc_analyze_1b_8s = sbc_analyze_eight_sse;
+		state->sbc_calc_scalefactors = sbc_calc_scalefactors_sse;
+		state->sbc_calc_scalefactors_j = sbc_calc_scalefactors_j_sse;
+		state->implementation_info = "SSE2";
+	}
+
+	if (check_ssse3_support()) {
+		state->sbc_enc_process_input_4s_le =
+					sbc_enc_process_input_4s_le_ssse3;
+		state->sbc_enc_process_input_4s_be =
+					sbc_enc_process_input_4s_be_ssse3;
+		state->sbc_enc_process_input_8s_le =
+					sbc_enc_process_input_8s_le_ssse3;
+		state->sbc_enc_process_input_8s_be =
+					sbc_enc_process_input_8s_be_ssse3;
+		state->implementation_info = "SSSE3";
+	}
+}
+
+void sbc_init_decoder_primitives_sse4(struct sbc_decoder_state *state)
+{
+	if (check_sse4_1_support()) {
+		state->sbc_synthesize_4s = sbc_synthesize_4s_sse4;
+		state->sbc_synthesize_8s = sbc_synthesize_8s_sse4;
+		state->implementation_info = "SSE4.1";
+	}
+}
+
+#endif
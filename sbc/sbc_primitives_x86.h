@@ -0,0 +1,103 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) library
+ *
+ *  Copyright (C) 2008-2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *  Copyright (C) 2004-2005  Henryk Ploetz <henryk@ploetzli.ch>
+ *  Copyright (C) 2005-2006  Brad Midgley <bmidgley@xmission.com>
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __SBC_PRIMITIVES_X86_H
+#define __SBC_PRIMITIVES_X86_H
+
+/*
+ * CPU features detection helpers shared by x86 SIMD implementations
+ */
+
+static inline void sbc_cpuid(uint32_t leaf, uint32_t regs[4])
+{
+#ifdef __amd64__
+	asm volatile (
+		"cpuid\n"
+		: "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+		: "0" (leaf), "2" (0));
+#else
+	/* %ebx may be used as PIC register, so preserve it */
+	asm volatile (
+		"movl       %%ebx, %1\n"
+		"cpuid\n"
+		"xchgl      %%ebx, %1\n"
+		: "=a" (regs[0]), "=&r" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+		: "0" (leaf), "2" (0));
+#endif
+}
+
+static inline int check_cpuid_support(void)
+{
+#ifdef __amd64__
+	return 1;
+#else
+	int changed;
+	/* According to Intel manual, CPUID instruction is supported
+	 * if the value of ID bit (bit 21) in EFLAGS can be modified */
+	asm volatile (
+		"pushf\n"
+		"movl     (%%esp),   %0\n"
+		"xorl     $0x200000, (%%esp)\n"
+		"popf\n"
+		"pushf\n"
+		"xorl     (%%esp),   %0\n"
+		"popf\n"
+		: "=r" (changed)
+		:
+		: "cc");
+	return changed & 0x200000;
+#endif
+}
+
+/* Returns non-zero and fills "regs" if the given CPUID leaf is available */
+static inline int sbc_cpuid_leaf(uint32_t leaf, uint32_t regs[4])
+{
+	if (!check_cpuid_support())
+		return 0;
+
+	sbc_cpuid(0, regs);
+	if (regs[0] < leaf)
+		return 0;
+
+	sbc_cpuid(leaf, regs);
+
+	return 1;
+}
+
+/*
+ * vzeroupper clears the upper halves of all the vector registers, so
+ * any asm block executing it has to declare all of them as clobbered
+ */
+#ifdef __amd64__
+#define SBC_VZEROUPPER_CLOBBERS \
+	"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", \
+	"xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"
+#else
+#define SBC_VZEROUPPER_CLOBBERS \
+	"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"
+#endif
+
+#endif
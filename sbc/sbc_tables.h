@@ -46,94 +46,6 @@ static const int sbc_offset8[4][8] = {
 #define SN4(val) ASR(val, SCALE_NPROTO4_TBL)
 #define SN8(val) ASR(val, SCALE_NPROTO8_TBL)
 
-static const int32_t sbc_proto_4_40m0[] = {
-	SS4(0x00000000), SS4(0xffa6982f), SS4(0xfba93848), SS4(0x0456c7b8),
-	SS4(0x005967d1), SS4(0xfffb9ac7), SS4(0xff589157), SS4(0xf9c2a8d8),
-	SS4(0x027c1434), SS4(0x0019118b), SS4(0xfff3c74c), SS4(0xff137330),
-	SS4(0xf81b8d70), SS4(0x00ec1b8b), SS4(0xfff0b71a), SS4(0xffe99b00),
-	SS4(0xfef84470), SS4(0xf6fb4370), SS4(0xffcdc351), SS4(0xffe01dc7)
-};
-
-static const int32_t sbc_proto_4_40m1[] = {
-	SS4(0xffe090ce), SS4(0xff2c0475), SS4(0xf694f800), SS4(0xff2c0475),
-	SS4(0xffe090ce), SS4(0xffe01dc7), SS4(0xffcdc351), SS4(0xf6fb4370),
-	SS4(0xfef84470), SS4(0xffe99b00), SS4(0xfff0b71a), SS4(0x00ec1b8b),
-	SS4(0xf81b8d70), SS4(0xff137330), SS4(0xfff3c74c), SS4(0x0019118b),
-	SS4(0x027c1434), SS4(0xf9c2a8d8), SS4(0xff589157), SS4(0xfffb9ac7)
-};
-
-static const int32_t sbc_proto_8_80m0[] = {
-	SS8(0x00000000), SS8(0xfe8d1970), SS8(0xee979f00), SS8(0x11686100),
-	SS8(0x0172e690), SS8(0xfff5bd1a), SS8(0xfdf1c8d4), SS8(0xeac182c0),
-	SS8(0x0d9daee0), SS8(0x00e530da), SS8(0xffe9811d), SS8(0xfd52986c),
-	SS8(0xe7054ca0), SS8(0x0a00d410), SS8(0x006c1de4), SS8(0xffdba705),
-	SS8(0xfcbc98e8), SS8(0xe3889d20), SS8(0x06af2308), SS8(0x000bb7db),
-	SS8(0xffca00ed), SS8(0xfc3fbb68), SS8(0xe071bc00), SS8(0x03bf7948),
-	SS8(0xffc4e05c), SS8(0xffb54b3b), SS8(0xfbedadc0), SS8(0xdde26200),
-	SS8(0x0142291c), SS8(0xff960e94), SS8(0xff9f3e17), SS8(0xfbd8f358),
-	SS8(0xdbf79400), SS8(0xff405e01), SS8(0xff7d4914), SS8(0xff8b1a31),
-	SS8(0xfc1417b8), SS8(0xdac7bb40), SS8(0xfdbb828c), SS8(0xff762170)
-};
-
-static const int32_t sbc_proto_8_80m1[] = {
-	SS8(0xff7c272c), SS8(0xfcb02620), SS8(0xda612700), SS8(0xfcb02620),
-	SS8(0xff7c272c), SS8(0xff762170), SS8(0xfdbb828c), SS8(0xdac7bb40),
-	SS8(0xfc1417b8), SS8(0xff8b1a31), SS8(0xff7d4914), SS8(0xff405e01),
-	SS8(0xdbf79400), SS8(0xfbd8f358), SS8(0xff9f3e17), SS8(0xff960e94),
-	SS8(0x0142291c), SS8(0xdde26200), SS8(0xfbedadc0), SS8(0xffb54b3b),
-	SS8(0xffc4e05c), SS8(0x03bf7948), SS8(0xe071bc00), SS8(0xfc3fbb68),
-	SS8(0xffca00ed), SS8(0x000bb7db), SS8(0x06af2308), SS8(0xe3889d20),
-	SS8(0xfcbc98e8), SS8(0xffdba705), SS8(0x006c1de4), SS8(0x0a00d410),
-	SS8(0xe7054ca0), SS8(0xfd52986c), SS8(0xffe9811d), SS8(0x00e530da),
-	SS8(0x0d9daee0), SS8(0xeac182c0), SS8(0xfdf1c8d4), SS8(0xfff5bd1a)
-};
-
-static const int32_t synmatrix4[8][4] = {
-	{ SN4(0x05a82798), SN4(0xfa57d868), SN4(0xfa57d868), SN4(0x05a82798) },
-	{ SN4(0x030fbc54), SN4(0xf89be510), SN4(0x07641af0), SN4(0xfcf043ac) },
-	{ SN4(0x00000000), SN4(0x00000000), SN4(0x00000000), SN4(0x00000000) },
-	{ SN4(0xfcf043ac), SN4(0x07641af0), SN4(0xf89be510), SN4(0x030fbc54) },
-	{ SN4(0xfa57d868), SN4(0x05a82798), SN4(0x05a82798), SN4(0xfa57d868) },
-	{ SN4(0xf89be510), SN4(0xfcf043ac), SN4(0x030fbc54), SN4(0x07641af0) },
-	{ SN4(0xf8000000), SN4(0xf8000000), SN4(0xf8000000), SN4(0xf8000000) },
-	{ SN4(0xf89be510), SN4(0xfcf043ac), SN4(0x030fbc54), SN4(0x07641af0) }
-};
-
-static const int32_t synmatrix8[16][8] = {
-	{ SN8(0x05a82798), SN8(0xfa57d868), SN8(0xfa57d868), SN8(0x05a82798),
-	  SN8(0x05a82798), SN8(0xfa57d868), SN8(0xfa57d868), SN8(0x05a82798) },
-	{ SN8(0x0471ced0), SN8(0xf8275a10), SN8(0x018f8b84), SN8(0x06a6d988),
-	  SN8(0xf9592678), SN8(0xfe70747c), SN8(0x07d8a5f0), SN8(0xfb8e3130) },
-	{ SN8(0x030fbc54), SN8(0xf89be510), SN8(0x07641af0), SN8(0xfcf043ac),
-	  SN8(0xfcf043ac), SN8(0x07641af0), SN8(0xf89be510), SN8(0x030fbc54) },
-	{ SN8(0x018f8b84), SN8(0xfb8e3130), SN8(0x06a6d988), SN8(0xf8275a10),
-	  SN8(0x07d8a5f0), SN8(0xf9592678), SN8(0x0471ced0), SN8(0xfe70747c) },
-	{ SN8(0x00000000), SN8(0x00000000), SN8(0x00000000), SN8(0x00000000),
-	  SN8(0x00000000), SN8(0x00000000), SN8(0x00000000), SN8(0x00000000) },
-	{ SN8(0xfe70747c), SN8(0x0471ced0), SN8(0xf9592678), SN8(0x07d8a5f0),
-	  SN8(0xf8275a10), SN8(0x06a6d988), SN8(0xfb8e3130), SN8(0x018f8b84) },
-	{ SN8(0xfcf043ac), SN8(0x07641af0), SN8(0xf89be510), SN8(0x030fbc54),
-	  SN8(0x030fbc54), SN8(0xf89be510), SN8(0x07641af0), SN8(0xfcf043ac) },
-	{ SN8(0xfb8e3130), SN8(0x07d8a5f0), SN8(0xfe70747c), SN8(0xf9592678),
-	  SN8(0x06a6d988), SN8(0x018f8b84), SN8(0xf8275a10), SN8(0x0471ced0) },
-	{ SN8(0xfa57d868), SN8(0x05a82798), SN8(0x05a82798), SN8(0xfa57d868),
-	  SN8(0xfa57d868), SN8(0x05a82798), SN8(0x05a82798), SN8(0xfa57d868) },
-	{ SN8(0xf9592678), SN8(0x018f8b84), SN8(0x07d8a5f0), SN8(0x0471ced0),
-	  SN8(0xfb8e3130), SN8(0xf8275a10), SN8(0xfe70747c), SN8(0x06a6d988) },
-	{ SN8(0xf89be510), SN8(0xfcf043ac), SN8(0x030fbc54), SN8(0x07641af0),
-	  SN8(0x07641af0), SN8(0x030fbc54), SN8(0xfcf043ac), SN8(0xf89be510) },
-	{ SN8(0xf8275a10), SN8(0xf9592678), SN8(0xfb8e3130), SN8(0xfe70747c),
-	  SN8(0x018f8b84), SN8(0x0471ced0), SN8(0x06a6d988), SN8(0x07d8a5f0) },
-	{ SN8(0xf8000000), SN8(0xf8000000), SN8(0xf8000000), SN8(0xf8000000),
-	  SN8(0xf8000000), SN8(0xf8000000), SN8(0xf8000000), SN8(0xf8000000) },
-	{ SN8(0xf8275a10), SN8(0xf9592678), SN8(0xfb8e3130), SN8(0xfe70747c),
-	  SN8(0x018f8b84), SN8(0x0471ced0), SN8(0x06a6d988), SN8(0x07d8a5f0) },
-	{ SN8(0xf89be510), SN8(0xfcf043ac), SN8(0x030fbc54), SN8(0x07641af0),
-	  SN8(0x07641af0), SN8(0x030fbc54), SN8(0xfcf043ac), SN8(0xf89be510) },
-	{ SN8(0xf9592678), SN8(0x018f8b84), SN8(0x07d8a5f0), SN8(0x0471ced0),
-	  SN8(0xfb8e3130), SN8(0xf8275a10), SN8(0xfe70747c), SN8(0x06a6d988) }
-};
-
 /* Uncomment the following line to enable high precision build of SBC encoder */
 
 /* #define SBC_HIGH_PRECISION */
@@ -658,3 +570,94 @@ static const FIXED_T SBC_ALIGNED analysis_consts_fixed8_simd_odd[80 + 64] = {
 #undef C6
 #undef C7
 };
+
+/*
+ * Constant tables for the use in SIMD optimized synthesis filters
+ *
+ * The "synmatrix" tables are transposed so that a single input subband
+ * sample gets multiplied by a whole column at once. In the reordered
+ * "proto" tables row N holds the coefficients applied to the history of
+ * age 2*N (first half) and 2*N+1 (second half) for every output sample.
+ */
+
+static const int32_t SBC_ALIGNED synmatrix4_simd[4][8] = {
+	{ SN4(0x05a82798), SN4(0x030fbc54), SN4(0x00000000), SN4(0xfcf043ac),
+	  SN4(0xfa57d868), SN4(0xf89be510), SN4(0xf8000000), SN4(0xf89be510) },
+	{ SN4(0xfa57d868), SN4(0xf89be510), SN4(0x00000000), SN4(0x07641af0),
+	  SN4(0x05a82798), SN4(0xfcf043ac), SN4(0xf8000000), SN4(0xfcf043ac) },
+	{ SN4(0xfa57d868), SN4(0x07641af0), SN4(0x00000000), SN4(0xf89be510),
+	  SN4(0x05a82798), SN4(0x030fbc54), SN4(0xf8000000), SN4(0x030fbc54) },
+	{ SN4(0x05a82798), SN4(0xfcf043ac), SN4(0x00000000), SN4(0x030fbc54),
+	  SN4(0xfa57d868), SN4(0x07641af0), SN4(0xf8000000), SN4(0x07641af0) }
+};
+
+static const int32_t SBC_ALIGNED synmatrix8_simd[8][16] = {
+	{ SN8(0x05a82798), SN8(0x0471ced0), SN8(0x030fbc54), SN8(0x018f8b84),
+	  SN8(0x00000000), SN8(0xfe70747c), SN8(0xfcf043ac), SN8(0xfb8e3130),
+	  SN8(0xfa57d868), SN8(0xf9592678), SN8(0xf89be510), SN8(0xf8275a10),
+	  SN8(0xf8000000), SN8(0xf8275a10), SN8(0xf89be510), SN8(0xf9592678) },
+	{ SN8(0xfa57d868), SN8(0xf8275a10), SN8(0xf89be510), SN8(0xfb8e3130),
+	  SN8(0x00000000), SN8(0x0471ced0), SN8(0x07641af0), SN8(0x07d8a5f0),
+	  SN8(0x05a82798), SN8(0x018f8b84), SN8(0xfcf043ac), SN8(0xf9592678),
+	  SN8(0xf8000000), SN8(0xf9592678), SN8(0xfcf043ac), SN8(0x018f8b84) },
+	{ SN8(0xfa57d868), SN8(0x018f8b84), SN8(0x07641af0), SN8(0x06a6d988),
+	  SN8(0x00000000), SN8(0xf9592678), SN8(0xf89be510), SN8(0xfe70747c),
+	  SN8(0x05a82798), SN8(0x07d8a5f0), SN8(0x030fbc54), SN8(0xfb8e3130),
+	  SN8(0xf8000000), SN8(0xfb8e3130), SN8(0x030fbc54), SN8(0x07d8a5f0) },
+	{ SN8(0x05a82798), SN8(0x06a6d988), SN8(0xfcf043ac), SN8(0xf8275a10),
+	  SN8(0x00000000), SN8(0x07d8a5f0), SN8(0x030fbc54), SN8(0xf9592678),
+	  SN8(0xfa57d868), SN8(0x0471ced0), SN8(0x07641af0), SN8(0xfe70747c),
+	  SN8(0xf8000000), SN8(0xfe70747c), SN8(0x07641af0), SN8(0x0471ced0) },
+	{ SN8(0x05a82798), SN8(0xf9592678), SN8(0xfcf043ac), SN8(0x07d8a5f0),
+	  SN8(0x00000000), SN8(0xf8275a10), SN8(0x030fbc54), SN8(0x06a6d988),
+	  SN8(0xfa57d868), SN8(0xfb8e3130), SN8(0x07641af0), SN8(0x018f8b84),
+	  SN8(0xf8000000), SN8(0x018f8b84), SN8(0x07641af0), SN8(0xfb8e3130) },
+	{ SN8(0xfa57d868), SN8(0xfe70747c), SN8(0x07641af0), SN8(0xf9592678),
+	  SN8(0x00000000), SN8(0x06a6d988), SN8(0xf89be510), SN8(0x018f8b84),
+	  SN8(0x05a82798), SN8(0xf8275a10), SN8(0x030fbc54), SN8(0x0471ced0),
+	  SN8(0xf8000000), SN8(0x0471ced0), SN8(0x030fbc54), SN8(0xf8275a10) },
+	{ SN8(0xfa57d868), SN8(0x07d8a5f0), SN8(0xf89be510), SN8(0x0471ced0),
+	  SN8(0x00000000), SN8(0xfb8e3130), SN8(0x07641af0), SN8(0xf8275a10),
+	  SN8(0x05a82798), SN8(0xfe70747c), SN8(0xfcf043ac), SN8(0x06a6d988),
+	  SN8(0xf8000000), SN8(0x06a6d988), SN8(0xfcf043ac), SN8(0xfe70747c) },
+	{ SN8(0x05a82798), SN8(0xfb8e3130), SN8(0x030fbc54), SN8(0xfe70747c),
+	  SN8(0x00000000), SN8(0x018f8b84), SN8(0xfcf043ac), SN8(0x0471ced0),
+	  SN8(0xfa57d868), SN8(0x06a6d988), SN8(0xf89be510), SN8(0x07d8a5f0),
+	  SN8(0xf8000000), SN8(0x07d8a5f0), SN8(0xf89be510), SN8(0x06a6d988) }
+};
+
+static const int32_t SBC_ALIGNED sbc_proto_4_40_simd[5][8] = {
+	{ SS4(0x00000000), SS4(0xfffb9ac7), SS4(0xfff3c74c), SS4(0xffe99b00),
+	  SS4(0xffe090ce), SS4(0xffe01dc7), SS4(0xfff0b71a), SS4(0x0019118b) },
+	{ SS4(0xffa6982f), SS4(0xff589157), SS4(0xff137330), SS4(0xfef84470),
+	  SS4(0xff2c0475), SS4(0xffcdc351), SS4(0x00ec1b8b), SS4(0x027c1434) },
+	{ SS4(0xfba93848), SS4(0xf9c2a8d8), SS4(0xf81b8d70), SS4(0xf6fb4370),
+	  SS4(0xf694f800), SS4(0xf6fb4370), SS4(0xf81b8d70), SS4(0xf9c2a8d8) },
+	{ SS4(0x0456c7b8), SS4(0x027c1434), SS4(0x00ec1b8b), SS4(0xffcdc351),
+	  SS4(0xff2c0475), SS4(0xfef84470), SS4(0xff137330), SS4(0xff589157) },
+	{ SS4(0x005967d1), SS4(0x0019118b), SS4(0xfff0b71a), SS4(0xffe01dc7),
+	  SS4(0xffe090ce), SS4(0xffe99b00), SS4(0xfff3c74c), SS4(0xfffb9ac7) }
+};
+
+static const int32_t SBC_ALIGNED sbc_proto_8_80_simd[5][16] = {
+	{ SS8(0x00000000), SS8(0xfff5bd1a), SS8(0xffe9811d), SS8(0xffdba705),
+	  SS8(0xffca00ed), SS8(0xffb54b3b), SS8(0xff9f3e17), SS8(0xff8b1a31),
+	  SS8(0xff7c272c), SS8(0xff762170), SS8(0xff7d4914), SS8(0xff960e94),
+	  SS8(0xffc4e05c), SS8(0x000bb7db), SS8(0x006c1de4), SS8(0x00e530da) },
+	{ SS8(0xfe8d1970), SS8(0xfdf1c8d4), SS8(0xfd52986c), SS8(0xfcbc98e8),
+	  SS8(0xfc3fbb68), SS8(0xfbedadc0), SS8(0xfbd8f358), SS8(0xfc1417b8),
+	  SS8(0xfcb02620), SS8(0xfdbb828c), SS8(0xff405e01), SS8(0x0142291c),
+	  SS8(0x03bf7948), SS8(0x06af2308), SS8(0x0a00d410), SS8(0x0d9daee0) },
+	{ SS8(0xee979f00), SS8(0xeac182c0), SS8(0xe7054ca0), SS8(0xe3889d20),
+	  SS8(0xe071bc00), SS8(0xdde26200), SS8(0xdbf79400), SS8(0xdac7bb40),
+	  SS8(0xda612700), SS8(0xdac7bb40), SS8(0xdbf79400), SS8(0xdde26200),
+	  SS8(0xe071bc00), SS8(0xe3889d20), SS8(0xe7054ca0), SS8(0xeac182c0) },
+	{ SS8(0x11686100), SS8(0x0d9daee0), SS8(0x0a00d410), SS8(0x06af2308),
+	  SS8(0x03bf7948), SS8(0x0142291c), SS8(0xff405e01), SS8(0xfdbb828c),
+	  SS8(0xfcb02620), SS8(0xfc1417b8), SS8(0xfbd8f358), SS8(0xfbedadc0),
+	  SS8(0xfc3fbb68), SS8(0xfcbc98e8), SS8(0xfd52986c), SS8(0xfdf1c8d4) },
+	{ SS8(0x0172e690), SS8(0x00e530da), SS8(0x006c1de4), SS8(0x000bb7db),
+	  SS8(0xffc4e05c), SS8(0xff960e94), SS8(0xff7d4914), SS8(0xff762170),
+	  SS8(0xff7c272c), SS8(0xff8b1a31), SS8(0xff9f3e17), SS8(0xffb54b3b),
+	  SS8(0xffca00ed), SS8(0xffdba705), SS8(0xffe9811d), SS8(0xfff5bd1a) }
+};
@@ -0,0 +1,492 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) benchmark
+ *
+ *  Copyright (C) 2008-2010  Nokia Corporation
+ *  Copyright (C) 2004-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "sbc.h"
+
+#define BENCH_FRAMES 256
+#define PCM_SIZE (BENCH_FRAMES * 512)
+#define SBC_SIZE (BENCH_FRAMES * 520)
+
+static int verbose = 0;
+static int machine = 0;
+static double min_time = 0.05;
+static unsigned long cache_flags = 0;
+
+static const struct {
+	unsigned long flag;
+	const char *name;
+} backends[] = {
+	{ SBC_BACKEND_C,	"c"	},
+	{ SBC_BACKEND_MMX,	"mmx"	},
+	{ SBC_BACKEND_SSE,	"sse"	},
+	{ SBC_BACKEND_AVX2,	"avx2"	},
+	{ SBC_BACKEND_ARMV6,	"armv6"	},
+	{ SBC_BACKEND_IWMMXT,	"iwmmxt" },
+	{ SBC_BACKEND_NEON,	"neon"	},
+};
+
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+static const char *mode_names[] = { "mono", "dual", "stereo", "joint" };
+
+static int16_t pcm[PCM_SIZE / 2];
+static uint8_t stream[SBC_SIZE];
+static uint8_t output[PCM_SIZE];
+
+/* Cycle counter: hardware cycles through perf if the kernel allows it,
+ * otherwise the time stamp counter on x86 */
+static int perf_fd = -1;
+
+static const char *cycles_init(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (perf_fd >= 0)
+		return "perf";
+
+#if defined(__i386__) || defined(__amd64__)
+	return "tsc";
+#else
+	return "none";
+#endif
+}
+
+static uint64_t cycles_read(void)
+{
+	uint64_t cycles = 0;
+
+	if (perf_fd >= 0) {
+		if (read(perf_fd, &cycles, sizeof(cycles)) != sizeof(cycles))
+			return 0;
+		return cycles;
+	}
+
+#if defined(__i386__) || defined(__amd64__)
+	{
+		uint32_t lo, hi;
+
+		__asm__ volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+		cycles = ((uint64_t) hi << 32) | lo;
+	}
+#endif
+
+	return cycles;
+}
+
+static double get_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Deterministic test signal: a couple of tones plus some noise, so that
+ * the scale factors and the bit allocation vary like with real audio */
+static void generate_pcm(void)
+{
+	uint32_t seed = 0x12345678;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(pcm) / sizeof(pcm[0]); i++) {
+		int phase = (i / 2) % 100, sample;
+
+		seed = seed * 1103515245 + 12345;
+
+		sample = (phase < 50 ? phase : 100 - phase) * 400 - 10000;
+		sample += (int) ((seed >> 16) & 0x0fff) - 0x0800;
+		if (i & 1)
+			sample = -sample / 2;
+
+		pcm[i] = sample;
+	}
+}
+
+static void setup(sbc_t *sbc, int subbands, int blocks, int mode,
+								int bitpool)
+{
+	sbc->frequency = SBC_FREQ_44100;
+	sbc->subbands = subbands == 4 ? SBC_SB_4 : SBC_SB_8;
+	sbc->blocks = blocks == 4 ? SBC_BLK_4 : blocks == 8 ? SBC_BLK_8 :
+				blocks == 12 ? SBC_BLK_12 : SBC_BLK_16;
+	sbc->mode = mode;
+	sbc->bitpool = bitpool;
+	sbc->allocation = SBC_AM_LOUDNESS;
+}
+
+/* Encodes the test signal, the SBC stream is kept for the decoder runs */
+static ssize_t encode_stream(sbc_t *sbc, size_t *stream_len, int *frames)
+{
+	ssize_t len, written;
+
+	len = sbc_encode_multi(sbc, pcm, sizeof(pcm), stream, sizeof(stream),
+				&written, NULL, BENCH_FRAMES, frames);
+	if (len <= 0 || written <= 0)
+		return -EIO;
+
+	*stream_len = written;
+
+	return len;
+}
+
+static ssize_t decode_stream(sbc_t *sbc, size_t stream_len, int *frames)
+{
+	size_t written;
+
+	return sbc_decode_multi(sbc, stream, stream_len, output,
+				sizeof(output), &written, NULL,
+				BENCH_FRAMES, frames);
+}
+
+struct result {
+	unsigned long frames;
+	double elapsed;
+	uint64_t cycles;
+};
+
+static int run(int decoder, unsigned long flags, int subbands, int blocks,
+				int mode, int bitpool, struct result *res)
+{
+	size_t stream_len;
+	double start;
+	uint64_t cycles;
+	sbc_t sbc;
+	int frames;
+
+	memset(res, 0, sizeof(*res));
+
+	flags |= cache_flags;
+
+	if (sbc_init(&sbc, flags) < 0)
+		return -EIO;
+
+	setup(&sbc, subbands, blocks, mode, bitpool);
+
+	if (encode_stream(&sbc, &stream_len, &frames) < 0) {
+		sbc_finish(&sbc);
+		return -EIO;
+	}
+
+	if (decoder) {
+		sbc_finish(&sbc);
+		if (sbc_init(&sbc, flags) < 0)
+			return -EIO;
+
+		/* Warm up and set up the decoder state */
+		if (decode_stream(&sbc, stream_len, &frames) <= 0) {
+			sbc_finish(&sbc);
+			return -EIO;
+		}
+	}
+
+	start = get_seconds();
+	cycles = cycles_read();
+
+	do {
+		ssize_t len;
+
+		if (decoder)
+			len = decode_stream(&sbc, stream_len, &frames);
+		else
+			len = encode_stream(&sbc, &stream_len, &frames);
+
+		if (len <= 0) {
+			sbc_finish(&sbc);
+			return -EIO;
+		}
+
+		res->frames += frames;
+		res->elapsed = get_seconds() - start;
+	} while (res->elapsed < min_time);
+
+	res->cycles = cycles_read() - cycles;
+
+	if (verbose && cache_flags) {
+		unsigned long hits, misses;
+
+		if (sbc_get_bits_cache_stats(&sbc, &hits, &misses) == 0)
+			fprintf(stderr, "bits cache: %lu hits, %lu misses\n",
+								hits, misses);
+	}
+
+	sbc_finish(&sbc);
+
+	return 0;
+}
+
+/* Returns the implementation actually used for a backend request */
+static const char *probe(int decoder, unsigned long flags)
+{
+	const char *info;
+	size_t stream_len = 0;
+	sbc_t sbc;
+	int frames;
+
+	if (sbc_init(&sbc, flags) < 0)
+		return NULL;
+
+	encode_stream(&sbc, &stream_len, &frames);
+
+	if (decoder) {
+		sbc_finish(&sbc);
+		sbc_init(&sbc, flags);
+		decode_stream(&sbc, stream_len, &frames);
+	}
+
+	info = sbc_get_implementation_info(&sbc);
+
+	sbc_finish(&sbc);
+
+	return info;
+}
+
+static void report(int decoder, const char *backend, const char *info,
+			int subbands, int blocks, int mode, int bitpool,
+			const struct result *res)
+{
+	double fps = res->elapsed > 0 ? res->frames / res->elapsed : 0;
+	double cpf = res->frames ? (double) res->cycles / res->frames : 0;
+
+	if (machine) {
+		printf("%s,%s,%s,%d,%d,%s,%d,%lu,%.6f,%.1f,%.1f\n",
+			decoder ? "decode" : "encode", backend, info,
+			subbands, blocks, mode_names[mode], bitpool,
+			res->frames, res->elapsed, fps, cpf);
+		return;
+	}
+
+	printf("%-6s %-10s %2d %2d %-6s %3d %10.0f %10.1f\n",
+		decoder ? "decode" : "encode", info, subbands, blocks,
+		mode_names[mode], bitpool, fps, cpf);
+}
+
+static int parse_list(const char *arg, int *list, int max)
+{
+	char *end;
+	int count = 0;
+
+	while (*arg && count < max) {
+		list[count++] = strtol(arg, &end, 10);
+		if (end == arg)
+			return -EINVAL;
+		arg = *end == ',' ? end + 1 : end;
+	}
+
+	return count;
+}
+
+static void usage(void)
+{
+	printf("SBC benchmark utility ver %s\n", VERSION);
+	printf("Copyright (c) 2004-2010  Marcel Holtmann\n\n");
+
+	printf("Usage:\n"
+		"\tsbcbench [options]\n"
+		"\n");
+
+	printf("Options:\n"
+		"\t-h, --help           Display help\n"
+		"\t-v, --verbose        Verbose mode\n"
+		"\t-m, --machine        Machine readable (CSV) output\n"
+		"\t-e, --encoder        Benchmark the encoder only\n"
+		"\t-d, --decoder        Benchmark the decoder only\n"
+		"\t-c, --cache          Enable the bit allocation cache\n"
+		"\t-b, --bitpool <list> Bitpool values (default is 16,32,53)\n"
+		"\t-k, --backend <name> Only this backend (c, mmx, sse, avx2,\n"
+		"\t                     armv6, iwmmxt or neon)\n"
+		"\t-t, --time <msec>    Minimum time per test (default is 50)\n"
+		"\n");
+}
+
+static struct option main_options[] = {
+	{ "help",	0, 0, 'h' },
+	{ "verbose",	0, 0, 'v' },
+	{ "machine",	0, 0, 'm' },
+	{ "encoder",	0, 0, 'e' },
+	{ "decoder",	0, 0, 'd' },
+	{ "cache",	0, 0, 'c' },
+	{ "bitpool",	1, 0, 'b' },
+	{ "backend",	1, 0, 'k' },
+	{ "time",	1, 0, 't' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+	static const int subbands_list[] = { 4, 8 };
+	static const int blocks_list[] = { 4, 8, 12, 16 };
+	const char *infos[NUM_BACKENDS], *counter, *backend = NULL;
+	int bitpools[16] = { 16, 32, 53 }, nbitpools = 3;
+	int opt, encoder = 1, decoder = 1, failed = 0;
+	unsigned int dec, b, i, s, k, m, p;
+
+	while ((opt = getopt_long(argc, argv, "+hvmedcb:k:t:",
+						main_options, NULL)) != -1) {
+		switch(opt) {
+		case 'h':
+			usage();
+			exit(0);
+
+		case 'v':
+			verbose = 1;
+			break;
+
+		case 'm':
+			machine = 1;
+			break;
+
+		case 'e':
+			decoder = 0;
+			break;
+
+		case 'd':
+			encoder = 0;
+			break;
+
+		case 'c':
+			cache_flags = SBC_BITS_CACHE;
+			break;
+
+		case 'b':
+			nbitpools = parse_list(optarg, bitpools, 16);
+			if (nbitpools <= 0) {
+				fprintf(stderr, "Invalid bitpool list\n");
+				exit(1);
+			}
+			break;
+
+		case 'k':
+			backend = optarg;
+			break;
+
+		case 't':
+			min_time = atoi(optarg) / 1000.0;
+			break;
+
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	if (!encoder && !decoder)
+		encoder = decoder = 1;
+
+	generate_pcm();
+
+	counter = cycles_init();
+
+	if (machine)
+		printf("# cycles=%s\n"
+			"codec,backend,implementation,subbands,blocks,mode,"
+			"bitpool,frames,seconds,frames_per_sec,"
+			"cycles_per_frame\n", counter);
+	else
+		printf("%-6s %-10s %2s %2s %-6s %3s %10s %10s (%s)\n",
+			"codec", "backend", "sb", "bl", "mode", "bp",
+			"frames/s", "cycles/fr", counter);
+
+	for (dec = 0; dec < 2; dec++) {
+		if ((dec && !decoder) || (!dec && !encoder))
+			continue;
+
+		for (b = 0; b < NUM_BACKENDS; b++) {
+			infos[b] = probe(dec, backends[b].flag);
+
+			if (backend && strcmp(backend, backends[b].name))
+				continue;
+
+			/* Backends not built in or not supported by this
+			 * CPU fall back to an already measured one */
+			for (i = 0; i < b; i++)
+				if (infos[i] && infos[b] &&
+						!strcmp(infos[i], infos[b]))
+					break;
+
+			if (!infos[b] || (i < b && !backend)) {
+				if (verbose)
+					fprintf(stderr, "skipping %s %s\n",
+						dec ? "decoder" : "encoder",
+						backends[b].name);
+				continue;
+			}
+
+			for (s = 0; s < 2; s++)
+			for (k = 0; k < 4; k++)
+			for (m = 0; m < 4; m++)
+			for (p = 0; p < (unsigned int) nbitpools; p++) {
+				int sb = subbands_list[s], bl = blocks_list[k];
+				int max = (m < SBC_MODE_STEREO ? 16 : 32) * sb;
+				struct result res;
+
+				if (bitpools[p] < 2 || bitpools[p] > max ||
+						bitpools[p] > 250)
+					continue;
+
+				if (run(dec, backends[b].flag, sb, bl, m,
+						bitpools[p], &res) < 0) {
+					fprintf(stderr, "%s failed: %s %d %d "
+						"%s %d\n", dec ? "decoding" :
+						"encoding", infos[b], sb, bl,
+						mode_names[m], bitpools[p]);
+					failed = 1;
+					continue;
+				}
+
+				report(dec, backends[b].name, infos[b], sb, bl,
+						m, bitpools[p], &res);
+			}
+		}
+	}
+
+	if (perf_fd >= 0)
+		close(perf_fd);
+
+	return failed;
+}
@@ -39,25 +39,28 @@
 
 #include "sbc.h"
 #include "formats.h"
+#include "batch.h"
 
 #define BUF_SIZE 8192
 
 static int verbose = 0;
+static int msbc = 0;
 
-static void decode(char *filename, char *output, int tofile)
+static int decode(sbc_t *sbc, char *filename, char *output, int tofile,
+							struct batch_job *job)
 {
 	unsigned char buf[BUF_SIZE], *stream;
 	struct stat st;
-	sbc_t sbc;
-	int fd, ad, pos, streamlen, framelen, count;
+	int fd, ad, pos, streamlen, framelen, count, err = -EIO;
 	size_t len;
 	int format = AFMT_S16_BE, frequency, channels;
 	ssize_t written;
 
 	if (stat(filename, &st) < 0) {
+		err = -errno;
 		fprintf(stderr, "Can't get size of file %s: %s\n",
 						filename, strerror(errno));
-		return;
+		return err;
 	}
 
 	stream = malloc(st.st_size);
@@ -65,11 +68,12 @@ static void decode(char *filename, char *output, int tofile)
 	if (!stream) {
 		fprintf(stderr, "Can't allocate memory for %s: %s\n",
 						filename, strerror(errno));
-		return;
+		return -ENOMEM;
 	}
 
 	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
+		err = -errno;
 		fprintf(stderr, "Can't open file %s: %s\n",
 						filename, strerror(errno));
 		goto free;
@@ -93,17 +97,18 @@ static void decode(char *filename, char *output, int tofile)
 		ad = open(output, O_WRONLY, 0);
 
 	if (ad < 0) {
+		err = -errno;
 		fprintf(stderr, "Can't open output %s: %s\n",
 						output, strerror(errno));
 		goto free;
 	}
 
-	sbc_init(&sbc, 0L);
-	sbc.endian = SBC_BE;
+	sbc_reinit(sbc, msbc ? SBC_MSBC : 0L);
+	sbc->endian = SBC_BE;
 
-	framelen = sbc_decode(&sbc, stream, streamlen, buf, sizeof(buf), &len);
-	channels = sbc.mode == SBC_MODE_MONO ? 1 : 2;
-	switch (sbc.frequency) {
+	framelen = sbc_decode(sbc, stream, streamlen, buf, sizeof(buf), &len);
+	channels = sbc->mode == SBC_MODE_MONO ? 1 : 2;
+	switch (sbc->frequency) {
 	case SBC_FREQ_16000:
 		frequency = 16000;
 		break;
@@ -126,10 +131,10 @@ static void decode(char *filename, char *output, int tofile)
 	if (verbose) {
 		fprintf(stderr,"decoding %s with rate %d, %d subbands, "
 			"%d bits, allocation method %s and mode %s\n",
-			filename, frequency, sbc.subbands * 4 + 4, sbc.bitpool,
-			sbc.allocation == SBC_AM_SNR ? "SNR" : "LOUDNESS",
-			sbc.mode == SBC_MODE_MONO ? "MONO" :
-					sbc.mode == SBC_MODE_STEREO ?
+			filename, frequency, sbc->subbands * 4 + 4, sbc->bitpool,
+			sbc->allocation == SBC_AM_SNR ? "SNR" : "LOUDNESS",
+			sbc->mode == SBC_MODE_MONO ? "MONO" :
+					sbc->mode == SBC_MODE_STEREO ?
 						"STEREO" : "JOINTSTEREO");
 	}
 
@@ -169,6 +174,7 @@ static void decode(char *filename, char *output, int tofile)
 	}
 
 	count = len;
+	err = 0;
 
 	while (framelen > 0) {
 		/* we have completed an sbc_decode at this point sbc.len is the
@@ -188,14 +194,19 @@ static void decode(char *filename, char *output, int tofile)
 			fprintf(stderr,
 				"buffer size of %d is too small for decoded"
 				" data (%lu)\n", BUF_SIZE, (unsigned long) (len + count));
-			exit(1);
+			err = -ENOBUFS;
+			goto close;
 		}
 
+		job->frames++;
+		job->pcm_bytes += len;
+		job->sbc_bytes += framelen;
+
 		/* push the pointer in the file forward to the next bit to be
 		 * decoded tell the decoder to decode up to the remaining
 		 * length of the file (!) */
 		pos += framelen;
-		framelen = sbc_decode(&sbc, stream + pos, streamlen - pos,
+		framelen = sbc_decode(sbc, stream + pos, streamlen - pos,
 					buf + count, sizeof(buf) - count, &len);
 
 		/* increase the count */
@@ -208,13 +219,60 @@ static void decode(char *filename, char *output, int tofile)
 			count -= written;
 	}
 
-close:
-	sbc_finish(&sbc);
+	job->duration = (unsigned long long) job->frames *
+					sbc_get_frame_duration(sbc);
 
+close:
 	close(ad);
 
 free:
 	free(stream);
+
+	return err;
+}
+
+static int decode_job(sbc_t *sbc, struct batch_job *job)
+{
+	return decode(sbc, job->filename, job->output, 1, job);
+}
+
+static int decode_batch(char *files[], int count, int threads)
+{
+	struct batch_job *jobs;
+	double elapsed;
+	int i, failed = 0;
+
+	jobs = calloc(count, sizeof(struct batch_job));
+	if (!jobs) {
+		perror("Can't allocate batch jobs");
+		return 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		jobs[i].filename = files[i];
+		jobs[i].output = batch_output_name(files[i], ".au");
+		if (!jobs[i].output) {
+			perror("Can't allocate output name");
+			failed = 1;
+			goto done;
+		}
+	}
+
+	elapsed = batch_run(jobs, count, threads, decode_job);
+
+	batch_report(stdout, jobs, count, elapsed);
+
+	for (i = 0; i < count; i++)
+		if (jobs[i].err < 0)
+			failed = 1;
+
+done:
+	for (i = 0; i < count; i++)
+		free(jobs[i].output);
+
+	free(jobs);
+
+	return failed;
 }
 
 static void usage(void)
@@ -231,6 +289,9 @@ static void usage(void)
 		"\t-v, --verbose        Verbose mode\n"
 		"\t-d, --device <dsp>   Sound device\n"
 		"\t-f, --file <file>    Decode to a file\n"
+		"\t-m, --msbc           mSBC codec (16 kHz mono, H2 packets)\n"
+		"\t-t, --threads        Decode files in parallel to <file>.au\n"
+		"\t                     (0 uses all online CPUs)\n"
 		"\n");
 }
 
@@ -239,15 +300,18 @@ static struct option main_options[] = {
 	{ "device",	1, 0, 'd' },
 	{ "verbose",	0, 0, 'v' },
 	{ "file",	1, 0, 'f' },
+	{ "msbc",	0, 0, 'm' },
+	{ "threads",	1, 0, 't' },
 	{ 0, 0, 0, 0 }
 };
 
 int main(int argc, char *argv[])
 {
 	char *output = NULL;
-	int i, opt, tofile = 0;
+	int i, opt, tofile = 0, threads = -1;
+	sbc_t sbc;
 
-	while ((opt = getopt_long(argc, argv, "+hvd:f:",
+	while ((opt = getopt_long(argc, argv, "+hvd:f:mt:",
 						main_options, NULL)) != -1) {
 		switch(opt) {
 		case 'h':
@@ -270,6 +334,18 @@ int main(int argc, char *argv[])
 			tofile = 1;
 			break;
 
+		case 'm':
+			msbc = 1;
+			break;
+
+		case 't':
+			threads = atoi(optarg);
+			if (threads < 0) {
+				fprintf(stderr, "Invalid threads\n");
+				exit(1);
+			}
+			break;
+
 		default:
 			exit(1);
 		}
@@ -284,8 +360,25 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	for (i = 0; i < argc; i++)
-		decode(argv[i], output ? output : "/dev/dsp", tofile);
+	if (threads >= 0) {
+		free(output);
+		return decode_batch(argv, argc, threads);
+	}
+
+	if (sbc_init(&sbc, 0L) < 0) {
+		fprintf(stderr, "Can't initialize SBC codec\n");
+		exit(1);
+	}
+
+	for (i = 0; i < argc; i++) {
+		struct batch_job job;
+
+		memset(&job, 0, sizeof(job));
+		decode(&sbc, argv[i], output ? output : "/dev/dsp", tofile,
+									&job);
+	}
+
+	sbc_finish(&sbc);
 
 	free(output);
 
@@ -38,33 +38,44 @@
 
 #include "sbc.h"
 #include "formats.h"
+#include "batch.h"
 
 static int verbose = 0;
+static int subbands = 8, bitpool = 32, joint = 0, dualchannel = 0;
+static int snr = 0, blocks = 16, msbc = 0;
 
 #define BUF_SIZE 32768
-static unsigned char input[BUF_SIZE], output[BUF_SIZE + BUF_SIZE / 4];
+#define OUT_SIZE (BUF_SIZE + BUF_SIZE / 4)
 
-static void encode(char *filename, int subbands, int bitpool, int joint,
-					int dualchannel, int snr, int blocks)
+static int encode(sbc_t *sbc, char *filename, int ofd, struct batch_job *job)
 {
 	struct au_header au_hdr;
-	sbc_t sbc;
-	int fd, size, srate, codesize, nframes;
+	unsigned char *input, *output;
+	int fd, size, srate, codesize, nframes, err = -EIO;
 	ssize_t encoded;
 	ssize_t len;
 
 	if (sizeof(au_hdr) != 24) {
 		/* Sanity check just in case */
 		fprintf(stderr, "FIXME: sizeof(au_hdr) != 24\n");
-		return;
+		return -EINVAL;
 	}
 
+	/* Buffers are per call so that several files can be encoded
+	 * concurrently in batch mode */
+	input = malloc(BUF_SIZE + OUT_SIZE);
+	if (!input)
+		return -ENOMEM;
+	output = input + BUF_SIZE;
+
 	if (strcmp(filename, "-")) {
 		fd = open(filename, O_RDONLY);
 		if (fd < 0) {
+			err = -errno;
 			fprintf(stderr, "Can't open file %s: %s\n",
 						filename, strerror(errno));
-			return;
+			free(input);
+			return err;
 		}
 	} else
 		fd = fileno(stdin);
@@ -84,79 +95,100 @@ static void encode(char *filename, int subbands, int bitpool, int joint,
 			BE_INT(au_hdr.hdr_size) < sizeof(au_hdr) ||
 			BE_INT(au_hdr.encoding) != AU_FMT_LIN16) {
 		fprintf(stderr, "Not in Sun/NeXT audio S16_BE format\n");
+		err = -EINVAL;
 		goto done;
 	}
 
-	sbc_init(&sbc, 0L);
+	if (msbc && (BE_INT(au_hdr.sample_rate) != 16000 ||
+					BE_INT(au_hdr.channels) != 1)) {
+		fprintf(stderr, "mSBC requires 16 kHz mono audio\n");
+		err = -EINVAL;
+		goto done;
+	}
+
+	sbc_reinit(sbc, msbc ? SBC_MSBC : 0L);
 
 	switch (BE_INT(au_hdr.sample_rate)) {
 	case 16000:
-		sbc.frequency = SBC_FREQ_16000;
+		sbc->frequency = SBC_FREQ_16000;
 		break;
 	case 32000:
-		sbc.frequency = SBC_FREQ_32000;
+		sbc->frequency = SBC_FREQ_32000;
 		break;
 	case 44100:
-		sbc.frequency = SBC_FREQ_44100;
+		sbc->frequency = SBC_FREQ_44100;
 		break;
 	case 48000:
-		sbc.frequency = SBC_FREQ_48000;
+		sbc->frequency = SBC_FREQ_48000;
 		break;
 	}
 
 	srate = BE_INT(au_hdr.sample_rate);
 
-	sbc.subbands = subbands == 4 ? SBC_SB_4 : SBC_SB_8;
+	if (!msbc)
+		sbc->subbands = subbands == 4 ? SBC_SB_4 : SBC_SB_8;
 
 	if (BE_INT(au_hdr.channels) == 1) {
-		sbc.mode = SBC_MODE_MONO;
+		sbc->mode = SBC_MODE_MONO;
 		if (joint || dualchannel) {
 			fprintf(stderr, "Audio is mono but joint or "
 				"dualchannel mode has been specified\n");
+			err = -EINVAL;
 			goto done;
 		}
 	} else if (joint && !dualchannel)
-		sbc.mode = SBC_MODE_JOINT_STEREO;
+		sbc->mode = SBC_MODE_JOINT_STEREO;
 	else if (!joint && dualchannel)
-		sbc.mode = SBC_MODE_DUAL_CHANNEL;
+		sbc->mode = SBC_MODE_DUAL_CHANNEL;
 	else if (!joint && !dualchannel)
-		sbc.mode = SBC_MODE_STEREO;
+		sbc->mode = SBC_MODE_STEREO;
 	else {
 		fprintf(stderr, "Both joint and dualchannel mode have been "
 								"specified\n");
+		err = -EINVAL;
 		goto done;
 	}
 
-	sbc.endian = SBC_BE;
+	sbc->endian = SBC_BE;
 	/* Skip extra bytes of the header if any */
-	if (read(fd, input, BE_INT(au_hdr.hdr_size) - len) < 0)
+	if (read(fd, input, BE_INT(au_hdr.hdr_size) - len) < 0) {
+		err = -errno;
 		goto done;
+	}
 
-	sbc.bitpool = bitpool;
-	sbc.allocation = snr ? SBC_AM_SNR : SBC_AM_LOUDNESS;
-	sbc.blocks = blocks == 4 ? SBC_BLK_4 :
-			blocks == 8 ? SBC_BLK_8 :
-				blocks == 12 ? SBC_BLK_12 : SBC_BLK_16;
+	/* mSBC has fixed blocks, bitpool and allocation method */
+	if (!msbc) {
+		sbc->bitpool = bitpool;
+		sbc->allocation = snr ? SBC_AM_SNR : SBC_AM_LOUDNESS;
+		sbc->blocks = blocks == 4 ? SBC_BLK_4 :
+				blocks == 8 ? SBC_BLK_8 :
+					blocks == 12 ? SBC_BLK_12 : SBC_BLK_16;
+	}
 
-	if (verbose) {
+	if (verbose && msbc) {
+		fprintf(stderr, "encoding %s with mSBC\n", filename);
+	} else if (verbose) {
 		fprintf(stderr, "encoding %s with rate %d, %d blocks, "
 			"%d subbands, %d bits, allocation method %s, "
 							"and mode %s\n",
 			filename, srate, blocks, subbands, bitpool,
-			sbc.allocation == SBC_AM_SNR ? "SNR" : "LOUDNESS",
-			sbc.mode == SBC_MODE_MONO ? "MONO" :
-					sbc.mode == SBC_MODE_STEREO ?
+			sbc->allocation == SBC_AM_SNR ? "SNR" : "LOUDNESS",
+			sbc->mode == SBC_MODE_MONO ? "MONO" :
+					sbc->mode == SBC_MODE_STEREO ?
 						"STEREO" : "JOINTSTEREO");
 	}
 
-	codesize = sbc_get_codesize(&sbc);
-	nframes = sizeof(input) / codesize;
+	codesize = sbc_get_codesize(sbc);
+	nframes = BUF_SIZE / codesize;
+	err = 0;
 	while (1) {
-		unsigned char *inp, *outp;
+		int frames;
+
 		/* read data for up to 'nframes' frames of input data */
 		size = read(fd, input, codesize * nframes);
 		if (size < 0) {
 			/* Something really bad happened */
+			err = -errno;
 			perror("Can't read audio data");
 			break;
 		}
@@ -164,25 +196,23 @@ static void encode(char *filename, int subbands, int bitpool, int joint,
 			/* Not enough data for encoding even a single frame */
 			break;
 		}
-		/* encode all the data from the input buffer in a loop */
-		inp = input;
-		outp = output;
-		while (size >= codesize) {
-			len = sbc_encode(&sbc, inp, codesize,
-				outp, sizeof(output) - (outp - output),
-				&encoded);
-			if (len != codesize || encoded <= 0) {
-				fprintf(stderr,
-					"sbc_encode fail, len=%zd, encoded=%lu\n",
-					len, (unsigned long) encoded);
-				break;
-			}
-			size -= len;
-			inp += len;
-			outp += encoded;
+		/* encode all the data from the input buffer at once */
+		len = sbc_encode_multi(sbc, input, size, output,
+				OUT_SIZE, &encoded, NULL, nframes, &frames);
+		if (len < codesize || encoded <= 0) {
+			fprintf(stderr,
+				"sbc_encode fail, len=%zd, encoded=%lu\n",
+				len, (unsigned long) encoded);
+			err = -EIO;
+			break;
 		}
-		len = write(fileno(stdout), output, outp - output);
-		if (len != outp - output) {
+		size -= len;
+		job->frames += frames;
+		job->pcm_bytes += len;
+		job->sbc_bytes += encoded;
+		len = write(ofd, output, encoded);
+		if (len != encoded) {
+			err = len < 0 ? -errno : -EIO;
 			perror("Can't write SBC output");
 			break;
 		}
@@ -196,11 +226,73 @@ static void encode(char *filename, int subbands, int bitpool, int joint,
 		}
 	}
 
-	sbc_finish(&sbc);
+	job->duration = (unsigned long long) job->frames *
+					sbc_get_frame_duration(sbc);
 
 done:
 	if (fd > fileno(stderr))
 		close(fd);
+
+	free(input);
+
+	return err;
+}
+
+static int encode_job(sbc_t *sbc, struct batch_job *job)
+{
+	int fd, err;
+
+	fd = open(job->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open output %s: %s\n",
+						job->output, strerror(errno));
+		return -errno;
+	}
+
+	err = encode(sbc, job->filename, fd, job);
+
+	close(fd);
+
+	return err;
+}
+
+static int encode_batch(char *files[], int count, int threads)
+{
+	struct batch_job *jobs;
+	double elapsed;
+	int i, failed = 0;
+
+	jobs = calloc(count, sizeof(struct batch_job));
+	if (!jobs) {
+		perror("Can't allocate batch jobs");
+		return 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		jobs[i].filename = files[i];
+		jobs[i].output = batch_output_name(files[i], ".sbc");
+		if (!jobs[i].output) {
+			perror("Can't allocate output name");
+			failed = 1;
+			goto done;
+		}
+	}
+
+	elapsed = batch_run(jobs, count, threads, encode_job);
+
+	batch_report(stdout, jobs, count, elapsed);
+
+	for (i = 0; i < count; i++)
+		if (jobs[i].err < 0)
+			failed = 1;
+
+done:
+	for (i = 0; i < count; i++)
+		free(jobs[i].output);
+
+	free(jobs);
+
+	return failed;
 }
 
 static void usage(void)
@@ -221,6 +313,9 @@ static void usage(void)
 		"\t-d, --dualchannel    Dual channel\n"
 		"\t-S, --snr            Use SNR mode (default is loudness)\n"
 		"\t-B, --blocks         Number of blocks (4, 8, 12 or 16)\n"
+		"\t-m, --msbc           mSBC codec (16 kHz mono, H2 packets)\n"
+		"\t-t, --threads        Encode files in parallel to <file>.sbc\n"
+		"\t                     (0 uses all online CPUs)\n"
 		"\n");
 }
 
@@ -233,15 +328,17 @@ static struct option main_options[] = {
 	{ "dualchannel",0, 0, 'd' },
 	{ "snr",	0, 0, 'S' },
 	{ "blocks",	1, 0, 'B' },
+	{ "msbc",	0, 0, 'm' },
+	{ "threads",	1, 0, 't' },
 	{ 0, 0, 0, 0 }
 };
 
 int main(int argc, char *argv[])
 {
-	int i, opt, subbands = 8, bitpool = 32, joint = 0, dualchannel = 0;
-	int snr = 0, blocks = 16;
+	int i, opt, threads = -1;
+	sbc_t sbc;
 
-	while ((opt = getopt_long(argc, argv, "+hvs:b:jdSB:",
+	while ((opt = getopt_long(argc, argv, "+hvs:b:jdSB:mt:",
 						main_options, NULL)) != -1) {
 		switch(opt) {
 		case 'h':
@@ -285,6 +382,18 @@ int main(int argc, char *argv[])
 			}
 			break;
 
+		case 'm':
+			msbc = 1;
+			break;
+
+		case 't':
+			threads = atoi(optarg);
+			if (threads < 0) {
+				fprintf(stderr, "Invalid threads\n");
+				exit(1);
+			}
+			break;
+
 		default:
 			usage();
 			exit(1);
@@ -300,9 +409,22 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	for (i = 0; i < argc; i++)
-		encode(argv[i], subbands, bitpool, joint, dualchannel,
-								snr, blocks);
+	if (threads >= 0)
+		return encode_batch(argv, argc, threads);
+
+	if (sbc_init(&sbc, 0L) < 0) {
+		fprintf(stderr, "Can't initialize SBC codec\n");
+		exit(1);
+	}
+
+	for (i = 0; i < argc; i++) {
+		struct batch_job job;
+
+		memset(&job, 0, sizeof(job));
+		encode(&sbc, argv[i], fileno(stdout), &job);
+	}
+
+	sbc_finish(&sbc);
 
 	return 0;
 }
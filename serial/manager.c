@@ -72,7 +72,6 @@ static int serial_probe(struct btd_device *device, const char *uuid)
 {
 	struct btd_adapter *adapter = device_get_adapter(device);
 	const gchar *path = device_get_path(device);
-	sdp_list_t *protos;
 	int ch;
 	bdaddr_t src, dst;
 	const sdp_record_t *rec;
@@ -83,13 +82,10 @@ static int serial_probe(struct btd_device *device, const char *uuid)
 	if (!rec)
 		return -EINVAL;
 
-	if (sdp_get_access_protos(rec, &protos) < 0)
+	ch = sdp_get_access_proto_port(rec, RFCOMM_UUID);
+	if (ch < 0)
 		return -EINVAL;
 
-	ch = sdp_get_proto_port(protos, RFCOMM_UUID);
-	sdp_list_foreach(protos, (sdp_list_func_t) sdp_list_free, NULL);
-	sdp_list_free(protos, NULL);
-
 	if (ch < 1 || ch > 30) {
 		error("Channel out of range: %d", ch);
 		return -EINVAL;
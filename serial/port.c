@@ -150,7 +150,8 @@ static int port_release(struct serial_port *port)
 			port->io = NULL;
 		} else
 			bt_cancel_discovery(&port->device->src,
-						&port->device->dst);
+						&port->device->dst,
+						NULL, port);
 
 		return 0;
 	}
@@ -357,12 +358,10 @@ fail:
 	port->listener_id = 0;
 }
 
-static void get_record_cb(sdp_list_t *recs, int err, gpointer user_data)
+static void get_channel_cb(int ch, int err, gpointer user_data)
 {
 	struct serial_port *port = user_data;
 	struct serial_device *device = port->device;
-	sdp_record_t *record = NULL;
-	sdp_list_t *protos;
 	DBusMessage *reply;
 	GError *gerr = NULL;
 
@@ -378,24 +377,13 @@ static void get_record_cb(sdp_list_t *recs, int err, gpointer user_data)
 		goto failed;
 	}
 
-	if (!recs || !recs->data) {
-		error("No record found");
-		reply = btd_error_failed(port->msg, "No record found");
-		goto failed;
-	}
-
-	record = recs->data;
-
-	if (sdp_get_access_protos(record, &protos) < 0) {
-		error("Unable to get access protos from port record");
+	if (ch == 0) {
+		error("No record found with an RFCOMM channel");
 		reply = btd_error_failed(port->msg, "Invalid channel");
 		goto failed;
 	}
 
-	port->channel = sdp_get_proto_port(protos, RFCOMM_UUID);
-
-	sdp_list_foreach(protos, (sdp_list_func_t) sdp_list_free, NULL);
-	sdp_list_free(protos, NULL);
+	port->channel = ch;
 
 	port->io = bt_io_connect(BT_IO_RFCOMM, rfcomm_connect_cb, port,
 				NULL, &gerr,
@@ -433,8 +421,8 @@ static int connect_port(struct serial_port *port)
 
 	sdp_uuid128_to_uuid(&uuid);
 
-	return bt_search_service(&device->src, &device->dst, &uuid,
-				get_record_cb, port, NULL);
+	return bt_search_service_port(&device->src, &device->dst, &uuid,
+				RFCOMM_UUID, get_channel_cb, port, NULL);
 
 connect:
 	port->io = bt_io_connect(BT_IO_RFCOMM, rfcomm_connect_cb, port,
@@ -153,7 +153,7 @@ static sdp_record_t *proxy_record_new(const char *uuid128, uint8_t channel)
 	sdp_record_t *record;
 	sdp_data_t *ch;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 	if (!record)
 		return NULL;
 
@@ -1915,7 +1915,7 @@ static sdp_record_t *create_rfcomm_record(struct btd_adapter *adapter,
 	sdp_list_t *svclass, *root, *proto;
 	sdp_record_t *record;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 	if (!record)
 		return NULL;
 
@@ -2023,7 +2023,7 @@ static int add_headset_ag_record(struct btd_adapter* adapter)
 	sdp_data_t *network = sdp_data_alloc(SDP_UINT8, &netid);
 	int ret = 0;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 	if (!record) return -1;
 
 	sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
@@ -2086,7 +2086,7 @@ static int add_handsfree_ag_record(struct btd_adapter* adapter) {
 	sdp_data_t *network = sdp_data_alloc(SDP_UINT8, &netid);
 	int ret = 0;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 	if (!record) return -1;
 
 	sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
@@ -2152,7 +2152,7 @@ static int add_pbap_pse_record(struct btd_adapter *adapter)
 	sdp_data_t *sflist;
 	int ret = 0;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 	if (!record) return -1;
 
 	sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
@@ -2219,7 +2219,7 @@ static int add_mas_record(struct btd_adapter *adapter)
 	sdp_data_t *channel;
 	int ret = 0;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 		if (!record) return -1;
 
 	sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
@@ -2297,7 +2297,7 @@ static int add_opush_record(struct btd_adapter *adapter)
 	sdp_data_t *sflist;
 	int ret = 0;
 
-	record = sdp_record_alloc();
+	record = sdp_record_alloc_arena(0);
 	if (!record) return -1;
 
 	sdp_uuid16_create(&root_uuid, PUBLIC_BROWSE_GROUP);
@@ -2666,6 +2666,7 @@ static void create_stored_device_from_primary(char *key, char *value,
 	struct btd_adapter *adapter = user_data;
 	struct btd_device *device;
 	GSList *services, *uuids, *l;
+	bdaddr_t dba;
 
 	if (g_slist_find_custom(adapter->devices,
 			key, (GCompareFunc) device_address_cmp))
@@ -2691,6 +2692,15 @@ static void create_stored_device_from_primary(char *key, char *value,
 	device_register_services(connection, device, services, -1);
 
 	g_slist_free(uuids);
+
+	/* Characteristics and descriptors too, until a Service Changed.
+	 * Only bonded devices indicate changes, drop the cache otherwise */
+	device_get_address(device, &dba);
+	if (device_is_bonded(device))
+		device_set_gatt_table(device,
+				read_gatt_cache(&adapter->bdaddr, &dba));
+	else
+		delete_gatt_cache(&adapter->bdaddr, &dba);
 }
 
 static void load_devices(struct btd_adapter *adapter)
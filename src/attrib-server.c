@@ -47,13 +47,27 @@
 
 #include "attrib-server.h"
 
-static GSList *database = NULL;
+/*
+ * The attribute database is an array of attributes sorted by handle, so
+ * lookups are a binary search and range requests start right at the
+ * requested handle. A secondary index maps each attribute type (as a
+ * UUID-128) to a sorted array of the attributes of that type, letting
+ * the by type requests skip everything else.
+ */
+struct attr_array {
+	struct attribute **attrs;
+	guint len;
+	guint size;
+};
+
+static struct attr_array database = { NULL, 0, 0 };
+static GHashTable *type_index = NULL;
 
 struct gatt_channel {
 	bdaddr_t src;
 	bdaddr_t dst;
 	GSList *configs;
-	GSList *notify;
+	GSList *notify;		/* Subscribed value handles */
 	GSList *indicate;
 	GAttrib *attrib;
 	guint mtu;
@@ -69,6 +83,19 @@ struct group_elem {
 	uint16_t len;
 };
 
+/*
+ * Channels subscribed to each characteristic value handle, so updates
+ * only visit the interested clients. Each channel keeps the handles it
+ * subscribed to in its notify and indicate lists to unsubscribe on
+ * disconnection.
+ */
+struct subscribers {
+	GSList *notify;
+	GSList *indicate;
+};
+
+static GHashTable *subscriptions = NULL;
+
 static GIOChannel *l2cap_io = NULL;
 static GIOChannel *le_io = NULL;
 static GSList *clients = NULL;
@@ -143,6 +170,191 @@ static sdp_record_t *server_record_new(uuid_t *uuid, uint16_t start, uint16_t en
 	return record;
 }
 
+/* Index of the first attribute whose handle is not lower than handle */
+static guint attr_array_bound(const struct attr_array *array, uint16_t handle)
+{
+	guint lo = 0, hi = array->len;
+
+	while (lo < hi) {
+		guint mid = (lo + hi) / 2;
+
+		if (array->attrs[mid]->handle < handle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static struct attribute *attr_array_find(const struct attr_array *array,
+							uint16_t handle)
+{
+	guint i = attr_array_bound(array, handle);
+
+	if (i < array->len && array->attrs[i]->handle == handle)
+		return array->attrs[i];
+
+	return NULL;
+}
+
+static void attr_array_insert(struct attr_array *array, struct attribute *a)
+{
+	guint i = attr_array_bound(array, a->handle);
+
+	if (array->len == array->size) {
+		array->size = array->size ? array->size * 2 : 16;
+		array->attrs = g_renew(struct attribute *, array->attrs,
+								array->size);
+	}
+
+	memmove(&array->attrs[i + 1], &array->attrs[i],
+				(array->len - i) * sizeof(struct attribute *));
+	array->attrs[i] = a;
+	array->len++;
+}
+
+static void attr_array_remove(struct attr_array *array, uint16_t handle)
+{
+	guint i = attr_array_bound(array, handle);
+
+	if (i == array->len || array->attrs[i]->handle != handle)
+		return;
+
+	array->len--;
+	memmove(&array->attrs[i], &array->attrs[i + 1],
+				(array->len - i) * sizeof(struct attribute *));
+}
+
+/* Slot holding the attribute, so it can be swapped once reallocated */
+static struct attribute **attr_array_slot(const struct attr_array *array,
+							uint16_t handle)
+{
+	guint i = attr_array_bound(array, handle);
+
+	if (i < array->len && array->attrs[i]->handle == handle)
+		return &array->attrs[i];
+
+	return NULL;
+}
+
+static void attr_array_free(gpointer data)
+{
+	struct attr_array *array = data;
+
+	g_free(array->attrs);
+	g_free(array);
+}
+
+static guint uuid128_hash(gconstpointer key)
+{
+	const uint32_t *data = key;
+
+	return data[0] ^ data[1] ^ data[2] ^ data[3];
+}
+
+static gboolean uuid128_equal(gconstpointer a, gconstpointer b)
+{
+	return memcmp(a, b, sizeof(uint128_t)) == 0;
+}
+
+static struct attr_array *type_lookup(const bt_uuid_t *uuid, gboolean create)
+{
+	struct attr_array *array;
+	bt_uuid_t uuid128;
+
+	if (type_index == NULL) {
+		if (!create)
+			return NULL;
+
+		type_index = g_hash_table_new_full(uuid128_hash, uuid128_equal,
+							g_free, attr_array_free);
+	}
+
+	memset(&uuid128, 0, sizeof(uuid128));
+	bt_uuid_to_uuid128(uuid, &uuid128);
+
+	array = g_hash_table_lookup(type_index, &uuid128.value.u128);
+	if (array || !create)
+		return array;
+
+	array = g_new0(struct attr_array, 1);
+	g_hash_table_insert(type_index, g_memdup(&uuid128.value.u128,
+						sizeof(uint128_t)), array);
+
+	return array;
+}
+
+static void index_add(struct attribute *a)
+{
+	attr_array_insert(&database, a);
+	attr_array_insert(type_lookup(&a->uuid, TRUE), a);
+}
+
+static void index_remove(struct attribute *a)
+{
+	struct attr_array *array = type_lookup(&a->uuid, FALSE);
+
+	attr_array_remove(&database, a->handle);
+	if (array)
+		attr_array_remove(array, a->handle);
+}
+
+static struct attribute *attrib_find(uint16_t handle)
+{
+	return attr_array_find(&database, handle);
+}
+
+/*
+ * Handle of the next service declaration after the given one, 0 if none.
+ * Both primary and secondary declarations end the current group.
+ */
+static uint16_t next_service(uint16_t handle)
+{
+	struct attr_array *array;
+	uint16_t next = 0;
+	guint i;
+
+	if (handle == 0xffff)
+		return 0;
+
+	array = type_lookup(&prim_uuid, FALSE);
+	if (array) {
+		i = attr_array_bound(array, handle + 1);
+		if (i < array->len)
+			next = array->attrs[i]->handle;
+	}
+
+	array = type_lookup(&snd_uuid, FALSE);
+	if (array) {
+		i = attr_array_bound(array, handle + 1);
+		if (i < array->len && (next == 0 ||
+					array->attrs[i]->handle < next))
+			next = array->attrs[i]->handle;
+	}
+
+	return next;
+}
+
+/*
+ * Handle of the last attribute below limit (0 means no limit). The
+ * attribute at handle is known to exist and is returned at worst.
+ */
+static uint16_t last_handle_before(uint16_t handle, uint32_t limit)
+{
+	guint i;
+
+	if (limit == 0 || limit > 0xffff)
+		i = database.len;
+	else
+		i = attr_array_bound(&database, limit);
+
+	if (i == 0)
+		return handle;
+
+	return database.attrs[i - 1]->handle;
+}
+
 static int handle_cmp(gconstpointer a, gconstpointer b)
 {
 	const struct attribute *attrib = a;
@@ -193,36 +405,106 @@ static uint8_t att_check_reqs(struct gatt_channel *channel, uint8_t opcode,
 	return 0;
 }
 
+static void channel_subscribe(struct gatt_channel *channel, uint16_t handle,
+					gboolean indicate, gboolean enable)
+{
+	GSList **handles = indicate ? &channel->indicate : &channel->notify;
+	gpointer key = GUINT_TO_POINTER(handle);
+	struct subscribers *subs;
+	GSList **channels;
+
+	if (enable == (g_slist_find(*handles, key) != NULL))
+		return;
+
+	if (subscriptions == NULL)
+		subscriptions = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL, g_free);
+
+	subs = g_hash_table_lookup(subscriptions, key);
+	if (subs == NULL) {
+		subs = g_new0(struct subscribers, 1);
+		g_hash_table_insert(subscriptions, key, subs);
+	}
+
+	channels = indicate ? &subs->indicate : &subs->notify;
+
+	if (enable) {
+		*handles = g_slist_prepend(*handles, key);
+		*channels = g_slist_prepend(*channels, channel);
+		return;
+	}
+
+	*handles = g_slist_remove(*handles, key);
+	*channels = g_slist_remove(*channels, channel);
+
+	if (subs->notify == NULL && subs->indicate == NULL)
+		g_hash_table_remove(subscriptions, key);
+}
+
+static void channel_unsubscribe_all(struct gatt_channel *channel)
+{
+	while (channel->notify)
+		channel_subscribe(channel,
+				GPOINTER_TO_UINT(channel->notify->data),
+				FALSE, FALSE);
+
+	while (channel->indicate)
+		channel_subscribe(channel,
+				GPOINTER_TO_UINT(channel->indicate->data),
+				TRUE, FALSE);
+}
+
+/* Deleted attributes take their subscriptions with them */
+static void drop_subscriptions(uint16_t handle)
+{
+	gpointer key = GUINT_TO_POINTER(handle);
+	struct subscribers *subs;
+
+	while (subscriptions &&
+			(subs = g_hash_table_lookup(subscriptions, key))) {
+		if (subs->notify)
+			channel_subscribe(subs->notify->data, handle, FALSE,
+									FALSE);
+		else
+			channel_subscribe(subs->indicate->data, handle, TRUE,
+									FALSE);
+	}
+}
+
 static uint8_t client_set_notifications(struct attribute *attr,
 							gpointer user_data)
 {
 	struct gatt_channel *channel = user_data;
-	struct attribute *last_chr_val = NULL;
-	uint16_t cfg_val;
+	struct attribute *last_chr_val, *chr;
+	struct attr_array *chars;
+	uint16_t cfg_val, handle;
 	uint8_t props;
 	bt_uuid_t uuid;
-	GSList *l;
+	guint i;
 
 	cfg_val = att_get_u16(attr->data);
 
+	/* The configuration belongs to the closest preceding characteristic */
 	bt_uuid16_create(&uuid, GATT_CHARAC_UUID);
-	for (l = database, props = 0; l != NULL; l = l->next) {
-		struct attribute *a = l->data;
-		static uint16_t handle = 0;
+	chars = type_lookup(&uuid, FALSE);
+	if (chars == NULL)
+		return 0;
 
-		if (a->handle >= attr->handle)
-			break;
+	i = attr_array_bound(chars, attr->handle);
+	if (i == 0)
+		return 0;
 
-		if (bt_uuid_cmp(&a->uuid, &uuid) == 0) {
-			props = att_get_u8(&a->data[0]);
-			handle = att_get_u16(&a->data[1]);
-			continue;
-		}
+	chr = chars->attrs[i - 1];
+	if (chr->len < 3)
+		return 0;
 
-		if (handle && a->handle == handle)
-			last_chr_val = a;
-	}
+	props = att_get_u8(&chr->data[0]);
+	handle = att_get_u16(&chr->data[1]);
 
+	if (handle <= chr->handle || handle >= attr->handle)
+		return 0;
+
+	last_chr_val = attrib_find(handle);
 	if (last_chr_val == NULL)
 		return 0;
 
@@ -232,17 +514,10 @@ static uint8_t client_set_notifications(struct attribute *attr,
 	if ((cfg_val & 0x0002) && !(props & ATT_CHAR_PROPER_INDICATE))
 		return ATT_ECODE_WRITE_NOT_PERM;
 
-	if (cfg_val & 0x0001)
-		channel->notify = g_slist_append(channel->notify, last_chr_val);
-	else
-		channel->notify = g_slist_remove(channel->notify, last_chr_val);
-
-	if (cfg_val & 0x0002)
-		channel->indicate = g_slist_append(channel->indicate,
-								last_chr_val);
-	else
-		channel->indicate = g_slist_remove(channel->indicate,
-								last_chr_val);
+	channel_subscribe(channel, last_chr_val->handle, FALSE,
+					(cfg_val & 0x0001) ? TRUE : FALSE);
+	channel_subscribe(channel, last_chr_val->handle, TRUE,
+					(cfg_val & 0x0002) ? TRUE : FALSE);
 
 	return 0;
 }
@@ -290,11 +565,13 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 						uint8_t *pdu, int len)
 {
 	struct att_data_list *adl;
+	struct attr_array *array;
 	struct attribute *a;
-	struct group_elem *cur, *old = NULL;
+	struct group_elem *cur;
 	GSList *l, *groups;
-	uint16_t length, last_handle, last_size = 0;
+	uint16_t length, last_size = 0;
 	uint8_t status;
+	guint n;
 	int i;
 
 	if (start > end || start == 0x0000)
@@ -311,35 +588,27 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, 0x0000,
 					ATT_ECODE_UNSUPP_GRP_TYPE, pdu, len);
 
-	last_handle = end;
-	for (l = database, groups = NULL, cur = NULL; l; l = l->next) {
-		struct attribute *client_attr;
+	array = type_lookup(uuid, FALSE);
+	if (array == NULL)
+		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
 
-		a = l->data;
+	groups = NULL;
 
-		if (a->handle < start)
-			continue;
+	for (n = attr_array_bound(array, start); n < array->len; n++) {
+		struct attribute *client_attr;
+		uint16_t handle;
+
+		a = array->attrs[n];
 
 		if (a->handle >= end)
 			break;
 
-		/* The old group ends when a new one starts */
-		if (old && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)) {
-			old->end = last_handle;
-			old = NULL;
-		}
-
-		if (bt_uuid_cmp(&a->uuid, uuid) != 0) {
-			/* Still inside a service, update its last handle */
-			if (old)
-				last_handle = a->handle;
-			continue;
-		}
-
 		if (last_size && (last_size != a->len))
 			break;
 
+		handle = a->handle;
+
 		status = att_check_reqs(channel, ATT_OP_READ_BY_GROUP_REQ,
 								a->read_reqs);
 
@@ -358,27 +627,26 @@ static uint16_t read_by_group(struct gatt_channel *channel, uint16_t start,
 		}
 
 		cur = g_new0(struct group_elem, 1);
-		cur->handle = a->handle;
+		cur->handle = handle;
 		cur->data = a->data;
 		cur->len = a->len;
 
+		/* The group ends right before the next service, or at the
+		 * last attribute inside the requested range */
+		cur->end = last_handle_before(handle, next_service(handle));
+		if (cur->end >= end)
+			cur->end = last_handle_before(handle, end);
+
 		/* Attribute Grouping Type found */
 		groups = g_slist_append(groups, cur);
 
 		last_size = a->len;
-		old = cur;
-		last_handle = cur->handle;
 	}
 
 	if (groups == NULL)
 		return enc_error_resp(ATT_OP_READ_BY_GROUP_REQ, start,
 					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
 
-	if (l == NULL)
-		cur->end = a->handle;
-	else
-		cur->end = last_handle;
-
 	length = g_slist_length(groups);
 
 	adl = att_data_list_alloc(length, last_size + 4);
@@ -410,30 +678,34 @@ static uint16_t read_by_type(struct gatt_channel *channel, uint16_t start,
 						uint8_t *pdu, int len)
 {
 	struct att_data_list *adl;
+	struct attr_array *array;
 	GSList *l, *types;
 	struct attribute *a;
 	uint16_t num, length;
 	uint8_t status;
+	guint n;
 	int i;
 
 	if (start > end || start == 0x0000)
 		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	for (l = database, length = 0, types = NULL; l; l = l->next) {
-		struct attribute *client_attr;
+	array = type_lookup(uuid, FALSE);
+	if (array == NULL)
+		return enc_error_resp(ATT_OP_READ_BY_TYPE_REQ, start,
+					ATT_ECODE_ATTR_NOT_FOUND, pdu, len);
 
-		a = l->data;
+	length = 0;
+	types = NULL;
 
-		if (a->handle < start)
-			continue;
+	for (n = attr_array_bound(array, start); n < array->len; n++) {
+		struct attribute *client_attr;
+
+		a = array->attrs[n];
 
 		if (a->handle > end)
 			break;
 
-		if (bt_uuid_cmp(&a->uuid, uuid)  != 0)
-			continue;
-
 		status = att_check_reqs(channel, ATT_OP_READ_BY_TYPE_REQ,
 								a->read_reqs);
 
@@ -498,17 +770,18 @@ static int find_info(uint16_t start, uint16_t end, uint8_t *pdu, int len)
 	GSList *l, *info;
 	uint8_t format, last_type = BT_UUID_UNSPEC;
 	uint16_t length, num;
+	guint n;
 	int i;
 
 	if (start > end || start == 0x0000)
 		return enc_error_resp(ATT_OP_FIND_INFO_REQ, start,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	for (l = database, info = NULL, num = 0; l; l = l->next) {
-		a = l->data;
+	info = NULL;
+	num = 0;
 
-		if (a->handle < start)
-			continue;
+	for (n = attr_array_bound(&database, start); n < database.len; n++) {
+		a = database.attrs[n];
 
 		if (a->handle > end)
 			break;
@@ -566,46 +839,61 @@ static int find_info(uint16_t start, uint16_t end, uint8_t *pdu, int len)
 static int find_by_type(uint16_t start, uint16_t end, bt_uuid_t *uuid,
 			const uint8_t *value, int vlen, uint8_t *opdu, int mtu)
 {
+	struct attr_array *array;
 	struct attribute *a;
 	struct att_range *range;
-	GSList *l, *matches;
+	GSList *matches;
+	guint n;
 	int len;
 
 	if (start > end || start == 0x0000)
 		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
 					ATT_ECODE_INVALID_HANDLE, opdu, mtu);
 
-	/* Searching first requested handle number */
-	for (l = database, matches = NULL, range = NULL; l; l = l->next) {
-		a = l->data;
+	array = type_lookup(uuid, FALSE);
+	if (array == NULL)
+		return enc_error_resp(ATT_OP_FIND_BY_TYPE_REQ, start,
+				ATT_ECODE_ATTR_NOT_FOUND, opdu, mtu);
 
-		if (a->handle < start)
-			continue;
+	matches = NULL;
+
+	for (n = attr_array_bound(array, start); n < array->len; n++) {
+		uint32_t limit;
+		uint16_t next;
+
+		a = array->attrs[n];
 
 		if (a->handle > end)
 			break;
 
 		/* Primary service? Attribute value matches? */
-		if ((bt_uuid_cmp(&a->uuid, uuid) == 0) && (a->len == vlen) &&
-					(memcmp(a->data, value, vlen) == 0)) {
-
-			range = g_new0(struct att_range, 1);
-			range->start = a->handle;
-			/* It is allowed to have end group handle the same as
-			 * start handle, for groups with only one attribute. */
-			range->end = a->handle;
-
-			matches = g_slist_append(matches, range);
-		} else if (range) {
-			/* Update the last found handle or reset the pointer
-			 * to track that a new group started: Primary or
-			 * Secondary service. */
-			if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-					bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
-				range = NULL;
-			else
-				range->end = a->handle;
+		if (a->len != vlen || memcmp(a->data, value, vlen) != 0)
+			continue;
+
+		range = g_new0(struct att_range, 1);
+		range->start = a->handle;
+
+		/* The range extends up to the next service or the next
+		 * match, within the requested range. It is allowed to have
+		 * end group handle the same as start handle, for groups
+		 * with only one attribute. */
+		limit = (uint32_t) end + 1;
+
+		next = next_service(a->handle);
+		if (next && next < limit)
+			limit = next;
+
+		if (matches) {
+			struct att_range *prev = g_slist_last(matches)->data;
+
+			if (prev->end >= a->handle)
+				prev->end = last_handle_before(prev->start,
+								a->handle);
 		}
+
+		range->end = last_handle_before(a->handle, limit);
+
+		matches = g_slist_append(matches, range);
 	}
 
 	if (matches == NULL)
@@ -623,32 +911,18 @@ static int find_by_type(uint16_t start, uint16_t end, bt_uuid_t *uuid,
 static struct attribute *find_primary_range(uint16_t start, uint16_t *end)
 {
 	struct attribute *attrib;
-	guint h = start;
-	GSList *l;
 
 	if (end == NULL)
 		return NULL;
 
-	l = g_slist_find_custom(database, GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	attrib = attrib_find(start);
+	if (!attrib)
 		return NULL;
 
-	attrib = l->data;
-
 	if (bt_uuid_cmp(&attrib->uuid, &prim_uuid) != 0)
 		return NULL;
 
-	*end = start;
-
-	for (l = l->next; l; l = l->next) {
-		struct attribute *a = l->data;
-
-		if (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
-				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0)
-			break;
-
-		*end = a->handle;
-	}
+	*end = last_handle_before(start, next_service(start));
 
 	return attrib;
 }
@@ -658,16 +932,12 @@ static uint16_t read_value(struct gatt_channel *channel, uint16_t handle,
 {
 	struct attribute *a, *client_attr;
 	uint8_t status;
-	GSList *l;
-	guint h = handle;
 
-	l = g_slist_find_custom(database, GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	a = attrib_find(handle);
+	if (!a)
 		return enc_error_resp(ATT_OP_READ_REQ, handle,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	a = l->data;
-
 	status = att_check_reqs(channel, ATT_OP_READ_REQ, a->read_reqs);
 
 	client_attr = client_cfg_attribute(channel, a, a->data, a->len);
@@ -689,16 +959,12 @@ static uint16_t read_blob(struct gatt_channel *channel, uint16_t handle,
 {
 	struct attribute *a, *client_attr;
 	uint8_t status;
-	GSList *l;
-	guint h = handle;
 
-	l = g_slist_find_custom(database, GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	a = attrib_find(handle);
+	if (!a)
 		return enc_error_resp(ATT_OP_READ_BLOB_REQ, handle,
 					ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	a = l->data;
-
 	if (a->len <= offset)
 		return enc_error_resp(ATT_OP_READ_BLOB_REQ, handle,
 					ATT_ECODE_INVALID_OFFSET, pdu, len);
@@ -725,16 +991,12 @@ static uint16_t write_value(struct gatt_channel *channel, uint16_t handle,
 {
 	struct attribute *a, *client_attr;
 	uint8_t status;
-	GSList *l;
-	guint h = handle;
 
-	l = g_slist_find_custom(database, GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	a = attrib_find(handle);
+	if (!a)
 		return enc_error_resp(ATT_OP_WRITE_REQ, handle,
 				ATT_ECODE_INVALID_HANDLE, pdu, len);
 
-	a = l->data;
-
 	status = att_check_reqs(channel, ATT_OP_WRITE_REQ, a->write_reqs);
 	if (status)
 		return enc_error_resp(ATT_OP_WRITE_REQ, handle, status, pdu,
@@ -784,8 +1046,7 @@ static void channel_disconnect(void *user_data)
 	g_attrib_unref(channel->attrib);
 	clients = g_slist_remove(clients, channel);
 
-	g_slist_free(channel->notify);
-	g_slist_free(channel->indicate);
+	channel_unsubscribe_all(channel);
 	g_slist_foreach(channel->configs, (GFunc) g_free, NULL);
 	g_slist_free(channel->configs);
 
@@ -976,41 +1237,50 @@ static void confirm_event(GIOChannel *io, void *user_data)
 	return;
 }
 
-static void attrib_notify_clients(struct attribute *attr)
+/*
+ * The value is encoded once and the same PDU goes to every subscriber
+ * whose MTU can hold it; g_attrib_send() keeps its own copy.
+ */
+static void send_to_subscribers(GSList *channels, const uint8_t *pdu,
+								uint16_t len)
 {
-	guint handle = attr->handle;
 	GSList *l;
 
-	for (l = clients; l; l = l->next) {
+	for (l = channels; l; l = l->next) {
 		struct gatt_channel *channel = l->data;
 
-		/* Notification */
-		if (g_slist_find_custom(channel->notify,
-					GUINT_TO_POINTER(handle), handle_cmp)) {
-			uint8_t pdu[ATT_MAX_MTU];
-			uint16_t len;
-
-			len = enc_notification(attr, pdu, channel->mtu);
-			if (len == 0)
-				continue;
+		if (channel->mtu < len)
+			continue;
 
-			g_attrib_send(channel->attrib, 0, pdu[0], pdu, len,
+		g_attrib_send(channel->attrib, 0, pdu[0], pdu, len,
 							NULL, NULL, NULL);
-		}
+	}
+}
 
-		/* Indication */
-		if (g_slist_find_custom(channel->indicate,
-					GUINT_TO_POINTER(handle), handle_cmp)) {
-			uint8_t pdu[ATT_MAX_MTU];
-			uint16_t len;
+static void attrib_notify_clients(struct attribute *attr)
+{
+	struct subscribers *subs = NULL;
+	uint8_t pdu[ATT_MAX_MTU];
+	uint16_t len;
 
-			len = enc_indication(attr, pdu, channel->mtu);
-			if (len == 0)
-				return;
+	if (subscriptions)
+		subs = g_hash_table_lookup(subscriptions,
+					GUINT_TO_POINTER(attr->handle));
+	if (subs == NULL)
+		return;
 
-			g_attrib_send(channel->attrib, 0, pdu[0], pdu, len,
-							NULL, NULL, NULL);
-		}
+	/* Notification */
+	if (subs->notify) {
+		len = enc_notification(attr, pdu, sizeof(pdu));
+		if (len)
+			send_to_subscribers(subs->notify, pdu, len);
+	}
+
+	/* Indication */
+	if (subs->indicate) {
+		len = enc_indication(attr, pdu, sizeof(pdu));
+		if (len)
+			send_to_subscribers(subs->indicate, pdu, len);
 	}
 }
 
@@ -1131,9 +1401,18 @@ failed:
 void attrib_server_exit(void)
 {
 	GSList *l;
+	guint i;
+
+	for (i = 0; i < database.len; i++)
+		g_free(database.attrs[i]);
 
-	g_slist_foreach(database, (GFunc) g_free, NULL);
-	g_slist_free(database);
+	g_free(database.attrs);
+	memset(&database, 0, sizeof(database));
+
+	if (type_index) {
+		g_hash_table_destroy(type_index);
+		type_index = NULL;
+	}
 
 	if (l2cap_io) {
 		g_io_channel_unref(l2cap_io);
@@ -1148,8 +1427,7 @@ void attrib_server_exit(void)
 	for (l = clients; l; l = l->next) {
 		struct gatt_channel *channel = l->data;
 
-		g_slist_free(channel->notify);
-		g_slist_free(channel->indicate);
+		channel_unsubscribe_all(channel);
 		g_slist_foreach(channel->configs, (GFunc) g_free, NULL);
 		g_slist_free(channel->configs);
 
@@ -1159,6 +1437,11 @@ void attrib_server_exit(void)
 
 	g_slist_free(clients);
 
+	if (subscriptions) {
+		g_hash_table_destroy(subscriptions);
+		subscriptions = NULL;
+	}
+
 	if (gatt_sdp_handle)
 		remove_record_from_server(gatt_sdp_handle);
 
@@ -1215,12 +1498,12 @@ void attrib_free_sdp(uint32_t sdp_handle)
 uint16_t attrib_db_find_avail(uint16_t nitems)
 {
 	uint16_t handle;
-	GSList *l;
+	guint i;
 
 	g_assert(nitems > 0);
 
-	for (l = database, handle = 0; l; l = l->next) {
-		struct attribute *a = l->data;
+	for (i = 0, handle = 0; i < database.len; i++) {
+		struct attribute *a = database.attrs[i];
 
 		if (handle && (bt_uuid_cmp(&a->uuid, &prim_uuid) == 0 ||
 				bt_uuid_cmp(&a->uuid, &snd_uuid) == 0) &&
@@ -1244,11 +1527,10 @@ struct attribute *attrib_db_add(uint16_t handle, bt_uuid_t *uuid, int read_reqs,
 				int write_reqs, const uint8_t *value, int len)
 {
 	struct attribute *a;
-	guint h = handle;
 
 	DBG("handle=0x%04x", handle);
 
-	if (g_slist_find_custom(database, GUINT_TO_POINTER(h), handle_cmp))
+	if (attrib_find(handle))
 		return NULL;
 
 	a = g_malloc0(sizeof(struct attribute) + len);
@@ -1259,7 +1541,7 @@ struct attribute *attrib_db_add(uint16_t handle, bt_uuid_t *uuid, int read_reqs,
 	a->len = len;
 	memcpy(a->data, value, len);
 
-	database = g_slist_insert_sorted(database, a, attribute_cmp);
+	index_add(a);
 
 	return a;
 }
@@ -1267,23 +1549,38 @@ struct attribute *attrib_db_add(uint16_t handle, bt_uuid_t *uuid, int read_reqs,
 int attrib_db_update(uint16_t handle, bt_uuid_t *uuid, const uint8_t *value,
 					int len, struct attribute **attr)
 {
-	struct attribute *a;
-	GSList *l;
-	guint h = handle;
+	struct attribute *a, *old, **slot, **type_slot = NULL;
 
 	DBG("handle=0x%04x", handle);
 
-	l = g_slist_find_custom(database, GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	slot = attr_array_slot(&database, handle);
+	if (!slot)
 		return -ENOENT;
 
-	a = g_try_realloc(l->data, sizeof(struct attribute) + len);
-	if (a == NULL)
-		return -ENOMEM;
+	old = *slot;
 
-	l->data = a;
+	/* The type index is keyed by the UUID, which may change here */
 	if (uuid != NULL)
+		index_remove(old);
+	else
+		type_slot = attr_array_slot(type_lookup(&old->uuid, FALSE),
+								handle);
+
+	a = g_try_realloc(old, sizeof(struct attribute) + len);
+	if (a == NULL) {
+		if (uuid != NULL)
+			index_add(old);
+		return -ENOMEM;
+	}
+
+	if (uuid != NULL) {
 		memcpy(&a->uuid, uuid, sizeof(bt_uuid_t));
+		index_add(a);
+	} else {
+		*slot = a;
+		*type_slot = a;
+	}
+
 	a->len = len;
 	memcpy(a->data, value, len);
 
@@ -1298,17 +1595,15 @@ int attrib_db_update(uint16_t handle, bt_uuid_t *uuid, const uint8_t *value,
 int attrib_db_del(uint16_t handle)
 {
 	struct attribute *a;
-	GSList *l;
-	guint h = handle;
 
 	DBG("handle=0x%04x", handle);
 
-	l = g_slist_find_custom(database, GUINT_TO_POINTER(h), handle_cmp);
-	if (!l)
+	a = attrib_find(handle);
+	if (!a)
 		return -ENOENT;
 
-	a = l->data;
-	database = g_slist_remove(database, a);
+	index_remove(a);
+	drop_subscriptions(handle);
 	g_free(a);
 
 	return 0;
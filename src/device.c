@@ -102,6 +102,9 @@ struct browse_req {
 	int search_uuid;
 	int reconnect_attempt;
 	guint listener_id;
+	uint32_t db_state;			/* Remote ServiceDatabaseState */
+	gboolean db_state_valid;
+	gboolean cached;			/* Records read from the cache */
 };
 
 struct btd_device {
@@ -114,6 +117,11 @@ struct btd_device {
 	GSList		*uuids;
 	GSList		*services;		/* Primary services path */
 	GSList		*primaries;		/* List of primary services */
+	struct gatt_table *gatt_table;		/* Last discovered attributes */
+	gboolean	refresh;		/* Service Changed while browsing */
+	uint16_t	refresh_start;
+	uint16_t	refresh_end;
+	gboolean	gatt_cache_new;		/* Cache written this session */
 	GSList		*drivers;		/* List of device drivers */
 	GSList		*watches;		/* List of disconnect_data */
 	gboolean	temporary;
@@ -169,6 +177,23 @@ static void browse_request_free(struct browse_req *req)
 	g_free(req);
 }
 
+/* Run the Service Changed refresh held back by the browse just done */
+static void browse_refresh(struct btd_device *device)
+{
+	int err;
+
+	if (!device->refresh)
+		return;
+
+	device->refresh = FALSE;
+
+	err = device_refresh_primaries(device, device->refresh_start,
+							device->refresh_end);
+	if (err < 0)
+		error("Can't rediscover services: %s (%d)", strerror(-err),
+									-err);
+}
+
 static void browse_request_cancel(struct browse_req *req)
 {
 	struct btd_device *device = req->device;
@@ -180,7 +205,8 @@ static void browse_request_cancel(struct browse_req *req)
 
 	adapter_get_address(adapter, &src);
 
-	bt_cancel_discovery(&src, &device->bdaddr);
+	/* any of the browse steps may be in progress */
+	bt_cancel_discovery(&src, &device->bdaddr, NULL, req);
 
 	device->browse = NULL;
 	browse_request_free(req);
@@ -208,6 +234,8 @@ static void device_free(gpointer user_data)
 	g_slist_foreach(device->primaries, (GFunc) g_free, NULL);
 	g_slist_free(device->primaries);
 
+	gatt_table_free(device->gatt_table);
+
 	if (device->tmp_records)
 		sdp_list_free(device->tmp_records,
 					(sdp_free_func_t) sdp_record_free);
@@ -900,6 +928,15 @@ void device_remove_connection(struct btd_device *device, DBusConnection *conn)
 	if (device_is_paired(device) && !device->bonded)
 		device_set_paired(device, FALSE);
 
+	/* Without a bond nothing tells about changes made meanwhile */
+	if (!device->bonded && device->gatt_table) {
+		bdaddr_t sba;
+
+		adapter_get_address(device->adapter, &sba);
+		delete_gatt_cache(&sba, &device->bdaddr);
+		device_set_gatt_table(device, NULL);
+	}
+
 	emit_property_changed(conn, device->path,
 					DEVICE_INTERFACE, "Connected",
 					DBUS_TYPE_BOOLEAN, &device->connected);
@@ -1499,6 +1536,14 @@ static void search_cb(sdp_list_t *recs, int err, gpointer user_data)
 	device->tmp_records = req->records;
 	req->records = NULL;
 
+	if (req->db_state_valid && !req->cached) {
+		bdaddr_t src;
+
+		adapter_get_address(device->adapter, &src);
+		write_record_cache(&src, &device->bdaddr, req->db_state,
+							device->tmp_records);
+	}
+
 	if (!req->profiles_added && !req->profiles_removed) {
 		DBG("%s: No service update", addr);
 		goto send_reply;
@@ -1558,22 +1603,45 @@ cleanup:
 	}
 
 	device->browse = NULL;
+	browse_refresh(device);
 	browse_request_free(req);
 }
 
-static void browse_cb(sdp_list_t *recs, int err, gpointer user_data)
+static void browse_cb(sdp_list_t *recs, int err, gpointer user_data);
+
+/*
+ * Search the next step of uuid_list: L2CAP and PnP Information go in a
+ * single request over the same session, the public browse group only
+ * when they found nothing
+ */
+static int browse_search(struct browse_req *req)
 {
-	struct browse_req *req = user_data;
 	struct btd_device *device = req->device;
-	struct btd_adapter *adapter = device->adapter;
+	uuid_t uuids[2];
 	bdaddr_t src;
-	uuid_t uuid;
+	int count = 0;
+
+	do {
+		sdp_uuid16_create(&uuids[count++],
+					uuid_list[req->search_uuid++]);
+	} while (req->search_uuid < 2);
+
+	adapter_get_address(device->adapter, &src);
+
+	return bt_search_services(&src, &device->bdaddr, uuids, count,
+							browse_cb, req, NULL);
+}
+
+static void browse_cb(sdp_list_t *recs, int err, gpointer user_data)
+{
+	struct browse_req *req = user_data;
 
 	/* If we have a valid response and req->search_uuid == 2, then L2CAP
 	 * UUID & PNP searching was successful -- we are done */
 	if (err < 0 || (req->search_uuid == 2 && req->records)) {
 		if (err == -ECONNRESET && req->reconnect_attempt < 1) {
-			req->search_uuid--;
+			/* retry the step that failed */
+			req->search_uuid = req->search_uuid > 2 ? 2 : 0;
 			req->reconnect_attempt++;
 		} else
 			goto done;
@@ -1581,13 +1649,9 @@ static void browse_cb(sdp_list_t *recs, int err, gpointer user_data)
 
 	update_services(req, recs);
 
-	adapter_get_address(adapter, &src);
-
 	/* Search for mandatory uuids */
 	if (uuid_list[req->search_uuid]) {
-		sdp_uuid16_create(&uuid, uuid_list[req->search_uuid++]);
-		bt_search_service(&src, &device->bdaddr, &uuid,
-						browse_cb, user_data, NULL);
+		browse_search(req);
 		return;
 	}
 
@@ -1595,6 +1659,51 @@ done:
 	search_cb(recs, err, user_data);
 }
 
+/*
+ * The remote ServiceDatabaseState changes whenever a record is added or
+ * removed, if it still matches the one the cached records were read with
+ * they are used instead of browsing again
+ */
+static void db_state_cb(sdp_list_t *recs, int err, gpointer user_data)
+{
+	struct browse_req *req = user_data;
+	struct btd_device *device = req->device;
+	struct btd_adapter *adapter = device->adapter;
+	sdp_list_t *cached;
+	sdp_data_t *d;
+	uint32_t state;
+	bdaddr_t src;
+
+	adapter_get_address(adapter, &src);
+
+	if (err == 0 && recs && recs->data) {
+		d = sdp_data_get(recs->data, SDP_ATTR_SVCDB_STATE);
+		if (d && d->dtd == SDP_UINT32) {
+			req->db_state = d->val.uint32;
+			req->db_state_valid = TRUE;
+		}
+	}
+
+	if (req->db_state_valid) {
+		cached = read_record_cache(&src, &device->bdaddr, &state);
+		if (cached && state == req->db_state) {
+			DBG("Database state 0x%08x unchanged, using cached "
+							"records", state);
+			req->cached = TRUE;
+			search_cb(cached, 0, req);
+			sdp_list_free(cached, (sdp_free_func_t) sdp_record_free);
+			return;
+		}
+
+		if (cached)
+			sdp_list_free(cached, (sdp_free_func_t) sdp_record_free);
+	}
+
+	err = browse_search(req);
+	if (err < 0)
+		search_cb(NULL, err, req);
+}
+
 static void init_browse(struct browse_req *req, gboolean reverse)
 {
 	GSList *l;
@@ -1648,14 +1757,29 @@ static void store_services(struct btd_device *device)
 	g_free(str);
 }
 
+static int primary_start_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct att_primary *prim1 = a;
+	const struct att_primary *prim2 = b;
+
+	return prim1->start - prim2->start;
+}
+
 static void primary_cb(GSList *services, guint8 status, gpointer user_data)
 {
 	struct browse_req *req = user_data;
 	struct btd_device *device = req->device;
-	GSList *l, *uuids = NULL;
+	GSList *l, *added = NULL, *uuids = NULL;
 
 	if (status) {
 		DBusMessage *reply;
+
+		if (req->msg == NULL) {
+			error("Discover primary services failed: %s",
+						att_ecode2str(status));
+			goto done;
+		}
+
 		reply = btd_error_failed(req->msg, att_ecode2str(status));
 		g_dbus_send_message(req->conn, reply);
 		goto done;
@@ -1666,24 +1790,60 @@ static void primary_cb(GSList *services, guint8 status, gpointer user_data)
 
 	for (l = services; l; l = l->next) {
 		struct att_primary *prim = l->data;
+
+		/* Kept registered across a Service Changed refresh */
+		if (g_slist_find_custom(device->primaries, prim,
+							primary_start_cmp)) {
+			g_free(prim);
+			continue;
+		}
+
+		added = g_slist_append(added, prim);
 		uuids = g_slist_append(uuids, prim->uuid);
 	}
 
 	device_probe_drivers(device, uuids);
 
-	device_register_services(req->conn, device, g_slist_copy(services), -1);
+	device_register_services(req->conn, device, added, -1);
 
 	g_slist_free(uuids);
 
-	create_device_reply(device, req);
+	if (req->msg)
+		create_device_reply(device, req);
 
 	store_services(device);
 
 done:
 	device->browse = NULL;
+	browse_refresh(device);
 	browse_request_free(req);
 }
 
+static void discover_all_cb(struct gatt_table *table, guint8 status,
+							gpointer user_data)
+{
+	struct browse_req *req = user_data;
+	struct btd_device *device = req->device;
+	GSList *services = NULL;
+
+	if (table) {
+		bdaddr_t sba;
+
+		services = gatt_table_primaries(table);
+		device_set_gatt_table(device, table);
+
+		/* Service Changed is only queued for bonded clients */
+		adapter_get_address(device->adapter, &sba);
+		if (device->bonded &&
+				write_gatt_cache(&sba, &device->bdaddr, table) == 0)
+			device->gatt_cache_new = TRUE;
+	}
+
+	/* The device keeps the primaries, only the list is ours */
+	primary_cb(services, status, req);
+	g_slist_free(services);
+}
+
 static void gatt_connect_cb(GIOChannel *io, GError *gerr, gpointer user_data)
 {
 	struct browse_req *req = user_data;
@@ -1694,10 +1854,13 @@ static void gatt_connect_cb(GIOChannel *io, GError *gerr, gpointer user_data)
 
 		DBG("%s", gerr->message);
 
-		reply = btd_error_failed(req->msg, gerr->message);
-		g_dbus_send_message(req->conn, reply);
+		if (req->msg) {
+			reply = btd_error_failed(req->msg, gerr->message);
+			g_dbus_send_message(req->conn, reply);
+		}
 
 		device->browse = NULL;
+		browse_refresh(device);
 		browse_request_free(req);
 
 		return;
@@ -1706,7 +1869,9 @@ static void gatt_connect_cb(GIOChannel *io, GError *gerr, gpointer user_data)
 	req->attrib = g_attrib_new(io);
 	g_io_channel_unref(io);
 
-	gatt_discover_primary(req->attrib, NULL, primary_cb, req);
+	/* Services, characteristics and descriptors in a single pass */
+	if (gatt_discover_all(req->attrib, discover_all_cb, req) == 0)
+		discover_all_cb(NULL, ATT_ECODE_IO, req);
 }
 
 int device_browse_primary(struct btd_device *device, DBusConnection *conn,
@@ -1766,7 +1931,6 @@ int device_browse_sdp(struct btd_device *device, DBusConnection *conn,
 {
 	struct btd_adapter *adapter = device->adapter;
 	struct browse_req *req;
-	bt_callback_t cb;
 	bdaddr_t src;
 	uuid_t uuid;
 	int err;
@@ -1780,14 +1944,16 @@ int device_browse_sdp(struct btd_device *device, DBusConnection *conn,
 	req->device = btd_device_ref(device);
 	if (search) {
 		memcpy(&uuid, search, sizeof(uuid_t));
-		cb = search_cb;
+		err = bt_search_service(&src, &device->bdaddr, &uuid,
+						search_cb, req, NULL);
 	} else {
-		sdp_uuid16_create(&uuid, uuid_list[req->search_uuid++]);
 		init_browse(req, reverse);
-		cb = browse_cb;
+		err = bt_read_service_attr(&src, &device->bdaddr,
+					SDP_SERVER_RECORD_HANDLE,
+					SDP_ATTR_SVCDB_STATE,
+					db_state_cb, req, NULL);
 	}
 
-	err = bt_search_service(&src, &device->bdaddr, &uuid, cb, req, NULL);
 	if (err < 0) {
 		browse_request_free(req);
 		return err;
@@ -1866,6 +2032,11 @@ void device_set_temporary(struct btd_device *device, gboolean temporary)
 	device->temporary = temporary;
 }
 
+gboolean device_is_bonded(struct btd_device *device)
+{
+	return device->bonded;
+}
+
 void device_set_bonded(struct btd_device *device, gboolean bonded)
 {
 	if (!device)
@@ -2456,16 +2627,107 @@ void device_set_authorizing(struct btd_device *device, gboolean auth)
 void device_register_services(DBusConnection *conn, struct btd_device *device,
 						GSList *prim_list, int psm)
 {
-	device->services = attrib_client_register(conn, device, psm, NULL,
-								prim_list);
+	GSList *paths;
+
+	paths = attrib_client_register(conn, device, psm, NULL, prim_list);
+
+	device->services = g_slist_concat(device->services, paths);
 	device->primaries = g_slist_concat(device->primaries, prim_list);
 }
 
+/*
+ * The remote database changed within start-end: forget the primary
+ * services overlapping it and browse again for the current ones. While
+ * a browse is running the refresh waits for it to finish.
+ */
+int device_refresh_primaries(struct btd_device *device, uint16_t start,
+								uint16_t end)
+{
+	GSList *l, *next;
+	bdaddr_t sba;
+
+	if (device->browse) {
+		if (device->refresh) {
+			start = MIN(start, device->refresh_start);
+			end = MAX(end, device->refresh_end);
+		}
+
+		device->refresh = TRUE;
+		device->refresh_start = start;
+		device->refresh_end = end;
+
+		return 0;
+	}
+
+	/* The objects go first, they point to the primaries */
+	attrib_client_remove_primaries(device, start, end);
+
+	for (l = device->primaries; l; l = next) {
+		struct att_primary *prim = l->data;
+		GSList *lpath;
+		char *path;
+
+		next = l->next;
+
+		if (prim->end < start || prim->start > end)
+			continue;
+
+		path = g_strdup_printf("%s/service%04x", device->path,
+								prim->start);
+		lpath = g_slist_find_custom(device->services, path,
+							(GCompareFunc) strcmp);
+		if (lpath) {
+			g_free(lpath->data);
+			device->services = g_slist_delete_link(device->services,
+									lpath);
+		}
+		g_free(path);
+
+		device->primaries = g_slist_delete_link(device->primaries, l);
+		g_free(prim);
+	}
+
+	adapter_get_address(device->adapter, &sba);
+	delete_gatt_cache(&sba, &device->bdaddr);
+	device_set_gatt_table(device, NULL);
+
+	store_services(device);
+	services_changed(device);
+
+	return device_browse_primary(device, NULL, NULL, FALSE);
+}
+
 GSList *btd_device_get_primaries(struct btd_device *device)
 {
 	return device->primaries;
 }
 
+struct gatt_table *device_get_gatt_table(struct btd_device *device)
+{
+	return device->gatt_table;
+}
+
+void device_set_gatt_table(struct btd_device *device,
+						struct gatt_table *table)
+{
+	if (device->gatt_table == table)
+		return;
+
+	gatt_table_free(device->gatt_table);
+	device->gatt_table = table;
+	device->gatt_cache_new = FALSE;
+}
+
+gboolean device_is_gatt_cache_new(struct btd_device *device)
+{
+	return device->gatt_cache_new;
+}
+
+void device_set_gatt_cache_new(struct btd_device *device, gboolean cache_new)
+{
+	device->gatt_cache_new = cache_new;
+}
+
 void btd_device_add_uuid(struct btd_device *device, const char *uuid)
 {
 	GSList *uuid_list;
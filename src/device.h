@@ -25,6 +25,7 @@
 #define DEVICE_INTERFACE	"org.bluez.Device"
 
 struct btd_device;
+struct gatt_table;
 
 typedef enum {
 	AUTH_TYPE_PINCODE,
@@ -58,8 +59,15 @@ void device_probe_drivers(struct btd_device *device, GSList *profiles);
 const sdp_record_t *btd_device_get_record(struct btd_device *device,
 						const char *uuid);
 GSList *btd_device_get_primaries(struct btd_device *device);
+struct gatt_table *device_get_gatt_table(struct btd_device *device);
+void device_set_gatt_table(struct btd_device *device,
+						struct gatt_table *table);
+gboolean device_is_gatt_cache_new(struct btd_device *device);
+void device_set_gatt_cache_new(struct btd_device *device, gboolean cache_new);
 void device_register_services(DBusConnection *conn, struct btd_device *device,
 						GSList *prim_list, int psm);
+int device_refresh_primaries(struct btd_device *device, uint16_t start,
+								uint16_t end);
 GSList *device_services_from_record(struct btd_device *device,
 							GSList *profiles);
 void btd_device_add_uuid(struct btd_device *device, const char *uuid);
@@ -74,6 +82,7 @@ gboolean device_is_trusted(struct btd_device *device);
 void device_set_paired(struct btd_device *device, gboolean paired);
 void device_set_temporary(struct btd_device *device, gboolean temporary);
 void device_set_type(struct btd_device *device, device_type_t type);
+gboolean device_is_bonded(struct btd_device *device);
 void device_set_bonded(struct btd_device *device, gboolean bonded);
 gboolean device_is_connected(struct btd_device *device);
 DBusMessage *device_create_bonding(struct btd_device *device,
@@ -38,114 +38,384 @@
 #include <glib.h>
 
 #include "btio.h"
+#include "log.h"
 #include "sdpd.h"
 #include "glib-helper.h"
 
-/* Number of seconds to keep a sdp_session_t in the cache */
+/* Number of seconds to keep an unused sdp_session_t in the cache */
 #define CACHE_TIMEOUT 2
 
+/* Default number of unused sessions kept in the cache */
+#define CACHE_MAX_SESSIONS 4
+
+/*
+ * SDP client sessions are pooled per pair of devices. A session is
+ * referenced by the search context using it and kept connected for
+ * CACHE_TIMEOUT seconds once released, the least recently released ones
+ * are closed first when more than cache_limit of them are unused.
+ */
 struct cached_sdp_session {
 	bdaddr_t src;
 	bdaddr_t dst;
 	sdp_session_t *session;
+	int ref;
 	guint timer;
 };
 
-static GSList *cached_sdp_sessions = NULL;
+static GHashTable *cached_sdp_sessions = NULL;
+static GQueue *cached_lru = NULL;	/* Unused, most recent first */
+static unsigned int cache_limit = CACHE_MAX_SESSIONS;
 
-static gboolean cached_session_expired(gpointer user_data)
+static struct {
+	unsigned long hits;		/* Requests served by a cached session */
+	unsigned long misses;		/* Requests that had to connect */
+	unsigned long evictions;	/* Unused sessions closed over the limit */
+	unsigned long expirations;	/* Unused sessions closed after timeout */
+} cache_stats;
+
+static guint cached_session_hash(gconstpointer key)
 {
-	struct cached_sdp_session *cached = user_data;
+	const struct cached_sdp_session *c = key;
+	guint h = 0;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		h = (h * 31 + c->dst.b[i]) ^ (c->src.b[i] << 8);
+
+	return h;
+}
+
+static gboolean cached_session_equal(gconstpointer a, gconstpointer b)
+{
+	const struct cached_sdp_session *c1 = a, *c2 = b;
+
+	return !bacmp(&c1->src, &c2->src) && !bacmp(&c1->dst, &c2->dst);
+}
+
+static void drop_sdp_session(struct cached_sdp_session *cached)
+{
+	if (cached->timer)
+		g_source_remove(cached->timer);
+
+	if (cached->ref == 0)
+		g_queue_remove(cached_lru, cached);
 
-	cached_sdp_sessions = g_slist_remove(cached_sdp_sessions, cached);
+	g_hash_table_remove(cached_sdp_sessions, cached);
 
 	sdp_close(cached->session);
 
 	g_free(cached);
+}
+
+static gboolean cached_session_expired(gpointer user_data)
+{
+	struct cached_sdp_session *cached = user_data;
+
+	cached->timer = 0;
+	cache_stats.expirations++;
+
+	drop_sdp_session(cached);
 
 	return FALSE;
 }
 
-static sdp_session_t *get_sdp_session(const bdaddr_t *src, const bdaddr_t *dst)
+static struct cached_sdp_session *get_sdp_session(const bdaddr_t *src,
+							const bdaddr_t *dst)
 {
-	GSList *l;
-
-	for (l = cached_sdp_sessions; l != NULL; l = l->next) {
-		struct cached_sdp_session *c = l->data;
-		sdp_session_t *session;
+	struct cached_sdp_session match, *cached;
+	sdp_session_t *session;
 
-		if (bacmp(&c->src, src) || bacmp(&c->dst, dst))
-			continue;
+	if (!cached_sdp_sessions) {
+		cached_sdp_sessions = g_hash_table_new(cached_session_hash,
+							cached_session_equal);
+		cached_lru = g_queue_new();
+	}
 
-		g_source_remove(c->timer);
+	bacpy(&match.src, src);
+	bacpy(&match.dst, dst);
 
-		session = c->session;
+	cached = g_hash_table_lookup(cached_sdp_sessions, &match);
+	if (cached) {
+		if (cached->ref++ == 0) {
+			g_queue_remove(cached_lru, cached);
+			g_source_remove(cached->timer);
+			cached->timer = 0;
+		}
 
-		cached_sdp_sessions = g_slist_remove(cached_sdp_sessions, c);
-		g_free(c);
+		cache_stats.hits++;
 
-		return session;
+		return cached;
 	}
 
-	return sdp_connect(src, dst, SDP_NON_BLOCKING);
-}
+	session = sdp_connect(src, dst, SDP_NON_BLOCKING);
+	if (!session)
+		return NULL;
 
-static void cache_sdp_session(bdaddr_t *src, bdaddr_t *dst,
-						sdp_session_t *session)
-{
-	struct cached_sdp_session *cached;
+	cache_stats.misses++;
 
 	cached = g_new0(struct cached_sdp_session, 1);
-
 	bacpy(&cached->src, src);
 	bacpy(&cached->dst, dst);
-
 	cached->session = session;
+	cached->ref = 1;
 
-	cached_sdp_sessions = g_slist_append(cached_sdp_sessions, cached);
+	g_hash_table_insert(cached_sdp_sessions, cached, cached);
 
+	return cached;
+}
+
+static void put_sdp_session(struct cached_sdp_session *cached)
+{
+	if (--cached->ref > 0)
+		return;
+
+	g_queue_push_head(cached_lru, cached);
 	cached->timer = g_timeout_add_seconds(CACHE_TIMEOUT,
 						cached_session_expired,
 						cached);
+
+	while (g_queue_get_length(cached_lru) > cache_limit) {
+		cache_stats.evictions++;
+		drop_sdp_session(g_queue_peek_tail(cached_lru));
+	}
+
+	DBG("%u SDP sessions open, %u unused: %lu hits, %lu misses, "
+		"%lu evictions, %lu expirations",
+		g_hash_table_size(cached_sdp_sessions),
+		g_queue_get_length(cached_lru), cache_stats.hits,
+		cache_stats.misses, cache_stats.evictions,
+		cache_stats.expirations);
 }
 
+void bt_set_sdp_session_cache_size(unsigned int size)
+{
+	cache_limit = size;
+
+	if (!cached_lru)
+		return;
+
+	while (g_queue_get_length(cached_lru) > cache_limit) {
+		cache_stats.evictions++;
+		drop_sdp_session(g_queue_peek_tail(cached_lru));
+	}
+}
+
+/*
+ * A search request covers one or more UUIDs, searched one after the
+ * other since a ServiceSearchPattern only matches records holding all of
+ * its UUIDs. The records found are merged and handed to the callback once
+ * the last UUID is done.
+ */
+struct search_request {
+	uuid_t			*uuids;
+	int			count;
+	int			index;		/* UUID being searched */
+	gboolean		read_attr;
+	uint32_t		handle;
+	uint16_t		attr;
+	sdp_list_t		*recs;
+	int			proto;		/* Port lookup only */
+	int			port;
+	bt_callback_t		cb;
+	bt_port_callback_t	port_cb;
+	bt_destroy_t		destroy;
+	gpointer		user_data;
+};
+
+/*
+ * All the requests for the same pair of devices are queued on a single
+ * context and run in turn over its SDP session, the first request of the
+ * queue is the one in progress.
+ */
 struct search_context {
 	bdaddr_t		src;
 	bdaddr_t		dst;
+	struct cached_sdp_session *cached;
 	sdp_session_t		*session;
-	bt_callback_t		cb;
-	bt_destroy_t		destroy;
-	gpointer		user_data;
-	uuid_t			uuid;
+	GSList			*requests;
 	guint			io_id;
 };
 
 static GSList *context_list = NULL;
 
+static gboolean search_process_cb(GIOChannel *chan, GIOCondition cond,
+							gpointer user_data);
+static int search_connect(struct search_context *ctxt);
+
+static void search_request_free(struct search_request *req)
+{
+	if (req->destroy)
+		req->destroy(req->user_data);
+
+	if (req->recs)
+		sdp_list_free(req->recs, (sdp_free_func_t) sdp_record_free);
+
+	g_free(req->uuids);
+	g_free(req);
+}
+
+static void search_request_reply(struct search_request *req, int err)
+{
+	if (req->port_cb)
+		req->port_cb(err < 0 ? 0 : req->port, err, req->user_data);
+	else if (req->cb)
+		req->cb(err < 0 ? NULL : req->recs, err, req->user_data);
+}
+
 static void search_context_cleanup(struct search_context *ctxt)
 {
 	context_list = g_slist_remove(context_list, ctxt);
 
-	if (ctxt->destroy)
-		ctxt->destroy(ctxt->user_data);
+	g_slist_foreach(ctxt->requests, (GFunc) search_request_free, NULL);
+	g_slist_free(ctxt->requests);
 
 	g_free(ctxt);
 }
 
+/*
+ * Fail every queued request, the context is unlisted first so callbacks
+ * retrying a search get a new connection
+ */
+static void search_context_fail(struct search_context *ctxt, int err)
+{
+	context_list = g_slist_remove(context_list, ctxt);
+
+	if (ctxt->cached) {
+		drop_sdp_session(ctxt->cached);
+		ctxt->cached = NULL;
+		ctxt->session = NULL;
+	}
+
+	while (ctxt->requests) {
+		struct search_request *req = ctxt->requests->data;
+
+		ctxt->requests = g_slist_remove(ctxt->requests, req);
+
+		search_request_reply(req, err);
+
+		search_request_free(req);
+	}
+
+	search_context_cleanup(ctxt);
+}
+
+static int rec_cmp(const void *a, const void *b)
+{
+	const sdp_record_t *r1 = a;
+	const sdp_record_t *r2 = b;
+
+	return r1->handle - r2->handle;
+}
+
+/* Start the transaction for the current step of the first request */
+static int search_send(struct search_context *ctxt)
+{
+	struct search_request *req = ctxt->requests->data;
+	sdp_list_t *search, *attrids;
+	uint32_t range = 0x0000ffff;
+	GIOChannel *chan;
+	int err;
+
+	if (req->read_attr) {
+		attrids = sdp_list_append(NULL, &req->attr);
+		err = sdp_service_attr_async(ctxt->session, req->handle,
+					SDP_ATTR_REQ_INDIVIDUAL, attrids);
+		sdp_list_free(attrids, NULL);
+	} else {
+		search = sdp_list_append(NULL, &req->uuids[req->index]);
+		attrids = sdp_list_append(NULL, &range);
+		err = sdp_service_search_attr_async(ctxt->session,
+				search, SDP_ATTR_REQ_RANGE, attrids);
+		sdp_list_free(attrids, NULL);
+		sdp_list_free(search, NULL);
+	}
+
+	if (err < 0)
+		return -EIO;
+
+	/* Set callback responsible for update the internal SDP transaction */
+	chan = g_io_channel_unix_new(sdp_get_socket(ctxt->session));
+	ctxt->io_id = g_io_add_watch(chan,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				search_process_cb, ctxt);
+	g_io_channel_unref(chan);
+
+	return 0;
+}
+
+/*
+ * Port of proto in the first record of a ServiceSearchAttribute response
+ * that has one, read in place without extracting the records
+ */
+static int rsp_get_proto_port(const uint8_t *rsp, size_t size, int proto)
+{
+	sdp_cursor_t cur;
+	sdp_elem_t seq, rec;
+	const uint8_t *start;
+	int port;
+
+	sdp_cursor_init(&cur, rsp, size);
+
+	if (sdp_cursor_next(&cur, &seq) <= 0 ||
+			seq.dtd < SDP_SEQ8 || seq.dtd > SDP_SEQ32)
+		return -EPROTO;
+
+	sdp_cursor_enter(&cur, &seq);
+
+	for (start = cur.pos; sdp_cursor_next(&cur, &rec) > 0;
+							start = cur.pos) {
+		port = sdp_pdu_get_proto_port(start, cur.pos - start, proto);
+		if (port > 0)
+			return port;
+	}
+
+	return 0;
+}
+
 static void search_completed_cb(uint8_t type, uint16_t status,
 			uint8_t *rsp, size_t size, void *user_data)
 {
 	struct search_context *ctxt = user_data;
-	sdp_list_t *recs = NULL;
+	struct search_request *req = ctxt->requests->data;
+	sdp_list_t *recs = NULL, *l;
 	int scanned, seqlen = 0, bytesleft = size;
 	uint8_t dataType;
 	int err = 0;
 
+	/* sdp_process() is done with the transaction, so is its watch */
+	ctxt->io_id = 0;
+
+	if (req->read_attr) {
+		sdp_record_t *rec;
+
+		if (status || type != SDP_SVC_ATTR_RSP) {
+			err = -EPROTO;
+			goto done;
+		}
+
+		rec = sdp_extract_pdu_arena(rsp, size, &scanned);
+		if (rec)
+			recs = sdp_list_append(NULL, rec);
+
+		goto done;
+	}
+
 	if (status || type != SDP_SVC_SEARCH_ATTR_RSP) {
 		err = -EPROTO;
 		goto done;
 	}
 
+	if (req->port_cb) {
+		err = rsp_get_proto_port(rsp, size, req->proto);
+		if (err > 0) {
+			req->port = err;
+			err = 0;
+			/* Found, the remaining UUIDs can't do better */
+			req->index = req->count;
+		}
+		goto done;
+	}
+
 	scanned = sdp_extract_seqtype(rsp, bytesleft, &dataType, &seqlen);
 	if (!scanned || !seqlen)
 		goto done;
@@ -157,7 +427,7 @@ static void search_completed_cb(uint8_t type, uint16_t status,
 		int recsize;
 
 		recsize = 0;
-		rec = sdp_extract_pdu(rsp, bytesleft, &recsize);
+		rec = sdp_extract_pdu_arena(rsp, bytesleft, &recsize);
 		if (!rec)
 			break;
 
@@ -174,13 +444,39 @@ static void search_completed_cb(uint8_t type, uint16_t status,
 	} while (scanned < (ssize_t) size && bytesleft > 0);
 
 done:
-	cache_sdp_session(&ctxt->src, &ctxt->dst, ctxt->session);
+	/* Merge the records, the UUIDs of a request may match the same ones */
+	for (l = recs; l; l = l->next) {
+		if (sdp_list_find(req->recs, l->data, rec_cmp))
+			sdp_record_free(l->data);
+		else
+			req->recs = sdp_list_append(req->recs, l->data);
+	}
+	sdp_list_free(recs, NULL);
+
+	if (err == 0 && ++req->index < req->count) {
+		if (search_send(ctxt) == 0)
+			return;
+
+		err = -EIO;
+	}
 
-	if (ctxt->cb)
-		ctxt->cb(recs, err, ctxt->user_data);
+	ctxt->requests = g_slist_remove(ctxt->requests, req);
 
-	if (recs)
-		sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+	search_request_reply(req, err);
+
+	search_request_free(req);
+
+	/* Requests queued meanwhile, including from the callback, reuse
+	 * the session right away */
+	if (ctxt->requests) {
+		if (search_send(ctxt) < 0)
+			search_context_fail(ctxt, -EIO);
+		return;
+	}
+
+	put_sdp_session(ctxt->cached);
+	ctxt->cached = NULL;
+	ctxt->session = NULL;
 
 	search_context_cleanup(ctxt);
 }
@@ -189,38 +485,25 @@ static gboolean search_process_cb(GIOChannel *chan, GIOCondition cond,
 							gpointer user_data)
 {
 	struct search_context *ctxt = user_data;
-	int err = 0;
 
 	if (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
-		err = EIO;
-		goto failed;
+		ctxt->io_id = 0;
+		search_context_fail(ctxt, -EIO);
+		return FALSE;
 	}
 
+	/* Once the transaction completes the context may be gone or have
+	 * installed a new watch for its next one */
 	if (sdp_process(ctxt->session) < 0)
-		goto failed;
+		return FALSE;
 
 	return TRUE;
-
-failed:
-	if (err) {
-		sdp_close(ctxt->session);
-		ctxt->session = NULL;
-
-		if (ctxt->cb)
-			ctxt->cb(NULL, err, ctxt->user_data);
-
-		search_context_cleanup(ctxt);
-	}
-
-	return FALSE;
 }
 
 static gboolean connect_watch(GIOChannel *chan, GIOCondition cond,
 							gpointer user_data)
 {
 	struct search_context *ctxt = user_data;
-	sdp_list_t *search, *attrids;
-	uint32_t range = 0x0000ffff;
 	socklen_t len;
 	int sk, err = 0;
 
@@ -241,129 +524,262 @@ static gboolean connect_watch(GIOChannel *chan, GIOCondition cond,
 		goto failed;
 	}
 
-	search = sdp_list_append(NULL, &ctxt->uuid);
-	attrids = sdp_list_append(NULL, &range);
-	if (sdp_service_search_attr_async(ctxt->session,
-				search, SDP_ATTR_REQ_RANGE, attrids) < 0) {
-		sdp_list_free(attrids, NULL);
-		sdp_list_free(search, NULL);
+	if (search_send(ctxt) < 0) {
 		err = EIO;
 		goto failed;
 	}
 
-	sdp_list_free(attrids, NULL);
-	sdp_list_free(search, NULL);
-
-	/* Set callback responsible for update the internal SDP transaction */
-	ctxt->io_id = g_io_add_watch(chan,
-				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-				search_process_cb, ctxt);
 	return FALSE;
 
 failed:
-	sdp_close(ctxt->session);
-	ctxt->session = NULL;
-
-	if (ctxt->cb)
-		ctxt->cb(NULL, -err, ctxt->user_data);
-
-	search_context_cleanup(ctxt);
+	search_context_fail(ctxt, -err);
 
 	return FALSE;
 }
 
-static int create_search_context(struct search_context **ctxt,
-					const bdaddr_t *src,
-					const bdaddr_t *dst,
-					uuid_t *uuid)
+static int search_connect(struct search_context *ctxt)
 {
-	sdp_session_t *s;
 	GIOChannel *chan;
 
-	if (!ctxt)
-		return -EINVAL;
-
-	s = get_sdp_session(src, dst);
-	if (!s)
+	ctxt->cached = get_sdp_session(&ctxt->src, &ctxt->dst);
+	if (!ctxt->cached)
 		return -errno;
 
-	*ctxt = g_try_malloc0(sizeof(struct search_context));
-	if (!*ctxt) {
-		sdp_close(s);
-		return -ENOMEM;
-	}
-
-	bacpy(&(*ctxt)->src, src);
-	bacpy(&(*ctxt)->dst, dst);
-	(*ctxt)->session = s;
-	(*ctxt)->uuid = *uuid;
+	ctxt->session = ctxt->cached->session;
 
-	chan = g_io_channel_unix_new(sdp_get_socket(s));
-	(*ctxt)->io_id = g_io_add_watch(chan,
+	chan = g_io_channel_unix_new(sdp_get_socket(ctxt->session));
+	ctxt->io_id = g_io_add_watch(chan,
 				G_IO_OUT | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-				connect_watch, *ctxt);
+				connect_watch, ctxt);
 	g_io_channel_unref(chan);
 
 	return 0;
 }
 
+static struct search_context *find_context(const bdaddr_t *src,
+							const bdaddr_t *dst)
+{
+	GSList *l;
+
+	for (l = context_list; l; l = l->next) {
+		struct search_context *ctxt = l->data;
+
+		if (!bacmp(&ctxt->src, src) && !bacmp(&ctxt->dst, dst))
+			return ctxt;
+	}
+
+	return NULL;
+}
+
+/*
+ * Queue req behind the ongoing requests for src and dst or start a new
+ * context for it. On failure req is left to the caller.
+ */
+static int search_request_add(const bdaddr_t *src, const bdaddr_t *dst,
+						struct search_request *req)
+{
+	struct search_context *ctxt;
+	int err;
+
+	ctxt = find_context(src, dst);
+	if (ctxt) {
+		ctxt->requests = g_slist_append(ctxt->requests, req);
+		return 0;
+	}
+
+	ctxt = g_try_malloc0(sizeof(struct search_context));
+	if (!ctxt)
+		return -ENOMEM;
+
+	bacpy(&ctxt->src, src);
+	bacpy(&ctxt->dst, dst);
+
+	err = search_connect(ctxt);
+	if (err < 0) {
+		g_free(ctxt);
+		return err;
+	}
+
+	ctxt->requests = g_slist_append(NULL, req);
+	context_list = g_slist_append(context_list, ctxt);
+
+	return 0;
+}
+
+int bt_search_services(const bdaddr_t *src, const bdaddr_t *dst,
+			uuid_t *uuids, int count, bt_callback_t cb,
+			void *user_data, bt_destroy_t destroy)
+{
+	struct search_request *req;
+	int err;
+
+	if (!cb || !uuids || count < 1)
+		return -EINVAL;
+
+	req = g_try_malloc0(sizeof(struct search_request));
+	if (!req)
+		return -ENOMEM;
+
+	req->uuids = g_memdup(uuids, count * sizeof(uuid_t));
+	req->count = count;
+	req->cb = cb;
+	req->destroy = destroy;
+	req->user_data = user_data;
+
+	err = search_request_add(src, dst, req);
+	if (err < 0) {
+		g_free(req->uuids);
+		g_free(req);
+	}
+
+	return err;
+}
+
 int bt_search_service(const bdaddr_t *src, const bdaddr_t *dst,
 			uuid_t *uuid, bt_callback_t cb, void *user_data,
 			bt_destroy_t destroy)
 {
-	struct search_context *ctxt = NULL;
+	return bt_search_services(src, dst, uuid, 1, cb, user_data, destroy);
+}
+
+/*
+ * Look up the port of proto (L2CAP or RFCOMM) in the records matching
+ * uuid, cb gets 0 if none has it. Nothing is extracted, the port is read
+ * straight from the response.
+ */
+int bt_search_service_port(const bdaddr_t *src, const bdaddr_t *dst,
+				uuid_t *uuid, int proto,
+				bt_port_callback_t cb, void *user_data,
+				bt_destroy_t destroy)
+{
+	struct search_request *req;
 	int err;
 
-	if (!cb)
+	if (!cb || !uuid)
 		return -EINVAL;
 
-	err = create_search_context(&ctxt, src, dst, uuid);
-	if (err < 0)
-		return err;
+	if (proto != L2CAP_UUID && proto != RFCOMM_UUID)
+		return -EINVAL;
 
-	ctxt->cb	= cb;
-	ctxt->destroy	= destroy;
-	ctxt->user_data	= user_data;
+	req = g_try_malloc0(sizeof(struct search_request));
+	if (!req)
+		return -ENOMEM;
 
-	context_list = g_slist_append(context_list, ctxt);
+	req->uuids = g_memdup(uuid, sizeof(uuid_t));
+	req->count = 1;
+	req->proto = proto;
+	req->port_cb = cb;
+	req->destroy = destroy;
+	req->user_data = user_data;
+
+	err = search_request_add(src, dst, req);
+	if (err < 0) {
+		g_free(req->uuids);
+		g_free(req);
+	}
 
-	return 0;
+	return err;
 }
 
-static gint find_by_bdaddr(gconstpointer data, gconstpointer user_data)
+/*
+ * Read a single attribute of the record with the given handle, cb gets
+ * a list with one record holding just that attribute
+ */
+int bt_read_service_attr(const bdaddr_t *src, const bdaddr_t *dst,
+				uint32_t handle, uint16_t attr,
+				bt_callback_t cb, void *user_data,
+				bt_destroy_t destroy)
 {
-	const struct search_context *ctxt = data, *search = user_data;
+	struct search_request *req;
+	int err;
 
-	return (bacmp(&ctxt->dst, &search->dst) &&
-					bacmp(&ctxt->src, &search->src));
+	if (!cb)
+		return -EINVAL;
+
+	req = g_try_malloc0(sizeof(struct search_request));
+	if (!req)
+		return -ENOMEM;
+
+	req->read_attr = TRUE;
+	req->handle = handle;
+	req->attr = attr;
+	req->cb = cb;
+	req->destroy = destroy;
+	req->user_data = user_data;
+
+	err = search_request_add(src, dst, req);
+	if (err < 0)
+		g_free(req);
+
+	return err;
 }
 
-int bt_cancel_discovery(const bdaddr_t *src, const bdaddr_t *dst)
+static struct search_request *find_request(struct search_context *ctxt,
+					bt_callback_t cb, void *user_data)
 {
-	struct search_context match, *ctxt;
 	GSList *l;
 
-	memset(&match, 0, sizeof(match));
-	bacpy(&match.src, src);
-	bacpy(&match.dst, dst);
+	for (l = ctxt->requests; l; l = l->next) {
+		struct search_request *req = l->data;
+
+		if (req->user_data != user_data)
+			continue;
+
+		if (cb == NULL || req->cb == cb)
+			return req;
+	}
+
+	return NULL;
+}
 
-	/* Ongoing SDP Discovery */
-	l = g_slist_find_custom(context_list, &match, find_by_bdaddr);
-	if (l == NULL)
+/*
+ * Cancel the request for src and dst made with cb and user_data, a NULL
+ * cb matches any callback. A queued request is just dropped; if it is the
+ * one in progress the session is closed and the requests queued behind it
+ * carry on over a new connection. The callback is not called.
+ */
+int bt_cancel_discovery(const bdaddr_t *src, const bdaddr_t *dst,
+					bt_callback_t cb, void *user_data)
+{
+	struct search_context *ctxt;
+	struct search_request *req;
+	gboolean running;
+	int err;
+
+	ctxt = find_context(src, dst);
+	if (ctxt == NULL)
 		return -ENOENT;
 
-	ctxt = l->data;
+	req = find_request(ctxt, cb, user_data);
+	if (req == NULL)
+		return -ENOENT;
 
-	if (!ctxt->session)
-		return -ENOTCONN;
+	/* While search_completed_cb() runs a callback the head of the queue
+	 * has no transaction yet, there is no watch for it */
+	running = req == ctxt->requests->data && ctxt->io_id > 0;
 
-	if (ctxt->io_id)
-		g_source_remove(ctxt->io_id);
+	ctxt->requests = g_slist_remove(ctxt->requests, req);
+	search_request_free(req);
 
-	if (ctxt->session)
-		sdp_close(ctxt->session);
+	if (!running)
+		return 0;
 
-	search_context_cleanup(ctxt);
+	g_source_remove(ctxt->io_id);
+	ctxt->io_id = 0;
+
+	/* The transaction can't be aborted, close the session */
+	drop_sdp_session(ctxt->cached);
+	ctxt->cached = NULL;
+	ctxt->session = NULL;
+
+	if (!ctxt->requests) {
+		search_context_cleanup(ctxt);
+		return 0;
+	}
+
+	err = search_connect(ctxt);
+	if (err < 0)
+		search_context_fail(ctxt, err);
 
 	return 0;
 }
@@ -22,12 +22,27 @@
  */
 
 typedef void (*bt_callback_t) (sdp_list_t *recs, int err, gpointer user_data);
+typedef void (*bt_port_callback_t) (int port, int err, gpointer user_data);
 typedef void (*bt_destroy_t) (gpointer user_data);
 
 int bt_search_service(const bdaddr_t *src, const bdaddr_t *dst,
 			uuid_t *uuid, bt_callback_t cb, void *user_data,
 			bt_destroy_t destroy);
-int bt_cancel_discovery(const bdaddr_t *src, const bdaddr_t *dst);
+int bt_search_services(const bdaddr_t *src, const bdaddr_t *dst,
+			uuid_t *uuids, int count, bt_callback_t cb,
+			void *user_data, bt_destroy_t destroy);
+int bt_search_service_port(const bdaddr_t *src, const bdaddr_t *dst,
+				uuid_t *uuid, int proto,
+				bt_port_callback_t cb, void *user_data,
+				bt_destroy_t destroy);
+int bt_read_service_attr(const bdaddr_t *src, const bdaddr_t *dst,
+				uint32_t handle, uint16_t attr,
+				bt_callback_t cb, void *user_data,
+				bt_destroy_t destroy);
+int bt_cancel_discovery(const bdaddr_t *src, const bdaddr_t *dst,
+					bt_callback_t cb, void *user_data);
+
+void bt_set_sdp_session_cache_size(unsigned int size);
 
 gchar *bt_uuid2string(uuid_t *uuid);
 char *bt_name2string(const char *string);
@@ -31,6 +31,7 @@ struct main_opts {
 	uint16_t	pageto;
 	uint32_t	discovto;
 	uint32_t	pairto;
+	uint32_t	sdp_sessions;
 	uint16_t	link_mode;
 	uint16_t	link_policy;
 	gboolean	remember_powered;
@@ -54,6 +54,7 @@
 #include "dbus-common.h"
 #include "agent.h"
 #include "manager.h"
+#include "glib-helper.h"
 
 #ifdef HAVE_CAPNG
 #include <cap-ng.h>
@@ -64,6 +65,7 @@
 #define LAST_ADAPTER_EXIT_TIMEOUT 30
 
 #define DEFAULT_DISCOVERABLE_TIMEOUT 180 /* 3 minutes */
+#define DEFAULT_SDP_SESSIONS 4
 
 struct main_opts main_opts;
 
@@ -129,6 +131,16 @@ static void parse_config(GKeyFile *config)
 		main_opts.flags |= 1 << HCID_SET_PAGETO;
 	}
 
+	val = g_key_file_get_integer(config, "General",
+						"SDPSessionCacheSize", &err);
+	if (err) {
+		DBG("%s", err->message);
+		g_clear_error(&err);
+	} else if (val >= 0) {
+		DBG("sdp_sessions=%d", val);
+		main_opts.sdp_sessions = val;
+	}
+
 	str = g_key_file_get_string(config, "General", "Name", &err);
 	if (err) {
 		DBG("%s", err->message);
@@ -247,6 +259,7 @@ static void init_defaults(void)
 	main_opts.mode	= MODE_CONNECTABLE;
 	main_opts.name	= g_strdup("BlueZ");
 	main_opts.discovto	= DEFAULT_DISCOVERABLE_TIMEOUT;
+	main_opts.sdp_sessions	= DEFAULT_SDP_SESSIONS;
 	main_opts.remember_powered = TRUE;
 	main_opts.reverse_sdp = TRUE;
 	main_opts.name_resolv = TRUE;
@@ -458,6 +471,8 @@ int main(int argc, char *argv[])
 
 	parse_config(config);
 
+	bt_set_sdp_session_cache_size(main_opts.sdp_sessions);
+
 	agent_init();
 
 	if (option_udev == FALSE) {
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 
 #include <bluetooth/bluetooth.h>
@@ -38,6 +39,8 @@
 #include <bluetooth/sdp.h>
 #include <bluetooth/sdp_lib.h>
 
+#include <glib.h>
+
 #include "sdpd.h"
 #include "log.h"
 #include "adapter.h"
@@ -46,6 +49,37 @@
 static sdp_list_t *service_db;
 static sdp_list_t *access_db;
 
+/* Lookup by handle, for both records and access data */
+static GHashTable *record_index;
+static GHashTable *access_index;
+
+/*
+ * UUID-128 of every pattern entry to the records containing it, held in
+ * a tree sorted by handle. Records are filled in after sdp_record_add()
+ * and updates change them in place, so they are (re)indexed lazily on
+ * the next search through the pending list.
+ */
+static GHashTable *uuid_index;
+static GSList *pending;
+
+/*
+ * Encoded attribute ID/value pairs of a record, with the offset of each
+ * attribute, by handle. Attributes are sorted by ID, so any requested ID
+ * or range is one contiguous slice. Built on first use and dropped when
+ * the record is added, reindexed after an update or removed.
+ */
+struct pdu_cache {
+	sdp_record_t *rec;
+	uint8_t *data;
+	int count;
+	struct {
+		uint16_t id;
+		uint32_t offset;
+	} attrs[0];		/* count + 1 entries, the last one is the end */
+};
+
+static GHashTable *pdu_index;
+
 typedef struct {
 	uint32_t handle;
 	bdaddr_t device;
@@ -87,13 +121,145 @@ static void access_free(void *p)
 	free(p);
 }
 
+static guint uuid128_hash(gconstpointer key)
+{
+	const uint32_t *data = key;
+
+	return data[0] ^ data[1] ^ data[2] ^ data[3];
+}
+
+static gboolean uuid128_equal(gconstpointer a, gconstpointer b)
+{
+	return memcmp(a, b, sizeof(uint128_t)) == 0;
+}
+
+static void pdu_cache_free(gpointer data)
+{
+	struct pdu_cache *cache = data;
+
+	free(cache->data);
+	g_free(cache);
+}
+
+static gint handle_cmp(gconstpointer a, gconstpointer b)
+{
+	uint32_t h1 = GPOINTER_TO_UINT(a), h2 = GPOINTER_TO_UINT(b);
+
+	return h1 < h2 ? -1 : h1 > h2;
+}
+
+static void index_init(void)
+{
+	if (record_index)
+		return;
+
+	record_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	access_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	uuid_index = g_hash_table_new_full(uuid128_hash, uuid128_equal,
+				g_free, (GDestroyNotify) g_tree_destroy);
+	pdu_index = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, pdu_cache_free);
+}
+
+static void index_cleanup(void)
+{
+	if (!record_index)
+		return;
+
+	g_hash_table_destroy(record_index);
+	g_hash_table_destroy(access_index);
+	g_hash_table_destroy(uuid_index);
+	g_hash_table_destroy(pdu_index);
+	record_index = access_index = uuid_index = NULL;
+	pdu_index = NULL;
+
+	g_slist_free(pending);
+	pending = NULL;
+}
+
+static GTree *uuid_index_lookup(const uuid_t *uuid)
+{
+	uuid_t uuid128;
+
+	switch (uuid->type) {
+	case SDP_UUID16:
+		sdp_uuid16_to_uuid128(&uuid128, (uuid_t *) uuid);
+		break;
+	case SDP_UUID32:
+		sdp_uuid32_to_uuid128(&uuid128, (uuid_t *) uuid);
+		break;
+	case SDP_UUID128:
+		uuid128 = *uuid;
+		break;
+	default:
+		return NULL;
+	}
+
+	return g_hash_table_lookup(uuid_index, &uuid128.value.uuid128);
+}
+
+/* The pattern of a record only ever grows, so it covers all the UUIDs
+ * the record has been indexed under */
+static void uuid_index_add(sdp_record_t *rec)
+{
+	sdp_list_t *p;
+
+	for (p = rec->pattern; p; p = p->next) {
+		uuid_t *uuid = p->data;
+		GTree *tree;
+
+		tree = g_hash_table_lookup(uuid_index, &uuid->value.uuid128);
+		if (!tree) {
+			tree = g_tree_new(handle_cmp);
+			g_hash_table_insert(uuid_index,
+					g_memdup(&uuid->value.uuid128,
+						sizeof(uint128_t)), tree);
+		}
+
+		g_tree_insert(tree, GUINT_TO_POINTER(rec->handle), rec);
+	}
+}
+
+static void uuid_index_remove(sdp_record_t *rec)
+{
+	sdp_list_t *p;
+
+	for (p = rec->pattern; p; p = p->next) {
+		uuid_t *uuid = p->data;
+		GTree *tree;
+
+		tree = g_hash_table_lookup(uuid_index, &uuid->value.uuid128);
+		if (!tree)
+			continue;
+
+		g_tree_remove(tree, GUINT_TO_POINTER(rec->handle));
+		if (g_tree_nnodes(tree) == 0)
+			g_hash_table_remove(uuid_index, &uuid->value.uuid128);
+	}
+}
+
+static void index_pending(void)
+{
+	GSList *l;
+
+	for (l = pending; l; l = l->next)
+		uuid_index_add(l->data);
+
+	g_slist_free(pending);
+	pending = NULL;
+}
+
 /*
  * Reset the service repository by deleting its contents
  */
 void sdp_svcdb_reset(void)
 {
+	index_cleanup();
+
 	sdp_list_free(service_db, (sdp_free_func_t) sdp_record_free);
 	sdp_list_free(access_db, access_free);
+	service_db = NULL;
+	access_db = NULL;
 }
 
 typedef struct _indexed {
@@ -176,7 +342,12 @@ void sdp_record_add(const bdaddr_t *device, sdp_record_t *rec)
 	SDPDBG("Adding rec : 0x%lx", (long) rec);
 	SDPDBG("with handle : 0x%x", rec->handle);
 
+	index_init();
+
 	service_db = sdp_list_insert_sorted(service_db, rec, record_sort);
+	g_hash_table_insert(record_index, GUINT_TO_POINTER(rec->handle), rec);
+	g_hash_table_remove(pdu_index, GUINT_TO_POINTER(rec->handle));
+	pending = g_slist_prepend(pending, rec);
 
 	dev = malloc(sizeof(*dev));
 	if (!dev)
@@ -186,6 +357,7 @@ void sdp_record_add(const bdaddr_t *device, sdp_record_t *rec)
 	dev->handle = rec->handle;
 
 	access_db = sdp_list_insert_sorted(access_db, dev, access_sort);
+	g_hash_table_insert(access_index, GUINT_TO_POINTER(dev->handle), dev);
 
 	if (bacmp(device, BDADDR_ANY) == 0) {
 		manager_foreach_adapter(adapter_service_insert, rec);
@@ -212,19 +384,18 @@ static sdp_list_t *record_locate(uint32_t handle)
 	return NULL;
 }
 
-static sdp_list_t *access_locate(uint32_t handle)
+static sdp_access_t *access_locate(uint32_t handle)
 {
-	if (access_db) {
-		sdp_list_t *p;
-		sdp_access_t a;
+	sdp_access_t *a = NULL;
 
-		a.handle = handle;
-		p = sdp_list_find(access_db, &a, access_sort);
-		return p;
-	}
+	if (access_index)
+		a = g_hash_table_lookup(access_index,
+						GUINT_TO_POINTER(handle));
 
-	SDPDBG("Could not find access data for : 0x%x", handle);
-	return NULL;
+	if (!a)
+		SDPDBG("Could not find access data for : 0x%x", handle);
+
+	return a;
 }
 
 /*
@@ -232,14 +403,212 @@ static sdp_list_t *access_locate(uint32_t handle)
  */
 sdp_record_t *sdp_record_find(uint32_t handle)
 {
-	sdp_list_t *p = record_locate(handle);
+	sdp_record_t *rec = NULL;
 
-	if (!p) {
+	if (record_index)
+		rec = g_hash_table_lookup(record_index,
+						GUINT_TO_POINTER(handle));
+
+	if (!rec) {
 		SDPDBG("Couldn't find record for : 0x%x", handle);
 		return 0;
 	}
 
-	return p->data;
+	return rec;
+}
+
+/*
+ * Queue a record already in the repository for reindexing, after its
+ * UUIDs changed
+ */
+void sdp_record_reindex(sdp_record_t *rec)
+{
+	sdp_record_pdu_invalidate(rec);
+
+	if (!g_slist_find(pending, rec))
+		pending = g_slist_prepend(pending, rec);
+}
+
+static struct pdu_cache *pdu_cache_new(sdp_record_t *rec)
+{
+	struct pdu_cache *cache;
+	sdp_list_t *l;
+	sdp_buf_t buf;
+	uint32_t size;
+	int i, count = sdp_list_len(rec->attrlist);
+
+	/* only used for a buffer large enough for the attributes */
+	if (sdp_gen_record_pdu(rec, &buf) < 0)
+		return NULL;
+
+	cache = g_malloc(sizeof(*cache) + (count + 1) * sizeof(cache->attrs[0]));
+	cache->rec = rec;
+	cache->data = buf.data;
+	cache->count = count;
+
+	/* same encoding as sdp_append_to_pdu(), without sequence header */
+	for (l = rec->attrlist, i = 0, size = 0; l; l = l->next, i++) {
+		sdp_data_t *d = l->data;
+		sdp_buf_t attr;
+
+		attr.data = cache->data + size;
+		attr.data_size = 0;
+		attr.buf_size = buf.buf_size - size;
+
+		sdp_set_attrid(&attr, d->attrId);
+		sdp_gen_pdu(&attr, d);
+
+		cache->attrs[i].id = d->attrId;
+		cache->attrs[i].offset = size;
+		size += attr.data_size;
+	}
+
+	cache->attrs[count].id = 0;
+	cache->attrs[count].offset = size;
+
+	return cache;
+}
+
+/* Index of the first attribute with an ID of at least id */
+static int pdu_cache_find(struct pdu_cache *cache, uint32_t id)
+{
+	int low = 0, high = cache->count;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (cache->attrs[mid].id < id)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/*
+ * Get the encoded attribute ID and value pairs of the attributes of a
+ * registered record with IDs from low to high, without the enclosing
+ * sequence header. Code changing a registered record in place has to call
+ * sdp_record_pdu_invalidate(). Returns the length of the data or a
+ * negative error.
+ */
+int sdp_record_pdu_range(sdp_record_t *rec, uint16_t low, uint16_t high,
+							const uint8_t **data)
+{
+	struct pdu_cache *cache;
+	int first, last;
+
+	index_init();
+
+	cache = g_hash_table_lookup(pdu_index, GUINT_TO_POINTER(rec->handle));
+	if (!cache || cache->rec != rec) {
+		cache = pdu_cache_new(rec);
+		if (!cache)
+			return -ENOMEM;
+
+		g_hash_table_replace(pdu_index, GUINT_TO_POINTER(rec->handle),
+									cache);
+	}
+
+	first = pdu_cache_find(cache, low);
+	last = pdu_cache_find(cache, high + 1);
+	if (last < first)
+		last = first;
+
+	*data = cache->data + cache->attrs[first].offset;
+
+	return cache->attrs[last].offset - cache->attrs[first].offset;
+}
+
+void sdp_record_pdu_invalidate(sdp_record_t *rec)
+{
+	if (pdu_index)
+		g_hash_table_remove(pdu_index, GUINT_TO_POINTER(rec->handle));
+}
+
+struct search_data {
+	GTree **trees;
+	int count;
+	GTree *smallest;
+	sdp_list_t *head;
+	sdp_list_t *tail;
+};
+
+static gboolean search_match(gpointer key, gpointer value, gpointer data)
+{
+	struct search_data *sd = data;
+	sdp_list_t *l;
+	int i;
+
+	for (i = 0; i < sd->count; i++) {
+		if (sd->trees[i] == sd->smallest)
+			continue;
+
+		if (!g_tree_lookup(sd->trees[i], key))
+			return FALSE;
+	}
+
+	l = malloc(sizeof(sdp_list_t));
+	if (!l)
+		return TRUE;
+
+	l->data = value;
+	l->next = NULL;
+
+	if (sd->tail)
+		sd->tail->next = l;
+	else
+		sd->head = l;
+	sd->tail = l;
+
+	return FALSE;
+}
+
+/*
+ * Find the records having every UUID of the search pattern, returned
+ * in handle order. Only the records under the least common UUID are
+ * looked at. The list must be freed with sdp_list_free(list, NULL).
+ */
+sdp_list_t *sdp_record_search(sdp_list_t *search)
+{
+	struct search_data sd;
+	sdp_list_t *l;
+
+	if (!record_index)
+		return NULL;
+
+	index_pending();
+
+	memset(&sd, 0, sizeof(sd));
+
+	if (!search) {
+		/* an empty pattern matches every record */
+		for (l = service_db; l; l = l->next)
+			sd.head = sdp_list_append(sd.head, l->data);
+		return sd.head;
+	}
+
+	sd.trees = g_new(GTree *, sdp_list_len(search));
+
+	for (l = search; l; l = l->next) {
+		GTree *tree = l->data ? uuid_index_lookup(l->data) : NULL;
+
+		if (!tree)
+			goto done;
+
+		if (!sd.smallest ||
+				g_tree_nnodes(tree) < g_tree_nnodes(sd.smallest))
+			sd.smallest = tree;
+
+		sd.trees[sd.count++] = tree;
+	}
+
+	g_tree_foreach(sd.smallest, search_match, &sd);
+
+done:
+	g_free(sd.trees);
+	return sd.head;
 }
 
 /*
@@ -257,15 +626,18 @@ int sdp_record_remove(uint32_t handle)
 	}
 
 	r = p->data;
-	if (r)
+	if (r) {
 		service_db = sdp_list_remove(service_db, r);
+		g_hash_table_remove(record_index, GUINT_TO_POINTER(handle));
+		pending = g_slist_remove(pending, r);
+		uuid_index_remove(r);
+		sdp_record_pdu_invalidate(r);
+	}
 
-	p = access_locate(handle);
-	if (p == NULL || p->data == NULL)
+	a = access_locate(handle);
+	if (a == NULL)
 		return 0;
 
-	a = p->data;
-
 	if (bacmp(&a->device, BDADDR_ANY) != 0) {
 		struct btd_adapter *adapter = manager_find_adapter(&a->device);
 		if (adapter)
@@ -274,6 +646,7 @@ int sdp_record_remove(uint32_t handle)
 		manager_foreach_adapter(adapter_service_remove, r);
 
 	access_db = sdp_list_remove(access_db, a);
+	g_hash_table_remove(access_index, GUINT_TO_POINTER(handle));
 	access_free(a);
 
 	return 0;
@@ -294,13 +667,8 @@ sdp_list_t *sdp_get_access_list(void)
 
 int sdp_check_access(uint32_t handle, bdaddr_t *device)
 {
-	sdp_list_t *p = access_locate(handle);
-	sdp_access_t *a;
-
-	if (!p)
-		return 1;
+	sdp_access_t *a = access_locate(handle);
 
-	a = p->data;
 	if (!a)
 		return 1;
 
@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 #include <sys/socket.h>
 
 #include <bluetooth/bluetooth.h>
@@ -42,6 +43,8 @@
 
 #include <netinet/in.h>
 
+#include <glib.h>
+
 #include "sdpd.h"
 #include "log.h"
 
@@ -55,43 +58,207 @@ typedef struct {
 
 #define SDP_CONT_STATE_SIZE (sizeof(uint8_t) + sizeof(sdp_cont_state_t))
 
+#ifndef MIN
 #define MIN(x, y) ((x) < (y)) ? (x): (y)
+#endif
+
+/* Total size of the responses kept for continuation requests */
+#define CSTATE_CACHE_SIZE	(256 * 1024)
 
-typedef struct _sdp_cstate_list sdp_cstate_list_t;
+/* Seconds a response is kept for the next continuation request */
+#define CSTATE_TIMEOUT		30
 
-struct _sdp_cstate_list {
-	sdp_cstate_list_t *next;
+typedef struct {
+	int sock;
 	uint32_t timestamp;
+} sdp_cstate_key_t;
+
+typedef struct {
+	sdp_cstate_key_t key;
+	time_t expire;
+	GList *link;
 	sdp_buf_t buf;
-};
+} sdp_cstate_entry_t;
+
+/*
+ * Responses too large for one PDU, by requesting socket and continuation
+ * state id. The queue holds them oldest first for expiry and eviction.
+ */
+static GHashTable *cstates;
+static GQueue *cstate_queue;
+static uint32_t cstate_id;
+static struct sdp_cstate_stats cstate_stats;
 
-static sdp_cstate_list_t *cstates;
+static guint cstate_hash(gconstpointer key)
+{
+	const sdp_cstate_key_t *k = key;
 
-/* FIXME: should probably remove it when it's found */
-static sdp_buf_t *sdp_get_cached_rsp(sdp_cont_state_t *cstate)
+	return k->timestamp ^ (k->sock << 16);
+}
+
+static gboolean cstate_equal(gconstpointer a, gconstpointer b)
 {
-	sdp_cstate_list_t *p;
+	const sdp_cstate_key_t *k1 = a, *k2 = b;
 
-	for (p = cstates; p; p = p->next)
-		if (p->timestamp == cstate->timestamp)
-			return &p->buf;
-	return 0;
+	return k1->sock == k2->sock && k1->timestamp == k2->timestamp;
 }
 
-static uint32_t sdp_cstate_alloc_buf(sdp_buf_t *buf)
+static time_t cstate_now(void)
 {
-	sdp_cstate_list_t *cstate = malloc(sizeof(sdp_cstate_list_t));
-	uint8_t *data = malloc(buf->data_size);
-
-	memcpy(data, buf->data, buf->data_size);
-	memset((char *)cstate, 0, sizeof(sdp_cstate_list_t));
-	cstate->buf.data = data;
-	cstate->buf.data_size = buf->data_size;
-	cstate->buf.buf_size = buf->data_size;
-	cstate->timestamp = sdp_get_time();
-	cstate->next = cstates;
-	cstates = cstate;
-	return cstate->timestamp;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec;
+}
+
+static void cstate_remove(sdp_cstate_entry_t *entry)
+{
+	g_hash_table_remove(cstates, &entry->key);
+	g_queue_delete_link(cstate_queue, entry->link);
+
+	cstate_stats.entries--;
+	cstate_stats.bytes -= entry->buf.data_size;
+
+	free(entry->buf.data);
+	free(entry);
+}
+
+static void cstate_expire(time_t now)
+{
+	sdp_cstate_entry_t *entry;
+
+	while ((entry = g_queue_peek_head(cstate_queue)) &&
+						entry->expire <= now) {
+		SDPDBG("Expiring cstate 0x%x", entry->key.timestamp);
+		cstate_remove(entry);
+		cstate_stats.expirations++;
+	}
+}
+
+static sdp_buf_t *sdp_get_cached_rsp(int sock, sdp_cont_state_t *cstate)
+{
+	sdp_cstate_entry_t *entry = NULL;
+	sdp_cstate_key_t key;
+
+	if (cstates) {
+		cstate_expire(cstate_now());
+
+		key.sock = sock;
+		key.timestamp = cstate->timestamp;
+		entry = g_hash_table_lookup(cstates, &key);
+	}
+
+	if (!entry) {
+		cstate_stats.misses++;
+		return NULL;
+	}
+
+	cstate_stats.hits++;
+
+	return &entry->buf;
+}
+
+/* Drops a response once its last part has been sent */
+static void sdp_cstate_release(int sock, sdp_cont_state_t *cstate)
+{
+	sdp_cstate_entry_t *entry;
+	sdp_cstate_key_t key;
+
+	if (!cstates)
+		return;
+
+	key.sock = sock;
+	key.timestamp = cstate->timestamp;
+
+	entry = g_hash_table_lookup(cstates, &key);
+	if (entry)
+		cstate_remove(entry);
+}
+
+static uint32_t sdp_cstate_alloc_buf(int sock, sdp_buf_t *buf)
+{
+	sdp_cstate_entry_t *entry;
+	time_t now = cstate_now();
+
+	if (!cstates) {
+		cstates = g_hash_table_new(cstate_hash, cstate_equal);
+		cstate_queue = g_queue_new();
+		cstate_id = sdp_get_time();
+	}
+
+	cstate_expire(now);
+
+	/* make room by dropping the oldest responses */
+	while (!g_queue_is_empty(cstate_queue) &&
+			cstate_stats.bytes + buf->data_size > CSTATE_CACHE_SIZE) {
+		cstate_remove(g_queue_peek_head(cstate_queue));
+		cstate_stats.evictions++;
+	}
+
+	entry = malloc(sizeof(sdp_cstate_entry_t));
+	if (!entry)
+		return 0;
+
+	memset(entry, 0, sizeof(sdp_cstate_entry_t));
+
+	entry->buf.data = malloc(buf->data_size);
+	if (!entry->buf.data) {
+		free(entry);
+		return 0;
+	}
+
+	memcpy(entry->buf.data, buf->data, buf->data_size);
+	entry->buf.data_size = buf->data_size;
+	entry->buf.buf_size = buf->data_size;
+
+	/* 0 means no continuation state */
+	if (++cstate_id == 0)
+		cstate_id++;
+
+	entry->key.sock = sock;
+	entry->key.timestamp = cstate_id;
+	entry->expire = now + CSTATE_TIMEOUT;
+
+	g_hash_table_insert(cstates, &entry->key, entry);
+	g_queue_push_tail(cstate_queue, entry);
+	entry->link = g_queue_peek_tail_link(cstate_queue);
+
+	cstate_stats.entries++;
+	cstate_stats.bytes += entry->buf.data_size;
+
+	return entry->key.timestamp;
+}
+
+/*
+ * Drop the responses still cached for a socket that has been closed
+ */
+void sdp_cstate_cleanup(int sock)
+{
+	GList *l, *next;
+
+	if (!cstates)
+		return;
+
+	for (l = cstate_queue->head; l; l = next) {
+		sdp_cstate_entry_t *entry = l->data;
+
+		next = l->next;
+
+		if (entry->key.sock == sock)
+			cstate_remove(entry);
+	}
+
+	DBG("cstate cache: %lu hits, %lu misses, %lu evictions, "
+		"%lu expirations, %lu entries of %lu bytes",
+		cstate_stats.hits, cstate_stats.misses,
+		cstate_stats.evictions, cstate_stats.expirations,
+		cstate_stats.entries, cstate_stats.bytes);
+}
+
+void sdp_cstate_get_stats(struct sdp_cstate_stats *stats)
+{
+	*stats = cstate_stats;
 }
 
 /* Additional values for checking datatype (not in spec) */
@@ -305,45 +472,6 @@ static int sdp_cstate_get(uint8_t *buffer, size_t len,
 	return 0;
 }
 
-/*
- * The matching process is defined as "each and every UUID
- * specified in the "search pattern" must be present in the
- * "target pattern". Here "search pattern" is the set of UUIDs
- * specified by the service discovery client and "target pattern"
- * is the set of UUIDs present in a service record.
- *
- * Return 1 if each and every UUID in the search
- * pattern exists in the target pattern, 0 if the
- * match succeeds and -1 on error.
- */
-static int sdp_match_uuid(sdp_list_t *search, sdp_list_t *pattern)
-{
-	/*
-	 * The target is a sorted list, so we need not look
-	 * at all elements to confirm existence of an element
-	 * from the search pattern
-	 */
-	int patlen = sdp_list_len(pattern);
-
-	if (patlen < sdp_list_len(search))
-		return -1;
-	for (; search; search = search->next) {
-		uuid_t *uuid128;
-		void *data = search->data;
-		sdp_list_t *list;
-		if (data == NULL)
-			return -1;
-
-		/* create 128-bit form of the search UUID */
-		uuid128 = sdp_uuid_to_uuid128((uuid_t *)data);
-		list = sdp_list_find(pattern, uuid128, sdp_uuid128_cmp);
-		bt_free(uuid128);
-		if (!list)
-			return 0;
-	}
-	return 1;
-}
-
 /*
  * Service search request PDU. This method extracts the search pattern
  * (a sequence of UUIDs) and calls the matching function
@@ -421,17 +549,18 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 	buf->data_size += sizeof(uint16_t);
 
 	if (cstate == NULL) {
-		/* for every record in the DB, do a pattern search */
-		sdp_list_t *list = sdp_get_record_list();
+		/* look up the records matching the pattern */
+		sdp_list_t *matches = sdp_record_search(pattern);
+		sdp_list_t *list;
 
 		handleSize = 0;
-		for (; list && rsp_count < expected; list = list->next) {
+		for (list = matches; list && rsp_count < expected;
+							list = list->next) {
 			sdp_record_t *rec = list->data;
 
 			SDPDBG("Checking svcRec : 0x%x", rec->handle);
 
-			if (sdp_match_uuid(pattern, rec->pattern) > 0 &&
-					sdp_check_access(rec->handle, &req->device)) {
+			if (sdp_check_access(rec->handle, &req->device)) {
 				rsp_count++;
 				bt_put_unaligned(htonl(rec->handle), (uint32_t *)pdata);
 				pdata += sizeof(uint32_t);
@@ -439,6 +568,8 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 			}
 		}
 
+		sdp_list_free(matches, NULL);
+
 		SDPDBG("Match count: %d", rsp_count);
 
 		buf->data_size += handleSize;
@@ -447,7 +578,7 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 
 		if (rsp_count > actual) {
 			/* cache the rsp and generate a continuation state */
-			cStateId = sdp_cstate_alloc_buf(buf);
+			cStateId = sdp_cstate_alloc_buf(req->sock, buf);
 			/*
 			 * subtract handleSize since we now send only
 			 * a subset of handles
@@ -468,7 +599,8 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 			 * Get the previous sdp_cont_state_t and obtain
 			 * the cached rsp
 			 */
-			sdp_buf_t *pCache = sdp_get_cached_rsp(cstate);
+			sdp_buf_t *pCache = sdp_get_cached_rsp(req->sock,
+									cstate);
 			if (pCache) {
 				pCacheBuffer = pCache->data;
 				/* get the rsp_count from the cached buffer */
@@ -514,6 +646,8 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 		if (i == rsp_count) {
 			/* set "null" continuationState */
 			sdp_set_cstate_pdu(buf, NULL);
+			if (cstate)
+				sdp_cstate_release(req->sock, cstate);
 		} else {
 			/*
 			 * there's more: set lastIndexSent to
@@ -551,8 +685,6 @@ done:
  */
 static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 {
-	sdp_buf_t pdu;
-
 	if (!rec)
 		return SDP_INVALID_RECORD_HANDLE;
 
@@ -563,53 +695,57 @@ static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 
 	SDPDBG("Entries in attr seq : %d", sdp_list_len(seq));
 
-	sdp_gen_record_pdu(rec, &pdu);
-
 	for (; seq; seq = seq->next) {
 		struct attrid *aid = seq->data;
+		const uint8_t *data;
+		uint16_t low, high;
+		int len;
 
 		SDPDBG("AttrDataType : %d", aid->dtd);
 
 		if (aid->dtd == SDP_UINT16) {
-			uint16_t attr = bt_get_unaligned((uint16_t *)&aid->uint16);
-			sdp_data_t *a = sdp_data_get(rec, attr);
-			if (a)
-				sdp_append_to_pdu(buf, a);
+			low = bt_get_unaligned((uint16_t *)&aid->uint16);
+			high = low;
 		} else if (aid->dtd == SDP_UINT32) {
 			uint32_t range = bt_get_unaligned((uint32_t *)&aid->uint32);
-			uint16_t attr;
-			uint16_t low = (0xffff0000 & range) >> 16;
-			uint16_t high = 0x0000ffff & range;
-			sdp_data_t *data;
+
+			low = (0xffff0000 & range) >> 16;
+			high = 0x0000ffff & range;
 
 			SDPDBG("attr range : 0x%x", range);
 			SDPDBG("Low id : 0x%x", low);
 			SDPDBG("High id : 0x%x", high);
-
-			if (low == 0x0000 && high == 0xffff && pdu.data_size <= buf->buf_size) {
-				/* copy it */
-				memcpy(buf->data, pdu.data, pdu.data_size);
-				buf->data_size = pdu.data_size;
-				break;
-			}
-			/* (else) sub-range of attributes */
-			for (attr = low; attr < high; attr++) {
-				data = sdp_data_get(rec, attr);
-				if (data)
-					sdp_append_to_pdu(buf, data);
-			}
-			data = sdp_data_get(rec, high);
-			if (data)
-				sdp_append_to_pdu(buf, data);
 		} else {
 			error("Unexpected data type : 0x%x", aid->dtd);
 			error("Expect uint16_t or uint32_t");
-			free(pdu.data);
 			return SDP_INVALID_SYNTAX;
 		}
-	}
 
-	free(pdu.data);
+		/* attributes are sorted by ID, so the requested ones are
+		 * a single slice of the encoded record */
+		len = sdp_record_pdu_range(rec, low, high, &data);
+		if (len < 0)
+			return SDP_INVALID_SYNTAX;
+
+		if (low == 0x0000 && high == 0xffff) {
+			/* the whole record replaces anything added before */
+			buf->data_size = 0;
+			buf->data[0] = 0;
+		}
+
+		/* leave room for a sequence header growing to 16 bits */
+		if (buf->data_size + len + 3 > buf->buf_size) {
+			error("Attributes of record 0x%x exceed the response",
+								rec->handle);
+			return SDP_INVALID_PDU_SIZE;
+		}
+
+		if (len > 0)
+			sdp_append_to_buf(buf, (uint8_t *) data, len);
+
+		if (low == 0x0000 && high == 0xffff)
+			break;
+	}
 
 	return 0;
 }
@@ -709,11 +845,15 @@ static int service_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 	buf->buf_size -= sizeof(uint16_t);
 
 	if (cstate) {
-		sdp_buf_t *pCache = sdp_get_cached_rsp(cstate);
+		sdp_buf_t *pCache = sdp_get_cached_rsp(req->sock, cstate);
 
 		SDPDBG("Obtained cached rsp : %p", pCache);
 
-		if (pCache) {
+		if (pCache && cstate->cStateValue.maxBytesSent >
+							pCache->data_size) {
+			status = SDP_INVALID_CSTATE;
+			error("Continuation state beyond the cached response");
+		} else if (pCache) {
 			short sent = MIN(max_rsp_size, pCache->data_size - cstate->cStateValue.maxBytesSent);
 			pResponse = pCache->data;
 			memcpy(buf->data, pResponse + cstate->cStateValue.maxBytesSent, sent);
@@ -722,9 +862,10 @@ static int service_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 
 			SDPDBG("Response size : %d sending now : %d bytes sent so far : %d",
 				pCache->data_size, sent, cstate->cStateValue.maxBytesSent);
-			if (cstate->cStateValue.maxBytesSent == pCache->data_size)
+			if (cstate->cStateValue.maxBytesSent == pCache->data_size) {
 				cstate_size = sdp_set_cstate_pdu(buf, NULL);
-			else
+				sdp_cstate_release(req->sock, cstate);
+			} else
 				cstate_size = sdp_set_cstate_pdu(buf, cstate);
 		} else {
 			status = SDP_INVALID_CSTATE;
@@ -737,7 +878,7 @@ static int service_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 			sdp_cont_state_t newState;
 
 			memset((char *)&newState, 0, sizeof(sdp_cont_state_t));
-			newState.timestamp = sdp_cstate_alloc_buf(buf);
+			newState.timestamp = sdp_cstate_alloc_buf(req->sock, buf);
 			/*
 			 * Reset the buffer size to the maximum expected and
 			 * set the sdp_cont_state_t
@@ -779,7 +920,7 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 	uint8_t *pdata, *pResponse = NULL;
 	unsigned int max;
 	int scanned, rsp_count = 0;
-	sdp_list_t *pattern = NULL, *seq = NULL, *svcList;
+	sdp_list_t *pattern = NULL, *seq = NULL, *svcList = NULL;
 	sdp_cont_state_t *cstate = NULL;
 	short cstate_size = 0;
 	uint8_t dtd = 0;
@@ -845,8 +986,6 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 		goto done;
 	}
 
-	svcList = sdp_get_record_list();
-
 	tmpbuf.data = malloc(USHRT_MAX);
 	tmpbuf.data_size = 0;
 	tmpbuf.buf_size = USHRT_MAX;
@@ -865,10 +1004,11 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 	if (cstate == NULL) {
 		/* no continuation state -> create new response */
 		sdp_list_t *p;
+
+		svcList = sdp_record_search(pattern);
 		for (p = svcList; p; p = p->next) {
 			sdp_record_t *rec = p->data;
-			if (sdp_match_uuid(pattern, rec->pattern) > 0 &&
-					sdp_check_access(rec->handle, &req->device)) {
+			if (sdp_check_access(rec->handle, &req->device)) {
 				rsp_count++;
 				status = extract_attrs(rec, seq, &tmpbuf);
 
@@ -881,8 +1021,8 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 				if (buf->data_size + tmpbuf.data_size < buf->buf_size) {
 					/* to be sure no relocations */
 					sdp_append_to_buf(buf, tmpbuf.data, tmpbuf.data_size);
+					memset(tmpbuf.data, 0, tmpbuf.data_size);
 					tmpbuf.data_size = 0;
-					memset(tmpbuf.data, 0, USHRT_MAX);
 				} else {
 					error("Relocation needed");
 					break;
@@ -894,7 +1034,7 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 			sdp_cont_state_t newState;
 
 			memset((char *)&newState, 0, sizeof(sdp_cont_state_t));
-			newState.timestamp = sdp_cstate_alloc_buf(buf);
+			newState.timestamp = sdp_cstate_alloc_buf(req->sock, buf);
 			/*
 			 * Reset the buffer size to the maximum expected and
 			 * set the sdp_cont_state_t
@@ -906,16 +1046,21 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 			cstate_size = sdp_set_cstate_pdu(buf, NULL);
 	} else {
 		/* continuation State exists -> get from cache */
-		sdp_buf_t *pCache = sdp_get_cached_rsp(cstate);
-		if (pCache) {
+		sdp_buf_t *pCache = sdp_get_cached_rsp(req->sock, cstate);
+		if (pCache && cstate->cStateValue.maxBytesSent >
+							pCache->data_size) {
+			status = SDP_INVALID_CSTATE;
+			SDPDBG("Continuation state beyond the cached response");
+		} else if (pCache) {
 			uint16_t sent = MIN(max, pCache->data_size - cstate->cStateValue.maxBytesSent);
 			pResponse = pCache->data;
 			memcpy(buf->data, pResponse + cstate->cStateValue.maxBytesSent, sent);
 			buf->data_size += sent;
 			cstate->cStateValue.maxBytesSent += sent;
-			if (cstate->cStateValue.maxBytesSent == pCache->data_size)
+			if (cstate->cStateValue.maxBytesSent == pCache->data_size) {
 				cstate_size = sdp_set_cstate_pdu(buf, NULL);
-			else
+				sdp_cstate_release(req->sock, cstate);
+			} else
 				cstate_size = sdp_set_cstate_pdu(buf, cstate);
 		} else {
 			status = SDP_INVALID_CSTATE;
@@ -947,6 +1092,8 @@ done:
 		sdp_list_free(pattern, free);
 	if (seq)
 		sdp_list_free(seq, free);
+	if (svcList)
+		sdp_list_free(svcList, NULL);
 	return status;
 }
 
@@ -955,18 +1102,21 @@ done:
  * function based on request type. Handles service registration
  * client requests also.
  */
-static void process_request(sdp_req_t *req)
+/*
+ * The response is built in buf, SDP_RSP_BUFFER_SIZE bytes owned by the
+ * session. The handlers write every byte they account for in data_size,
+ * so it isn't cleared between requests.
+ */
+static void process_request(sdp_req_t *req, uint8_t *buf)
 {
 	sdp_pdu_hdr_t *reqhdr = (sdp_pdu_hdr_t *)req->buf;
 	sdp_pdu_hdr_t *rsphdr;
 	sdp_buf_t rsp;
-	uint8_t *buf = malloc(USHRT_MAX);
 	int status = SDP_INVALID_SYNTAX;
 
-	memset(buf, 0, USHRT_MAX);
 	rsp.data = buf + sizeof(sdp_pdu_hdr_t);
 	rsp.data_size = 0;
-	rsp.buf_size = USHRT_MAX - sizeof(sdp_pdu_hdr_t);
+	rsp.buf_size = SDP_RSP_BUFFER_SIZE - sizeof(sdp_pdu_hdr_t);
 	rsphdr = (sdp_pdu_hdr_t *)buf;
 
 	if (ntohs(reqhdr->plen) != req->len - sizeof(sdp_pdu_hdr_t)) {
@@ -1011,6 +1161,13 @@ static void process_request(sdp_req_t *req)
 			rsphdr->pdu_id = SDP_SVC_REMOVE_RSP;
 		}
 		break;
+	case SDP_SVC_BATCH_REQ:
+		SDPDBG("Service batch request");
+		if (req->local) {
+			status = service_batch_req(req, &rsp);
+			rsphdr->pdu_id = SDP_SVC_BATCH_RSP;
+		}
+		break;
 	default:
 		error("Unknown PDU ID : 0x%x received", reqhdr->pdu_id);
 		status = SDP_INVALID_SYNTAX;
@@ -1038,21 +1195,23 @@ send_rsp:
 		error("send: %s (%d)", strerror(errno), errno);
 
 	SDPDBG("Bytes Sent : %d", sent);
-
-	free(rsp.data);
-	free(req->buf);
 }
 
-void handle_request(int sk, uint8_t *data, int len)
+/*
+ * Fill in the peer address and MTU of the session on socket sk, they
+ * stay the same for all its requests
+ */
+int init_request(int sk, sdp_req_t *req)
 {
 	struct sockaddr_l2 sa;
 	socklen_t size;
-	sdp_req_t req;
+
+	memset(req, 0, sizeof(*req));
 
 	size = sizeof(sa);
 	if (getpeername(sk, (struct sockaddr *) &sa, &size) < 0) {
 		error("getpeername: %s", strerror(errno));
-		return;
+		return -1;
 	}
 
 	if (sa.l2_family == AF_BLUETOOTH) {
@@ -1063,31 +1222,44 @@ void handle_request(int sk, uint8_t *data, int len)
 
 		if (getsockopt(sk, SOL_L2CAP, L2CAP_OPTIONS, &lo, &size) < 0) {
 			error("getsockopt: %s", strerror(errno));
-			return;
+			return -1;
 		}
 
-		bacpy(&req.bdaddr, &sa.l2_bdaddr);
-		req.mtu = lo.omtu;
-		req.local = 0;
+		bacpy(&req->bdaddr, &sa.l2_bdaddr);
+		req->mtu = lo.omtu;
+		req->local = 0;
 		memset(&sa, 0, sizeof(sa));
 		size = sizeof(sa);
 
 		if (getsockname(sk, (struct sockaddr *) &sa, &size) < 0) {
 			error("getsockname: %s", strerror(errno));
-			return;
+			return -1;
 		}
 
-		bacpy(&req.device, &sa.l2_bdaddr);
+		bacpy(&req->device, &sa.l2_bdaddr);
 	} else {
-		bacpy(&req.device, BDADDR_ANY);
-		bacpy(&req.bdaddr, BDADDR_LOCAL);
-		req.mtu = 2048;
-		req.local = 1;
+		bacpy(&req->device, BDADDR_ANY);
+		bacpy(&req->bdaddr, BDADDR_LOCAL);
+		req->mtu = 2048;
+		req->local = 1;
 	}
 
-	req.sock = sk;
+	req->sock = sk;
+
+	return 0;
+}
+
+/*
+ * Handle the request PDU in data, received on the session set up by
+ * init_request(). The data stays owned by the caller.
+ */
+void handle_request(const sdp_req_t *session, uint8_t *data, int len,
+								uint8_t *rsp)
+{
+	sdp_req_t req = *session;
+
 	req.buf  = data;
 	req.len  = len;
 
-	process_request(&req);
+	process_request(&req, rsp);
 }
@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <cutils/sockets.h>
@@ -162,11 +163,115 @@ static int init_server(uint16_t mtu, int master, int compat)
         return 0;
 }
 
+/* Reads handled per wakeup, so that one busy session can't starve others */
+#define SESSION_MAX_READS	16
+
+struct session {
+	sdp_req_t req;		/* Peer of the session, see init_request() */
+	int stream;		/* Unix socket, a PDU can span several reads */
+	uint8_t *buf;
+	size_t size;		/* Allocated size of buf */
+	size_t len;		/* Bytes received but not handled yet */
+	uint8_t *rsp;		/* Response, SDP_RSP_BUFFER_SIZE bytes */
+};
+
+static struct session *session_new(int sk, int stream)
+{
+	struct session *session;
+	struct l2cap_options lo;
+	socklen_t optlen = sizeof(lo);
+
+	session = g_try_new0(struct session, 1);
+	if (!session)
+		return NULL;
+
+	if (init_request(sk, &session->req) < 0) {
+		g_free(session);
+		return NULL;
+	}
+
+	session->stream = stream;
+
+	/* packets are never larger than the incoming MTU, the buffer of a
+	 * stream grows when a PDU doesn't fit */
+	memset(&lo, 0, sizeof(lo));
+	if (!stream && getsockopt(sk, SOL_L2CAP, L2CAP_OPTIONS, &lo,
+							&optlen) == 0)
+		session->size = MAX(lo.imtu, sizeof(sdp_pdu_hdr_t));
+	else
+		session->size = SDP_REQ_BUFFER_SIZE;
+
+	session->buf = g_try_malloc(session->size);
+	session->rsp = g_try_malloc(SDP_RSP_BUFFER_SIZE);
+	if (!session->buf || !session->rsp) {
+		g_free(session->buf);
+		g_free(session->rsp);
+		g_free(session);
+		return NULL;
+	}
+
+	return session;
+}
+
+static void session_free(gpointer data)
+{
+	struct session *session = data;
+
+	g_free(session->buf);
+	g_free(session->rsp);
+	g_free(session);
+}
+
+static void session_close(int sk)
+{
+	sdp_svcdb_collect_all(sk);
+	sdp_cstate_cleanup(sk);
+}
+
+/*
+ * Handle the complete PDUs received on a stream and keep the start of
+ * the next one. Returns -1 if the buffer can't grow to fit it.
+ */
+static int session_parse(struct session *session)
+{
+	sdp_pdu_hdr_t *hdr;
+	size_t offset = 0, size = 0;
+
+	while (session->len - offset >= sizeof(sdp_pdu_hdr_t)) {
+		hdr = (sdp_pdu_hdr_t *) (session->buf + offset);
+		size = sizeof(sdp_pdu_hdr_t) + ntohs(hdr->plen);
+
+		if (session->len - offset < size)
+			break;
+
+		handle_request(&session->req, session->buf + offset, size,
+								session->rsp);
+
+		offset += size;
+		size = 0;
+	}
+
+	if (offset > 0) {
+		session->len -= offset;
+		memmove(session->buf, session->buf + offset, session->len);
+	}
+
+	if (size > session->size) {
+		uint8_t *buf = g_try_realloc(session->buf, size);
+		if (!buf)
+			return -1;
+
+		session->buf = buf;
+		session->size = size;
+	}
+
+	return 0;
+}
+
 static gboolean io_session_event(GIOChannel *chan, GIOCondition cond, gpointer data)
 {
-	sdp_pdu_hdr_t hdr;
-	uint8_t *buf;
-	int sk, len, size;
+	struct session *session = data;
+	int sk, reads;
 
 	if (cond & G_IO_NVAL)
 		return FALSE;
@@ -174,35 +279,54 @@ static gboolean io_session_event(GIOChannel *chan, GIOCondition cond, gpointer d
 	sk = g_io_channel_unix_get_fd(chan);
 
 	if (cond & (G_IO_HUP | G_IO_ERR)) {
-		sdp_svcdb_collect_all(sk);
+		session_close(sk);
 		return FALSE;
 	}
 
-	len = recv(sk, &hdr, sizeof(sdp_pdu_hdr_t), MSG_PEEK);
-	if (len <= 0) {
-		sdp_svcdb_collect_all(sk);
-		return FALSE;
-	}
+	/* handle all requests queued on the socket */
+	for (reads = 0; reads < SESSION_MAX_READS; reads++) {
+		sdp_pdu_hdr_t *hdr;
+		ssize_t len;
 
-	size = sizeof(sdp_pdu_hdr_t) + ntohs(hdr.plen);
-	buf = malloc(size);
-	if (!buf)
-		return TRUE;
+		len = recv(sk, session->buf + session->len,
+				session->size - session->len, MSG_DONTWAIT);
+		if (len < 0 && errno == EINTR)
+			continue;
 
-	len = recv(sk, buf, size, 0);
-	if (len <= 0) {
-		sdp_svcdb_collect_all(sk);
-		free(buf);
-		return FALSE;
-	}
+		if (len < 0 && errno == EAGAIN)
+			break;
+
+		if (len <= 0) {
+			session_close(sk);
+			return FALSE;
+		}
+
+		if (session->stream) {
+			session->len += len;
+			if (session_parse(session) < 0) {
+				error("No memory for SDP request");
+				session_close(sk);
+				return FALSE;
+			}
+			continue;
+		}
+
+		/* every packet holds one PDU */
+		if ((size_t) len < sizeof(sdp_pdu_hdr_t))
+			continue;
 
-	handle_request(sk, buf, len);
+		hdr = (sdp_pdu_hdr_t *) session->buf;
+		len = MIN((size_t) len, sizeof(sdp_pdu_hdr_t) + ntohs(hdr->plen));
+
+		handle_request(&session->req, session->buf, len, session->rsp);
+	}
 
 	return TRUE;
 }
 
 static gboolean io_accept_event(GIOChannel *chan, GIOCondition cond, gpointer data)
 {
+	struct session *session;
 	GIOChannel *io;
 	int nsk;
 
@@ -227,11 +351,18 @@ static gboolean io_accept_event(GIOChannel *chan, GIOCondition cond, gpointer da
 		return TRUE;
 	}
 
+	session = session_new(nsk, data == &unix_sock);
+	if (!session) {
+		close(nsk);
+		return TRUE;
+	}
+
 	io = g_io_channel_unix_new(nsk);
 	g_io_channel_set_close_on_unref(io, TRUE);
 
-	g_io_add_watch(io, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
-					io_session_event, data);
+	g_io_add_watch_full(io, G_PRIORITY_DEFAULT,
+					G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+					io_session_event, session, session_free);
 
 	g_io_channel_unref(io);
 
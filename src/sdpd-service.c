@@ -91,6 +91,7 @@ static void update_db_timestamp(void)
 	uint32_t dbts = sdp_get_time();
 	sdp_data_t *d = sdp_data_alloc(SDP_UINT32, &dbts);
 	sdp_attr_replace(server, SDP_ATTR_SVCDB_STATE, d);
+	sdp_record_pdu_invalidate(server);
 }
 
 void register_public_browse_group(void)
@@ -342,8 +343,7 @@ static sdp_record_t *extract_pdu_server(bdaddr_t *device, uint8_t *p,
 			sdp_record_add(device, rec);
 		}
 	} else {
-		sdp_list_free(rec->attrlist, (sdp_free_func_t) sdp_data_free);
-		rec->attrlist = NULL;
+		sdp_record_free_attrs(rec);
 	}
 
 	while (localExtractedLength < seqlen) {
@@ -396,31 +396,39 @@ static sdp_record_t *extract_pdu_server(bdaddr_t *device, uint8_t *p,
 /*
  * Add the newly created service record to the service repository
  */
-int service_register_req(sdp_req_t *req, sdp_buf_t *rsp)
+static int register_record(const sdp_req_t *req, uint8_t *p, int bufsize,
+							uint32_t *handle)
 {
 	int scanned = 0;
-	sdp_data_t *handle;
-	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
-	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
+	sdp_data_t *data;
 	sdp_record_t *rec;
-
-	req->flags = *p++;
-	if (req->flags & SDP_DEVICE_RECORD) {
-		bacpy(&req->device, (bdaddr_t *) p);
+	bdaddr_t device;
+	uint8_t flags;
+
+	if (bufsize < (int) sizeof(uint8_t))
+		return SDP_INVALID_SYNTAX;
+
+	bacpy(&device, &req->device);
+	flags = *p++;
+	bufsize--;
+	if (flags & SDP_DEVICE_RECORD) {
+		if (bufsize < (int) sizeof(bdaddr_t))
+			return SDP_INVALID_SYNTAX;
+		bacpy(&device, (bdaddr_t *) p);
 		p += sizeof(bdaddr_t);
 		bufsize -= sizeof(bdaddr_t);
 	}
 
 	/* save image of PDU: we need it when clients request this attribute */
-	rec = extract_pdu_server(&req->device, p, bufsize, 0xffffffff, &scanned);
+	rec = extract_pdu_server(&device, p, bufsize, 0xffffffff, &scanned);
 	if (!rec)
-		goto invalid;
+		return SDP_INVALID_SYNTAX;
 
 	if (rec->handle == 0xffffffff) {
 		rec->handle = sdp_next_handle();
 		if (rec->handle < 0x10000) {
 			sdp_record_free(rec);
-			goto invalid;
+			return SDP_INVALID_SYNTAX;
 		}
 	} else {
 		if (sdp_record_find(rec->handle)) {
@@ -431,12 +439,12 @@ int service_register_req(sdp_req_t *req, sdp_buf_t *rsp)
 		}
 	}
 
-	sdp_record_add(&req->device, rec);
-	if (!(req->flags & SDP_RECORD_PERSIST))
+	sdp_record_add(&device, rec);
+	if (!(flags & SDP_RECORD_PERSIST))
 		sdp_svcdb_set_collectable(rec, req->sock);
 
-	handle = sdp_data_alloc(SDP_UINT32, &rec->handle);
-	sdp_attr_replace(rec, SDP_ATTR_RECORD_HANDLE, handle);
+	data = sdp_data_alloc(SDP_UINT32, &rec->handle);
+	sdp_attr_replace(rec, SDP_ATTR_RECORD_HANDLE, data);
 
 success:
 	/* if the browse group descriptor is NULL,
@@ -447,57 +455,84 @@ success:
 		sdp_pattern_add_uuid(rec, &uuid);
 	}
 
+	/* an already registered record may have been changed */
+	sdp_record_reindex(rec);
+
+	*handle = rec->handle;
+
+	return 0;
+}
+
+int service_register_req(sdp_req_t *req, sdp_buf_t *rsp)
+{
+	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
+	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
+	uint32_t handle;
+	int status;
+
+	status = register_record(req, p, bufsize, &handle);
+	if (status) {
+		bt_put_unaligned(htons(status), (uint16_t *) rsp->data);
+		rsp->data_size = sizeof(uint16_t);
+		return status;
+	}
+
 	update_db_timestamp();
 
 	/* Build a rsp buffer */
-	bt_put_unaligned(htonl(rec->handle), (uint32_t *) rsp->data);
+	bt_put_unaligned(htonl(handle), (uint32_t *) rsp->data);
 	rsp->data_size = sizeof(uint32_t);
 
 	return 0;
-
-invalid:
-	bt_put_unaligned(htons(SDP_INVALID_SYNTAX), (uint16_t *) rsp->data);
-	rsp->data_size = sizeof(uint16_t);
-
-	return -1;
 }
 
 /*
  * Update a service record
  */
-int service_update_req(sdp_req_t *req, sdp_buf_t *rsp)
+static int update_record(uint8_t *p, int bufsize, uint32_t *handle)
 {
 	sdp_record_t *orec, *nrec;
-	int status = 0, scanned = 0;
-	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
-	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
-	uint32_t handle = ntohl(bt_get_unaligned((uint32_t *) p));
+	int scanned = 0;
+
+	if (bufsize < (int) sizeof(uint32_t))
+		return SDP_INVALID_SYNTAX;
+
+	*handle = ntohl(bt_get_unaligned((uint32_t *) p));
 
-	SDPDBG("Svc Rec Handle: 0x%x", handle);
+	SDPDBG("Svc Rec Handle: 0x%x", *handle);
 
 	p += sizeof(uint32_t);
 	bufsize -= sizeof(uint32_t);
 
-	orec = sdp_record_find(handle);
+	orec = sdp_record_find(*handle);
 
 	SDPDBG("SvcRecOld: %p", orec);
 
-	if (!orec) {
-		status = SDP_INVALID_RECORD_HANDLE;
-		goto done;
-	}
+	if (!orec)
+		return SDP_INVALID_RECORD_HANDLE;
 
-	nrec = extract_pdu_server(BDADDR_ANY, p, bufsize, handle, &scanned);
-	if (!nrec) {
-		status = SDP_INVALID_SYNTAX;
-		goto done;
-	}
+	nrec = extract_pdu_server(BDADDR_ANY, p, bufsize, *handle, &scanned);
+	if (!nrec)
+		return SDP_INVALID_SYNTAX;
 
 	assert(nrec == orec);
 
-	update_db_timestamp();
+	sdp_record_reindex(orec);
+
+	return 0;
+}
+
+int service_update_req(sdp_req_t *req, sdp_buf_t *rsp)
+{
+	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
+	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
+	uint32_t handle;
+	int status;
+
+	status = update_record(p, bufsize, &handle);
+	if (status == 0)
+		update_db_timestamp();
 
-done:
 	p = rsp->data;
 	bt_put_unaligned(htons(status), (uint16_t *) p);
 	rsp->data_size = sizeof(uint16_t);
@@ -507,30 +542,144 @@ done:
 /*
  * Remove a registered service record
  */
-int service_remove_req(sdp_req_t *req, sdp_buf_t *rsp)
+static int remove_record(uint8_t *p, int bufsize, uint32_t *handle)
 {
-	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
-	uint32_t handle = ntohl(bt_get_unaligned((uint32_t *) p));
 	sdp_record_t *rec;
-	int status = 0;
+	int status;
+
+	if (bufsize < (int) sizeof(uint32_t))
+		return SDP_INVALID_SYNTAX;
 
 	/* extract service record handle */
+	*handle = ntohl(bt_get_unaligned((uint32_t *) p));
 
-	rec = sdp_record_find(handle);
-	if (rec) {
-		sdp_svcdb_collect(rec);
-		status = sdp_record_remove(handle);
-		sdp_record_free(rec);
-		if (status == 0)
-			update_db_timestamp();
-	} else {
-		status = SDP_INVALID_RECORD_HANDLE;
-		SDPDBG("Could not find record : 0x%x", handle);
+	rec = sdp_record_find(*handle);
+	if (!rec) {
+		SDPDBG("Could not find record : 0x%x", *handle);
+		return SDP_INVALID_RECORD_HANDLE;
 	}
 
+	sdp_svcdb_collect(rec);
+	status = sdp_record_remove(*handle);
+	sdp_record_free(rec);
+
+	return status;
+}
+
+int service_remove_req(sdp_req_t *req, sdp_buf_t *rsp)
+{
+	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
+	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
+	uint32_t handle;
+	int status;
+
+	status = remove_record(p, bufsize, &handle);
+	if (status == 0)
+		update_db_timestamp();
+
 	p = rsp->data;
 	bt_put_unaligned(htons(status), (uint16_t *) p);
 	rsp->data_size = sizeof(uint16_t);
 
 	return status;
 }
+
+/*
+ * Register, update and remove several records with a single request.
+ *
+ * The request carries a 16 bit operation count followed by one entry per
+ * operation: the PDU id of the single request it stands for, the 16 bit
+ * length of its parameters and the parameters themselves. The response
+ * holds the count followed by a 16 bit status and the 32 bit record
+ * handle of every operation, in request order.
+ */
+int service_batch_req(sdp_req_t *req, sdp_buf_t *rsp)
+{
+	uint8_t *p = req->buf + sizeof(sdp_pdu_hdr_t);
+	int bufsize = req->len - sizeof(sdp_pdu_hdr_t);
+	uint8_t *q, *out;
+	uint16_t count, i;
+	int left, changed = 0;
+
+	if (bufsize < (int) sizeof(uint16_t))
+		return SDP_INVALID_SYNTAX;
+
+	count = ntohs(bt_get_unaligned((uint16_t *) p));
+	p += sizeof(uint16_t);
+	bufsize -= sizeof(uint16_t);
+
+	if (sizeof(uint16_t) + count * (sizeof(uint16_t) + sizeof(uint32_t)) >
+								rsp->buf_size)
+		return SDP_INVALID_SYNTAX;
+
+	/* Check the framing before touching the database */
+	for (i = 0, q = p, left = bufsize; i < count; i++) {
+		uint16_t len;
+
+		if (left < (int) (sizeof(uint8_t) + sizeof(uint16_t)))
+			return SDP_INVALID_PDU_SIZE;
+
+		len = ntohs(bt_get_unaligned((uint16_t *) (q + 1)));
+		q += sizeof(uint8_t) + sizeof(uint16_t);
+		left -= sizeof(uint8_t) + sizeof(uint16_t);
+
+		if (left < len)
+			return SDP_INVALID_PDU_SIZE;
+
+		q += len;
+		left -= len;
+	}
+
+	if (left)
+		return SDP_INVALID_PDU_SIZE;
+
+	out = rsp->data;
+	bt_put_unaligned(htons(count), (uint16_t *) out);
+	out += sizeof(uint16_t);
+
+	for (i = 0; i < count; i++) {
+		uint8_t op = *p;
+		uint16_t len = ntohs(bt_get_unaligned((uint16_t *) (p + 1)));
+		uint32_t handle = 0;
+		int status;
+
+		p += sizeof(uint8_t) + sizeof(uint16_t);
+
+		switch (op) {
+		case SDP_SVC_REGISTER_REQ:
+			status = register_record(req, p, len, &handle);
+			break;
+		case SDP_SVC_UPDATE_REQ:
+			status = update_record(p, len, &handle);
+			break;
+		case SDP_SVC_REMOVE_REQ:
+			status = remove_record(p, len, &handle);
+			break;
+		default:
+			error("Unknown batched PDU ID : 0x%x", op);
+			status = SDP_INVALID_SYNTAX;
+			break;
+		}
+
+		SDPDBG("Batched op 0x%x handle 0x%x status %d", op, handle,
+								status);
+
+		if (status == 0)
+			changed = 1;
+
+		bt_put_unaligned(htons(status), (uint16_t *) out);
+		out += sizeof(uint16_t);
+		bt_put_unaligned(htonl(handle), (uint32_t *) out);
+		out += sizeof(uint32_t);
+
+		p += len;
+	}
+
+	/* One database state change for the whole batch */
+	if (changed)
+		update_db_timestamp();
+
+	rsp->data_size = out - rsp->data;
+
+	return 0;
+}
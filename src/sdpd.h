@@ -45,11 +45,29 @@ typedef struct request {
 	int      len;
 } sdp_req_t;
 
-void handle_request(int sk, uint8_t *data, int len);
+/* Size of the response buffer handed to handle_request() */
+#define SDP_RSP_BUFFER_SIZE	USHRT_MAX
+
+int init_request(int sk, sdp_req_t *req);
+void handle_request(const sdp_req_t *session, uint8_t *data, int len,
+								uint8_t *rsp);
+
+struct sdp_cstate_stats {
+	unsigned long hits;		/* Continuation requests served */
+	unsigned long misses;		/* Unknown or expired states */
+	unsigned long evictions;	/* Dropped to stay within the size cap */
+	unsigned long expirations;	/* Dropped after the timeout */
+	unsigned long entries;		/* Responses cached now */
+	unsigned long bytes;		/* Size of the cached responses */
+};
+
+void sdp_cstate_cleanup(int sock);
+void sdp_cstate_get_stats(struct sdp_cstate_stats *stats);
 
 int service_register_req(sdp_req_t *req, sdp_buf_t *rsp);
 int service_update_req(sdp_req_t *req, sdp_buf_t *rsp);
 int service_remove_req(sdp_req_t *req, sdp_buf_t *rsp);
+int service_batch_req(sdp_req_t *req, sdp_buf_t *rsp);
 
 void register_public_browse_group(void);
 void register_server_service(void);
@@ -64,6 +82,11 @@ void sdp_svcdb_collect(sdp_record_t *rec);
 sdp_record_t *sdp_record_find(uint32_t handle);
 void sdp_record_add(const bdaddr_t *device, sdp_record_t *rec);
 int sdp_record_remove(uint32_t handle);
+void sdp_record_reindex(sdp_record_t *rec);
+int sdp_record_pdu_range(sdp_record_t *rec, uint16_t low, uint16_t high,
+							const uint8_t **data);
+void sdp_record_pdu_invalidate(sdp_record_t *rec);
+sdp_list_t *sdp_record_search(sdp_list_t *search);
 sdp_list_t *sdp_get_record_list(void);
 sdp_list_t *sdp_get_access_list(void);
 int sdp_check_access(uint32_t handle, bdaddr_t *device);
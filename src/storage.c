@@ -43,11 +43,15 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/sdp.h>
 #include <bluetooth/sdp_lib.h>
+#include <bluetooth/uuid.h>
 
 #include "textfile.h"
 #include "adapter.h"
 #include "device.h"
 #include "glib-helper.h"
+#include "log.h"
+#include "gattrib.h"
+#include "gatt.h"
 #include "storage.h"
 
 struct match {
@@ -832,7 +836,7 @@ sdp_record_t *record_from_string(const gchar *str)
 		pdata[i] = (uint8_t) strtol(tmp, NULL, 16);
 	}
 
-	rec = sdp_extract_pdu(pdata, size, &len);
+	rec = sdp_extract_pdu_arena(pdata, size, &len);
 	free(pdata);
 
 	return rec;
@@ -907,6 +911,8 @@ void delete_all_records(const bdaddr_t *src, const bdaddr_t *dst)
 
 	if (records)
 		sdp_list_free(records, (sdp_free_func_t) sdp_record_free);
+
+	delete_record_cache(src, dst);
 }
 
 sdp_list_t *read_records(const bdaddr_t *src, const bdaddr_t *dst)
@@ -927,6 +933,157 @@ sdp_list_t *read_records(const bdaddr_t *src, const bdaddr_t *dst)
 	return rec_list.recs;
 }
 
+/*
+ * The record cache keeps the records of a remote device in their binary
+ * PDU form together with the ServiceDatabaseState value they were read
+ * with, so they can be reused without browsing again while the remote
+ * database stays the same.
+ */
+#define RECORD_CACHE_MAGIC	0x53445043	/* "SDPC" */
+#define RECORD_CACHE_VERSION	1
+
+struct record_cache_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t state;
+	uint32_t count;
+} __attribute__ ((packed));
+
+static void create_record_cache_name(char *filename, const bdaddr_t *src,
+							const bdaddr_t *dst)
+{
+	char srcaddr[18], dstaddr[18], name[27];
+
+	ba2str(src, srcaddr);
+	ba2str(dst, dstaddr);
+	snprintf(name, sizeof(name), "sdpcache/%s", dstaddr);
+
+	create_name(filename, PATH_MAX, STORAGEDIR, srcaddr, name);
+}
+
+int write_record_cache(const bdaddr_t *src, const bdaddr_t *dst,
+					uint32_t state, sdp_list_t *recs)
+{
+	char filename[PATH_MAX + 1];
+	struct record_cache_hdr hdr;
+	GByteArray *data;
+	GError *gerr = NULL;
+	sdp_list_t *l;
+
+	create_record_cache_name(filename, src, dst);
+	create_file(filename, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+	data = g_byte_array_new();
+
+	hdr.magic = RECORD_CACHE_MAGIC;
+	hdr.version = RECORD_CACHE_VERSION;
+	hdr.state = state;
+	hdr.count = 0;
+	g_byte_array_append(data, (guint8 *) &hdr, sizeof(hdr));
+
+	for (l = recs; l; l = l->next) {
+		sdp_record_t *rec = l->data;
+		sdp_buf_t buf;
+		uint32_t size;
+
+		if (sdp_gen_record_pdu(rec, &buf) < 0)
+			continue;
+
+		size = buf.data_size;
+		g_byte_array_append(data, (guint8 *) &size, sizeof(size));
+		g_byte_array_append(data, buf.data, size);
+		free(buf.data);
+
+		hdr.count++;
+	}
+
+	memcpy(data->data, &hdr, sizeof(hdr));
+
+	if (!g_file_set_contents(filename, (gchar *) data->data, data->len,
+								&gerr)) {
+		error("Unable to write %s: %s", filename, gerr->message);
+		g_error_free(gerr);
+		g_byte_array_free(data, TRUE);
+		return -EIO;
+	}
+
+	g_byte_array_free(data, TRUE);
+
+	return 0;
+}
+
+sdp_list_t *read_record_cache(const bdaddr_t *src, const bdaddr_t *dst,
+							uint32_t *state)
+{
+	char filename[PATH_MAX + 1];
+	struct record_cache_hdr hdr;
+	sdp_list_t *recs = NULL;
+	gchar *contents;
+	gsize len, offset;
+	uint32_t i;
+
+	create_record_cache_name(filename, src, dst);
+
+	if (!g_file_get_contents(filename, &contents, &len, NULL))
+		return NULL;
+
+	if (len < sizeof(hdr))
+		goto failed;
+
+	memcpy(&hdr, contents, sizeof(hdr));
+	if (hdr.magic != RECORD_CACHE_MAGIC ||
+				hdr.version != RECORD_CACHE_VERSION)
+		goto failed;
+
+	for (i = 0, offset = sizeof(hdr); i < hdr.count; i++) {
+		sdp_record_t *rec;
+		uint32_t size;
+		int scanned;
+
+		if (len - offset < sizeof(size))
+			goto failed;
+
+		memcpy(&size, contents + offset, sizeof(size));
+		offset += sizeof(size);
+
+		if (len - offset < size)
+			goto failed;
+
+		rec = sdp_extract_pdu_arena((uint8_t *) contents + offset, size,
+								&scanned);
+		if (!rec)
+			goto failed;
+
+		recs = sdp_list_append(recs, rec);
+		offset += size;
+	}
+
+	g_free(contents);
+
+	*state = hdr.state;
+
+	return recs;
+
+failed:
+	error("Invalid record cache %s", filename);
+
+	g_free(contents);
+
+	if (recs)
+		sdp_list_free(recs, (sdp_free_func_t) sdp_record_free);
+
+	return NULL;
+}
+
+void delete_record_cache(const bdaddr_t *src, const bdaddr_t *dst)
+{
+	char filename[PATH_MAX + 1];
+
+	create_record_cache_name(filename, src, dst);
+
+	unlink(filename);
+}
+
 sdp_record_t *find_record_in_list(sdp_list_t *recs, const char *uuid)
 {
 	sdp_list_t *seq;
@@ -1188,6 +1345,8 @@ int delete_device_service(const bdaddr_t *sba, const bdaddr_t *dba)
 	char filename[PATH_MAX + 1], address[18];
 	int err;
 
+	delete_gatt_cache(sba, dba);
+
 	create_filename(filename, PATH_MAX, sba, "primary");
 
 	memset(address, 0, sizeof(address));
@@ -1279,6 +1438,20 @@ char *read_device_characteristics(const bdaddr_t *sba, const bdaddr_t *dba,
 	return textfile_caseget(filename, key);
 }
 
+int delete_device_characteristics(const bdaddr_t *sba, const bdaddr_t *dba,
+							uint16_t handle)
+{
+	char filename[PATH_MAX + 1], addr[18], key[23];
+
+	create_filename(filename, PATH_MAX, sba, "characteristic");
+
+	ba2str(dba, addr);
+
+	snprintf(key, sizeof(key), "%17s#%04X", addr, handle);
+
+	return textfile_del(filename, key);
+}
+
 int write_device_attribute(const bdaddr_t *sba, const bdaddr_t *dba,
 					uint16_t handle, const char *chars)
 {
@@ -1306,6 +1479,191 @@ int read_device_attributes(const bdaddr_t *sba, textfile_cb func, void *data)
 	return textfile_foreach(filename, func, data);
 }
 
+/*
+ * The GATT cache keeps every service, characteristic and descriptor
+ * found on a remote device, so that reconnecting does not need another
+ * discovery until the device reports a Service Changed.
+ */
+#define GATT_CACHE_MAGIC	0x47415443	/* "GATC" */
+#define GATT_CACHE_VERSION	1
+
+struct gatt_cache_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+} __attribute__ ((packed));
+
+struct gatt_cache_entry {
+	uint16_t handle;
+	uint16_t end;
+	uint16_t value_handle;
+	uint8_t kind;
+	uint8_t properties;
+	uint8_t uuid_type;
+	uint8_t uuid[16];
+} __attribute__ ((packed));
+
+static void create_gatt_cache_name(char *filename, const bdaddr_t *src,
+							const bdaddr_t *dst)
+{
+	char srcaddr[18], dstaddr[18], name[28];
+
+	ba2str(src, srcaddr);
+	ba2str(dst, dstaddr);
+	snprintf(name, sizeof(name), "gattcache/%s", dstaddr);
+
+	create_name(filename, PATH_MAX, STORAGEDIR, srcaddr, name);
+}
+
+int write_gatt_cache(const bdaddr_t *src, const bdaddr_t *dst,
+					const struct gatt_table *table)
+{
+	char filename[PATH_MAX + 1];
+	struct gatt_cache_hdr hdr;
+	struct gatt_cache_entry *entries;
+	GError *gerr = NULL;
+	gsize size;
+	unsigned int i;
+	int err = 0;
+
+	create_gatt_cache_name(filename, src, dst);
+	create_file(filename, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+	size = sizeof(hdr) + table->len * sizeof(*entries);
+	entries = g_malloc0(size);
+
+	hdr.magic = GATT_CACHE_MAGIC;
+	hdr.version = GATT_CACHE_VERSION;
+	hdr.count = table->len;
+	memcpy(entries, &hdr, sizeof(hdr));
+
+	for (i = 0; i < table->len; i++) {
+		const struct gatt_table_entry *entry = &table->entries[i];
+		struct gatt_cache_entry *ce = (void *) ((uint8_t *) entries +
+					sizeof(hdr) + i * sizeof(*ce));
+
+		ce->handle = entry->handle;
+		ce->end = entry->end;
+		ce->value_handle = entry->value_handle;
+		ce->kind = entry->kind;
+		ce->properties = entry->properties;
+		ce->uuid_type = entry->uuid.type;
+
+		if (entry->uuid.type == BT_UUID16)
+			memcpy(ce->uuid, &entry->uuid.value.u16,
+						sizeof(entry->uuid.value.u16));
+		else if (entry->uuid.type == BT_UUID32)
+			memcpy(ce->uuid, &entry->uuid.value.u32,
+						sizeof(entry->uuid.value.u32));
+		else
+			memcpy(ce->uuid, &entry->uuid.value.u128,
+						sizeof(entry->uuid.value.u128));
+	}
+
+	if (!g_file_set_contents(filename, (gchar *) entries, size, &gerr)) {
+		error("Unable to write %s: %s", filename, gerr->message);
+		g_error_free(gerr);
+		err = -EIO;
+	}
+
+	g_free(entries);
+
+	return err;
+}
+
+struct gatt_table *read_gatt_cache(const bdaddr_t *src, const bdaddr_t *dst)
+{
+	char filename[PATH_MAX + 1];
+	struct gatt_cache_hdr hdr;
+	struct gatt_table *table;
+	gchar *contents;
+	gsize len;
+	uint32_t i;
+
+	create_gatt_cache_name(filename, src, dst);
+
+	if (!g_file_get_contents(filename, &contents, &len, NULL))
+		return NULL;
+
+	if (len < sizeof(hdr))
+		goto failed;
+
+	memcpy(&hdr, contents, sizeof(hdr));
+	if (hdr.magic != GATT_CACHE_MAGIC ||
+				hdr.version != GATT_CACHE_VERSION)
+		goto failed;
+
+	if (hdr.count == 0 || (len - sizeof(hdr)) /
+			sizeof(struct gatt_cache_entry) != hdr.count)
+		goto failed;
+
+	table = g_new0(struct gatt_table, 1);
+	table->entries = g_new0(struct gatt_table_entry, hdr.count);
+	table->len = hdr.count;
+	table->size = hdr.count;
+
+	for (i = 0; i < hdr.count; i++) {
+		struct gatt_table_entry *entry = &table->entries[i];
+		struct gatt_cache_entry ce;
+
+		memcpy(&ce, contents + sizeof(hdr) + i * sizeof(ce),
+								sizeof(ce));
+
+		entry->handle = ce.handle;
+		entry->end = ce.end;
+		entry->value_handle = ce.value_handle;
+		entry->kind = ce.kind;
+		entry->properties = ce.properties;
+
+		switch (ce.uuid_type) {
+		case BT_UUID16:
+			entry->uuid.type = BT_UUID16;
+			memcpy(&entry->uuid.value.u16, ce.uuid,
+						sizeof(entry->uuid.value.u16));
+			break;
+		case BT_UUID32:
+			entry->uuid.type = BT_UUID32;
+			memcpy(&entry->uuid.value.u32, ce.uuid,
+						sizeof(entry->uuid.value.u32));
+			break;
+		case BT_UUID128:
+			entry->uuid.type = BT_UUID128;
+			memcpy(&entry->uuid.value.u128, ce.uuid,
+						sizeof(entry->uuid.value.u128));
+			break;
+		default:
+			gatt_table_free(table);
+			goto failed;
+		}
+
+		/* Entries are written sorted, anything else is corrupted */
+		if (i > 0 && entry->handle <= table->entries[i - 1].handle) {
+			gatt_table_free(table);
+			goto failed;
+		}
+	}
+
+	g_free(contents);
+
+	return table;
+
+failed:
+	error("Invalid GATT cache %s", filename);
+
+	g_free(contents);
+
+	return NULL;
+}
+
+void delete_gatt_cache(const bdaddr_t *src, const bdaddr_t *dst)
+{
+	char filename[PATH_MAX + 1];
+
+	create_gatt_cache_name(filename, src, dst);
+
+	unlink(filename);
+}
+
 int write_device_type(const bdaddr_t *sba, const bdaddr_t *dba,
 						device_type_t type)
 {
@@ -23,6 +23,8 @@
 
 #include "textfile.h"
 
+struct gatt_table;
+
 int read_device_alias(const char *src, const char *dst, char *alias, size_t size);
 int write_device_alias(const char *src, const char *dst, const char *alias);
 int write_discoverable_timeout(bdaddr_t *bdaddr, int timeout);
@@ -61,6 +63,11 @@ sdp_record_t *fetch_record(const gchar *src, const gchar *dst, const uint32_t ha
 int delete_record(const gchar *src, const gchar *dst, const uint32_t handle);
 void delete_all_records(const bdaddr_t *src, const bdaddr_t *dst);
 sdp_list_t *read_records(const bdaddr_t *src, const bdaddr_t *dst);
+int write_record_cache(const bdaddr_t *src, const bdaddr_t *dst,
+					uint32_t state, sdp_list_t *recs);
+sdp_list_t *read_record_cache(const bdaddr_t *src, const bdaddr_t *dst,
+							uint32_t *state);
+void delete_record_cache(const bdaddr_t *src, const bdaddr_t *dst);
 sdp_record_t *find_record_in_list(sdp_list_t *recs, const char *uuid);
 int store_device_id(const gchar *src, const gchar *dst,
 				const uint16_t source, const uint16_t vendor,
@@ -81,9 +88,15 @@ int write_device_characteristics(const bdaddr_t *sba, const bdaddr_t *dba,
 					uint16_t handle, const char *chars);
 char *read_device_characteristics(const bdaddr_t *sba, const bdaddr_t *dba,
 							uint16_t handle);
+int delete_device_characteristics(const bdaddr_t *sba, const bdaddr_t *dba,
+							uint16_t handle);
 int write_device_attribute(const bdaddr_t *sba, const bdaddr_t *dba,
                                         uint16_t handle, const char *chars);
 int read_device_attributes(const bdaddr_t *sba, textfile_cb func, void *data);
+int write_gatt_cache(const bdaddr_t *src, const bdaddr_t *dst,
+					const struct gatt_table *table);
+struct gatt_table *read_gatt_cache(const bdaddr_t *src, const bdaddr_t *dst);
+void delete_gatt_cache(const bdaddr_t *src, const bdaddr_t *dst);
 int write_device_type(const bdaddr_t *sba, const bdaddr_t *dba,
 						device_type_t type);
 device_type_t read_device_type(const bdaddr_t *sba, const bdaddr_t *dba);